@@ -0,0 +1,108 @@
+#! /usr/bin/perl -w
+
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT license.
+
+# Fits the coefficients of QBASHQ's query cost predictor to a query log.  Run QBASHQ.exe
+# with -x_show_qtimes=1 over a representative set of queries, with the options to be used
+# in production, and feed the output to this script.  Each QCOSTS: line gives the actual
+# cost of a query in kops followed by the features the prediction was made from.  The
+# least squares fit is printed as an x_cost_model option, along with how well the fitted
+# and the current models predict the actual costs.
+#
+# Queries whose cost was limited by a timeout are ignored, since their actual cost
+# understates what the plan would have cost.
+
+die "Usage: $0 <file containing QBASHQ -x_show_qtimes output> [<current x_cost_model>]\n"
+    unless $#ARGV >= 0;
+
+$current = "0,1,0,0,0,0";   # DFLT_COST_MODEL in QBASHQ.h
+$current = $ARGV[1] if $#ARGV >= 1;
+@cur = split /,/, $current;
+
+die "Can't open $ARGV[0]\n" unless open I, $ARGV[0];
+
+$n = 0;
+$timed_out = 'N';
+while (<I>) {
+    if (/^QTIMES:\s+timedOut= (.)/) {
+	$timed_out = $1;
+    } elsif (/^QCOSTS: actualKops= ([0-9.]+) features= (.*)/) {
+	$y = $1;
+	@x = split /\s+/, $2;
+	$dims = @x;
+	next if $timed_out eq 'Y';
+	push @ys, $y;
+	push @xs, [@x];
+	$n++;
+    }
+}
+close(I);
+
+die "No QCOSTS: lines found.  Was QBASHQ run with -x_show_qtimes=1 and the query planner on?\n"
+    unless $n > 0;
+
+
+# Normal equations (X'X) b = X'y, solved by Gaussian elimination with partial pivoting.
+# A small ridge keeps the system solvable when a feature is constant over the log, e.g.
+# the relaxation level.
+for ($i = 0; $i < $dims; $i++) {
+    for ($j = 0; $j <= $dims; $j++) { $a[$i][$j] = 0; }
+}
+for ($q = 0; $q < $n; $q++) {
+    for ($i = 0; $i < $dims; $i++) {
+	for ($j = 0; $j < $dims; $j++) { $a[$i][$j] += $xs[$q][$i] * $xs[$q][$j]; }
+	$a[$i][$dims] += $xs[$q][$i] * $ys[$q];
+    }
+}
+for ($i = 0; $i < $dims; $i++) { $a[$i][$i] += 1e-6 * ($a[$i][$i] + 1); }
+
+for ($c = 0; $c < $dims; $c++) {
+    $p = $c;
+    for ($r = $c + 1; $r < $dims; $r++) { $p = $r if abs($a[$r][$c]) > abs($a[$p][$c]); }
+    ($a[$c], $a[$p]) = ($a[$p], $a[$c]);
+    die "Singular system.  Need a more varied set of queries.\n" if abs($a[$c][$c]) < 1e-12;
+    for ($r = $c + 1; $r < $dims; $r++) {
+	$f = $a[$r][$c] / $a[$c][$c];
+	for ($j = $c; $j <= $dims; $j++) { $a[$r][$j] -= $f * $a[$c][$j]; }
+    }
+}
+for ($i = $dims - 1; $i >= 0; $i--) {
+    $s = $a[$i][$dims];
+    for ($j = $i + 1; $j < $dims; $j++) { $s -= $a[$i][$j] * $b[$j]; }
+    $b[$i] = $s / $a[$i][$i];
+}
+
+
+print "Queries: $n\n";
+report("Current model", @cur);
+report("Fitted model ", @b);
+print "\n-x_cost_model=", join(",", map { sprintf("%.6g", $_) } @b), "\n";
+
+exit(0);
+
+# ----------------------------------------------------------------------------
+
+sub report {
+    # Show the correlation of the predictions with the actual costs, and the mean
+    # absolute error, for the given coefficients.
+    my ($label, @coeffs) = @_;
+    my ($q, $i, $pred, $sp, $sy, $spp, $syy, $spy, $mae, $corr, $vp, $vy);
+    $sp = $sy = $spp = $syy = $spy = $mae = 0;
+    for ($q = 0; $q < $n; $q++) {
+	$pred = 0;
+	for ($i = 0; $i < $dims; $i++) { $pred += ($coeffs[$i] || 0) * $xs[$q][$i]; }
+	$pred = 0 if $pred < 0;   # As in plan_predict_kops()
+	$sp += $pred;
+	$sy += $ys[$q];
+	$spp += $pred * $pred;
+	$syy += $ys[$q] * $ys[$q];
+	$spy += $pred * $ys[$q];
+	$mae += abs($pred - $ys[$q]);
+    }
+    $vp = $n * $spp - $sp * $sp;
+    $vy = $n * $syy - $sy * $sy;
+    $corr = ($vp > 0 && $vy > 0) ? ($n * $spy - $sp * $sy) / sqrt($vp * $vy) : 0;
+    printf "%s:  correlation with actual kops %.3f, mean absolute error %.3f kops\n",
+	$label, $corr, $mae / $n;
+}
@@ -0,0 +1,86 @@
+#! /usr/bin/perl - w
+
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT license.
+
+
+# Checks the query planner's estimate of cost, which is the main feature of
+# the query cost predictor used by cost_limit_kops, against the operations
+# QBASHQ actually performs.  In particular, matches are only scored when the
+# ranking coefficients (or the classifier) need scores, and the planner should
+# charge for scoring exactly when they do.  With the default coefficients, no
+# scores are calculated, and a planner which charged for them would over-
+# predict the cost of cheap queries by two orders of magnitude.
+#
+# The planner's estimate is the second feature on the QCOSTS: line printed
+# with x_show_qtimes=1.
+
+$|++;
+
+$idxdir = "../test_data";
+$ix = "$idxdir/wikipedia_titles_500k";
+
+die "Usage: $0 <QBASHQ binary>\n"
+		unless ($#ARGV >= 0);
+
+$qp = $ARGV[0];
+$qp = "../src/visual_studio/x64/Release/QBASHQ.exe"
+    if $qp eq "default";
+
+die "$qp is not executable\n" unless -e $qp;
+
+$fail_fast = 0;
+$fail_fast = 1 if ($#ARGV > 0 && $ARGV[1] eq "-fail_fast");
+
+die "Can't find $ix/QBASH.if\n" unless -r "$ix/QBASH.if";
+
+$errs = 0;
+
+foreach $query ("new york", "history of", "river", "john smith") {
+    ($unscored_estimate, $unscored_count) = estimate_and_scored_count($query, "");
+    ($scored_estimate, $scored_count) = estimate_and_scored_count($query, "-beta=0.5");
+    ($classifier_estimate, $classifier_count) =
+	estimate_and_scored_count($query, "-classifier_mode=1 -classifier_threshold=0.5");
+
+    print "{$query}: estimated kops $unscored_estimate without scores, $scored_estimate with ",
+	"($scored_count scored), $classifier_estimate classifying";
+
+    if ($unscored_count != 0) {
+	print "\n   Scores were calculated although none were needed";
+	$errs++;
+    } elsif ($scored_count > 0 && $scored_estimate <= $unscored_estimate) {
+	print "\n   Estimate doesn't include the cost of scoring";
+	$errs++;
+    } elsif ($scored_count == 0 && $scored_estimate != $unscored_estimate) {
+	print "\n   Estimate charged for scoring but nothing was scored";
+	$errs++;
+    } elsif ($classifier_estimate < $scored_estimate) {
+	print "\n   Classifier estimate doesn't include the cost of scoring";
+	$errs++;
+    } else {
+	print " [OK]\n";
+	next;
+    }
+    print " [FAIL]\n";
+    exit(1) if $fail_fast;
+}
+
+if ($errs) {print "\n\nAlas!  $errs cost prediction checks failed.\n";}
+else {print "\n\nAll cost prediction checks passed.\n";}
+
+exit($errs);
+
+# ------------------------------------------------------------
+
+sub estimate_and_scored_count {
+    # Run a query with x_show_qtimes=1 and return the planner's estimate of its cost from the
+    # QCOSTS: line, and the number of candidates scored from the QTIMES: line.
+    my $query = shift;
+    my $options = shift;
+    my $cmd = "$qp index_dir=$ix -pq=\"$query\" -x_show_qtimes=1 $options";
+    my $rslts = `$cmd`;
+    die "Command '$cmd' failed with code $?\n" if ($?);
+    die "No QTIMES: or QCOSTS: lines in output of '$cmd'\n"
+	unless $rslts =~ /candidatesScored=\s*([0-9]+).*?QCOSTS:.*?features=\s*\S+\s+(\S+)/s;
+    return ($2, $1);
+}
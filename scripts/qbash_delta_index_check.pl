@@ -0,0 +1,256 @@
+#! /usr/bin/perl - w
+
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT license.
+
+
+# Tests that a main index with a delta index stacked on it (delta_dir=) gives
+# exactly the same results as a single index of the same records.  The
+# wikipedia_titles_500k records are split in two.  The first part is indexed
+# as the main index and the second as a delta, with first_docnum set to the
+# number of docs in the main index and max_raw_score set to the value recorded
+# in the main index's .if, so that static scores are quantized alike.  Query
+# results are compared with those from an index of all the records, at several
+# relaxation levels, with both relaxed evaluators and when only counting
+# matches (max_to_show=0).
+#
+# Then every 20th document of the main index is deleted by listing it in the
+# delta's QBASH.tombstones and added again at the end of the delta, as if it had
+# been updated.  Results and match counts must be the same as from an index of
+# the live records in the same order, with no duplicates.  Counts are also
+# checked with the deletions from a main index with bitmaps, whose matches
+# may be counted by ANDing bitmaps, and a delta of one record.
+#
+# Also checks that a delta whose scores were quantized against its own maximum
+# is refused.
+
+$|++;
+
+
+die "Usage: $0 <QBASHQ binary>\n"
+		unless ($#ARGV >= 0);
+
+$qp = $ARGV[0];
+$qp = "../src/visual_studio/x64/Release/QBASHQ.exe"
+    if $qp eq "default";
+
+die "$qp is not executable\n" unless -e $qp;
+
+$fail_fast = 0;
+$fail_fast = 1 if ($#ARGV > 0 && $ARGV[1] eq "-fail_fast");
+
+$dexer = $qp;
+$dexer =~ s/QBASHQ/QBASHI/;
+$dexer =~ s/qbashq/qbashi/;
+
+die "$dexer not executable\n" unless -e $dexer;
+
+$fwd = "../test_data/wikipedia_titles_500k/QBASH.forward";
+$qlog = "../test_queries/emulated_log_1k.q";
+$main_records = 400000;
+$tomb_every = 20;
+
+die "Can't find $fwd.  Run qbash_run_tests.pl with the RI option to unzip it.\n"
+    unless -r $fwd;
+die "Can't find $qlog\n" unless -r $qlog;
+
+$tmp = "Delta_Index_Tempdata";
+system("rm -rf $tmp");
+foreach $d ($tmp, "$tmp/main", "$tmp/delta", "$tmp/unscaled_delta", "$tmp/full",
+	    "$tmp/tombstoned_delta", "$tmp/live", "$tmp/main_bitmaps", "$tmp/tiny_delta", "$tmp/tiny_live") {
+    mkdir $d unless -d $d;
+}
+
+# Split the records, remembering where each main one starts in the main .forward.
+die "Can't read $fwd\n" unless open F, $fwd;
+die "Can't write $tmp/main/QBASH.forward\n" unless open M, ">$tmp/main/QBASH.forward";
+die "Can't write $tmp/delta/QBASH.forward\n" unless open D, ">$tmp/delta/QBASH.forward";
+die "Can't write $tmp/full/QBASH.forward\n" unless open A, ">$tmp/full/QBASH.forward";
+$records = 0;
+$offset = 0;
+@main_recs = ();
+@main_offsets = ();
+while (<F>) {
+    print A $_;
+    if ($records++ < $main_records) {
+	print M $_;
+	push @main_recs, $_;
+	push @main_offsets, $offset;
+	$offset += length($_);
+    }
+    else { print D $_; }
+}
+close(F);
+close(M);
+close(D);
+close(A);
+system("cp $tmp/delta/QBASH.forward $tmp/unscaled_delta/QBASH.forward");
+
+
+index_it("$tmp/full", "");
+index_it("$tmp/main", "");
+
+# The delta's docnums start where the main index's finish
+$main_docs = (-s "$tmp/main/QBASH.doctable") / 8;
+die "Can't read $tmp/main/QBASH.if\n" unless open I, "$tmp/main/QBASH.if";
+while (<I>) {
+    if (/^max_raw_score=(\S+)/) {
+	$max_raw_score = $1;
+	last;
+    }
+}
+close(I);
+die "max_raw_score not recorded in $tmp/main/QBASH.if\n" unless defined($max_raw_score);
+print "Main index has $main_docs docs and max_raw_score=$max_raw_score\n";
+
+index_it("$tmp/delta", "first_docnum=$main_docs max_raw_score=$max_raw_score");
+index_it("$tmp/unscaled_delta", "first_docnum=$main_docs");
+
+# Delete every ${tomb_every}th doc of the main index and add it to the end of a copy of the delta.
+# QBASHI skips some records, so the deleted records are found from the .forward offsets
+# in the main index's .doctable.
+die "Can't read $tmp/main/QBASH.doctable\n" unless open DT, "$tmp/main/QBASH.doctable";
+binmode DT;
+die "Can't write $tmp/tombstoned_delta/QBASH.tombstones\n"
+    unless open T, ">$tmp/tombstoned_delta/QBASH.tombstones";
+%deleted = ();
+for ($d = 0; $d < $main_docs; $d++) {
+    read(DT, $dte, 8);
+    next if ($d % $tomb_every);
+    $deleted{(unpack("Q<", $dte) >> 5) & ((1 << 42) - 1)} = 1;   # DTE_DOCOFF_SHIFT, DTE_DOCOFF_BITS
+    print T "$d\n";
+}
+close(DT);
+close(T);
+
+# The live index has the records in the same order as the main index plus the tombstoned delta.
+@updated = ();
+die "Can't write $tmp/live/QBASH.forward\n" unless open L, ">$tmp/live/QBASH.forward";
+for ($r = 0; $r <= $#main_recs; $r++) {
+    if ($deleted{$main_offsets[$r]}) { push @updated, $main_recs[$r]; }
+    else { print L $main_recs[$r]; }
+}
+die "Only ", $#updated + 1, " deleted records found in $tmp/main/QBASH.forward\n"
+    unless $#updated + 1 == scalar(keys %deleted);
+close(L);
+system("cat $tmp/delta/QBASH.forward >> $tmp/live/QBASH.forward");
+system("cp $tmp/delta/QBASH.forward $tmp/tombstoned_delta/QBASH.forward");
+foreach $f ("$tmp/live/QBASH.forward", "$tmp/tombstoned_delta/QBASH.forward") {
+    die "Can't append to $f\n" unless open U, ">>$f";
+    print U @updated;
+    close(U);
+}
+print $#updated + 1, " main index docs deleted and added to the delta\n";
+
+index_it("$tmp/tombstoned_delta", "first_docnum=$main_docs max_raw_score=$max_raw_score");
+index_it("$tmp/live", "");
+
+# The same deletions with a bitmapped main index and a delta of just the first delta record, so
+# that most query words aren't in the delta.
+die "Can't read $tmp/delta/QBASH.forward\n" unless open D, "$tmp/delta/QBASH.forward";
+$tiny_rec = <D>;
+close(D);
+system("cp $tmp/main/QBASH.forward $tmp/main_bitmaps/QBASH.forward");
+system("cp $tmp/tombstoned_delta/QBASH.tombstones $tmp/tiny_delta/QBASH.tombstones");
+die "Can't write $tmp/tiny_delta/QBASH.forward\n" unless open D, ">$tmp/tiny_delta/QBASH.forward";
+print D $tiny_rec;
+close(D);
+die "Can't write $tmp/tiny_live/QBASH.forward\n" unless open L, ">$tmp/tiny_live/QBASH.forward";
+for ($r = 0; $r <= $#main_recs; $r++) {
+    print L $main_recs[$r] unless $deleted{$main_offsets[$r]};
+}
+print L $tiny_rec;
+close(L);
+index_it("$tmp/main_bitmaps", "x_bitmap_density=0.01");
+die "No QBASH.bitmaps in $tmp/main_bitmaps\n" unless -e "$tmp/main_bitmaps/QBASH.bitmaps";
+index_it("$tmp/tiny_delta", "first_docnum=$main_docs max_raw_score=$max_raw_score");
+index_it("$tmp/tiny_live", "");
+
+# Hardly any logged queries consist only of words common enough to have bitmaps.
+$common_qlog = "$tmp/common_words.q";
+die "Can't write $common_qlog\n" unless open Q, ">$common_qlog";
+print Q "the\nof the\nnew\njohn\nin the\nde la\nthe of and\nlist of\nthe new\nof\n";
+close(Q);
+
+$errs = 0;
+
+# A delta quantized against a different max score must be refused.
+$cmd = "$qp index_dir=$tmp/main delta_dir=$tmp/unscaled_delta -pq=donald 2>&1";
+$rslts = `$cmd`;
+if ($? && $rslts =~ /max_raw_score/) {
+    print "Delta with mismatched max_raw_score refused [OK]\n";
+} else {
+    print "\n$cmd\nShould have failed with a max_raw_score error [FAIL]\n";
+    print $rslts if $fail_fast;
+    exit(1) if $fail_fast;
+    $errs++;
+}
+
+foreach $opts ("relaxation_level=0",
+	       "relaxation_level=1",
+	       "relaxation_level=2",
+	       "relaxation_level=1 x_relaxed_evaluator=1",
+	       "relaxation_level=1 x_relaxed_evaluator=2",
+	       "relaxation_level=0 max_to_show=3",
+	       "relaxation_level=2 max_to_show=20",
+	       "relaxation_level=0 max_to_show=0",
+	       "relaxation_level=1 max_to_show=0") {
+    $errs += compare_results("full", "main", "delta", $opts);
+    $errs += compare_results("live", "main", "tombstoned_delta", $opts);
+}
+foreach $opts ("relaxation_level=0 max_to_show=0",
+	       "relaxation_level=1 max_to_show=0") {
+    $errs += compare_results("tiny_live", "main_bitmaps", "tiny_delta", $opts);
+    $errs += compare_results("tiny_live", "main_bitmaps", "tiny_delta", $opts, $common_qlog);
+}
+
+if ($errs) {
+    print "\n$errs delta index check(s) failed.\n";
+    exit(1);
+}
+
+system("rm -rf $tmp");
+print "\nAll delta index checks passed.\n";
+exit(0);
+
+# -------------------------------------------------------------------
+
+sub index_it {
+    my $dir = shift;
+    my $options = shift;
+    my $cmd = "$dexer index_dir=$dir $options > $dir/index.log";
+    my $code = system($cmd);
+    die "Command '$cmd' failed with code $code\n"
+	if ($code);
+}
+
+
+sub compare_results {
+    # Compare the results from the single index $full with those from the index $main plus $delta.
+    my $full = shift;
+    my $main = shift;
+    my $delta = shift;
+    my $options = shift;
+    my $log = shift;
+    $log = $qlog unless defined($log);
+    my $fullcmd = "$qp index_dir=$tmp/$full file_query_batch=$log $options -chatty=off";
+    my $deltacmd = "$qp index_dir=$tmp/$main delta_dir=$tmp/$delta file_query_batch=$log $options -chatty=off";
+    my $frslts = `$fullcmd`;
+    die "Command '$fullcmd' failed with code $?\n" if ($?);
+    my $drslts = `$deltacmd`;
+    die "Command '$deltacmd' failed with code $?\n" if ($?);
+    my @full = split /\n/, $frslts;
+    my @delta = split /\n/, $drslts;
+    my $l;
+
+    for ($l = 0; $l <= $#full || $l <= $#delta; $l++) {
+	if (!defined($full[$l]) || !defined($delta[$l]) || $full[$l] ne $delta[$l]) {
+	    print "$delta $log $options: result line $l differs:\n   $full: $full[$l]\n  $delta: $delta[$l]\n";
+	    print "$deltacmd [FAIL]\n";
+	    exit(1) if $fail_fast;
+	    return 1;
+	}
+    }
+    print "$delta $log $options: ", $#full + 1, " result lines identical [OK]\n";
+    return 0;
+}
@@ -0,0 +1,211 @@
+#! /usr/bin/perl - w
+
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT license.
+
+
+# Tests that a front-coded QBASH.vocab (QBASHI x_front_coded_vocab=TRUE) is
+# equivalent to the plain fixed-length record one.  Part of the
+# wikipedia_titles_500k records are indexed both ways and the check is that:
+#   - the front-coded .vocab is smaller, and the .doctable and the postings
+#     part of the .if are unchanged;
+#   - QBASH_vocab_lister writes the same vocab.tsv and .tfd from each, and
+#     lists the same terms for a range of prefix= arguments;
+#   - query results are identical, with full words, with auto_partials
+#     (which looks up ranges of terms by prefix) and with operators.
+
+$|++;
+
+
+die "Usage: $0 <QBASHQ binary>\n"
+		unless ($#ARGV >= 0);
+
+$qp = $ARGV[0];
+$qp = "../src/visual_studio/x64/Release/QBASHQ.exe"
+    if $qp eq "default";
+
+die "$qp is not executable\n" unless -e $qp;
+
+$fail_fast = 0;
+$fail_fast = 1 if ($#ARGV > 0 && $ARGV[1] eq "-fail_fast");
+
+$dexer = $qp;
+$dexer =~ s/QBASHQ/QBASHI/;
+$dexer =~ s/qbashq/qbashi/;
+
+die "$dexer not executable\n" unless -e $dexer;
+
+$vlister = $qp;
+$vlister =~ s/QBASHQ/QBASH_vocab_lister/;
+$vlister =~ s/qbashq/vocab_lister/;
+
+die "$vlister not executable\n" unless -e $vlister;
+
+$fwd = "../test_data/wikipedia_titles_500k/QBASH.forward";
+$qlog = "../test_queries/emulated_log_1k.q";
+$oplog = "../test_queries/emulated_log_four_words_with_operators.q";
+$records = 150000;
+$if_header_len = 4096;
+
+die "Can't find $fwd.  Run qbash_run_tests.pl with the RI option to unzip it.\n"
+    unless -r $fwd;
+die "Can't find $qlog\n" unless -r $qlog;
+die "Can't find $oplog\n" unless -r $oplog;
+
+$tmp = "Front_Coded_Vocab_Tempdata";
+system("rm -rf $tmp");
+mkdir $tmp;
+$plain = "$tmp/plain";
+$fc = "$tmp/front_coded";
+mkdir $plain;
+mkdir $fc;
+
+die "Can't read $fwd\n" unless open F, $fwd;
+die "Can't write $plain/QBASH.forward\n" unless open P, ">$plain/QBASH.forward";
+die "Can't write $fc/QBASH.forward\n" unless open C, ">$fc/QBASH.forward";
+$n = 0;
+while (<F>) {
+    last if ($n++ >= $records);
+    print P $_;
+    print C $_;
+}
+close(F);
+close(P);
+close(C);
+
+index_it($plain, "");
+index_it($fc, "x_front_coded_vocab=TRUE");
+
+$errs = 0;
+
+# ---------------- The index files ----------------
+$plain_size = -s "$plain/QBASH.vocab";
+$fc_size = -s "$fc/QBASH.vocab";
+if ($fc_size < $plain_size) {
+    printf "Front-coded .vocab is %.1f%% of the size of the plain one [OK]\n", 100.0 * $fc_size / $plain_size;
+} else {
+    print "Front-coded .vocab ($fc_size bytes) isn't smaller than the plain one ($plain_size) [FAIL]\n";
+    exit(1) if $fail_fast;
+    $errs++;
+}
+$errs += compare_files("QBASH.doctable", 0);
+$errs += compare_files("QBASH.if", $if_header_len);
+
+
+# ---------------- QBASH_vocab_lister ----------------
+foreach $opts ("", "sort=alpha") {
+    foreach $dir ($plain, $fc) {
+	unlink "$dir/vocab.tsv", "$dir/vocab.tfd";
+	my $cmd = "$vlister $dir/QBASH.vocab $opts > $dir/lister.log";
+	my $code = system($cmd);
+	die "Command '$cmd' failed with code $code\n" if ($code);
+    }
+    my $label = $opts eq "" ? "QBASH_vocab_lister" : "QBASH_vocab_lister $opts";
+    $errs += compare_files("vocab.tsv", 0, $label);
+    $errs += compare_files("vocab.tfd", 0, $label) unless $opts eq "sort=alpha";
+}
+
+# Prefixes near the start and end of the vocabulary, common and rare ones, non-ASCII
+# ones, and ones which match few or no terms.
+foreach $prefix ("a", "new", "joh", "x", "zz", "zzzzzz", "0", "1", "s", "st", "the",
+		 "mozart", "qq", "é", "ü") {
+    my $plist = `$vlister $plain/QBASH.vocab prefix=$prefix`;
+    die "QBASH_vocab_lister prefix=$prefix failed on $plain\n" if ($?);
+    my $flist = `$vlister $fc/QBASH.vocab prefix=$prefix`;
+    die "QBASH_vocab_lister prefix=$prefix failed on $fc\n" if ($?);
+    my $terms = ($plist =~ tr/\n//);
+    if ($plist ne $flist) {
+	print "QBASH_vocab_lister prefix=$prefix: listings differ [FAIL]\n";
+	exit(1) if $fail_fast;
+	$errs++;
+    } else {
+	print "QBASH_vocab_lister prefix=$prefix: $terms lines identical [OK]\n";
+    }
+}
+
+
+# ---------------- QBASHQ ----------------
+foreach $opts ("relaxation_level=0",
+	       "relaxation_level=1",
+	       "relaxation_level=2",
+	       "relaxation_level=0 auto_partials=TRUE") {
+    $errs += compare_results($qlog, $opts);
+}
+$errs += compare_results($oplog, "relaxation_level=0");
+
+
+if ($errs) {
+    print "\n$errs front-coded vocab check(s) failed.\n";
+    exit(1);
+}
+
+system("rm -rf $tmp");
+print "\nAll front-coded vocab checks passed.\n";
+exit(0);
+
+# -------------------------------------------------------------------
+
+sub index_it {
+    my $dir = shift;
+    my $options = shift;
+    my $cmd = "$dexer index_dir=$dir $options > $dir/index.log";
+    my $code = system($cmd);
+    die "Command '$cmd' failed with code $code\n"
+	if ($code);
+}
+
+
+sub slurp {
+    my $fname = shift;
+    my $contents;
+    local $/;
+    die "Can't read $fname\n" unless open B, $fname;
+    binmode B;
+    $contents = <B>;
+    close(B);
+    return $contents;
+}
+
+
+sub compare_files {
+    # Compare a file in the plain and front-coded directories, ignoring the first $skip bytes.
+    my $file = shift;
+    my $skip = shift;
+    my $label = shift;
+    my $p = slurp("$plain/$file");
+    my $f = slurp("$fc/$file");
+    $label = "Index" unless defined($label);
+    if (length($p) != length($f) || substr($p, $skip) ne substr($f, $skip)) {
+	print "$label: $file differs between plain and front-coded [FAIL]\n";
+	exit(1) if $fail_fast;
+	return 1;
+    }
+    print "$label: $file identical", $skip ? " after the header" : "", " [OK]\n";
+    return 0;
+}
+
+
+sub compare_results {
+    my $log = shift;
+    my $options = shift;
+    my $plaincmd = "$qp index_dir=$plain file_query_batch=$log $options -chatty=off";
+    my $fccmd = "$qp index_dir=$fc file_query_batch=$log $options -chatty=off";
+    my $p = `$plaincmd`;
+    die "Command '$plaincmd' failed with code $?\n" if ($?);
+    my $f = `$fccmd`;
+    die "Command '$fccmd' failed with code $?\n" if ($?);
+    my @p = split /\n/, $p;
+    my @f = split /\n/, $f;
+    my $l;
+
+    for ($l = 0; $l <= $#p || $l <= $#f; $l++) {
+	if (!defined($p[$l]) || !defined($f[$l]) || $p[$l] ne $f[$l]) {
+	    print "$log $options: result line $l differs:\n        plain: $p[$l]\n  front-coded: $f[$l]\n";
+	    print "$fccmd [FAIL]\n";
+	    exit(1) if $fail_fast;
+	    return 1;
+	}
+    }
+    print "$log $options: ", $#p + 1, " result lines identical [OK]\n";
+    return 0;
+}
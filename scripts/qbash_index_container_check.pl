@@ -0,0 +1,248 @@
+#! /usr/bin/perl - w
+
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT license.
+
+
+# Tests QBASH_index_container and QBASHQ's loading of a QBASH.qbx container.
+# Part of the wikipedia_titles_500k records are indexed three ways: plainly,
+# with bitmaps (QBASH.bitmaps), and with a front-coded QBASH.vocab.  For each
+# index, query results are recorded from the loose files, the index is packed,
+# the container is verified, the loose files are moved out of the way, and the
+# results from the container alone are compared with those recorded.
+#
+# Also checks that:
+#   - QBASH.bitmaps is packed without being named as a sidecar;
+#   - a container without a .bitmaps section falls back to a loose
+#     QBASH.bitmaps beside it;
+#   - a corrupted section is detected, both by verify= and by QBASHQ with
+#     x_verify_container_checksums=TRUE.
+
+$|++;
+
+
+die "Usage: $0 <QBASHQ binary>\n"
+		unless ($#ARGV >= 0);
+
+$qp = $ARGV[0];
+$qp = "../src/visual_studio/x64/Release/QBASHQ.exe"
+    if $qp eq "default";
+
+die "$qp is not executable\n" unless -e $qp;
+
+$fail_fast = 0;
+$fail_fast = 1 if ($#ARGV > 0 && $ARGV[1] eq "-fail_fast");
+
+$dexer = $qp;
+$dexer =~ s/QBASHQ/QBASHI/;
+$dexer =~ s/qbashq/qbashi/;
+
+die "$dexer not executable\n" unless -e $dexer;
+
+$packer = $qp;
+$packer =~ s/QBASHQ/QBASH_index_container/;
+$packer =~ s/qbashq/index_container/;
+
+die "$packer not executable\n" unless -e $packer;
+
+$fwd = "../test_data/wikipedia_titles_500k/QBASH.forward";
+$qlog = "../test_queries/emulated_log_1k.q";
+$records = 100000;
+
+die "Can't find $fwd.  Run qbash_run_tests.pl with the RI option to unzip it.\n"
+    unless -r $fwd;
+die "Can't find $qlog\n" unless -r $qlog;
+
+# Start afresh: a container left over from an earlier run would be loaded instead
+# of the loose files.
+$tmp = "Index_Container_Tempdata";
+system("rm -rf $tmp");
+mkdir $tmp;
+
+%variants = (
+    "plain" => "",
+    "bitmaps" => "x_bitmap_density=0.01",
+    "front_coded" => "x_front_coded_vocab=TRUE",
+    );
+
+@core = ("forward", "if", "vocab", "doctable");
+
+$errs = 0;
+
+foreach $v (sort keys %variants) {
+    my $dir = "$tmp/$v";
+    mkdir $dir unless -d $dir;
+    mkdir "$dir/loose" unless -d "$dir/loose";
+    make_forward($dir);
+    index_it($dir, $variants{$v});
+    my $has_bitmaps = -e "$dir/QBASH.bitmaps";
+    if ($v eq "bitmaps" && !$has_bitmaps) {
+	print "$v: QBASHI didn't write a QBASH.bitmaps [FAIL]\n";
+	exit(1) if $fail_fast;
+	$errs++;
+    }
+
+    my @loose_rslts = (run_queries($dir, "relaxation_level=0"), run_queries($dir, "relaxation_level=1"));
+
+    # Pack and verify, checking that the bitmaps went in without being asked for.
+    run_or_die("$packer index_dir=$dir > $dir/pack.log");
+    my $toc = `$packer verify=$dir/QBASH.qbx`;
+    if ($?) {
+	print "$v: container failed verification [FAIL]\n$toc";
+	exit(1) if $fail_fast;
+	$errs++;
+	next;
+    }
+    my @expected = map { ".$_" } @core;
+    push @expected, ".bitmaps" if $has_bitmaps;
+    foreach $section (@expected) {
+	if (!($toc =~ /^\s+\Q$section\E\s+offset/m)) {
+	    print "$v: section $section missing from container [FAIL]\n$toc";
+	    exit(1) if $fail_fast;
+	    $errs++;
+	}
+    }
+    print "$v: container packed and verified with ", $#expected + 1, " sections [OK]\n";
+
+    # Now make sure that the results come from the container alone.
+    foreach $f (@core, "bitmaps") {
+	rename "$dir/QBASH.$f", "$dir/loose/QBASH.$f" if -e "$dir/QBASH.$f";
+    }
+    my @container_rslts = (run_queries($dir, "relaxation_level=0"), run_queries($dir, "relaxation_level=1"));
+    $errs += compare_results("$v container", \@loose_rslts, \@container_rslts);
+    @container_rslts = (run_queries($dir, "relaxation_level=0 x_verify_container_checksums=TRUE"));
+    $errs += compare_results("$v container with checksums verified", [ $loose_rslts[0] ], \@container_rslts);
+
+    if ($has_bitmaps) {
+	# A container packed before the bitmaps were written (or by an older container tool)
+	# has no .bitmaps section.  QBASHQ should pick up the loose QBASH.bitmaps instead.
+	my $old = "$tmp/${v}_old_style";
+	mkdir $old unless -d $old;
+	foreach $f (@core) {
+	    system("cp $dir/loose/QBASH.$f $old/QBASH.$f");
+	}
+	run_or_die("$packer index_dir=$old > $old/pack.log");
+	$toc = `$packer verify=$old/QBASH.qbx`;
+	die "Old style container in $old is wrong:\n$toc" if ($? || $toc =~ /\.bitmaps/);
+	foreach $f (@core) {
+	    unlink "$old/QBASH.$f";
+	}
+	system("cp $dir/loose/QBASH.bitmaps $old/QBASH.bitmaps");
+	my $dbg = `$qp index_dir=$old -pq=the -debug=1 2>&1`;
+	if (!($dbg =~ /Loading \S*QBASH\.bitmaps/)) {
+	    print "$v: loose QBASH.bitmaps not loaded beside a container without one [FAIL]\n";
+	    exit(1) if $fail_fast;
+	    $errs++;
+	}
+	@container_rslts = (run_queries($old, "relaxation_level=0"), run_queries($old, "relaxation_level=1"));
+	$errs += compare_results("$v container with loose bitmaps", \@loose_rslts, \@container_rslts);
+    }
+}
+
+# Corrupt one byte of the .doctable section of a copy of the plain container.
+$dir = "$tmp/corrupt";
+mkdir $dir unless -d $dir;
+system("cp $tmp/plain/QBASH.qbx $dir/QBASH.qbx");
+$toc = `$packer verify=$dir/QBASH.qbx`;
+die "Can't find the .doctable section in $dir/QBASH.qbx\n"
+    unless $toc =~ /^\s+\.doctable\s+offset\s+([0-9]+)/m;
+$offset = $1 + 100;
+die "Can't update $dir/QBASH.qbx\n" unless open C, "+<$dir/QBASH.qbx";
+binmode C;
+seek(C, $offset, 0);
+read(C, $byte, 1);
+seek(C, $offset, 0);
+print C chr(ord($byte) ^ 0xFF);
+close(C);
+
+$rslts = `$packer verify=$dir/QBASH.qbx 2>&1`;
+if ($?) {
+    print "Corrupted container failed verification [OK]\n";
+} else {
+    print "Corrupted container passed verification [FAIL]\n$rslts";
+    exit(1) if $fail_fast;
+    $errs++;
+}
+$rslts = `$qp index_dir=$dir -pq=the -x_verify_container_checksums=TRUE 2>&1`;
+if ($?) {
+    print "Corrupted container refused by QBASHQ [OK]\n";
+} else {
+    print "Corrupted container loaded by QBASHQ with x_verify_container_checksums=TRUE [FAIL]\n$rslts";
+    exit(1) if $fail_fast;
+    $errs++;
+}
+
+if ($errs) {
+    print "\n$errs index container check(s) failed.\n";
+    exit(1);
+}
+
+system("rm -rf $tmp");
+print "\nAll index container checks passed.\n";
+exit(0);
+
+# -------------------------------------------------------------------
+
+sub make_forward {
+    # Copy the first $records records of $fwd into the directory given.
+    my $dir = shift;
+    my $n = 0;
+    die "Can't read $fwd\n" unless open F, $fwd;
+    die "Can't write $dir/QBASH.forward\n" unless open O, ">$dir/QBASH.forward";
+    while (<F>) {
+	last if ($n++ >= $records);
+	print O $_;
+    }
+    close(F);
+    close(O);
+}
+
+
+sub run_or_die {
+    my $cmd = shift;
+    my $code = system($cmd);
+    die "Command '$cmd' failed with code $code\n"
+	if ($code);
+}
+
+
+sub index_it {
+    my $dir = shift;
+    my $options = shift;
+    run_or_die("$dexer index_dir=$dir $options > $dir/index.log");
+}
+
+
+sub run_queries {
+    my $dir = shift;
+    my $options = shift;
+    my $cmd = "$qp index_dir=$dir file_query_batch=$qlog $options -chatty=off";
+    my $rslts = `$cmd`;
+    die "Command '$cmd' failed with code $?\n" if ($?);
+    return $rslts;
+}
+
+
+sub compare_results {
+    # Compare two lists of result sets, line by line.
+    my $label = shift;
+    my $expected = shift;
+    my $got = shift;
+    my ($r, $l, $lines);
+
+    $lines = 0;
+    for ($r = 0; $r <= $#$expected; $r++) {
+	my @e = split /\n/, $expected->[$r];
+	my @g = split /\n/, $got->[$r];
+	for ($l = 0; $l <= $#e || $l <= $#g; $l++) {
+	    if (!defined($e[$l]) || !defined($g[$l]) || $e[$l] ne $g[$l]) {
+		print "$label: result line $l of set $r differs:\n   loose: $e[$l]\n  packed: $g[$l]\n [FAIL]\n";
+		exit(1) if $fail_fast;
+		return 1;
+	    }
+	}
+	$lines += $#e + 1;
+    }
+    print "$label: $lines result lines identical [OK]\n";
+    return 0;
+}
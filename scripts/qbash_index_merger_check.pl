@@ -0,0 +1,206 @@
+#! /usr/bin/perl - w
+
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT license.
+
+
+# Tests that QBASH_index_merger produces the index QBASHI would have built in a
+# single pass.  Part of the wikipedia_titles_500k records are split into three
+# slices of different sizes, each is indexed separately and the three indexes
+# are merged.  The merged .doctable and .vocab, and the postings part of the
+# .if, must be byte-for-byte the same as those of a single index of all the
+# records, and query results must be identical at several relaxation levels.
+#
+# The slices are indexed with QBASHI's defaults, so each is quantized against
+# its own maximum score and the merger has to requantize and reorder them.
+# The check is repeated with front-coded vocabularies in the inputs.
+
+$|++;
+
+
+die "Usage: $0 <QBASHQ binary>\n"
+		unless ($#ARGV >= 0);
+
+$qp = $ARGV[0];
+$qp = "../src/visual_studio/x64/Release/QBASHQ.exe"
+    if $qp eq "default";
+
+die "$qp is not executable\n" unless -e $qp;
+
+$fail_fast = 0;
+$fail_fast = 1 if ($#ARGV > 0 && $ARGV[1] eq "-fail_fast");
+
+$dexer = $qp;
+$dexer =~ s/QBASHQ/QBASHI/;
+$dexer =~ s/qbashq/qbashi/;
+
+die "$dexer not executable\n" unless -e $dexer;
+
+$merger = $qp;
+$merger =~ s/QBASHQ/QBASH_index_merger/;
+$merger =~ s/qbashq/index_merger/;
+
+die "$merger not executable\n" unless -e $merger;
+
+$fwd = "../test_data/wikipedia_titles_500k/QBASH.forward";
+$qlog = "../test_queries/emulated_log_1k.q";
+@slice_ends = (70000, 140000, 200000);
+$if_header_len = 4096;
+
+die "Can't find $fwd.  Run qbash_run_tests.pl with the RI option to unzip it.\n"
+    unless -r $fwd;
+die "Can't find $qlog\n" unless -r $qlog;
+
+$tmp = "Index_Merger_Tempdata";
+system("rm -rf $tmp");
+mkdir $tmp;
+mkdir "$tmp/full";
+for ($s = 0; $s <= $#slice_ends; $s++) {
+    mkdir "$tmp/slice$s";
+}
+
+# Split the records
+die "Can't read $fwd\n" unless open F, $fwd;
+die "Can't write $tmp/full/QBASH.forward\n" unless open A, ">$tmp/full/QBASH.forward";
+$records = 0;
+$s = 0;
+open S, ">$tmp/slice$s/QBASH.forward" or die "Can't write $tmp/slice$s/QBASH.forward\n";
+while (<F>) {
+    last if ($records >= $slice_ends[$#slice_ends]);
+    if ($records >= $slice_ends[$s]) {
+	close(S);
+	$s++;
+	open S, ">$tmp/slice$s/QBASH.forward" or die "Can't write $tmp/slice$s/QBASH.forward\n";
+    }
+    print A $_;
+    print S $_;
+    $records++;
+}
+close(F);
+close(A);
+close(S);
+
+$errs = 0;
+
+index_it("$tmp/full", "");
+
+foreach $options ("", "x_front_coded_vocab=TRUE") {
+    my $label = $options eq "" ? "plain" : "front-coded";
+    my @slices = ();
+    for ($s = 0; $s <= $#slice_ends; $s++) {
+	index_it("$tmp/slice$s", $options);
+	push @slices, "$tmp/slice$s";
+    }
+    system("rm -rf $tmp/merged");
+    mkdir "$tmp/merged";
+    my $cmd = "$merger output_dir=$tmp/merged @slices > $tmp/merged/merge.log";
+    my $code = system($cmd);
+    die "Command '$cmd' failed with code $code\n" if ($code);
+
+    # The front-coded inputs are merged into an ordinary .vocab, so all the files can be compared.
+    $errs += compare_files($label, "QBASH.doctable", 0);
+    $errs += compare_files($label, "QBASH.vocab", 0);
+    $errs += compare_files($label, "QBASH.if", $if_header_len);
+    $errs += compare_header_value($label, "max_raw_score");
+
+    foreach $opts ("relaxation_level=0",
+		   "relaxation_level=1",
+		   "relaxation_level=2",
+		   "relaxation_level=1 x_relaxed_evaluator=1") {
+	$errs += compare_results($label, $opts);
+    }
+}
+
+if ($errs) {
+    print "\n$errs index merger check(s) failed.\n";
+    exit(1);
+}
+
+system("rm -rf $tmp");
+print "\nAll index merger checks passed.\n";
+exit(0);
+
+# -------------------------------------------------------------------
+
+sub index_it {
+    my $dir = shift;
+    my $options = shift;
+    my $cmd = "$dexer index_dir=$dir $options > $dir/index.log";
+    my $code = system($cmd);
+    die "Command '$cmd' failed with code $code\n"
+	if ($code);
+}
+
+
+sub slurp {
+    my $fname = shift;
+    my $contents;
+    local $/;
+    die "Can't read $fname\n" unless open B, $fname;
+    binmode B;
+    $contents = <B>;
+    close(B);
+    return $contents;
+}
+
+
+sub compare_files {
+    # Compare a file in the merged and the full index, ignoring the first $skip bytes.
+    my $label = shift;
+    my $file = shift;
+    my $skip = shift;
+    my $full = slurp("$tmp/full/$file");
+    my $merged = slurp("$tmp/merged/$file");
+    if (length($full) != length($merged) || substr($full, $skip) ne substr($merged, $skip)) {
+	print "$label: merged $file differs from the single pass one [FAIL]\n";
+	exit(1) if $fail_fast;
+	return 1;
+    }
+    print "$label: merged $file identical", $skip ? " after the header" : "", " [OK]\n";
+    return 0;
+}
+
+
+sub compare_header_value {
+    my $label = shift;
+    my $name = shift;
+    my $full = slurp("$tmp/full/QBASH.if");
+    my $merged = slurp("$tmp/merged/QBASH.if");
+    my ($fv, $mv);
+    $fv = $1 if $full =~ /\n$name=(\S+)/;
+    $mv = $1 if $merged =~ /\n$name=(\S+)/;
+    if (!defined($fv) || !defined($mv) || $fv ne $mv) {
+	print "$label: $name in merged .if header is ", defined($mv) ? $mv : "missing",
+	    " not ", defined($fv) ? $fv : "missing", " [FAIL]\n";
+	exit(1) if $fail_fast;
+	return 1;
+    }
+    print "$label: $name=$mv in merged .if header [OK]\n";
+    return 0;
+}
+
+
+sub compare_results {
+    my $label = shift;
+    my $options = shift;
+    my $fullcmd = "$qp index_dir=$tmp/full file_query_batch=$qlog $options -chatty=off";
+    my $mergedcmd = "$qp index_dir=$tmp/merged file_query_batch=$qlog $options -chatty=off";
+    my $full = `$fullcmd`;
+    die "Command '$fullcmd' failed with code $?\n" if ($?);
+    my $merged = `$mergedcmd`;
+    die "Command '$mergedcmd' failed with code $?\n" if ($?);
+    my @full = split /\n/, $full;
+    my @merged = split /\n/, $merged;
+    my $l;
+
+    for ($l = 0; $l <= $#full || $l <= $#merged; $l++) {
+	if (!defined($full[$l]) || !defined($merged[$l]) || $full[$l] ne $merged[$l]) {
+	    print "$label $options: result line $l differs:\n    full: $full[$l]\n  merged: $merged[$l]\n";
+	    print "$mergedcmd [FAIL]\n";
+	    exit(1) if $fail_fast;
+	    return 1;
+	}
+    }
+    print "$label $options: ", $#full + 1, " result lines identical [OK]\n";
+    return 0;
+}
@@ -19,6 +19,7 @@ $tmpqfile = "tmp_qshort.q";
 
 
 $ix = "$idxdir/wikipedia_titles";
+$ix500k = "$idxdir/wikipedia_titles_500k";
 
 @qsets = (
     "$tqdir/emulated_log_10k.q"
@@ -65,6 +66,26 @@ print "\nRanking: Checking result counts in a multi-query ...\n";
 $err_cnt += check_count("it's a mad mad mad mad wurrald\t\t\tN<1\036it's a mad mad mad mad wurrald\t-query_shortening_threshold=4", "-allow_per_query_options=true", 8, 0);
 
 
+# --------------------------------------------------------------------------------------
+#      Check which words are dropped.  By default the most frequent words are, whether or
+#      not the query planner chooses the evaluation order.  Dropping the words which most
+#      reduce the planner's estimated cost (often the rarest) must be asked for.
+# --------------------------------------------------------------------------------------
+
+print "\nChecking the words dropped by shortening ...\n";
+$err_cnt += check_shortening("of nephi in for", "-relaxation_level=1 -query_shortening_threshold=3",
+			     "of nephi in for", "");
+$err_cnt += check_shortening("of nephi in for", "-relaxation_level=1 -query_shortening_threshold=3 -x_cost_based_shortening=TRUE",
+			     "of in for", "C");
+$err_cnt += check_shortening("List of colleges and universities in New York", "-query_shortening_threshold=3",
+			     "colleges and universities new york", "H");
+$err_cnt += check_shortening("Protocol amending the Agreements, Conventions and Protocols on Narcotic Drugs, 1946",
+			     "-query_shortening_threshold=3", "agreements conventions protocols narcotic drugs", "X9H");
+
+print "\nChecking that shortening and results don't depend on x_query_planner ...\n";
+$err_cnt += compare_planned_and_unplanned("$tqdir/emulated_log_1k.q", "-query_shortening_threshold=3 -relaxation_level=1");
+
+
 # --------------------------------------------------------------------------------------
 #      Run a file of 10k queries with query shortening -- hopefully it doesn't crash
 # --------------------------------------------------------------------------------------
@@ -129,6 +150,62 @@ sub check_count {
 }
 
 
+sub check_shortening {
+	# Check the candidate generation query and the shortening code reported for a query
+	# against the wikipedia_titles_500k index.
+	my $query = shift;
+	my $options = shift;
+	my $expected_cgq = shift;
+	my $expected_code = shift;
+
+	my $cmd = "$qp index_dir=$ix500k -pq=\"$query\" -display_parsed_query=TRUE $options";
+	print $cmd;
+	my $rslts = `$cmd`;
+	die "\n\nCommand '$cmd' failed with code $?\n"
+		if ($?);
+	if ($rslts =~ /candidate generation is \{([^}]*)\};.*?Shortening code: \{([^}]*)\}/
+	    && $1 eq $expected_cgq && $2 eq $expected_code) {
+		print " [OK]\n";
+		return 0;
+	}
+	print "\n   Expected {$expected_cgq} and code {$expected_code}, got {$1} and code {$2} [FAIL]\n";
+	if ($fail_fast) {
+		print $rslts;
+		exit(1);
+	}
+	return 1;
+}
+
+
+sub compare_planned_and_unplanned {
+	# x_query_planner only chooses the order in which terms are checked, so the candidate
+	# generation queries and results must be the same with and without it.
+	my $qfile = shift;
+	my $options = shift;
+	my @outputs;
+
+	foreach $planner ("TRUE", "FALSE") {
+		my $cmd = "$qp index_dir=$ix500k -file_query_batch=$qfile -display_parsed_query=TRUE -x_query_planner=$planner $options";
+		my $rslts = `$cmd`;
+		die "\n\nCommand '$cmd' failed with code $?\n"
+			if ($?);
+		my $kept = "";
+		foreach $line (split /\n/, $rslts) {
+			$kept .= "$line\n" if $line =~ /candidate generation is/ || $line =~ /\t[0-9]+\.[0-9]+$/;
+		}
+		push @outputs, $kept;
+	}
+	print "$qfile $options";
+	if ($outputs[0] eq $outputs[1] && length($outputs[0]) > 0) {
+		print " [OK]\n";
+		return 0;
+	}
+	print " [FAIL]\n";
+	exit(1) if $fail_fast;
+	return 1;
+}
+
+
 sub check_topk_results {
     # This used to test ranks, but that's prone to errors when two items have
     # identical scores.  Now changed to check presence and (optionally) scores instead.
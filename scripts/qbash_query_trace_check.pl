@@ -0,0 +1,259 @@
+#! /usr/bin/perl - w
+
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the MIT license.
+
+
+# Tests the per-query traces written with file_query_trace=<file>.  Checks that:
+#   - every line of the trace is a valid JSON object with the expected fields
+#     and types, and that queries needing JSON escapes (quotes, backslashes,
+#     control characters) and UTF-8 ones come back exactly as they went in;
+#   - with query_trace_sampling=1, every query is traced once, in order with a
+#     single query stream, and once each with several streams;
+#   - the cost of every traced query with words is predicted, even though no
+#     cost_limit_kops is set, and predicted_kops and route are left out when
+#     the planner is off (x_query_planner=FALSE);
+#   - with query_trace_sampling=N, about one query in N is traced, and each
+#     traced query is one of those run.
+
+use JSON::PP;
+
+$|++;
+
+$idxdir = "../test_data";
+$ix = "$idxdir/wikipedia_titles_500k";
+
+die "Usage: $0 <QBASHQ binary>\n"
+		unless ($#ARGV >= 0);
+
+$qp = $ARGV[0];
+$qp = "../src/visual_studio/x64/Release/QBASHQ.exe"
+    if $qp eq "default";
+
+die "$qp is not executable\n" unless -e $qp;
+
+$fail_fast = 0;
+$fail_fast = 1 if ($#ARGV > 0 && $ARGV[1] eq "-fail_fast");
+
+die "Can't find $ix/QBASH.if\n" unless -r "$ix/QBASH.if";
+
+$qlog = "../test_queries/emulated_log_1k.q";
+$sampling_qlog = "../test_queries/emulated_log_10k.q";
+die "Can't find $qlog\n" unless -r $qlog;
+die "Can't find $sampling_qlog\n" unless -r $sampling_qlog;
+
+$tmp = "Query_Trace_Tempdata";
+system("rm -rf $tmp");
+mkdir $tmp;
+
+# Queries whose strings need escaping in JSON.  (A TAB would end the query.)
+$oddq = "$tmp/odd.q";
+die "Can't write $oddq\n" unless open Q, ">$oddq";
+binmode Q;
+print Q "\"new york\" city\n";
+print Q "back\\slash\n";
+print Q "trailing backslash\\\n";
+print Q "ctl\x01char\x1f\n";
+print Q "j\xc3\xa4\xc3\xa4tynyt djurdjevi\xc4\x87\n";
+print Q "{\"json\": [1, 2]}\n";
+print Q "/ ~ % [ ]\n";
+close(Q);
+
+# JSON::PP without ->utf8 takes the line as it is, byte for byte, so decoded strings compare
+# directly with the raw bytes of the queries.
+$json = JSON::PP->new;
+
+$errs = 0;
+
+@odd = read_queries($oddq);
+$errs += check_trace("odd queries", $oddq, "query_streams=1", \@odd, 1);
+
+@log = read_queries($qlog);
+$errs += check_trace("$qlog", $qlog, "query_streams=1", \@log, 1);
+$errs += check_trace("$qlog with 4 streams", $qlog, "query_streams=4", \@log, 0);
+
+@traced = run_traced($qlog, "query_streams=1 x_query_planner=FALSE");
+@predicted = grep { exists($_->{predicted_kops}) || exists($_->{route}) } @traced;
+if ($#traced != $#log || $#predicted >= 0) {
+    print "x_query_planner=FALSE: ", $#traced + 1, " traces, ", $#predicted + 1, " with predictions [FAIL]\n";
+    exit(1) if $fail_fast;
+    $errs++;
+} else {
+    print "x_query_planner=FALSE: ", $#traced + 1, " traces without predictions [OK]\n";
+}
+
+# Sampling.  The choice is pseudo-random so the counts are only checked against
+# generous bounds: +/- 15% at 1 in 10 is about five standard deviations.
+@log = read_queries($sampling_qlog);
+foreach $rate (10, 100) {
+    my @traced = run_traced($sampling_qlog, "query_streams=1 query_trace_sampling=$rate");
+    my $expected = ($#log + 1) / $rate;
+    my $n = $#traced + 1;
+    my ($lo, $hi) = (int($expected * 0.85), int($expected * 1.15 + 0.5));
+    if ($rate == 100) {
+	# Too few to expect much accuracy
+	($lo, $hi) = (int($expected * 0.5), int($expected * 1.5 + 0.5));
+    }
+    my $bad = 0;
+    my %run = map { $_ => 1 } @log;
+    foreach $t (@traced) {
+	$bad++ unless (validate_trace($t) eq "" && $run{$t->{query}});
+    }
+    if ($n < $lo || $n > $hi || $bad) {
+	print "query_trace_sampling=$rate: $n traces, $bad bad, expected $lo - $hi [FAIL]\n";
+	exit(1) if $fail_fast;
+	$errs++;
+    } else {
+	print "query_trace_sampling=$rate: $n of ", $#log + 1, " queries traced [OK]\n";
+    }
+}
+
+@traced = run_traced($sampling_qlog, "query_streams=1 query_trace_sampling=1000000000");
+if ($#traced > 0) {
+    print "query_trace_sampling=1000000000: ", $#traced + 1, " traces [FAIL]\n";
+    exit(1) if $fail_fast;
+    $errs++;
+} else {
+    print "query_trace_sampling=1000000000: ", $#traced + 1, " traces [OK]\n";
+}
+
+if ($errs) {
+    print "\n$errs query trace check(s) failed.\n";
+    exit(1);
+}
+
+system("rm -rf $tmp");
+print "\nAll query trace checks passed.\n";
+exit(0);
+
+# -------------------------------------------------------------------
+
+sub read_queries {
+    my $fname = shift;
+    my @queries = ();
+    die "Can't read $fname\n" unless open L, $fname;
+    binmode L;
+    while (<L>) {
+	chomp;
+	s/\r$//;
+	push @queries, $_;
+    }
+    close(L);
+    return @queries;
+}
+
+
+sub run_traced {
+    # Run the queries in $qfile with tracing and return the decoded traces, dying if any line
+    # of the trace file isn't valid JSON.
+    my $qfile = shift;
+    my $options = shift;
+    my $trace = "$tmp/trace.jsonl";
+    my @traces = ();
+    unlink $trace;
+    my $cmd = "$qp index_dir=$ix file_query_batch=$qfile file_query_trace=$trace $options > $tmp/results.txt";
+    my $code = system($cmd);
+    die "Command '$cmd' failed with code $code\n" if ($code);
+    return () unless -e $trace;
+    die "Can't read $trace\n" unless open T, $trace;
+    binmode T;
+    while (<T>) {
+	my $t;
+	die "Trace line $. doesn't end with a newline\n" unless /\n$/;
+	eval { $t = $json->decode($_); };
+	if ($@ || ref($t) ne "HASH") {
+	    print "Invalid JSON on line $. of trace from '$cmd':\n$_\n$@ [FAIL]\n";
+	    exit(1);
+	}
+	push @traces, $t;
+    }
+    close(T);
+    return @traces;
+}
+
+
+sub is_number {
+    my $v = shift;
+    return defined($v) && !ref($v) && $v =~ /^-?[0-9]+(\.[0-9]+)?([eE][-+]?[0-9]+)?$/;
+}
+
+
+sub validate_trace {
+    # Return a description of what's wrong with a decoded trace, or "" if nothing.
+    my $t = shift;
+    foreach $f ("start_time", "results", "cost") {
+	return "$f is not a number" unless is_number($t->{$f});
+    }
+    foreach $f ("query", "processed_query", "cg_query", "shortening") {
+	return "$f is not a string" unless defined($t->{$f}) && !ref($t->{$f});
+    }
+    # predicted_kops and route are only there if a prediction was made
+    return "predicted_kops without route, or vice versa" if (exists($t->{predicted_kops}) != exists($t->{route}));
+    if (exists($t->{predicted_kops})) {
+	return "predicted_kops is not a number" unless is_number($t->{predicted_kops});
+	return "route is not a string" unless defined($t->{route}) && !ref($t->{route});
+    }
+    return "label is neither null nor a string" if ref($t->{label});
+    return "unknown shortening code '$t->{shortening}'" unless $t->{shortening} =~ /^[XR9HC]*$/;
+    return "unknown route code '$t->{route}'" unless $t->{route} =~ /^[RST]*$/;
+    return "timed_out is not a boolean" unless JSON::PP::is_bool($t->{timed_out});
+    return "ops is not an object" unless ref($t->{ops}) eq "HASH" && exists($t->{ops}{term_lookup});
+    foreach $o (keys %{$t->{ops}}) {
+	return "ops.$o is not a count" unless $t->{ops}{$o} =~ /^[0-9]+$/;
+    }
+    return "stages_usec is not an object" unless ref($t->{stages_usec}) eq "HASH";
+    return "stages_usec has no total" unless is_number($t->{stages_usec}{total});
+    foreach $s (keys %{$t->{stages_usec}}) {
+	return "stages_usec.$s is not a number" unless is_number($t->{stages_usec}{$s});
+    }
+    return "candidates_per_block is not an array" unless ref($t->{candidates_per_block}) eq "ARRAY";
+    foreach $c (@{$t->{candidates_per_block}}) {
+	return "candidates_per_block has a non-count" unless $c =~ /^[0-9]+$/;
+    }
+    return "";
+}
+
+
+sub check_trace {
+    # Run the queries with every one traced and check each trace.  If $in_order, the traces must
+    # be in the same order as the queries, otherwise they may be in any order.
+    my $label = shift;
+    my $qfile = shift;
+    my $options = shift;
+    my $queries = shift;
+    my $in_order = shift;
+    my @traces = run_traced($qfile, $options);
+    my ($i, $problem, @got, @expected);
+
+    if ($#traces != $#$queries) {
+	print "$label: ", $#traces + 1, " traces for ", $#$queries + 1, " queries [FAIL]\n";
+	exit(1) if $fail_fast;
+	return 1;
+    }
+    for ($i = 0; $i <= $#traces; $i++) {
+	$problem = validate_trace($traces[$i]);
+	$problem = "no cost prediction"
+	    if ($problem eq "" && $traces[$i]->{cg_query} ne ""
+		&& !(exists($traces[$i]->{predicted_kops}) && $traces[$i]->{predicted_kops} > 0));
+	if ($problem ne "") {
+	    print "$label: trace $i: $problem [FAIL]\n";
+	    exit(1) if $fail_fast;
+	    return 1;
+	}
+    }
+    @got = map { $_->{query} } @traces;
+    @expected = @$queries;
+    if (!$in_order) {
+	@got = sort @got;
+	@expected = sort @expected;
+    }
+    for ($i = 0; $i <= $#got; $i++) {
+	if ($got[$i] ne $expected[$i]) {
+	    print "$label: trace $i is for {$got[$i]} not {$expected[$i]} [FAIL]\n";
+	    exit(1) if $fail_fast;
+	    return 1;
+	}
+    }
+    print "$label: ", $#traces + 1, " valid traces", $in_order ? ", in order" : "", " [OK]\n";
+    return 0;
+}
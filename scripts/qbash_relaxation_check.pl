@@ -60,6 +60,34 @@ foreach $query ("St Anne Catholic Church Greensboro North Carolina",
 
 
     $errs = check_a_in_b($rslts, $relaxed);
+
+    # The candidate-at-a-time and window-at-a-time evaluators must find the same results.
+    for ($rl = 1; $rl <= 3; $rl++) {
+	$by_candidates = `$base_cmd -pq="$query" -relaxation_level=$rl -x_relaxed_evaluator=1`;
+	$by_windows = `$base_cmd -pq="$query" -relaxation_level=$rl -x_relaxed_evaluator=2`;
+	if ($by_candidates ne $by_windows) {
+	    print "Error: Relaxed evaluators disagree at relaxation_level=$rl\n";
+	    $errs++;
+	    exit(1) if $fail_fast;
+	}
+
+	# The planner only changes the order in which terms are checked, not the results.
+	$unplanned = `$base_cmd -pq="$query" -relaxation_level=$rl -x_relaxed_evaluator=1 -x_query_planner=FALSE`;
+	if ($by_candidates ne $unplanned) {
+	    print "Error: Results depend on x_query_planner at relaxation_level=$rl\n";
+	    $errs++;
+	    exit(1) if $fail_fast;
+	}
+
+	# Nor must a timeout make the evaluators disagree.
+	$errs += check_evaluators_with_timeout($ix, $query, $rl);
+    }
+}
+
+# A query which times out after a few results in the 500k index, if it's there.
+$ix500k = "$idxdir/wikipedia_titles_500k";
+if (-r "$ix500k/QBASH.if") {
+    $errs += check_evaluators_with_timeout($ix500k, "railway prapoutel amp", 1);
 }
 
 if ($errs) {print "\n\nGaak!  $errs encountered by $0\n";}
@@ -69,6 +97,27 @@ exit($errs);
 
 # ------------------------------------------------------------
 
+sub check_evaluators_with_timeout {
+    # Under timeout_kops, the automatic choice of evaluator and the window evaluator
+    # must give exactly what the candidate evaluator does.
+    my $index = shift;
+    my $query = shift;
+    my $rl = shift;
+    my $cmd = "$qp -index_dir=$index -pq=\"$query\" -relaxation_level=$rl -timeout_kops=1";
+    my $by_candidates = `$cmd -x_relaxed_evaluator=1`;
+    my $errs = 0;
+    foreach $evaluator (0, 2) {
+	my $rslts = `$cmd -x_relaxed_evaluator=$evaluator`;
+	if ($rslts ne $by_candidates) {
+	    print "Error: With timeout_kops=1, x_relaxed_evaluator=$evaluator disagrees with 1 for {$query} at relaxation_level=$rl\n";
+	    $errs++;
+	    exit(1) if $fail_fast;
+	}
+    }
+    return $errs;
+}
+
+
 sub check_a_in_b {
     my $a = shift;
     my $b = shift;
@@ -39,11 +39,19 @@ die "Can't find QBASHER indexes in $ix\n"
 
 $errs = 0;
 
+# For each relaxation level, the evaluator chosen by the cost model is compared with the
+# candidate-at-a-time (x_relaxed_evaluator=1) and window-at-a-time (2) evaluators.
 @options = (
     "-relaxation_level=0",
     "-relaxation_level=1",
+    "-relaxation_level=1 -x_relaxed_evaluator=1",
+    "-relaxation_level=1 -x_relaxed_evaluator=2",
     "-relaxation_level=2",
+    "-relaxation_level=2 -x_relaxed_evaluator=1",
+    "-relaxation_level=2 -x_relaxed_evaluator=2",
     "-relaxation_level=3",
+    "-relaxation_level=3 -x_relaxed_evaluator=1",
+    "-relaxation_level=3 -x_relaxed_evaluator=2",
     );
 
 
@@ -117,12 +117,18 @@ if ($lite_tests) {
 	"sanity",
 	"multi_query",
 	"query_shortening",
+	"cost_prediction",
+	"query_trace",
 	"disjunctions",
 	"substitution_rules",
 	"classifier_modes",    
 	"relaxation",
 	"street_addresses",
 	"index_modes",
+	"delta_index",
+	"index_container",
+	"index_merger",
+	"front_coded_vocab",
 	"timeout",
 	"fuzz",
 	"batch_labels",
@@ -139,6 +145,8 @@ if ($lite_tests) {
 	"sanity",
 	"multi_query",
 	"query_shortening",
+	"cost_prediction",
+	"query_trace",
 	"disjunctions",
 	"substitution_rules",
 	"c-sharp",
@@ -148,6 +156,10 @@ if ($lite_tests) {
 	"street_addresses",
 	"multi_threading",
 	"index_modes",
+	"delta_index",
+	"index_container",
+	"index_merger",
+	"front_coded_vocab",
 	"fuzz",
 	"batch_labels",
 	"timeout",
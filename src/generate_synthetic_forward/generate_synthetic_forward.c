@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Write a synthetic QBASH.forward file to stdout, for performance testing of QBASHI and QBASHQ
+// on collections of controllable size and shape.  Each record is a line of words separated
+// by single spaces, a TAB and a static score.
+//
+// Word frequencies follow a Zipf distribution:  the probability of the word of rank r (from 1)
+// is proportional to 1 / r^zipf_alpha.  Optionally, the probabilities of the most frequent
+// words can be given explicitly as percentages, in which case the Zipf distribution is
+// scaled to share what's left among the remaining words.  The word of rank r is the r-th
+// string in the sequence a, b, ... z, aa, ab, ..., so that, as in natural language, frequent
+// words are short.
+//
+// Record lengths in words follow a gamma distribution with the given mean and shape, and are
+// limited to the range 1 - max_doc_length.  The smaller the shape, the more skewed the
+// distribution.  A shape of zero makes every record doc_length words long.
+//
+// The output is a function of the arguments alone, on all platforms.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define MAX_HEAD_TERMS 100
+#define MAX_SYNTH_WORD_LEN 16   // Longer than any word generated from a vocabulary of fewer than 26^15 words
+
+typedef unsigned long long u_ll;
+
+
+// ---------------------------------------------------------------------------------------------------
+// Options
+// ---------------------------------------------------------------------------------------------------
+
+static u_ll seed = 1, docs = 100000, vocab_size = 100000;
+static double zipf_alpha = 1.0, doc_length = 8.0, doc_length_shape = 4.0;
+static int max_doc_length = 200, max_score = 1000;
+static char *head_term_percentages = NULL;
+
+
+static void print_usage(char *progname) {
+  fprintf(stderr,
+	  "Usage: %s [name=value ...] > QBASH.forward\n"
+	  "   seed=<integer>                  - Random seed. (Default 1)\n"
+	  "   docs=<integer>                  - Number of records to generate. (Default 100000)\n"
+	  "   vocab_size=<integer>            - Number of distinct words. (Default 100000)\n"
+	  "   zipf_alpha=<float>              - Exponent of the Zipf distribution of word frequencies. (Default 1.0)\n"
+	  "   head_term_percentages=<p1,p2..> - Percentages of all word occurrences taken by the most frequent words.\n"
+	  "                                     The Zipf distribution applies to the rest.  (Default none)\n"
+	  "   doc_length=<float>              - Mean record length in words. (Default 8)\n"
+	  "   doc_length_shape=<float>        - Shape of the gamma distribution of record lengths.  0 -> constant. (Default 4)\n"
+	  "   max_doc_length=<integer>        - Longest record to generate, in words. (Default 200)\n"
+	  "   max_score=<integer>             - Static scores are uniformly distributed from 1 to this. (Default 1000)\n\n",
+	  progname);
+  exit(1);
+}
+
+
+static void assign_option(char *progname, char *arg) {
+  char *val = strchr(arg, '=');
+  if (val == NULL) print_usage(progname);
+  *val++ = 0;
+  if (!strcmp(arg, "seed")) seed = strtoull(val, NULL, 10);
+  else if (!strcmp(arg, "docs")) docs = strtoull(val, NULL, 10);
+  else if (!strcmp(arg, "vocab_size")) vocab_size = strtoull(val, NULL, 10);
+  else if (!strcmp(arg, "zipf_alpha")) zipf_alpha = strtod(val, NULL);
+  else if (!strcmp(arg, "head_term_percentages")) head_term_percentages = val;
+  else if (!strcmp(arg, "doc_length")) doc_length = strtod(val, NULL);
+  else if (!strcmp(arg, "doc_length_shape")) doc_length_shape = strtod(val, NULL);
+  else if (!strcmp(arg, "max_doc_length")) max_doc_length = atoi(val);
+  else if (!strcmp(arg, "max_score")) max_score = atoi(val);
+  else {
+    fprintf(stderr, "Error: Unknown option '%s'\n", arg);
+    print_usage(progname);
+  }
+}
+
+
+// ---------------------------------------------------------------------------------------------------
+// Random numbers.  SplitMix64, so that the output doesn't depend on the platform's rand().
+// ---------------------------------------------------------------------------------------------------
+
+static u_ll rng_state;
+
+static u_ll random_u_ll() {
+  u_ll z = (rng_state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+
+static double random_uniform() {
+  // In (0, 1)
+  return ((double)(random_u_ll() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+
+static double random_normal() {
+  // Box-Muller.  Only one of the pair is used.
+  return sqrt(-2.0 * log(random_uniform())) * cos(6.283185307179586 * random_uniform());
+}
+
+
+static double random_gamma(double shape) {
+  // Marsaglia and Tsang's method, with unit scale.  Shapes below one are boosted by one and
+  // corrected by a power of a uniform variate.
+  double d, c, x, v, u;
+
+  if (shape < 1.0) return random_gamma(shape + 1.0) * pow(random_uniform(), 1.0 / shape);  // ----------------->
+  d = shape - 1.0 / 3.0;
+  c = 1.0 / sqrt(9.0 * d);
+  while (1) {
+    do {
+      x = random_normal();
+      v = 1.0 + c * x;
+    } while (v <= 0.0);
+    v = v * v * v;
+    u = random_uniform();
+    if (u < 1.0 - 0.0331 * x * x * x * x) return d * v;  // ----------------->
+    if (log(u) < 0.5 * x * x + d * (1.0 - v + log(v))) return d * v;  // ----------------->
+  }
+}
+
+
+// ---------------------------------------------------------------------------------------------------
+// The vocabulary
+// ---------------------------------------------------------------------------------------------------
+
+static double *setup_cumulative_probabilities() {
+  // Return an array whose r-th element is the probability of a word of rank r + 1 or less.
+  double *cumprobs, head[MAX_HEAD_TERMS], head_total = 0.0, zipf_total = 0.0, cum;
+  int heads = 0;
+  u_ll r;
+  char *p;
+
+  if (head_term_percentages != NULL) {
+    p = head_term_percentages;
+    while (*p && heads < MAX_HEAD_TERMS) {
+      head[heads] = strtod(p, &p) / 100.0;
+      head_total += head[heads++];
+      while (*p == ',' || *p == ' ') p++;
+    }
+    if (head_total >= 1.0 || heads >= vocab_size) {
+      fprintf(stderr, "Error: head_term_percentages must add up to less than 100 and be fewer than vocab_size.\n");
+      exit(1);
+    }
+  }
+
+  cumprobs = (double *)malloc(vocab_size * sizeof(double));
+  if (cumprobs == NULL) {
+    fprintf(stderr, "Error: Unable to allocate probabilities for %llu words.\n", vocab_size);
+    exit(1);
+  }
+  for (r = heads; r < vocab_size; r++) zipf_total += pow((double)(r + 1), -zipf_alpha);
+
+  cum = 0.0;
+  for (r = 0; r < vocab_size; r++) {
+    if (r < heads) cum += head[r];
+    else cum += (1.0 - head_total) * pow((double)(r + 1), -zipf_alpha) / zipf_total;
+    cumprobs[r] = cum;
+  }
+  cumprobs[vocab_size - 1] = 1.0;  // Guard against rounding
+  return cumprobs;
+}
+
+
+static u_ll random_rank(double *cumprobs) {
+  // Binary search for the first rank whose cumulative probability exceeds a uniform variate.
+  double u = random_uniform();
+  u_ll lo = 0, hi = vocab_size - 1, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (cumprobs[mid] < u) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+
+static int word_for_rank(u_ll rank, char *word) {
+  // Write the word of the given rank (from zero) in bijective base 26 and return its length.
+  char reversed[MAX_SYNTH_WORD_LEN];
+  int len = 0, i;
+
+  rank++;
+  while (rank > 0 && len < MAX_SYNTH_WORD_LEN) {
+    rank--;
+    reversed[len++] = 'a' + (char)(rank % 26);
+    rank /= 26;
+  }
+  for (i = 0; i < len; i++) word[i] = reversed[len - 1 - i];
+  word[len] = 0;
+  return len;
+}
+
+
+static int random_doc_length() {
+  int len;
+  if (doc_length_shape <= 0.0) len = (int)floor(doc_length + 0.5);
+  else len = (int)floor(random_gamma(doc_length_shape) * doc_length / doc_length_shape + 0.5);
+  if (len < 1) len = 1;
+  if (len > max_doc_length) len = max_doc_length;
+  return len;
+}
+
+
+int main(int argc, char **argv) {
+  double *cumprobs;
+  char word[MAX_SYNTH_WORD_LEN + 1];
+  u_ll d, r, total_words = 0, distinct_words = 0;
+  unsigned char *used;
+  int a, w, len;
+
+  for (a = 1; a < argc; a++) assign_option(argv[0], argv[a]);
+  if (docs < 1 || vocab_size < 1 || doc_length < 1.0 || max_doc_length < 1 || max_score < 1) {
+    fprintf(stderr, "Error: docs, vocab_size, doc_length, max_doc_length and max_score must all be at least one.\n");
+    print_usage(argv[0]);
+  }
+
+  rng_state = seed;
+  cumprobs = setup_cumulative_probabilities();
+  used = (unsigned char *)calloc(vocab_size, 1);
+  if (used == NULL) {
+    fprintf(stderr, "Error: Unable to allocate memory for %llu words.\n", vocab_size);
+    exit(1);
+  }
+
+  for (d = 0; d < docs; d++) {
+    len = random_doc_length();
+    for (w = 0; w < len; w++) {
+      r = random_rank(cumprobs);
+      if (!used[r]) {
+	used[r] = 1;
+	distinct_words++;
+      }
+      word_for_rank(r, word);
+      if (w > 0) putchar(' ');
+      fputs(word, stdout);
+    }
+    printf("\t%d\n", (int)(random_u_ll() % max_score) + 1);
+    total_words += len;
+  }
+
+  fprintf(stderr, "Generated %llu records containing %llu words (mean length %.2f), %llu of the %llu words in the vocabulary.\n",
+	  docs, total_words, (double)total_words / (double)docs, distinct_words, vocab_size);
+  free(used);
+  free(cumprobs);
+  return 0;
+}
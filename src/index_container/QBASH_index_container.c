@@ -0,0 +1,172 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// QBASH_index_container packs the four files of a QBASHER index, plus any sidecar files, into a
+// single container file (by default <index_dir>/QBASH.qbx) with a binary table of contents and
+// page-aligned, checksummed sections.  See shared/index_container.h for the format.  QBASHQ
+// maps the container instead of the individual files whenever it's present in index_dir or
+// delta_dir, so the container must be re-packed (or deleted) whenever the index is rebuilt.
+// QBASH.bitmaps, if there is one, is packed without having to be named as a sidecar.
+//
+// It can also check an existing container, including all its section checksums, and list its
+// table of contents.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef WIN64
+#include <windows.h>
+#endif
+
+#include "../shared/utility_nodeps.h"
+#include "../shared/index_container.h"
+
+static char *core_suffixes[] = { ".forward", ".if", ".vocab", ".doctable" };
+
+
+static void print_usage(char *progname) {
+  printf("Usage: %s index_dir=<dir> [output=<container>] [sidecar=<file>] ...\n"
+	 "       Packs <dir>/QBASH.forward, .if, .vocab and .doctable, plus any sidecar files, into a\n"
+	 "       container, by default <dir>/QBASH.qbx.  The section name for a sidecar is the suffix\n"
+	 "       of its file name, e.g. \".skipdir\" for QBASH.skipdir.  <dir>/QBASH.bitmaps is packed\n"
+	 "       if it exists, unless a sidecar is already called \".bitmaps\".\n"
+	 "   or: %s verify=<container>\n"
+	 "       Checks the table of contents and all the section checksums of a container and lists its sections.\n",
+	 progname, progname);
+  exit(1);
+}
+
+
+static u_char *section_name_for(u_char *fname) {
+  // The section name is the suffix of the last component of fname, or the whole of it if there is no suffix.
+  u_char *p = fname + strlen((char *)fname), *dot = NULL;
+  while (p > fname && *(p - 1) != '/' && *(p - 1) != '\\') {
+    p--;
+    if (*p == '.' && dot == NULL) dot = p;
+  }
+  return dot != NULL ? dot : p;
+}
+
+
+static int verify_container(u_char *fname) {
+  CROSS_PLATFORM_FILE_HANDLE H;
+  HANDLE MH;
+  byte *container;
+  size_t sighs;
+  int error_code = 0;
+  double start = what_time_is_it();
+
+  container = (byte *)mmap_all_of(fname, &sighs, FALSE, &H, &MH, &error_code);
+  if (error_code < 0) {
+    printf("Error: Can't map %s.  Code = %d\n", fname, error_code);
+    return 1;  // ----------------->
+  }
+  error_code = qbx_check_header(container, sighs);
+  if (error_code < 0) {
+    printf("Error: %s is not a valid container.  Code = %d\n", fname, error_code);
+  } else {
+    qbx_print_toc(stdout, container);
+    error_code = qbx_verify_checksums(container, TRUE);
+    if (error_code < 0) printf("Error: checksum verification failed for %s.  Code = %d\n", fname, error_code);
+    else printf("All section checksums verified. (%.1f sec.)\n", what_time_is_it() - start);
+  }
+  unmmap_all_of(container, H, MH, sighs);
+  return error_code < 0 ? 1 : 0;
+}
+
+
+int main(int argc, char **argv) {
+  u_char *index_dir = NULL, *output = NULL, *fnames[QBX_MAX_SECTIONS], *section_names[QBX_MAX_SECTIONS];
+  char *p;
+  int a, s, num_sections = 4, num_sidecars = 0, error_code;
+  u_char *bitmaps_fname = NULL;
+  BOOL have_bitmaps = FALSE;
+  double start;
+
+  if (sizeof(size_t) != 8) error_exit("Error:  program must be compiled for 64 bit!\n");
+  setvbuf(stdout, NULL, _IONBF, 0);
+  if (argc < 2) print_usage(argv[0]);
+
+  for (a = 1; a < argc; a++) {
+    p = argv[a];
+    while (*p == '-') p++;  // Skip over leading hyphens
+    if (!strncmp(p, "verify=", 7)) exit(verify_container((u_char *)p + 7));
+    else if (!strncmp(p, "index_dir=", 10)) index_dir = (u_char *)p + 10;
+    else if (!strncmp(p, "output=", 7)) output = (u_char *)p + 7;
+    else if (!strncmp(p, "sidecar=", 8)) {
+      if (num_sections >= QBX_MAX_SECTIONS) {
+	printf("Error: a container can't hold more than %d sections.\n", QBX_MAX_SECTIONS);
+	exit(1);
+      }
+      fnames[num_sections] = (u_char *)p + 8;
+      section_names[num_sections] = section_name_for(fnames[num_sections]);
+      if (strlen((char *)section_names[num_sections]) >= QBX_MAX_SECTION_NAME) {
+	printf("Error: section name '%s' is too long.\n", section_names[num_sections]);
+	exit(1);
+      }
+      num_sections++;
+      num_sidecars++;
+    }
+    else {
+      printf("Unrecognized argument '%s'.\n", argv[a]);
+      print_usage(argv[0]);
+    }
+  }
+  if (index_dir == NULL) print_usage(argv[0]);
+  if (!is_a_directory((char *)index_dir)) {
+    printf("Error: index_dir %s is not a directory.\n", index_dir);
+    exit(1);
+  }
+
+  for (s = 0; s < 4; s++) {
+    fnames[s] = (u_char *)malloc(strlen((char *)index_dir) + 20);
+    if (fnames[s] == NULL) error_exit("Error: malloc failed for file names\n");
+    sprintf((char *)fnames[s], "%s/QBASH%s", index_dir, core_suffixes[s]);
+    section_names[s] = (u_char *)core_suffixes[s];
+  }
+  for (s = 4; s < num_sections; s++) {
+    for (a = 0; a < s; a++) {
+      if (!strcmp((char *)section_names[a], (char *)section_names[s])) {
+	printf("Error: more than one section would be called '%s'.\n", section_names[s]);
+	exit(1);
+      }
+    }
+    if (!strcmp((char *)section_names[s], ".bitmaps")) have_bitmaps = TRUE;
+  }
+  if (!have_bitmaps) {
+    // QBASHQ looks for the bitmaps in the container when there is one, so don't leave them out.
+    bitmaps_fname = (u_char *)malloc(strlen((char *)index_dir) + 20);
+    if (bitmaps_fname == NULL) error_exit("Error: malloc failed for file names\n");
+    sprintf((char *)bitmaps_fname, "%s/QBASH.bitmaps", index_dir);
+    if (exists((char *)bitmaps_fname, "")) {
+      if (num_sections >= QBX_MAX_SECTIONS) {
+	printf("Error: a container can't hold more than %d sections.\n", QBX_MAX_SECTIONS);
+	exit(1);
+      }
+      fnames[num_sections] = bitmaps_fname;
+      section_names[num_sections] = (u_char *)".bitmaps";
+      num_sections++;
+      num_sidecars++;
+    }
+  }
+  if (output == NULL) {
+    output = (u_char *)malloc(strlen((char *)index_dir) + 20);
+    if (output == NULL) error_exit("Error: malloc failed for output file name\n");
+    sprintf((char *)output, "%s/QBASH%s", index_dir, QBX_SUFFIX);
+  }
+
+  start = what_time_is_it();
+  printf("Packing %d index files and %d sidecars into %s\n", 4, num_sidecars, output);
+  error_code = qbx_pack(output, fnames, section_names, num_sections, TRUE);
+  if (error_code < 0) {
+    printf("Error: packing failed.  Code = %d\n", error_code);
+    exit(1);
+  }
+  printf("Container written. (%.1f sec.)\n", what_time_is_it() - start);
+  for (s = 0; s < 4; s++) free(fnames[s]);
+  free(bitmaps_fname);
+  return 0;
+}
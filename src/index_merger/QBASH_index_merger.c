@@ -0,0 +1,916 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// QBASH_index_merger combines two or more QBASHER indexes, e.g. ones built per day or per
+// shard, into a single index as though QBASHI had been run over all the data at once.
+//
+// Docnums are reassigned by a k-way merge of the input .doctables on static score, so that
+// the merged index is in descending score order (as produced by sort_records_by_weight) and
+// early termination in QBASHQ still works.  Ties go to the earliest input, so the result is
+// the same as QBASHI's sort of the inputs' .forwards concatenated in order.
+//
+// QBASHI quantizes scores relative to the highest score in its own .forward, so the doctable
+// scores of separately built indexes aren't comparable.  The merger requantizes each document's 
+// score from column 2 of its .forward record, relative to the highest score in all the inputs,
+// and uses that both for the merge and in the merged doctable.  Requantizing can change the
+// order of an input's documents: ones with equal scores in the input may be separated, and
+// ones with different scores may become equal and so have to be put back in .forward order.
+// Each input's documents are therefore sorted into merge order first.  Most of an input's
+// postings still come out in ascending merged docnum order.  Those which don't are confined to
+// runs of entries which are reordered among themselves, and each such run is sorted as it's read.
+//
+// The merged .forward is the concatenation of the input .forwards, with doctable offsets
+// adjusted accordingly.  Term IDFs are requantized against the merged list lengths and skip
+// blocks are rebuilt in exactly the same way as QBASHI does.
+//
+// All the inputs are memory mapped but each is read sequentially, from start to end, because
+// the vocabularies and the postings lists within the .if files are in the same alphabetical
+// order.  A front-coded .vocab is decoded a term at a time as it's stepped through, not
+// expanded.  Apart from I/O buffers, the memory used in proportion to the data is the docnum
+// remapping and merge order tables, at 17 bytes per document, plus 24 bytes per document of
+// one input at a time while its merge order is worked out.
+//
+// An input may be a delta index built with QBASHI first_docnum=<N>.  Tombstones are not
+// applied.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#ifdef WIN64
+#include <windows.h>
+#include <tchar.h>
+#include <strsafe.h>
+#else
+#include <errno.h>
+#endif
+
+#include "../shared/unicode.h"
+#include "../shared/QBASHER_common_definitions.h"
+#include "../shared/utility_nodeps.h"
+#include "../shared/front_coded_vocab.h"
+
+#define MAX_INPUTS 100
+
+
+// Shifts and masks for the doctable fields this program needs.  (Others are copied unchanged.)
+static unsigned long long DOCOFF_SHIFT, DOCOFF_MASK2, DOCOFF_MASK, DOCSCORE_SHIFT, DOCSCORE_MASK2, DOCSCORE_MASK;
+
+
+// Options settable from the command line.  Defaults are the same as QBASHI's.
+static u_int SB_POSTINGS_PER_RUN = 0, SB_TRIGGER = 500;
+
+
+typedef struct {
+  u_char *dir;
+  byte *forward, *index, *vocab, *doctable;
+  size_t fsz, isz, vsz, dsz;
+  vocab_iterator_t vocab_it;  // Steps through the .vocab, in either layout, during each merge pass
+  byte *vocab_rec;            // The current record in the standard layout, or NULL at the end
+  CROSS_PLATFORM_FILE_HANDLE forward_H, index_H, vocab_H, doctable_H;
+  HANDLE forward_MH, index_MH, vocab_MH, doctable_MH;
+  docnum_t first_docnum,  // Non-zero for a delta index.  Postings docnums are offset by this.
+    docs,                 // Number of doctable entries
+    next_doc;             // Used in the doctable merge.  Indexes order.
+  u_int next_score;       // Requantized score of order[next_doc]
+  docnum_t *order;        // order[k] is the doctable entry which is this input's k-th in merge order
+  byte *run_start;        // run_start[d] is TRUE if the entries before d are exactly the first d in merge order
+  docnum_t reordered;     // The number of entries not in their original position in merge order
+  docnum_t *remap;        // remap[d] is the merged docnum of doctable entry d
+  size_t forward_base;    // Offset of this input's .forward within the merged one.
+  u_ll header_postings, header_docs;
+} merge_input_t;
+
+
+typedef struct {
+  docnum_t newdoc;
+  int wpos;
+} run_posting_t;
+
+
+typedef struct {
+  // Reads one input's postings for the current term, translating the docnums.
+  merge_input_t *input;
+  byte *ixptr;            // Next byte of the list in the input .if, or NULL if the posting was in the .vocab entry
+  u_ll payload, remaining;
+  docnum_t docnum;        // Input docnum of the last posting decoded
+  docnum_t newdoc;        // Merged docnum of the current posting
+  int wpos;
+  // The postings in a run of reordered entries (see run_start), sorted by merged docnum.  A
+  // posting decoded beyond the end of the run is held over for the next one.
+  run_posting_t *run;
+  size_t run_size, run_count, run_next;
+  BOOL held;
+  docnum_t held_entry;
+  int held_wpos;
+} list_reader_t;
+
+
+static merge_input_t inputs[MAX_INPUTS];
+static int num_inputs = 0;
+static byte sb_run_accumulator[SB_MAX_BYTES_PER_RUN];
+static byte vocabfile_record[VOCABFILE_REC_LEN];
+
+
+static void print_usage(char *progname) {
+  printf("Usage: %s output_dir=<dir> <index_dir> <index_dir> ... [sb_trigger=<int>] [sb_run_length=<int>]\n"
+	 "       Merges the QBASH.forward, .doctable, .vocab and .if files in each of the index_dirs and\n"
+	 "       writes the combined index to output_dir, which must already exist.  Docnums are assigned\n"
+	 "       in descending order of doctable score.  All inputs must have been indexed with the\n"
+	 "       same options.  The skip block options have the same meaning and defaults as for QBASHI.\n",
+	 progname);
+  exit(1);
+}
+
+
+static u_char *get_header_value(byte *header, char *name) {
+  // Find the line in header starting with name (e.g. "case_fold=") and return a malloced copy of
+  // the rest of it, or NULL if there's no such line.
+  u_char *p, *q, *rslt;
+  size_t l = strlen(name);
+  p = (u_char *)header;
+  while (p < header + IF_HEADER_LEN && *p) {
+    if (!strncmp((char *)p, name, l)) {
+      p += l;
+      q = p;
+      while (*q && *q != '\n') q++;
+      rslt = (u_char *)cmalloc(q - p + 1, (u_char *)"header value", FALSE);
+      memcpy(rslt, p, q - p);
+      rslt[q - p] = 0;
+      return rslt;  // ------------------------------------------->
+    }
+    while (*p && *p != '\n') p++;
+    if (*p) p++;
+  }
+  return NULL;
+}
+
+
+// Header lines which must agree for the inputs to be mergeable.
+static char *must_match[] = {
+  "Index_format: ",
+  "Query_meta_chars: ",
+  "Other_token_breakers: ",
+  "language=",
+  "case_fold=",
+  "conflate_accents=",
+  "expect_cp1252=",
+  "max_line_prefix=",
+  "x_bigger_trigger=",
+  "x_geo_tile_width=",
+  "x_geo_big_tile_factor=",
+  NULL
+};
+
+
+static void open_input(merge_input_t *in, u_char *dir) {
+  // Map the four index files in dir and check the .if header.
+  u_char *fname, *value;
+  size_t l = strlen((char *)dir);
+  u_ll *llp;
+  int error_code = 0, m;
+
+  in->dir = dir;
+  fname = (u_char *)cmalloc(l + 30, (u_char *)"input filename", FALSE);
+  sprintf((char *)fname, "%s/QBASH.forward", dir);
+  in->forward = (byte *)mmap_all_of(fname, &(in->fsz), FALSE, &(in->forward_H), &(in->forward_MH), &error_code);
+  if (error_code < 0) {
+    printf("Error: can't map %s\n", fname);
+    exit(1);
+  }
+  sprintf((char *)fname, "%s/QBASH.doctable", dir);
+  in->doctable = (byte *)mmap_all_of(fname, &(in->dsz), FALSE, &(in->doctable_H), &(in->doctable_MH), &error_code);
+  if (error_code < 0) {
+    printf("Error: can't map %s\n", fname);
+    exit(1);
+  }
+  sprintf((char *)fname, "%s/QBASH.vocab", dir);
+  in->vocab = (byte *)mmap_all_of(fname, &(in->vsz), FALSE, &(in->vocab_H), &(in->vocab_MH), &error_code);
+  if (error_code < 0) {
+    printf("Error: can't map %s\n", fname);
+    exit(1);
+  }
+  sprintf((char *)fname, "%s/QBASH.if", dir);
+  in->index = (byte *)mmap_all_of(fname, &(in->isz), FALSE, &(in->index_H), &(in->index_MH), &error_code);
+  if (error_code < 0) {
+    printf("Error: can't map %s\n", fname);
+    exit(1);
+  }
+  free(fname);
+
+  // Everything is read from start to end.
+  apply_access_hint(in->forward, in->fsz, ACCESS_HINT_SEQUENTIAL);
+  apply_access_hint(in->doctable, in->dsz, ACCESS_HINT_SEQUENTIAL);
+  apply_access_hint(in->vocab, in->vsz, ACCESS_HINT_SEQUENTIAL);
+  apply_access_hint(in->index, in->isz, ACCESS_HINT_SEQUENTIAL);
+
+  if (in->isz < IF_HEADER_LEN + sizeof(u_ll)) {
+    printf("Error: %s/QBASH.if is too short to be an index.\n", dir);
+    exit(1);
+  }
+  llp = (u_ll *)(in->index + in->isz - sizeof(u_ll));
+  if (*llp != in->isz) {
+    printf("Error: %s/QBASH.if is truncated or corrupt.\n", dir);
+    exit(1);
+  }
+  value = get_header_value(in->index, "Index_format: ");
+  if (value == NULL || strcmp((char *)value, INDEX_FORMAT)) {
+    printf("Error: %s is not a %s index.\n", dir, INDEX_FORMAT);
+    exit(1);
+  }
+  free(value);
+  for (m = 0; must_match[m] != NULL; m++) {
+    u_char *v0, *v;
+    if (in == inputs) break;
+    v0 = get_header_value(inputs[0].index, must_match[m]);
+    v = get_header_value(in->index, must_match[m]);
+    if ((v0 == NULL) != (v == NULL) || (v != NULL && strcmp((char *)v0, (char *)v))) {
+      printf("Error: %s and %s were indexed with different '%s' settings.\n", inputs[0].dir, dir, must_match[m]);
+      exit(1);
+    }
+    free(v0);
+    free(v);
+  }
+
+  value = get_header_value(in->index, "first_docnum=");
+  if (value != NULL) in->first_docnum = strtoll((char *)value, NULL, 10);
+  free(value);
+  value = get_header_value(in->index, "Total postings: ");
+  if (value != NULL) in->header_postings = strtoull((char *)value, NULL, 10);
+  free(value);
+  value = get_header_value(in->index, "Number of documents: ");
+  if (value != NULL) in->header_docs = strtoull((char *)value, NULL, 10);
+  free(value);
+
+  in->docs = (docnum_t)(in->dsz / DTE_LENGTH);
+  in->remap = (docnum_t *)cmalloc(in->docs * sizeof(docnum_t) + 1, (u_char *)"docnum remap table", FALSE);
+  printf("Input %s: %lld docs from docnum %lld, %llu distinct terms.\n", dir, in->docs, in->first_docnum,
+	 vocab_term_count(in->vocab, in->vsz));
+}
+
+
+static void close_input(merge_input_t *in) {
+  unmmap_all_of(in->forward, in->forward_H, in->forward_MH, in->fsz);
+  unmmap_all_of(in->doctable, in->doctable_H, in->doctable_MH, in->dsz);
+  unmmap_all_of(in->vocab, in->vocab_H, in->vocab_MH, in->vsz);
+  unmmap_all_of(in->index, in->index_H, in->index_MH, in->isz);
+  free(in->remap);
+  in->remap = NULL;
+  free(in->order);
+  in->order = NULL;
+  free(in->run_start);
+  in->run_start = NULL;
+}
+
+
+static double max_score = 0.0, log_max_score = 1.0;
+
+
+static u_ll get_docoff(u_ll dte) {
+  return (dte & DOCOFF_MASK) >> DOCOFF_SHIFT;
+}
+
+
+static double raw_score_of(byte *record, byte *last) {
+  // Column 2 of the .forward record, found the same way as in QBASHI.
+  byte *p = record;
+  while (p < last && *p != '\t') p++;  // Skip the trigger
+  if (p >= last) return 0.0;
+  return strtod((char *)p + 1, NULL);
+}
+
+
+static void find_max_score(merge_input_t *in) {
+  // Scan the .forward like QBASHI's first pass, updating max_score
+  byte *p = in->forward, *last = in->forward + in->fsz;
+  double score;
+  while (p < last) {
+    score = raw_score_of(p, last);
+    if (score > max_score) max_score = score;
+    while (p < last && *p != '\n') p++;  // Skip to end of record.
+    p++;
+  }
+}
+
+
+static u_int quantize_log_score_ratio(double score) {
+  // The same quantization as in QBASHI.
+  double lograt, dmv = (double)DOCSCORE_MASK2;
+  u_int rslt;
+
+  if (score <= 0 || log_max_score < 1.0) return 0;
+  lograt = log(score + 1) / log_max_score;
+  if (lograt > 1.0) lograt = 1.0;
+  lograt *= dmv;
+  rslt = (u_int)lograt;
+  if (rslt > (u_int)DOCSCORE_MASK2) rslt = (u_int)DOCSCORE_MASK2;
+  return rslt;
+}
+
+
+static u_int requantized_score(merge_input_t *in, docnum_t d) {
+  u_ll dte = *(u_ll *)(in->doctable + d * DTE_LENGTH);
+  return quantize_log_score_ratio(raw_score_of(in->forward + get_docoff(dte), in->forward + in->fsz));
+}
+
+
+static void requantize_next_score(merge_input_t *in) {
+  if (in->next_doc >= in->docs) return;
+  in->next_score = requantized_score(in, in->order[in->next_doc]);
+}
+
+
+typedef struct {
+  u_int score;
+  u_ll docoff;
+  docnum_t entry;
+} merge_key_t;
+
+
+static int cmp_merge_keys(const void *i, const void *j) {
+  // Descending score, then ascending position in the .forward, as in QBASHI's counting sort
+  const merge_key_t *a = (const merge_key_t *)i, *b = (const merge_key_t *)j;
+  if (a->score != b->score) return a->score > b->score ? -1 : 1;
+  if (a->docoff != b->docoff) return a->docoff < b->docoff ? -1 : 1;
+  return 0;
+}
+
+
+static void find_merge_order(merge_input_t *in) {
+  // Set up in->order and in->run_start.  Unless the input was quantized against the same
+  // maximum as the merge, a few entries are likely to change places.
+  merge_key_t *keys;
+  docnum_t d, k, *rank, max_rank = -1;
+
+  keys = (merge_key_t *)cmalloc(in->docs * sizeof(merge_key_t) + 1, (u_char *)"merge keys", FALSE);
+  for (d = 0; d < in->docs; d++) {
+    keys[d].score = requantized_score(in, d);
+    keys[d].docoff = get_docoff(*(u_ll *)(in->doctable + d * DTE_LENGTH));
+    keys[d].entry = d;
+  }
+  qsort(keys, in->docs, sizeof(merge_key_t), cmp_merge_keys);
+  in->order = (docnum_t *)cmalloc(in->docs * sizeof(docnum_t) + 1, (u_char *)"merge order", FALSE);
+  in->reordered = 0;
+  for (k = 0; k < in->docs; k++) {
+    in->order[k] = keys[k].entry;
+    if (keys[k].entry != k) in->reordered++;
+  }
+
+  // The keys have all been used, so their space can hold the rank of each entry in merge order.
+  rank = (docnum_t *)keys;
+  for (k = 0; k < in->docs; k++) rank[in->order[k]] = k;
+  in->run_start = (byte *)cmalloc(in->docs + 1, (u_char *)"run starts", FALSE);
+  for (d = 0; d < in->docs; d++) {
+    in->run_start[d] = (max_rank == d - 1);
+    if (rank[d] > max_rank) max_rank = rank[d];
+  }
+  free(keys);
+}
+
+
+static docnum_t merge_forwards_and_doctables(u_char *outdir, size_t *forward_size) {
+  // Write the merged .forward and .doctable, recording the new docnum of every input document
+  // in the remap tables.  At each step the document taken is the one with the highest score
+  // among the next unmerged documents of the inputs.  Ties go to the earliest input, so that
+  // indexes of consecutive slices of a file merge into the order QBASHI would have produced.
+  // Return the number of documents, and the size of the .forward via forward_size.
+  u_char *fname;
+  CROSS_PLATFORM_FILE_HANDLE fwd_handle, dt_handle;
+  byte *fwd_buf = NULL, *dt_buf = NULL, lf = '\n';
+  size_t fwd_buf_used = 0, dt_buf_used = 0;
+  docnum_t newdoc = 0, entry;
+  u_ll dte, docoff;
+  u_int best_score;
+  int i, best, error_code = 0;
+
+  fname = (u_char *)cmalloc(strlen((char *)outdir) + 30, (u_char *)"output filename", FALSE);
+  sprintf((char *)fname, "%s/QBASH.forward", outdir);
+  fwd_handle = open_w((char *)fname, &error_code);
+  if (error_code < 0) {
+    printf("Error: can't open %s for writing.\n", fname);
+    exit(1);
+  }
+  sprintf((char *)fname, "%s/QBASH.doctable", outdir);
+  dt_handle = open_w((char *)fname, &error_code);
+  if (error_code < 0) {
+    printf("Error: can't open %s for writing.\n", fname);
+    exit(1);
+  }
+  free(fname);
+
+  *forward_size = 0;
+  for (i = 0; i < num_inputs; i++) {
+    inputs[i].forward_base = *forward_size;
+    buffered_write(fwd_handle, &fwd_buf, HUGEBUFSIZE, &fwd_buf_used, inputs[i].forward, inputs[i].fsz, ".forward");
+    *forward_size += inputs[i].fsz;
+    if (inputs[i].fsz > 0 && inputs[i].forward[inputs[i].fsz - 1] != '\n') {
+      // Records are located by QBASHQ from the preceding LF.
+      buffered_write(fwd_handle, &fwd_buf, HUGEBUFSIZE, &fwd_buf_used, &lf, 1, ".forward");
+      (*forward_size)++;
+    }
+    find_max_score(inputs + i);
+  }
+  buffered_flush(fwd_handle, &fwd_buf, &fwd_buf_used, ".forward", TRUE);
+  if (*forward_size > DOCOFF_MASK2) {
+    printf("Error: merged .forward would be too big (%zu bytes) for doctable offsets.\n", *forward_size);
+    exit(1);
+  }
+  if (max_score >= 1) log_max_score = log(max_score);
+  printf("Max score in all inputs: %.3f\n", max_score);
+  for (i = 0; i < num_inputs; i++) {
+    find_merge_order(inputs + i);
+    if (inputs[i].reordered > 0)
+      printf("Input %s: %lld docs change places after requantization.\n", inputs[i].dir, inputs[i].reordered);
+    inputs[i].next_doc = 0;
+    requantize_next_score(inputs + i);
+  }
+
+  while (1) {
+    best = -1;
+    best_score = 0;
+    for (i = 0; i < num_inputs; i++) {
+      if (inputs[i].next_doc >= inputs[i].docs) continue;
+      if (best < 0 || inputs[i].next_score > best_score) {
+	best = i;
+	best_score = inputs[i].next_score;
+      }
+    }
+    if (best < 0) break;
+
+    entry = inputs[best].order[inputs[best].next_doc++];
+    dte = *(u_ll *)(inputs[best].doctable + entry * DTE_LENGTH);
+    docoff = get_docoff(dte) + inputs[best].forward_base;
+    dte = (dte & ~(DOCOFF_MASK | DOCSCORE_MASK)) | (docoff << DOCOFF_SHIFT) | ((u_ll)best_score << DOCSCORE_SHIFT);
+    buffered_write(dt_handle, &dt_buf, HUGEBUFSIZE, &dt_buf_used, (byte *)&dte, DTE_LENGTH, ".doctable");
+    inputs[best].remap[entry] = newdoc++;
+    requantize_next_score(inputs + best);
+  }
+  buffered_flush(dt_handle, &dt_buf, &dt_buf_used, ".doctable", TRUE);
+
+  if (newdoc > SB_MAX_DOCNO) {
+    printf("Error: too many documents (%lld) for skip blocks.\n", newdoc);
+    exit(1);
+  }
+  return newdoc;
+}
+
+
+static void start_vocabs() {
+  // Position every input on the first record of its vocab, ready for a pass over the merged vocab.
+  int i;
+  for (i = 0; i < num_inputs; i++) {
+    vocab_iterator_start(&(inputs[i].vocab_it), inputs[i].vocab, inputs[i].vsz, (u_char *)"");
+    inputs[i].vocab_rec = vocab_iterator_next(&(inputs[i].vocab_it));
+  }
+}
+
+
+static void advance_vocabs(int *members, int m) {
+  // Move the inputs which contain the current merged term on to their next records.
+  int i;
+  for (i = 0; i < m; i++)
+    inputs[members[i]].vocab_rec = vocab_iterator_next(&(inputs[members[i]].vocab_it));
+}
+
+
+static int next_merged_term(int *members) {
+  // Find the alphabetically lowest term among the next unmerged vocab entries of the inputs,
+  // and record which inputs have it.  Return the number of inputs containing the term, zero
+  // when all vocabs are exhausted.
+  int i, m = 0, cmp;
+  char *lowest = NULL, *term;
+  for (i = 0; i < num_inputs; i++) {
+    if (inputs[i].vocab_rec == NULL) continue;
+    term = (char *)inputs[i].vocab_rec;
+    if (lowest == NULL) cmp = -1;
+    else cmp = strcmp(term, lowest);
+    if (cmp < 0) {
+      lowest = term;
+      m = 0;
+      members[m++] = i;
+    }
+    else if (cmp == 0) members[m++] = i;
+  }
+  return m;
+}
+
+
+static u_ll merged_term_count(int *members, int m) {
+  u_ll count, total = 0, payload;
+  byte qidf;
+  int i;
+  for (i = 0; i < m; i++) {
+    vocabfile_entry_unpacker(inputs[members[i]].vocab_rec, MAX_WD_LEN + 1, &count, &qidf, &payload);
+    total += count;
+  }
+  return total;
+}
+
+
+static void list_reader_init(list_reader_t *lr, merge_input_t *in, byte *vocab_entry) {
+  // The run buffer is kept from one term to the next.
+  byte qidf;
+  lr->input = in;
+  vocabfile_entry_unpacker(vocab_entry, MAX_WD_LEN + 1, &(lr->remaining), &qidf, &(lr->payload));
+  if (lr->remaining == 1) lr->ixptr = NULL;
+  else lr->ixptr = in->index + lr->payload;
+  lr->docnum = 0;
+  lr->run_count = 0;
+  lr->run_next = 0;
+  lr->held = FALSE;
+}
+
+
+static BOOL decode_posting(list_reader_t *lr, docnum_t *entry, int *wpos) {
+  // Decode the next posting in the input's order, if any, returning its doctable entry and wpos.
+  u_ll docgap;
+  byte bight, last;
+  docnum_t d;
+
+  if (lr->remaining == 0) return FALSE;
+  lr->remaining--;
+  if (lr->ixptr == NULL) {
+    lr->docnum = lr->payload >> WDPOS_BITS;
+    *wpos = (int)(lr->payload & WDPOS_MASK);
+  }
+  else {
+    if (*lr->ixptr == SB_MARKER) lr->ixptr += (SB_BYTES + 1);  // Skip blocks are rebuilt
+    *wpos = *lr->ixptr++;
+    docgap = 0;
+    do {
+      docgap <<= 7;
+      bight = *lr->ixptr++;
+      last = bight & 1;
+      bight >>= 1;
+      docgap |= bight;
+    } while (!last);
+    lr->docnum += docgap;
+  }
+  d = lr->docnum - lr->input->first_docnum;
+  if (d < 0 || d >= lr->input->docs) {
+    printf("Error: posting for docnum %lld is outside the doctable of %s\n", lr->docnum, lr->input->dir);
+    exit(1);
+  }
+  *entry = d;
+  return TRUE;
+}
+
+
+static void add_to_run(list_reader_t *lr, docnum_t entry, int wpos) {
+  if (lr->run_count >= lr->run_size) {
+    lr->run_size = lr->run_size == 0 ? 64 : 2 * lr->run_size;
+    lr->run = (run_posting_t *)realloc(lr->run, lr->run_size * sizeof(run_posting_t));
+    if (lr->run == NULL) error_exit("Error: realloc failed for postings run\n");
+  }
+  lr->run[lr->run_count].newdoc = lr->input->remap[entry];
+  lr->run[lr->run_count].wpos = wpos;
+  lr->run_count++;
+}
+
+
+static int cmp_run_postings(const void *i, const void *j) {
+  const run_posting_t *a = (const run_posting_t *)i, *b = (const run_posting_t *)j;
+  if (a->newdoc != b->newdoc) return a->newdoc < b->newdoc ? -1 : 1;
+  return a->wpos - b->wpos;
+}
+
+
+static BOOL list_reader_next(list_reader_t *lr) {
+  // Set newdoc and wpos from the next posting in merged docnum order, if any.  Postings are
+  // collected up to the start of the next run (see run_start) and sorted.  Where the input's
+  // order is unchanged, every entry starts a run, and a run has just the postings for one doc.
+  docnum_t entry, first;
+  int wpos;
+
+  if (lr->run_next >= lr->run_count) {
+    lr->run_count = 0;
+    lr->run_next = 0;
+    if (lr->held) {
+      first = lr->held_entry;
+      add_to_run(lr, lr->held_entry, lr->held_wpos);
+      lr->held = FALSE;
+    }
+    else if (decode_posting(lr, &first, &wpos)) add_to_run(lr, first, wpos);
+    else return FALSE;
+    while (decode_posting(lr, &entry, &wpos)) {
+      if (entry != first && lr->input->run_start[entry]) {
+	lr->held = TRUE;
+	lr->held_entry = entry;
+	lr->held_wpos = wpos;
+	break;
+      }
+      add_to_run(lr, entry, wpos);
+    }
+    if (lr->run_count > 1) qsort(lr->run, lr->run_count, sizeof(run_posting_t), cmp_run_postings);
+  }
+  lr->newdoc = lr->run[lr->run_next].newdoc;
+  lr->wpos = lr->run[lr->run_next].wpos;
+  lr->run_next++;
+  return TRUE;
+}
+
+
+static int vbyte_encode_docnum_diff(docnum_t docnum_diff, byte *bytes) {
+  // Encode docnum_diff in big-endian 7-bit groups with the termination bit set in the
+  // LSB of the last byte.  Return the number of bytes used.   (Same as in QBASHI.)
+  docnum_t limit = 1ULL << 7;
+  int b, bytes_needed = 1;
+  byte bight;
+  while (docnum_diff >= limit) {
+    bytes_needed++;
+    limit <<= 7;
+  }
+  for (b = bytes_needed - 1; b >= 0; b--) {
+    bight = docnum_diff & 0x7F;
+    bight <<= 1;
+    bytes[b] = bight;
+    docnum_diff >>= 7;
+  }
+  bytes[bytes_needed - 1] |= 1;   // Set the termination bit on the last byte
+  return bytes_needed;
+}
+
+
+static BOOL merged_postings_next(list_reader_t *readers, int m, docnum_t *docnum, int *wdnum) {
+  // Take the posting with the lowest merged docnum from among the readers' current ones, and
+  // replace it with the next from the same list.  Inputs never share a docnum, so there can't
+  // be ties.
+  int i, best = -1;
+  for (i = 0; i < m; i++) {
+    if (readers[i].newdoc < 0) continue;  // Exhausted
+    if (best < 0 || readers[i].newdoc < readers[best].newdoc) best = i;
+  }
+  if (best < 0) return FALSE;
+  *docnum = readers[best].newdoc;
+  *wdnum = readers[best].wpos;
+  if (!list_reader_next(readers + best)) readers[best].newdoc = -1;
+  return TRUE;
+}
+
+
+static u_char *build_if_header(u_char *outdir, size_t fsz, docnum_t docs, u_ll vocab_size) {
+  // The header follows the format written by QBASHI, with the option lines copied from the first
+  // input, except for those which describe the files or the docnum range.
+  u_char *header, *w, *p, *q, *line_start;
+  u_ll tot_postings = 0, header_docs = 0;
+  int i;
+  size_t l;
+
+  for (i = 0; i < num_inputs; i++) {
+    tot_postings += inputs[i].header_postings;
+    header_docs += inputs[i].header_docs;
+  }
+  header = (u_char *)cmalloc(IF_HEADER_LEN, (u_char *)"if header", FALSE);
+  memset(header, 0, IF_HEADER_LEN);
+  p = get_header_value(inputs[0].index, "Other_token_breakers: ");
+  sprintf((char *)header, "Index_format: %s\nQBASHER version:%s%s\nQuery_meta_chars: %s\nOther_token_breakers: %s\n"
+	  "Size of .forward: %zu\nSize of .dt: %lld\nSize of .vocab: %llu\nTotal postings: %llu\nNumber of documents: %llu\n"
+	  "Vocabulary size: %llu\n",
+	  INDEX_FORMAT, INDEX_FORMAT, QBASHER_VERSION, QBASH_META_CHARS, p,
+	  fsz, docs * DTE_LENGTH, vocab_size * VOCABFILE_REC_LEN, tot_postings, header_docs, vocab_size);
+  free(p);
+  w = header + strlen((char *)header);
+
+  // Copy the options, which start after the Vocabulary size line.
+  p = (u_char *)strstr((char *)inputs[0].index, "\nVocabulary size:");
+  if (p != NULL) p = (u_char *)strchr((char *)p + 1, '\n');
+  while (p != NULL && *p == '\n' && *(p + 1)) {
+    line_start = p + 1;
+    q = line_start;
+    while (*q && *q != '\n') q++;
+    l = q - line_start;
+    if (w + l + MAX_WD_LEN + strlen((char *)outdir) + 100 > header + IF_HEADER_LEN) break;
+    if (!strncmp((char *)line_start, "index_dir=", 10))
+      w += sprintf((char *)w, "index_dir=%s\n", outdir);
+    else if (!strncmp((char *)line_start, "file_", 5))
+      ;  // Not applicable.  (Directory names are.)
+    else if (!strncmp((char *)line_start, "first_docnum=", 13))
+      w += sprintf((char *)w, "first_docnum=0\n");
+    else if (!strncmp((char *)line_start, "max_raw_score=", 14))
+      w += sprintf((char *)w, "max_raw_score=%.15g\n", max_score);
+    else if (!strncmp((char *)line_start, "sb_run_length=", 14))
+      w += sprintf((char *)w, "sb_run_length=%u\n", SB_POSTINGS_PER_RUN);
+    else if (!strncmp((char *)line_start, "sb_trigger=", 11))
+      w += sprintf((char *)w, "sb_trigger=%u\n", SB_TRIGGER);
+    else {
+      memcpy(w, line_start, l);
+      w += l;
+      *w++ = '\n';
+    }
+    p = q;
+  }
+  sprintf((char *)w, "merged_inputs=%d\n", num_inputs);
+  return header;
+}
+
+
+static void merge_vocabs_and_postings(u_char *outdir, size_t fsz, docnum_t docs) {
+  // Two passes over the merged vocabularies.  The first finds the number of distinct terms for
+  // the .if header and the longest list, needed for the IDFs.  The second writes the .vocab
+  // entries and the postings lists with skip blocks, just as write_inverted_file() does in QBASHI.
+  size_t vocab_buf_used = 0, if_buf_used = 0;
+  int members[MAX_INPUTS], m, i, bytes_needed;
+  u_ll count, max_plist_len = 0, vocab_size = 0, if_off = 0, list_elts, e,
+    postings_lists_with_skip_blocks = 0, tot_skip_blocks_written = 0;
+  u_char *fname, *header, *value;
+  byte *vocab_buf = NULL, *if_buf = NULL, qidf, bight, bytes[8];
+  CROSS_PLATFORM_FILE_HANDLE vocab_handle, if_handle;
+  list_reader_t readers[MAX_INPUTS];
+  BOOL x_2postings_in_vocab = TRUE;
+  int error_code = 0;
+
+  // QBASHI doesn't count lists of up to three postings in the longest list if it's keeping
+  // two postings in the hash table.
+  value = get_header_value(inputs[0].index, "x_2postings_in_vocab=");
+  if (value != NULL && !strcmp((char *)value, "FALSE")) x_2postings_in_vocab = FALSE;
+  free(value);
+  memset(readers, 0, sizeof(readers));
+
+  start_vocabs();
+  while ((m = next_merged_term(members)) > 0) {
+    count = merged_term_count(members, m);
+    if (count > max_plist_len && (!x_2postings_in_vocab || count > 3)) max_plist_len = count;
+    advance_vocabs(members, m);
+    vocab_size++;
+  }
+  printf("Merged vocabulary: %llu distinct terms.  Longest postings list: %llu\n", vocab_size, max_plist_len);
+
+  fname = (u_char *)cmalloc(strlen((char *)outdir) + 30, (u_char *)"output filename", FALSE);
+  sprintf((char *)fname, "%s/QBASH.vocab", outdir);
+  vocab_handle = open_w((char *)fname, &error_code);
+  if (error_code < 0) {
+    printf("Error: can't open %s for writing.\n", fname);
+    exit(1);
+  }
+  sprintf((char *)fname, "%s/QBASH.if", outdir);
+  if_handle = open_w((char *)fname, &error_code);
+  if (error_code < 0) {
+    printf("Error: can't open %s for writing.\n", fname);
+    exit(1);
+  }
+  free(fname);
+
+  header = build_if_header(outdir, fsz, docs, vocab_size);
+  buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, header, IF_HEADER_LEN, "IF header");
+  if_off += IF_HEADER_LEN;
+  free(header);
+
+  start_vocabs();
+  for (e = 0; (m = next_merged_term(members)) > 0; e++) {
+    char key[MAX_WD_LEN + 1];  // Copied because a front-coded input's record is overwritten when it advances
+    docnum_t last_docnum = 0, docnum = 0;
+    int wdnum = 0;
+
+    strcpy(key, (char *)inputs[members[0]].vocab_rec);
+    count = merged_term_count(members, m);
+    for (i = 0; i < m; i++) {
+      list_reader_init(readers + i, inputs + members[i], inputs[members[i]].vocab_rec);
+      if (!list_reader_next(readers + i)) readers[i].newdoc = -1;
+    }
+    advance_vocabs(members, m);
+
+    if (count <= 1) {
+      // There's only one posting, write docnum and wdnum into .vocab entry
+      merged_postings_next(readers, m, &docnum, &wdnum);
+      qidf = (byte)quantized_idf(max_plist_len * 1.5, (double)count, 0XFF);
+      vocabfile_entry_packer(vocabfile_record, MAX_WD_LEN + 1, (byte *)key, count, qidf,
+			     ((u_ll)docnum << WDPOS_BITS) | (wdnum & WDPOS_MASK));
+      buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, vocabfile_record,
+		     VOCABFILE_REC_LEN, "vocab single posting");
+      continue;
+    }
+
+    qidf = (byte)quantized_idf(max_plist_len * 1.05, (double)count, 0XFF);
+    vocabfile_entry_packer(vocabfile_record, MAX_WD_LEN + 1, (byte *)key, count, qidf, if_off);
+    buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, vocabfile_record,
+		   VOCABFILE_REC_LEN, "vocab if offset");
+
+    if (SB_TRIGGER > 0 && count >= SB_TRIGGER) {
+      u_int sb_postings_accumulated = 0, sb_bytes_accumulated = SB_BYTES + 1, current_sb_postings_per_run;
+      u_ll *ullp;
+
+      if (SB_POSTINGS_PER_RUN == 0) {
+	current_sb_postings_per_run = (u_int)round(sqrt((double)count));
+	if (current_sb_postings_per_run > SB_MAX_COUNT) current_sb_postings_per_run = SB_MAX_COUNT;
+      }
+      else current_sb_postings_per_run = SB_POSTINGS_PER_RUN;
+      postings_lists_with_skip_blocks++;
+
+      list_elts = 0;
+      while (merged_postings_next(readers, m, &docnum, &wdnum)) {
+	list_elts++;
+	sb_run_accumulator[sb_bytes_accumulated++] = (byte)wdnum;
+	bytes_needed = vbyte_encode_docnum_diff(docnum - last_docnum, sb_run_accumulator + sb_bytes_accumulated);
+	last_docnum = docnum;
+	sb_bytes_accumulated += bytes_needed;
+	sb_postings_accumulated++;
+	if (sb_postings_accumulated >= current_sb_postings_per_run || list_elts >= count) {
+	  // Output SB_MARKER, skipblock and run.  The length of the last run is recorded as zero.
+	  sb_run_accumulator[0] = SB_MARKER;
+	  ullp = (u_ll *)(sb_run_accumulator + 1);
+	  if (list_elts >= count) *ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, 0ULL);
+	  else *ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, (u_ll)sb_bytes_accumulated);
+	  buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, sb_run_accumulator, sb_bytes_accumulated, "SB run");
+	  if_off += sb_bytes_accumulated;
+	  tot_skip_blocks_written++;
+	  sb_postings_accumulated = 0;
+	  sb_bytes_accumulated = SB_BYTES + 1;
+	}
+      }
+    }
+    else {
+      while (merged_postings_next(readers, m, &docnum, &wdnum)) {
+	bight = (byte)wdnum;
+	buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, &bight, 1, "if wdnum");
+	bytes_needed = vbyte_encode_docnum_diff(docnum - last_docnum, bytes);
+	last_docnum = docnum;
+	buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, bytes, bytes_needed, "if docgap");
+	if_off += (bytes_needed + 1);
+      }
+    }
+  }
+
+  // Write the length of the file into the last 8 bytes so we may be able to  tell if it's truncated
+  if_off += sizeof(if_off);
+  buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, (byte *)&if_off, sizeof(if_off), ".if file length");
+  buffered_flush(if_handle, &if_buf, &if_buf_used, ".if", TRUE);
+  buffered_flush(vocab_handle, &vocab_buf, &vocab_buf_used, ".vocab", TRUE);
+  for (i = 0; i < num_inputs; i++) free(readers[i].run);
+  printf("Postings lists with skip blocks: %llu, skip blocks written: %llu.  Size of .if: %llu\n",
+	 postings_lists_with_skip_blocks, tot_skip_blocks_written, if_off);
+}
+
+
+int main(int argc, char **argv) {
+  u_char *outdir = NULL;
+  char *p;
+  docnum_t docs;
+  size_t fsz;
+  double very_start, start;
+  int a, i;
+
+  if (sizeof(size_t) != 8) error_exit("Error:  program must be compiled for 64 bit!\n");
+  setvbuf(stdout, NULL, _IONBF, 0);
+  very_start = what_time_is_it();
+
+  DOCOFF_SHIFT = DTE_WDCNT_BITS;
+  DOCOFF_MASK2 = (1ULL << DTE_DOCOFF_BITS) - 1;
+  DOCOFF_MASK = DOCOFF_MASK2 << DOCOFF_SHIFT;
+  DOCSCORE_SHIFT = DTE_WDCNT_BITS + DTE_DOCOFF_BITS;
+  DOCSCORE_MASK2 = (1ULL << DTE_SCORE_BITS) - 1;
+  DOCSCORE_MASK = DOCSCORE_MASK2 << DOCSCORE_SHIFT;
+
+  for (a = 1; a < argc; a++) {
+    p = argv[a];
+    while (*p == '-') p++;  // Skip over leading hyphens
+    if (!strncmp(p, "output_dir=", 11)) outdir = (u_char *)p + 11;
+    else if (!strncmp(p, "sb_trigger=", 11)) SB_TRIGGER = (u_int)strtoul(p + 11, NULL, 10);
+    else if (!strncmp(p, "sb_run_length=", 14)) {
+      SB_POSTINGS_PER_RUN = (u_int)strtoul(p + 14, NULL, 10);
+      if (SB_POSTINGS_PER_RUN > SB_MAX_COUNT) SB_POSTINGS_PER_RUN = SB_MAX_COUNT;
+    }
+    else if (strchr(p, '=') == NULL && is_a_directory(p)) {
+      if (num_inputs >= MAX_INPUTS) {
+	printf("Error: can't merge more than %d indexes.\n", MAX_INPUTS);
+	exit(1);
+      }
+      memset(inputs + num_inputs, 0, sizeof(merge_input_t));
+      open_input(inputs + num_inputs, (u_char *)p);
+      num_inputs++;
+    }
+    else {
+      printf("Unrecognized argument '%s'.\n", argv[a]);
+      print_usage(argv[0]);
+    }
+  }
+  if (outdir == NULL || num_inputs < 2) print_usage(argv[0]);
+  if (!is_a_directory((char *)outdir)) {
+    printf("Error: output_dir %s is not a directory.\n", outdir);
+    exit(1);
+  }
+  for (i = 0; i < num_inputs; i++) {
+    if (!strcmp((char *)outdir, (char *)inputs[i].dir)) {
+      printf("Error: output_dir must not be one of the inputs.\n");
+      exit(1);
+    }
+  }
+
+  start = what_time_is_it();
+  docs = merge_forwards_and_doctables(outdir, &fsz);
+  printf("Merged .forward and .doctable written: %lld docs. (%.1f sec.)\n", docs, what_time_is_it() - start);
+
+  start = what_time_is_it();
+  merge_vocabs_and_postings(outdir, fsz, docs);
+  printf("Merged .vocab and .if written. (%.1f sec.)\n", what_time_is_it() - start);
+
+  for (i = 0; i < num_inputs; i++) close_input(inputs + i);
+  printf("Merge of %d indexes into %s complete.  Total elapsed time %.1f sec.\n", num_inputs, outdir,
+	 what_time_is_it() - very_start);
+  return 0;
+}
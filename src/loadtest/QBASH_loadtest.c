@@ -0,0 +1,360 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// QBASH_loadtest - Open-loop load testing of the QBASHQ library.
+//
+// Queries from a log are replayed at a fixed arrival rate by a pool of threads calling
+// handle_labelled_multi_query().  Arrivals are either Poisson or evenly spaced.  The arrival
+// schedule is fixed before the test starts and does not depend on how fast queries are answered,
+// so when the threads can't keep up, queries start late.  Latencies are measured from each query's
+// scheduled arrival, not from when a thread got around to starting it, so that the delays are
+// counted rather than omitted (the correction for "coordinated omission".)  Service times, from
+// actual start to finish, are reported as well.
+//
+// Usage: QBASH_loadtest.exe index_dir=<dir> query_log=<file> [load test options] [QBASHQ options]
+//
+// Load test options (all others are passed to the library, as by QBASHQ.exe):
+//   query_log=<file>           - Queries, one per line, in the QBASHQ.exe batch format.  Used cyclically.
+//   qps=<float>                - Target arrival rate in queries per second.  (Default 100)
+//   arrivals=poisson|constant  - Exponential or constant gaps between arrivals.  (Default poisson)
+//   duration=<float>           - Seconds over which queries arrive.  (Default 10)
+//   threads=<int>              - Number of threads running queries.  (Default 4, max. MAX_LOAD_THREADS)
+//   seed=<int>                 - For the Poisson arrival schedule.  (Default 1)
+//
+// Note that QBASHQ.exe is built with NO_THREADS, but the library is always safe for concurrent
+// queries, apart from the approximate batch statistics it keeps in the qoenv.
+
+#ifndef WIN64
+#define _POSIX_C_SOURCE 200809L  // For nanosleep() under -std=c11
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef WIN64
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include "../shared/unicode.h"
+#include "../shared/utility_nodeps.h"
+#include "../shared/QBASHER_common_definitions.h"
+#include "../utils/dahash.h"
+#include "../qbashq-lib/QBASHQ.h"
+#include "../qbashq-lib/stage_timing.h"
+
+
+#define MAX_LOAD_THREADS 256
+#define MAX_LOG_QUERIES 10000000
+
+
+static u_char *query_log = NULL, *arrivals = (u_char *)"poisson";
+static double qps = 100.0, duration = 10.0;
+static int threads = 4;
+static u_ll seed = 1;
+
+static index_environment_t *ixenv;
+static query_processing_environment_t *qoenv;
+static u_char **queries;
+static long num_queries, queries_to_send;
+static double *arrival_offsets, *latencies, *service_times, test_start;
+static volatile long next_query = 0;
+
+
+typedef struct {
+  long completed, timeouts, without_answers, errors;
+  int last_error_code;
+  double last_finish;
+} thread_context_t;
+
+
+static void print_usage(char *progname) {
+  printf("Usage: %s index_dir=<dir> query_log=<file> [qps=<float>] [arrivals=poisson|constant] [duration=<secs>]\n"
+	 "          [threads=<int>] [seed=<int>] [QBASHQ options]\n", progname);
+  exit(1);
+}
+
+
+static BOOL assign_load_test_option(u_char *arg) {
+  // Return TRUE iff arg is one of the load test options, rather than a library option.
+  u_char *val = (u_char *)strchr((char *)arg, '=');
+  size_t len;
+
+  if (val == NULL) return FALSE;  // ----------------->
+  len = val - arg;
+  val++;
+  if (len == 9 && !strncmp((char *)arg, "query_log", len)) query_log = val;
+  else if (len == 3 && !strncmp((char *)arg, "qps", len)) qps = strtod((char *)val, NULL);
+  else if (len == 8 && !strncmp((char *)arg, "arrivals", len)) arrivals = val;
+  else if (len == 8 && !strncmp((char *)arg, "duration", len)) duration = strtod((char *)val, NULL);
+  else if (len == 7 && !strncmp((char *)arg, "threads", len)) threads = atoi((char *)val);
+  else if (len == 4 && !strncmp((char *)arg, "seed", len)) seed = strtoull((char *)val, NULL, 10);
+  else return FALSE;  // ----------------->
+  return TRUE;
+}
+
+
+static void read_query_log() {
+  // Read the non-blank lines of the query log into queries[]
+  FILE *f;
+  u_char line[MAX_QLINE + 1], *p;
+
+  f = fopen((char *)query_log, "rb");
+  if (f == NULL) {
+    printf("Error: Can't open query_log %s\n", query_log);
+    exit(1);
+  }
+  queries = (u_char **)malloc(MAX_LOG_QUERIES * sizeof(u_char *));
+  if (queries == NULL) error_exit("Malloc failed for queries\n");
+  num_queries = 0;
+  while (num_queries < MAX_LOG_QUERIES && fgets((char *)line, MAX_QLINE + 1, f) != NULL) {
+    p = line + strlen((char *)line);
+    while (p > line && (p[-1] == '\n' || p[-1] == '\r')) *--p = 0;
+    p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == 0) continue;
+    queries[num_queries++] = make_a_copy_of(p);
+  }
+  fclose(f);
+  if (num_queries == 0) {
+    printf("Error: No queries in %s\n", query_log);
+    exit(1);
+  }
+}
+
+
+static void set_up_arrival_schedule() {
+  // arrival_offsets[i] is the time after the start of the test at which query i arrives.  Gaps
+  // between Poisson arrivals are exponentially distributed, drawn with a SplitMix64 generator so
+  // that the schedule is the same on all platforms.
+  u_ll state = seed, z;
+  double t = 0.0, u;
+  long i;
+  BOOL poisson = !strcmp((char *)arrivals, "poisson");
+
+  if (!poisson && strcmp((char *)arrivals, "constant")) {
+    printf("Error: arrivals must be poisson or constant, not %s\n", arrivals);
+    exit(1);
+  }
+  queries_to_send = (long)floor(qps * duration + 0.5);
+  if (queries_to_send < 1) queries_to_send = 1;
+  arrival_offsets = (double *)malloc(queries_to_send * sizeof(double));
+  latencies = (double *)malloc(queries_to_send * sizeof(double));
+  service_times = (double *)malloc(queries_to_send * sizeof(double));
+  if (arrival_offsets == NULL || latencies == NULL || service_times == NULL)
+    error_exit("Malloc failed for the arrival schedule\n");
+
+  for (i = 0; i < queries_to_send; i++) {
+    arrival_offsets[i] = t;
+    if (poisson) {
+      z = (state += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      z ^= z >> 31;
+      u = ((double)(z >> 11) + 0.5) / 9007199254740992.0;  // In (0, 1)
+      t += -log(u) / qps;
+    }
+    else t += 1.0 / qps;
+  }
+}
+
+
+static void wait_until(double when) {
+#ifdef WIN64
+  double remaining;
+  // Sleep() has millisecond resolution at best, so spin for the last couple of milliseconds.
+  while ((remaining = when - what_time_is_it()) > 0.0) {
+    if (remaining > 0.002) Sleep((DWORD)((remaining - 0.001) * 1000.0));
+  }
+#else
+  double remaining;
+  struct timespec req;
+  while ((remaining = when - what_time_is_it()) > 0.0) {
+    req.tv_sec = (time_t)remaining;
+    req.tv_nsec = (long)((remaining - (double)req.tv_sec) * 1.0e9);
+    nanosleep(&req, NULL);
+  }
+#endif
+}
+
+
+static void run_queries(thread_context_t *tc) {
+  // Repeatedly take the next query in the schedule, wait for its arrival time if it is still in
+  // the future, and run it.
+  u_char query_buf[MAX_QLINE + 1], *label, *p, **returned_results = NULL;
+  double *corresponding_scores = NULL, arrival, started, finished;
+  long i;
+  int how_many_results;
+  BOOL timed_out;
+
+  while ((i = ATOMIC_INCREMENT(next_query) - 1) < queries_to_send) {
+    arrival = test_start + arrival_offsets[i];
+    wait_until(arrival);
+    started = what_time_is_it();
+
+    // handle_labelled_multi_query() modifies the query, so it has to work on a copy.  As in
+    // QBASHQ.exe, a label may follow a group separator.
+    strcpy((char *)query_buf, (char *)queries[i % num_queries]);
+    label = NULL;
+    p = (u_char *)strchr((char *)query_buf, 0x1D);
+    if (p != NULL) {
+      *p = 0;
+      label = p + 1;
+    }
+    timed_out = FALSE;
+    how_many_results = handle_labelled_multi_query(ixenv, qoenv, query_buf, label, &returned_results,
+						   &corresponding_scores, &timed_out);
+    finished = what_time_is_it();
+
+    if (how_many_results < 0) {
+      tc->errors++;
+      tc->last_error_code = how_many_results;
+    }
+    else {
+      free_results_memory(&returned_results, &corresponding_scores, how_many_results);
+      if (how_many_results == 0) tc->without_answers++;
+    }
+    if (timed_out) tc->timeouts++;
+    latencies[i] = finished - arrival;
+    service_times[i] = finished - started;
+    tc->completed++;
+    tc->last_finish = finished;
+  }
+}
+
+
+#ifdef WIN64
+static DWORD WINAPI worker(LPVOID context) {
+  run_queries((thread_context_t *)context);
+  return 0;
+}
+#else
+static void *worker(void *context) {
+  run_queries((thread_context_t *)context);
+  return NULL;
+}
+#endif
+
+
+static int compare_doubles(const void *a, const void *b) {
+  double da = *(const double *)a, db = *(const double *)b;
+  if (da < db) return -1;  // ----------------->
+  if (da > db) return 1;  // ----------------->
+  return 0;
+}
+
+
+static void report_distribution(char *name, double *times, long n) {
+  // Sort times and print the mean and the percentiles, in milliseconds, using the nearest-rank method.
+  double total = 0.0, fractions[3] = { 0.5, 0.99, 0.999 };
+  long i, rank;
+  int f;
+
+  qsort(times, n, sizeof(double), compare_doubles);
+  for (i = 0; i < n; i++) total += times[i];
+  printf("%-28s mean %9.3f", name, 1000.0 * total / (double)n);
+  for (f = 0; f < 3; f++) {
+    rank = (long)ceil(fractions[f] * (double)n);
+    if (rank < 1) rank = 1;
+    printf("  p%g %9.3f", 100.0 * fractions[f], 1000.0 * times[rank - 1]);
+  }
+  printf("  max %9.3f  msec.\n", 1000.0 * times[n - 1]);
+}
+
+
+int main(int argc, char **argv) {
+  thread_context_t contexts[MAX_LOAD_THREADS] = { { 0 } };
+  long completed = 0, timeouts = 0, without_answers = 0, errors = 0;
+  double last_finish = 0.0, elapsed, achieved_qps;
+  long long total_cost;
+  int a, t, error_code = 0, last_error_code = 0;
+#ifdef WIN64
+  HANDLE thread_handles[MAX_LOAD_THREADS];
+#else
+  pthread_t thread_ids[MAX_LOAD_THREADS];
+#endif
+
+  if (argc < 2) print_usage(argv[0]);
+  initialize_unicode_conversion_arrays(FALSE);
+  qoenv = load_query_processing_environment();
+  if (qoenv == NULL) error_exit("Can't load a query processing environment\n");
+  for (a = 1; a < argc; a++) {
+    if (assign_load_test_option((u_char *)argv[a])) continue;
+    if (assign_one_arg(qoenv, (u_char *)argv[a], TRUE, TRUE, TRUE) < 0) print_usage(argv[0]);
+  }
+  if (query_log == NULL || qps <= 0.0 || duration <= 0.0 || threads < 1 || threads > MAX_LOAD_THREADS)
+    print_usage(argv[0]);
+
+  if (finalize_query_processing_environment(qoenv, FALSE, TRUE) < 0) error_exit("Can't finalize the query processing environment\n");
+  ixenv = load_indexes(qoenv, FALSE, FALSE, &error_code);
+  if (error_code < 0) {
+    printf("Error: load_indexes() failed with code %d: %s\n", error_code, explain_error(error_code)->explanation);
+    exit(1);
+  }
+  qoenv->ixenv = ixenv;
+  if (qoenv->warm_indexes) warmup_indexes(qoenv, ixenv);
+
+  read_query_log();
+  set_up_arrival_schedule();
+  printf("Load test: %ld queries (from %ld in %s) at %.1f QPS with %s arrivals, run by %d threads\n",
+	 queries_to_send, num_queries, query_log, qps, arrivals, threads);
+
+  test_start = what_time_is_it() + 0.01;  // Time for the threads to be created
+  for (t = 0; t < threads; t++) {
+#ifdef WIN64
+    thread_handles[t] = CreateThread(NULL, 0, worker, contexts + t, 0, NULL);
+    if (thread_handles[t] == NULL) {
+      printf("Error %u: CreateThread() for worker thread %d\n", GetLastError(), t);
+      exit(1);
+    }
+#else
+    error_code = pthread_create(thread_ids + t, NULL, worker, contexts + t);
+    if (error_code) {
+      printf("Error %d: pthread_create() for worker thread %d\n", error_code, t);
+      exit(1);
+    }
+#endif
+  }
+  for (t = 0; t < threads; t++) {
+#ifdef WIN64
+    WaitForSingleObject(thread_handles[t], INFINITE);
+    CloseHandle(thread_handles[t]);
+#else
+    pthread_join(thread_ids[t], NULL);
+#endif
+    completed += contexts[t].completed;
+    timeouts += contexts[t].timeouts;
+    without_answers += contexts[t].without_answers;
+    errors += contexts[t].errors;
+    if (contexts[t].errors) last_error_code = contexts[t].last_error_code;
+    if (contexts[t].last_finish > last_finish) last_finish = contexts[t].last_finish;
+  }
+
+  elapsed = last_finish - test_start;
+  achieved_qps = elapsed > 0.0 ? (double)completed / elapsed : 0.0;
+  printf("Queries completed: %ld   Timed out: %ld   Without answers: %ld   Errors: %ld\n",
+	 completed, timeouts, without_answers, errors);
+  if (errors) printf("Last error: %d: %s\n", last_error_code, explain_error(last_error_code)->explanation);
+  printf("Elapsed: %.3f sec.   Target QPS: %.1f   Achieved QPS: %.1f\n", elapsed, qps, achieved_qps);
+  report_distribution("Latency from arrival:", latencies, queries_to_send);
+  report_distribution("Service time:", service_times, queries_to_send);
+  if (achieved_qps < 0.95 * qps)
+    printf("Warning: Achieved QPS is more than 5%% below the target.  The threads could not keep up, and\n"
+	   "         latencies from arrival include the time queries waited to be started.\n");
+
+  total_cost = report_op_count_totals(qoenv, stdout);
+  printf("Mean cost per query = %.1f\n", (double)total_cost / (double)completed);
+
+  free(arrival_offsets);
+  free(latencies);
+  free(service_times);
+  for (a = 0; a < num_queries; a++) free(queries[a]);
+  free(queries);
+  unload_indexes(&ixenv);
+  qoenv->ixenv = NULL;
+  unload_query_processing_environment(&qoenv, FALSE, TRUE);
+  return 0;
+}
@@ -0,0 +1,354 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// QBASH_microbench - Microbenchmarks of the inner loops of QBASHQ, each reported in ns/op.
+// Usage: QBASH_microbench.exe <index_dir> [seconds per benchmark]
+//
+// The operations timed are:
+//   lookup_word        - Look up a word in the .vocab
+//   dahash_lookup      - Look up a word in a dahash table of the distinct words looked up
+//   vbyte_decode       - Decode one posting, as in saat_skipto(), while scanning whole lists
+//   saat_skipto/<n>    - Skip to the first posting at least n documents beyond the current one
+//   utf8_lowering      - Lower case the first column of a .forward record with utf8_lowering_ncopy()
+//   store_in_order/<k> - Offer a candidate to possibly_store_in_order() with room for k results
+//
+// The words are the first MAX_SAMPLE_WORDS words in the first column of the index's .forward, so
+// they occur with roughly the frequencies of query words.  `make bench` in src/ builds a synthetic
+// index with generate_synthetic_forward.exe and QBASHI.exe, then runs this on it.
+//
+// Each benchmark is repeated until it has run for the given number of seconds (default 0.5).  The
+// checksum printed with each result is there to stop the compiler from optimising the work away.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef WIN64
+#include <windows.h>
+#endif
+
+#include "../shared/unicode.h"
+#include "../shared/utility_nodeps.h"
+#include "../shared/QBASHER_common_definitions.h"
+#include "../utils/dahash.h"
+#include "../qbashq-lib/QBASHQ.h"
+#include "../shared/bitmap_postings.h"
+#include "../qbashq-lib/saat.h"
+
+
+#define MAX_SAMPLE_WORDS 100000
+#define MAX_SAMPLE_RECORDS 100000
+#define MAX_SAMPLE_LISTS 1000
+#define MAX_RECORD_COPY 10000
+
+
+static double seconds_per_benchmark = 0.5;
+
+
+static void report(char *name, u_ll ops, double elapsed, u_ll checksum) {
+  printf("%-22s %10.1f ns/op  (%llu ops in %.2f sec, checksum %llu)\n", name,
+	 ops > 0 ? elapsed * 1.0e9 / (double)ops : 0.0, ops, elapsed, checksum);
+}
+
+
+static u_char **sample_words(byte *forward, size_t fsz, int *num_words) {
+  // Return copies of the first MAX_SAMPLE_WORDS words in the first columns of the records in
+  // forward.  ASCII is lower cased.  Any ASCII character other than a letter or digit breaks
+  // words, and words are truncated to MAX_WD_LEN bytes, as by QBASHQ.
+  u_char **words, word[MAX_WD_LEN + 1];
+  byte *p = forward, *eof = forward + fsz;
+  int n = 0, len = 0;
+  BOOL in_first_column = TRUE;
+
+  words = (u_char **)malloc(MAX_SAMPLE_WORDS * sizeof(u_char *));
+  if (words == NULL) {
+    printf("Error: malloc failed in sample_words()\n");
+    exit(1);
+  }
+  while (p < eof && n < MAX_SAMPLE_WORDS) {
+    if (in_first_column && (*p >= 0x80 || isalnum(*p))) {
+      if (len < MAX_WD_LEN) word[len++] = (u_char)tolower(*p);
+    }
+    else if (len > 0) {
+      word[len] = 0;
+      words[n++] = make_a_copy_of(word);
+      len = 0;
+    }
+    if (*p == '\t') in_first_column = FALSE;
+    else if (*p == '\n') in_first_column = TRUE;
+    p++;
+  }
+  *num_words = n;
+  return words;
+}
+
+
+static void bench_lookup_word(index_environment_t *ixenv, u_char **words, int num_words) {
+  byte entry_buf[VOCABFILE_REC_LEN];
+  u_ll ops = 0, checksum = 0;
+  double start = what_time_is_it(), elapsed;
+  int w;
+
+  do {
+    for (w = 0; w < num_words; w++) {
+      if (lookup_word(words[w], ixenv->vocab, ixenv->vsz, entry_buf, 0) != NULL) checksum++;
+    }
+    ops += num_words;
+  } while ((elapsed = what_time_is_it() - start) < seconds_per_benchmark);
+  report("lookup_word", ops, elapsed, checksum);
+}
+
+
+static void bench_dahash_lookup(u_char **words, int num_words) {
+  dahash_table_t *ht;
+  u_ll ops = 0, checksum = 0;
+  double start, elapsed;
+  int w, bits = 10;
+
+  // Big enough never to double, so that the table is the same size on every run.
+  while (bits < 30 && (double)num_words > 0.9 * (double)(1 << bits)) bits++;
+  ht = dahash_create((u_char *)"microbench", bits, MAX_WD_LEN, sizeof(int), 0.9, FALSE);
+  for (w = 0; w < num_words; w++) (*(int *)dahash_lookup(ht, words[w], 1))++;
+
+  start = what_time_is_it();
+  do {
+    for (w = 0; w < num_words; w++) checksum += *(int *)dahash_lookup(ht, words[w], 0);
+    ops += num_words;
+  } while ((elapsed = what_time_is_it() - start) < seconds_per_benchmark);
+  report("dahash_lookup", ops, elapsed, checksum);
+  dahash_destroy(&ht);
+}
+
+
+static int find_lists(index_environment_t *ixenv, u_char **words, int num_words, byte **lists, u_ll *lengths) {
+  // Find the postings lists in the .if of the first MAX_SAMPLE_LISTS sample words which have them.
+  // (A word which occurs only once has its posting in the .vocab.)
+  byte entry_buf[VOCABFILE_REC_LEN], *dicent, qidf;
+  u_ll occurrences, payload;
+  int w, n = 0;
+
+  for (w = 0; w < num_words && n < MAX_SAMPLE_LISTS; w++) {
+    dicent = lookup_word(words[w], ixenv->vocab, ixenv->vsz, entry_buf, 0);
+    if (dicent == NULL) continue;
+    vocabfile_entry_unpacker(dicent, MAX_WD_LEN + 1, &occurrences, &qidf, &payload);
+    if (occurrences < 2) continue;
+    lists[n] = ixenv->index + payload;
+    lengths[n++] = occurrences;
+  }
+  return n;
+}
+
+
+static void bench_vbyte_decode(byte **lists, u_ll *lengths, int num_lists) {
+  // The decoding loop is the one in saat_skipto().
+  u_ll ops = 0, checksum = 0, docgap, p;
+  docnum_t curdoc;
+  double start = what_time_is_it(), elapsed;
+  byte *ixptr, bight, last;
+  int l;
+
+  do {
+    for (l = 0; l < num_lists; l++) {
+      ixptr = lists[l];
+      curdoc = 0;
+      for (p = 0; p < lengths[l]; p++) {
+	if (*ixptr == SB_MARKER) ixptr += (SB_BYTES + 1);
+	checksum += *ixptr;  // The word position
+	ixptr++;
+	docgap = 0;
+	do {
+	  docgap <<= 7;
+	  bight = *ixptr++;
+	  last = bight & 1;
+	  bight >>= 1;
+	  docgap |= bight;
+	} while (!last);
+	curdoc += docgap;
+      }
+      checksum += curdoc;
+      ops += lengths[l];
+    }
+  } while ((elapsed = what_time_is_it() - start) < seconds_per_benchmark);
+  report("vbyte_decode", ops, elapsed, checksum);
+}
+
+
+static void bench_saat_skipto(query_processing_environment_t *qoenv, u_char **words, int num_words, int stride) {
+  // Each sample word with a postings list is set up once by saat_setup().  The timed loop restores
+  // the control block to its initial state and skips through the list to the end.
+  book_keeping_for_one_query_t *qex;
+  saat_control_t **initial, working;
+  u_char wordcopy[MAX_WD_LEN + 1], name[40];
+  u_ll ops = 0, checksum = 0;
+  double start, elapsed;
+  int w, b, blocks = 0, terms_not_present, error_code;
+
+  qex = (book_keeping_for_one_query_t *)calloc(1, sizeof(book_keeping_for_one_query_t));
+  initial = (saat_control_t **)malloc(MAX_SAMPLE_LISTS * sizeof(saat_control_t *));
+  if (qex == NULL || initial == NULL) {
+    printf("Error: malloc failed in bench_saat_skipto()\n");
+    exit(1);
+  }
+  for (w = 0; w < num_words && blocks < MAX_SAMPLE_LISTS; w++) {
+    strcpy((char *)wordcopy, (char *)words[w]);
+    qex->cg_qterms[0] = wordcopy;
+    qex->cg_qwd_cnt = 1;
+    initial[blocks] = saat_setup(qoenv, qex, &terms_not_present, &error_code);
+    if (initial[blocks] == NULL) continue;
+    if (initial[blocks]->exhausted || initial[blocks]->curpsting == NULL) {
+      free_querytree_memory(initial + blocks, 1);
+      continue;
+    }
+    blocks++;
+  }
+
+  start = what_time_is_it();
+  do {
+    for (b = 0; b < blocks; b++) {
+      memcpy(&working, initial[b], sizeof(saat_control_t));
+      while (!working.exhausted) {
+	saat_skipto(qoenv->query_output, &working, 0, working.curdoc + stride, DONT_CARE,
+		    qoenv->ixenv->index, qex->op_count, 0, &error_code);
+	ops++;
+      }
+      checksum += working.posting_num;
+    }
+  } while ((elapsed = what_time_is_it() - start) < seconds_per_benchmark);
+  sprintf((char *)name, "saat_skipto/%d", stride);
+  report((char *)name, ops, elapsed, checksum);
+
+  for (b = 0; b < blocks; b++) free_querytree_memory(initial + b, 1);
+  free(initial);
+  free(qex);
+}
+
+
+static void bench_utf8_lowering(byte *forward, size_t fsz) {
+  byte *p = forward, *eof = forward + fsz, **records;
+  u_char *output;
+  size_t *lengths, total_bytes = 0;
+  u_ll ops = 0, checksum = 0;
+  double start, elapsed;
+  int r, num_records = 0;
+  char name[40];
+
+  records = (byte **)malloc(MAX_SAMPLE_RECORDS * sizeof(byte *));
+  lengths = (size_t *)malloc(MAX_SAMPLE_RECORDS * sizeof(size_t));
+  output = (u_char *)malloc(3 * MAX_RECORD_COPY + 1);  // Room for CP-1252 bytes to become 3-byte UTF-8
+  if (records == NULL || lengths == NULL || output == NULL) {
+    printf("Error: malloc failed in bench_utf8_lowering()\n");
+    exit(1);
+  }
+  while (p < eof && num_records < MAX_SAMPLE_RECORDS) {
+    records[num_records] = p;
+    while (p < eof && *p != '\t' && *p != '\n' && p - records[num_records] < MAX_RECORD_COPY) p++;
+    lengths[num_records] = p - records[num_records];
+    total_bytes += lengths[num_records++];
+    while (p < eof && *p != '\n') p++;
+    p++;
+  }
+
+  start = what_time_is_it();
+  do {
+    for (r = 0; r < num_records; r++) {
+      utf8_lowering_ncopy(output, records[r], lengths[r]);
+      checksum += output[0];
+    }
+    ops += num_records;
+  } while ((elapsed = what_time_is_it() - start) < seconds_per_benchmark);
+  sprintf(name, "utf8_lowering/%.0fB", num_records > 0 ? (double)total_bytes / num_records : 0.0);
+  report(name, ops, elapsed, checksum);
+  free(records);
+  free(lengths);
+  free(output);
+}
+
+
+static void bench_store_in_order(int max_to_show) {
+  // Candidates arrive with random scores, a thousand per query, as in classifier mode.
+  double cf_coeffs[NUM_CF_COEFFS] = { 1.0, 0.0, 0.0 }, FV[FV_ELTS] = { 0.0 }, score;
+  candidate_t *candidates;
+  u_ll ops = 0, checksum = 0, rng = 12345;
+  double start = what_time_is_it(), elapsed;
+  int c, recorded;
+  char name[40];
+
+  candidates = (candidate_t *)malloc(max_to_show * sizeof(candidate_t));
+  if (candidates == NULL) {
+    printf("Error: malloc failed in bench_store_in_order()\n");
+    exit(1);
+  }
+  do {
+    recorded = 0;
+    for (c = 0; c < 1000; c++) {
+      rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+      score = (double)(rng >> 11) / 9007199254740992.0;
+      checksum += possibly_store_in_order(cf_coeffs, c, score, candidates, max_to_show, &recorded, 0, 0, FV);
+    }
+    ops += 1000;
+  } while ((elapsed = what_time_is_it() - start) < seconds_per_benchmark);
+  sprintf(name, "store_in_order/%d", max_to_show);
+  report(name, ops, elapsed, checksum);
+  free(candidates);
+}
+
+
+int main(int argc, char **argv) {
+  query_processing_environment_t *qoenv;
+  index_environment_t *ixenv;
+  u_char arg[MAX_QLINE + 1], **words;
+  byte **lists;
+  u_ll *lengths;
+  int error_code = 0, num_words, num_lists, w;
+
+  if (argc < 2) {
+    printf("Usage: %s <index_dir> [seconds per benchmark]\n", argv[0]);
+    exit(1);
+  }
+  if (argc > 2) seconds_per_benchmark = strtod(argv[2], NULL);
+  if (seconds_per_benchmark <= 0.0) seconds_per_benchmark = 0.5;
+
+  initialize_unicode_conversion_arrays(FALSE);
+  qoenv = load_query_processing_environment();
+  if (qoenv == NULL) error_exit("Can't load a query processing environment\n");
+  snprintf((char *)arg, MAX_QLINE, "index_dir=%s", argv[1]);
+  assign_one_arg(qoenv, arg, TRUE, TRUE, TRUE);
+  // saat_skipto() is to be timed on postings, not bitmaps.
+  // (assign_one_arg() modifies its argument, so it can't be given a literal.)
+  strcpy((char *)arg, "x_bitmap_postings=FALSE");
+  assign_one_arg(qoenv, arg, TRUE, TRUE, TRUE);
+  if (finalize_query_processing_environment(qoenv, FALSE, TRUE) < 0) error_exit("Can't finalize the query processing environment\n");
+  ixenv = load_indexes(qoenv, FALSE, FALSE, &error_code);
+  if (error_code < 0) {
+    printf("Error: load_indexes() failed with code %d: %s", error_code, explain_error(error_code)->explanation);
+    exit(1);
+  }
+  qoenv->ixenv = ixenv;
+
+  words = sample_words(ixenv->forward, ixenv->fsz, &num_words);
+  lists = (byte **)malloc(MAX_SAMPLE_LISTS * sizeof(byte *));
+  lengths = (u_ll *)malloc(MAX_SAMPLE_LISTS * sizeof(u_ll));
+  if (lists == NULL || lengths == NULL) error_exit("Malloc failed\n");
+  num_lists = find_lists(ixenv, words, num_words, lists, lengths);
+  printf("Index %s:  %d sample words, %d postings lists\n\n", argv[1], num_words, num_lists);
+
+  bench_lookup_word(ixenv, words, num_words);
+  bench_dahash_lookup(words, num_words);
+  bench_vbyte_decode(lists, lengths, num_lists);
+  bench_saat_skipto(qoenv, words, num_words, 1);
+  bench_saat_skipto(qoenv, words, num_words, 100);
+  bench_saat_skipto(qoenv, words, num_words, 10000);
+  bench_utf8_lowering(ixenv->forward, ixenv->fsz);
+  bench_store_in_order(8);
+  bench_store_in_order(100);
+
+  for (w = 0; w < num_words; w++) free(words[w]);
+  free(words);
+  free(lists);
+  free(lengths);
+  unload_indexes(&ixenv);
+  qoenv->ixenv = NULL;
+  unload_query_processing_environment(&qoenv, FALSE, TRUE);
+  return 0;
+}
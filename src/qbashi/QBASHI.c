@@ -10,6 +10,7 @@
 #include <Psapi.h>  // Windows Process State API
 #else
 #include <errno.h>
+#include <pthread.h>
 #endif
 
 #include <stdio.h>
@@ -21,6 +22,10 @@
 #include <fcntl.h>
 #include <time.h>
 #include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QBASHI_SSE2
+#endif
 
 #include "../shared/unicode.h"
 #include "../shared/QBASHER_common_definitions.h"
@@ -65,7 +70,38 @@ static int MAX_LINE = MAX_DOCBYTES_NORMAL;    // Will be increased by -x_bigger_
 
 
 CROSS_PLATFORM_FILE_HANDLE forward_handle, dt_handle;  // Make global so error handlers can close.
-static dahash_table_t *word_table = NULL;
+
+
+// Words and word positions saved by a tokenizing thread of the file order pipeline, for later
+// indexing in record order.  Each word is stored as a byte holding its word position, followed 
+// by the null-terminated word.
+typedef struct {
+  u_char *bytes;
+  size_t used, allocated;
+} deferred_words_t;
+
+
+// Everything which is updated while records are being indexed.  Each indexing thread has its
+// own one of these, so that no locking is needed.  Serial indexing uses just one.  The counts 
+// are added into the corresponding globals once indexing is complete.
+typedef struct {
+  partial_index_t pix;    // The vocabulary hash table and the DOH in which postings lists are built
+  docnum_t doccount, ignored_docs, truncated_docs, incompletely_indexed_docs, empty_docs;
+  u_ll tot_postings, *doc_length_histo;
+  BOOL this_trigger_was_truncated;
+  u_char *cpybuf;          // Used in split_and_index_record()
+  BOOL word_is_plain_ascii;  // Set while the ASCII fast path is indexing words which need no case folding or accent removal
+  // The following are only used by the tokenizing threads of the file order pipeline.
+  deferred_words_t *deferred_words;  // If not NULL, words are saved here rather than being indexed
+  BOOL last_trigger_incompletely_indexed;
+  // The following are only used when indexing in score order.
+  u_char *forward, **recstarts;
+  u_ll *permute, first_rec, last_rec;   // This state indexes permute[first_rec] ... permute[last_rec - 1]
+  u_ll *dt_entries;                     // If not NULL, doctable entries are saved here rather than written
+} indexing_state_t;
+
+static indexing_state_t *indexing_states = NULL;
+static int num_indexing_states = 1;
 
 // Define the masks and shifts to enable extraction of the fields from a .doctable entry.
 // the fields are:  word count, document offset in .forward, document static score, and
@@ -96,6 +132,7 @@ DTE_WDCNT_SHIFT,
 // Variables settable from the command line
 u_int SB_POSTINGS_PER_RUN = 0;   // How many postings per skip block run.  Can't exceed SB_MAX_COUNT.  Zero means set dynamically
 u_int SB_TRIGGER = 500;            // If there are more than this number of postings and it's > 0, skip blocks will be inserted.
+docnum_t first_docnum = 0;   // Docnum of the first document.  Non-zero when building a delta index.
 docnum_t x_max_docs = DFLT_MAX_DOCS;   // QBASHI can be configured to stop after x_max_docs records.  This 
 double max_forward_GB;
 docnum_t doccount = 0, ignored_docs = 0, truncated_docs = 0, incompletely_indexed_docs = 0, empty_docs = 0;
@@ -112,17 +149,22 @@ u_int max_line_prefix = 0, // This turns on and controls the line prefix indexin
 // non-experimental values are set as defaults and the corresponding x_<blah> option can be used to 
 // set an experimental non-default value of <blah>.  Experimental options are disabled in arg_parser.cpp 
 // when QBASHER_LITE is defined.
-BOOL x_use_vbyte_in_chunks = TRUE, x_bigger_trigger = FALSE, x_doc_length_histo = FALSE, x_2postings_in_vocab = TRUE;
+BOOL x_use_vbyte_in_chunks = TRUE, x_bigger_trigger = FALSE, x_doc_length_histo = FALSE, x_2postings_in_vocab = TRUE,
+  x_ascii_fast_path = TRUE, x_front_coded_vocab = FALSE;
+static BOOL ascii_fast_path_usable = FALSE;  // Set up by check_ascii_fast_path()
 u_int x_min_payloads_per_chunk = 0;
-//int x_sort_postings_instead = 0;
-int x_hashbits = 0, x_hashprobe = 0, x_chunk_func = 102, x_cpu_affinity = -1;
-double x_geo_tile_width = 0;
+u_int x_sort_postings_instead = 0;
+u_int x_postings_gather_batch = 8;   // Millions of postings gathered into contiguous buffers before compression
+int x_compression_threads = 1;
+int x_hashbits = 0, x_hashprobe = 0, x_chunk_func = 102, x_cpu_affinity = -1, x_indexing_threads = 1,
+  x_tokenizing_threads = 0;
+double x_geo_tile_width = 0, x_bitmap_density = 0;
 int x_geo_big_tile_factor = 1;
 BOOL x_use_large_pages = FALSE, x_fileorder_use_mmap = FALSE, x_minimize_io = FALSE;
+size_t large_page_minimum = 0;
 
 
 #ifdef WIN64
-size_t large_page_minimum;
 DWORD pfc_list_build_start, pfc_list_build_end, pfc_list_scan_start, pfc_list_scan_end;  // Page fault counts
 #endif
 
@@ -132,20 +174,13 @@ u_char *index_dir = NULL, *fname_if = NULL, *fname_doctable = NULL, *fname_vocab
   *fname_forward = NULL, *fname_dlh = NULL, *language = NULL, *other_token_breakers = NULL,
   *token_break_set = NULL;
 BOOL sort_records_by_weight = TRUE, unicode_case_fold = TRUE, conflate_accents = FALSE,
-  expect_cp1252 = TRUE, this_trigger_was_truncated = FALSE;
-
-// Next two are items for when we sort postings rather than build linked lists (not fully implemented)
-byte *postings_accumulator_for_sort;
-u_ll postings_accumulated;
+  expect_cp1252 = TRUE;
 
-
-
-doh_t ll_heap;     // Note that ll_heap is nothing to do with min_heaps or max_heaps.  It's a reference to 
-// a program-managed memory heap in which linked_list blocks are allocated.   Replacing 
+// Note that each partial index has an ll_heap, which is nothing to do with min_heaps or max_heaps.  It's
+// a reference to a program-managed memory heap in which linked_list blocks are allocated.   Replacing 
 // millions of very small malloc()s with a small number of big ones saved huge amounts of 
 // time and reduced memory overhead.  A pointer to ll_heap is passed to all the functions
-// which need to access linked lists.
-size_t num_doh_blocks;   // DOH = Dave's Own Heap
+// which need to access linked lists.  DOH = Dave's Own Heap
 
 
 static void print_usage();
@@ -578,70 +613,28 @@ static void show_count_n_postings(const void *valptr, doh_t ll_heap) {
 // Functions for accessing records in QBASH.forward and indexing the trigger                                           //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static void process_a_word_internal(u_char *wd, docnum_t doccount, u_int wdpos, u_ll *max_plist_len, 
-		    doh_t ll_heap) {
-  // Look up wd in the vocabulary hash, inserting if not already there. Update 
-  // occurrence count, add a posting and boost max_plist_len if appropriate
-  // All the information needed to build the .vocab and .if files is accumulated
-  // in memory until the input is all consumed, then those files are written.
-  // The in-memory representation is a hash table keyed by words in the vocabulary,
-  // in which the values are postings lists represented by single-linked lists, 
-  // referenced by head and tail pointers.  (The tail pointer is essential to 
-  // fast appending to long lists.)  Relevant linked list definitions are in 
-  // linked_list.cpp and linked_list.h
-  //
-  // Note about wdpos:  wdpos represents the position of this word in the record, numbered.
-  // from zero.  It is incremented by the code which calls this function, and, depending upon
-  // the setting of x_bigger_trigger, may reach values as high as 100,000.  HOWEVER,
-  // since only one byte is allocated for wdpos in the postings lists, and the value
-  // 255 is used to introduce a skip block, any value > 254 which is passed in is
-  // locally treated as 254.
-
+static void add_posting_for_word(u_char *wd, docnum_t doccount, u_int wdpos, indexing_state_t *ixs) {
+  // The part of process_a_word_internal() (below) which updates the vocabulary hash and the
+  // postings lists.  wd has already been case folded if necessary.
   vocab_entry_p vep;
   u_int count;
+  doh_t ll_heap = ixs->pix.ll_heap;
 
-  if (wdpos > MAX_WDPOS) wdpos = MAX_WDPOS;  // Make sure the wdpos written into postings never exceeds 254
-
-  // ASCII lower casing
-  if (unicode_case_fold) utf8_lower_case(wd);  // This function returns length but we ignore it.
-
-  vep = (vocab_entry_p)dahash_lookup(word_table, (byte *)wd, 1);  // Returns a pointer to the value part of the entry.
+  vep = (vocab_entry_p)dahash_lookup(ixs->pix.ht, (byte *)wd, 1);  // Returns a pointer to the value part of the entry.
   if (vep != NULL) {
     // NOTE: Memory in the hash table is zeroed when created
     count = ve_get_count(vep);   // ve_get_count works whether the hash table entry is organized 4,6,6 or 4,5,5,2.  This relies on that
     if (wd[0] == '>' && count >= max_line_prefix_postings) return;
-#if 0
-    if (x_sort_postings_instead > 0) {
-      u_int termid;
-      byte *entryp;
-      u_ll *entryullp, ull;
-      u_short *entryshortp;
-      vep -= word_table->key_size;  // In this mode, we want this to point to the key rather than the value
-
-      if (postings_accumulator_for_sort == NULL) {
-	// The value of x_sort_postings_instead gives the number of million entries in an array of termid, docnum, wordpos postings
-	postings_accumulator_for_sort = (byte *)malloc((size_t)x_sort_postings_instead * 1000000 * SORTABLE_POSTING_SIZE);
-	if (postings_accumulator_for_sort == NULL) error_exit("Malloc failed for postings_accumulator_for_sort");
-      }
-      else if (postings_accumulated > x_sort_postings_instead * 1000000) {
-	error_exit("Array postings_accumulator_for_sort has overflowed.");
-      }
-      termid = (u_int)((vep - (vocab_entry_p)(word_table->table))/word_table->entry_size);   // Termid is just entry number in vocab
-
-      if (0) printf("PAW(%s) - termid is %u.  HT contains (%s)\n", wd, termid, vep);
-      entryp = postings_accumulator_for_sort + postings_accumulated * SORTABLE_POSTING_SIZE;
-      // The entry is written as a u_ll containing 4byte u-int termid and leading 4 bytes of docnum, followed by
-      // a u_short containing the last byte of the docnum and the one-byte wordpos
-      ull = termid;
-      ull <<= 32;
-      ull |= (doccount>> 8);
-      entryullp = (u_ll *)entryp;
-      *entryullp = ull;
-      entryshortp = (u_short *)(entryullp + 1);
-      *entryshortp = ((u_short)(doccount & 0xFF) << 8) | (wdpos);
-      postings_accumulated++;
+    if (ixs->pix.runs != NULL) {
+      // Sort mode:  The vocab entry holds the count and a termid which indexes the term's postings
+      // in the accumulator.  No linked list is ever built.
+      u_ll termid, ignore;
+      if (count == 0) ve_pack466(vep, 0, ixs->pix.runs->next_termid++, 0);
+      ve_unpack466(vep, &count, &termid, &ignore);
+      accumulate_sortable_posting(ixs->pix.ht, ixs->pix.runs, (u_int)termid, doccount, wdpos);
+      count++;
+      ve_store_count(vep, count);
     } else
-#endif
       {
 	if (x_2postings_in_vocab  && count < 3) {
 	  // In this mode we store up to two postings in the vocabulary entry and copy them out again if we 
@@ -705,7 +698,6 @@ static void process_a_word_internal(u_char *wd, docnum_t doccount, u_int wdpos,
 
 	count++;
 	ve_store_count(vep, count);
-	if (count > *max_plist_len) *max_plist_len = count;
 	if (0) printf("  ------  About to append a posting for '%s', count = %d\n", wd, count);
 	append_posting(ll_heap, vep, doccount, wdpos, wd);
       }
@@ -715,28 +707,239 @@ static void process_a_word_internal(u_char *wd, docnum_t doccount, u_int wdpos,
   }
 }
 
-void process_a_word(u_char *wd, docnum_t doccount, u_int wdpos, u_ll *max_plist_len, 
-		    doh_t ll_heap) {
+static void defer_word(deferred_words_t *dw, u_char *wd, u_int wdpos) {
+  // Save wd and wdpos for later indexing by add_posting_for_word().  The word is first
+  // truncated exactly as dahash_lookup() would truncate it, because process_a_word() goes on to
+  // remove accents from the (possibly truncated) word.
+  size_t len;
+  dahash_truncate_key(wd, MAX_WD_LEN);
+  len = strlen((char *)wd);
+  if (dw->used + len + 2 > dw->allocated) {
+    dw->allocated = 2 * dw->allocated + len + 2;
+    dw->bytes = (u_char *)realloc(dw->bytes, dw->allocated);
+    if (dw->bytes == NULL) error_exit("Realloc failed for deferred words\n");
+  }
+  dw->bytes[dw->used++] = (u_char)wdpos;   // Always <= MAX_WDPOS
+  memcpy(dw->bytes + dw->used, wd, len + 1);
+  dw->used += len + 1;
+}
+
+
+static void process_a_word_internal(u_char *wd, docnum_t doccount, u_int wdpos, indexing_state_t *ixs) {
+  // Look up wd in the vocabulary hash, inserting if not already there. Update 
+  // occurrence count, add a posting and boost max_plist_len if appropriate
+  // All the information needed to build the .vocab and .if files is accumulated
+  // in memory until the input is all consumed, then those files are written.
+  // The in-memory representation is a hash table keyed by words in the vocabulary,
+  // in which the values are postings lists represented by single-linked lists, 
+  // referenced by head and tail pointers.  (The tail pointer is essential to 
+  // fast appending to long lists.)  Relevant linked list definitions are in 
+  // linked_list.cpp and linked_list.h
+  //
+  // Note about wdpos:  wdpos represents the position of this word in the record, numbered.
+  // from zero.  It is incremented by the code which calls this function, and, depending upon
+  // the setting of x_bigger_trigger, may reach values as high as 100,000.  HOWEVER,
+  // since only one byte is allocated for wdpos in the postings lists, and the value
+  // 255 is used to introduce a skip block, any value > 254 which is passed in is
+  // locally treated as 254.
+
+  if (wdpos > MAX_WDPOS) wdpos = MAX_WDPOS;  // Make sure the wdpos written into postings never exceeds 254
+
+  // ASCII lower casing
+  if (unicode_case_fold && !ixs->word_is_plain_ascii) utf8_lower_case(wd);  // This function returns length but we ignore it.
+
+  if (ixs->deferred_words != NULL) {
+    defer_word(ixs->deferred_words, wd, wdpos);
+    return;   // ------------------------------------------------------->
+  }
+  add_posting_for_word(wd, doccount, wdpos, ixs);
+}
+
+
+static void process_a_word(u_char *wd, docnum_t doccount, u_int wdpos, indexing_state_t *ixs) {
   // This fn is now a front-end to process_a_word_internal(), which allows us to
   // generate multiple variants of the same word and index them at the same word
   // position.  This structure is initially motivated by the desire to be able
   // to index accented and unaccented versions of a word.
 
   int accents_removed = 0, verbose = 0;
-  process_a_word_internal(wd, doccount, wdpos, max_plist_len, ll_heap);  // First one first
-  if (conflate_accents) {
+  process_a_word_internal(wd, doccount, wdpos, ixs);  // First one first
+  if (conflate_accents && !ixs->word_is_plain_ascii) {
     if (verbose) printf("Indexed '%s' at position %d\n", wd, wdpos);
     accents_removed = utf8_remove_accents(wd);
     if (accents_removed > 0) {
-      process_a_word_internal(wd, doccount, wdpos, max_plist_len, ll_heap);
+      process_a_word_internal(wd, doccount, wdpos, ixs);
       if (verbose) printf("Also indexed '%s' at position %d\n", wd, wdpos);
     }
   }
 }
 
 
-static int process_trigger(u_char *str, docnum_t doccount, u_ll *max_plist_len,
-			   doh_t ll_heap) {
+// ASCII fast path for tokenizing triggers.  Most triggers are pure ASCII, and for those the 
+// unicode decoding in process_trigger(), and the per-word calls to utf8_lower_case() and 
+// utf8_remove_accents() in process_a_word(), are wasted effort.  A trigger with no byte above 127 
+// is instead lower-cased in one pass, 16 bytes at a time, and split into words by 
+// skip_ascii_token_chars(), which only consults ascii_non_tokens[] for bytes which aren't letters 
+// or digits.  The words and word positions are exactly those which the general path would produce.
+// The fast path is only used if check_ascii_fast_path() confirms that no letter or digit is a
+// token breaker and that the unicode mappings treat ASCII in the obvious way.
+
+static void check_ascii_fast_path() {
+  u_char all_ascii[128], lowered[128];
+  int a;
+
+  ascii_fast_path_usable = FALSE;
+  if (!x_ascii_fast_path) return;   // ----------------------------------->
+  for (a = 0; a < 128; a++) {
+    if (isalnum(a) && ascii_non_tokens[a]) {
+      printf("ASCII fast path not used because '%c' is a token breaker.\n", a);
+      return;   // ----------------------------------->
+    }
+  }
+  for (a = 1; a < 128; a++) {
+    all_ascii[a - 1] = (u_char)a;
+    lowered[a - 1] = (u_char)((a >= 'A' && a <= 'Z') ? a + ('a' - 'A') : a);
+  }
+  all_ascii[127] = 0;
+  lowered[127] = 0;
+  utf8_lower_case(all_ascii);
+  if (strcmp((char *)all_ascii, (char *)lowered)) {
+    printf("ASCII fast path not used because of unexpected ASCII case folding.\n");
+    return;   // ----------------------------------->
+  }
+  utf8_remove_accents(all_ascii);
+  if (strcmp((char *)all_ascii, (char *)lowered)) {
+    printf("ASCII fast path not used because of unexpected ASCII accent removal.\n");
+    return;   // ----------------------------------->
+  }
+  ascii_fast_path_usable = TRUE;
+}
+
+
+static BOOL is_ascii(u_char *str, size_t len) {
+  size_t i = 0;
+#ifdef QBASHI_SSE2
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 16 <= len; i += 16) acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i *)(str + i)));
+  if (_mm_movemask_epi8(acc)) return FALSE;
+#endif
+  for (; i < len; i++) if (str[i] & 0x80) return FALSE;
+  return TRUE;
+}
+
+
+static void ascii_lower_case(u_char *str, size_t len) {
+  size_t i = 0;
+#ifdef QBASHI_SSE2
+  __m128i before_A = _mm_set1_epi8('A' - 1), after_Z = _mm_set1_epi8('Z' + 1), to_lower = _mm_set1_epi8('a' - 'A'),
+    v, upper;
+  for (; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((__m128i *)(str + i));
+    upper = _mm_and_si128(_mm_cmpgt_epi8(v, before_A), _mm_cmplt_epi8(v, after_Z));
+    _mm_storeu_si128((__m128i *)(str + i), _mm_add_epi8(v, _mm_and_si128(upper, to_lower)));
+  }
+#endif
+  for (; i < len; i++) if (str[i] >= 'A' && str[i] <= 'Z') str[i] += ('a' - 'A');
+}
+
+
+static u_char *skip_ascii_token_chars(u_char *p, u_char *end) {
+  // Return a pointer to the first non-token character at or after p, or end if there isn't one.
+#ifdef QBASHI_SSE2
+  __m128i v, alnum;
+  u_int others;
+  int i;
+  while (p + 16 <= end) {
+    v = _mm_loadu_si128((__m128i *)p);
+    alnum = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    alnum = _mm_or_si128(alnum, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1))));
+    alnum = _mm_or_si128(alnum, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+    others = ~(u_int)_mm_movemask_epi8(alnum) & 0xFFFF;
+    while (others) {
+#ifdef WIN64
+      unsigned long bit;
+      _BitScanForward(&bit, others);
+      i = (int)bit;
+#else
+      i = __builtin_ctz(others);
+#endif
+      if (ascii_non_tokens[p[i]]) return p + i;   // ----------------------------------->
+      others &= others - 1;
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && !ascii_non_tokens[*p]) p++;
+  return p;
+}
+
+
+static int index_ascii_trigger(u_char *str, size_t len, docnum_t doccount, indexing_state_t *ixs,
+			       BOOL *incompletely_indexed) {
+  // The fast path equivalent of the word splitting in process_trigger().  str must be pure ASCII.
+  // Return a count of words indexed
+  u_char *p = str, *end = str + len, *wdstart, savep;
+  u_char line_prefix[MAX_WD_LEN + 2];
+  int wdcount = 0;
+
+  if (unicode_case_fold) ascii_lower_case(str, len);
+  ixs->word_is_plain_ascii = TRUE;
+
+  while (*p >= ' ' && ascii_non_tokens[*p]) p++;  // Skip over leading non tokens
+
+  if (max_line_prefix) {
+    u_int l;
+    if (max_line_prefix >= MAX_WD_LEN) max_line_prefix = MAX_WD_LEN - 1;  // Avoid nastiness resulting from bad arg value
+    line_prefix[0] = '>';
+    l = 1;
+    while (l <= max_line_prefix) {
+      if (ascii_non_tokens[*p] || *p == 0) break;  
+      line_prefix[l++] = *p++;
+      line_prefix[l] = 0;
+      process_a_word(line_prefix, doccount, 0, ixs);
+    }
+  }
+
+  p = str;
+  while (1) {
+    while (p < end && ascii_non_tokens[*p]) p++;
+    if (p >= end) break;
+    wdstart = p;
+    p = skip_ascii_token_chars(p, end);
+    savep = *p;
+    *p = 0;
+    process_a_word(wdstart, doccount, wdcount, ixs);
+    wdcount++;
+    *p = savep;  // Put things back as they were
+    if (wdcount >= MAX_WDS_INDEXED_PER_DOC) {
+      // Check whether there are remaining words
+      while (p < end && ascii_non_tokens[*p]) p++;
+      if (p < end) *incompletely_indexed = TRUE;
+      break;
+    }
+  }
+
+  ixs->word_is_plain_ascii = FALSE;
+  return wdcount;
+}
+
+
+static int record_trigger_stats(indexing_state_t *ixs, int wdcount, BOOL incompletely_indexed) {
+  if (ixs->this_trigger_was_truncated) incompletely_indexed = TRUE;  // this_trigger_was_truncated means length exceeded buffer
+  ixs->last_trigger_incompletely_indexed = incompletely_indexed;
+  if (incompletely_indexed) ixs->incompletely_indexed_docs++;
+
+  ixs->tot_postings += wdcount;
+
+  if (x_doc_length_histo && index_dir != NULL  && ixs->doc_length_histo != NULL) {
+    if (incompletely_indexed) ixs->doc_length_histo[MAX_WDS_INDEXED_PER_DOC + 1]++;  // Array malloced with MAX_w... + 2
+    else if (wdcount > 0) ixs->doc_length_histo[wdcount]++;
+  }
+  return  wdcount;
+}
+
+
+static int process_trigger(u_char *str, docnum_t doccount, indexing_state_t *ixs) {
   // str is assumed to be a null terminated string in which words are separated by 
   // non-token characters.   Break into words and (eventually) add to the term
   // hash.
@@ -751,6 +954,14 @@ static int process_trigger(u_char *str, docnum_t doccount, u_ll *max_plist_len,
 
   if (verbose) printf("(%s)\n", str);
 
+  if (ascii_fast_path_usable) {
+    size_t len = strlen((char *)str);
+    if (is_ascii(str, len)) {
+      wdcount = index_ascii_trigger(str, len, doccount, ixs, &incompletely_indexed);
+      return record_trigger_stats(ixs, wdcount, incompletely_indexed);   // ----------------------------------->
+    }
+  }
+
   while (*p >= ' ') { // Skip over leading non tokens
     if (*p & 0x80) {   // Using a loose defn allows conversion of CP-1252 punctuation
       unicode = utf8_getchar(p, &bafter, TRUE);
@@ -782,14 +993,14 @@ static int process_trigger(u_char *str, docnum_t doccount, u_ll *max_plist_len,
 	  if (verbose) printf("Indexing UTF-8 '%s'\n", line_prefix);
 	}	  
 	line_prefix[l] = 0;
-	process_a_word(line_prefix, doccount, 0, max_plist_len, ll_heap);
+	process_a_word(line_prefix, doccount, 0, ixs);
 	// wdcount++;  // Don't count invisible words!
       } else {
 	if (ascii_non_tokens[*p] || *p == 0) break;  
 	line_prefix[l++] = *p++;
 	line_prefix[l] = 0;
 	if (verbose) printf("Indexing ASCII'%s'\n", line_prefix);
-	process_a_word(line_prefix, doccount, 0, max_plist_len, ll_heap);
+	process_a_word(line_prefix, doccount, 0, ixs);
 	// wdcount++; // Don't count invisible words!
       }
     }
@@ -825,7 +1036,7 @@ static int process_trigger(u_char *str, docnum_t doccount, u_ll *max_plist_len,
       savep = *p;
       *p = 0;
       if (wdstart[0]) {
-	process_a_word(wdstart, doccount, wdcount, max_plist_len, ll_heap);
+	process_a_word(wdstart, doccount, wdcount, ixs);
 	wdcount++;
 	if (verbose) printf("INdexing '%s'\n", wdstart);
       }
@@ -848,7 +1059,7 @@ static int process_trigger(u_char *str, docnum_t doccount, u_ll *max_plist_len,
       // Processing the last word in the trigger
       if (verbose) printf("   Processing last word in trigger\n");
       if (!ascii_non_tokens[wdstart[0]]) {
-	process_a_word(wdstart, doccount, wdcount, max_plist_len, ll_heap);
+	process_a_word(wdstart, doccount, wdcount, ixs);
 	wdcount++;
 	if (verbose) printf("INDexing '%s'\n", wdstart);
       }
@@ -873,24 +1084,15 @@ static int process_trigger(u_char *str, docnum_t doccount, u_ll *max_plist_len,
     }
   }  // End of outer loop over words.
 
-  if (this_trigger_was_truncated) incompletely_indexed = TRUE;  // this_trigger_was_truncated means length exceeded buffer
-  if (incompletely_indexed) incompletely_indexed_docs++;
-
-  tot_postings += wdcount;
   if (verbose) printf("Wdcnt = %d\n", wdcount);
 
   //if (0 && wdcount == 1) printf("Short rec: %d wds: '%s'\n", wdcount, str);
-  if (x_doc_length_histo && index_dir != NULL  && doc_length_histo != NULL) {
-    if (incompletely_indexed) doc_length_histo[MAX_WDS_INDEXED_PER_DOC + 1]++;  // Array malloced with MAX_w... + 2
-    else if (wdcount > 0) doc_length_histo[wdcount]++;
-  }
-  return  wdcount;
+  return record_trigger_stats(ixs, wdcount, incompletely_indexed);
 } 
 
 #define CPYBUF_SIZE MAX_DOCBYTES_BIGGER 
-static u_char cpybuf[CPYBUF_SIZE + 1];  // Used in split_and_index_record() below
 
-static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_plist_len, doh_t ll_heap, 
+static double split_and_index_record(u_char *buf, docnum_t doccount, indexing_state_t *ixs,
 				     unsigned long long *d_signature, u_int *wds_indexed,
 				     size_t *actual_trigger_length) {
   // Each input record consists of at least two tab separated fields.
@@ -898,7 +1100,7 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
   // Return the raw score as a double
   // Skip indexing if the raw score in column 2 is below the score_threshold.
   // Also calculate and return a signature based on word first letters.
-  u_char *start = buf, *end = start, *p, *q;
+  u_char *start = buf, *end = start, *p, *q, *cpybuf = ixs->cpybuf;
   double score;
   int l = 0;
 
@@ -907,7 +1109,7 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
     show_string_upto_nator(start, '\n', 0);
   }
 
-  this_trigger_was_truncated = FALSE;
+  ixs->this_trigger_was_truncated = FALSE;
 
   // Scan the trigger (first column) and copy into cpybuf 
   while (*end && *end != '\t' && l < CPYBUF_SIZE) {
@@ -916,7 +1118,7 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
   }
   cpybuf[l] = 0;
   if (l >= CPYBUF_SIZE) {
-    this_trigger_was_truncated = TRUE;
+    ixs->this_trigger_was_truncated = TRUE;
     // The trigger field has been truncated.  Avoid the chance of indexing a truncated word.
     l--;
     while (l >= 0 && ((cpybuf[l] & 0x80) || (!ascii_non_tokens[cpybuf[l]]))) {
@@ -927,7 +1129,7 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
     }
     // Now skip end forward to the tab so we can get the frequency.
     while (*end && *end != '\t') end++;
-    truncated_docs++;
+    ixs->truncated_docs++;
   }
   *actual_trigger_length = end - buf;
 
@@ -945,9 +1147,9 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
   }
   if (score < score_threshold) return score;  // Frequency too low, signal no_index
   *d_signature = calculate_signature_from_first_letters(cpybuf, (int)DTE_BLOOM_BITS);
-  *wds_indexed = process_trigger(cpybuf, doccount, max_plist_len, ll_heap);
+  *wds_indexed = process_trigger(cpybuf, doccount, ixs);
   if (*wds_indexed <= 0)
-    empty_docs++;
+    ixs->empty_docs++;
 
   // Generation and indexing of special words indicating geospatial tiles
   if (x_geo_tile_width > 0) {
@@ -983,7 +1185,7 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
 					       MAX_WD_LEN, 0);
 	    for (g = 0; g < generated; g++) {
 	      process_a_word((u_char *)special_words + g * (MAX_WD_LEN + 1), doccount,
-			     wdpos, max_plist_len, ll_heap);
+			     wdpos, ixs);
 	      if (0) printf("   Special word '%s' indexed at wdpos %d\n",
 			    special_words + g * (MAX_WD_LEN + 1), wdpos);
 	      if (g == 2) wdpos++;  // First three are lat words, 2nd three are long words	      
@@ -1000,7 +1202,7 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
 	      for (g = 0; g < generated; g++) {
 		strcpy(big_words + 3, special_words + g * (MAX_WD_LEN + 1));  // Buffer has room
 		process_a_word((u_char *)big_words, doccount,
-			       wdpos, max_plist_len, ll_heap);
+			       wdpos, ixs);
 		if (0) printf("   Special word '%s' indexed at wdpos %d\n",
 			      special_words + g * (MAX_WD_LEN + 1), wdpos);
 		if (g == 2) wdpos++;  // First three are lat words, 2nd three are long words	      
@@ -1035,7 +1237,7 @@ static double split_and_index_record(u_char *buf, docnum_t doccount, u_ll *max_p
 								    TRUE, FALSE, FALSE, FALSE);
 	      for (w = 0; w < numWords; w++) {
 		process_a_word(funny_word_starts[w], doccount,
-			       ++wdpos, max_plist_len, ll_heap);
+			       ++wdpos, ixs);
 		if (0) printf("   Special word '%s' indexed at wdpos %d\n",
 			      funny_word_starts[w], wdpos);
 	      }
@@ -1114,10 +1316,11 @@ static int count_wds_in_trigger(u_char *str) {
 
 #define DFLT_DOH_BLOCKSIZE 67108864   // that ensures allocations are 64MB which is large multiple of the 1 or 2MB Large Page size [Note: bytes not entries]
 
-void allocate_hashtable_and_heap(docnum_t doccount_estimate) {
+static void allocate_hashtable_and_heap(indexing_state_t *ixs, docnum_t doccount_estimate) {
   // The hashtable is for storing the vocabulary and the heap provides memory storage for the linked 
   // lists representing postings lists internally.
   int hashbits;
+  size_t num_doh_blocks;
 
   if (x_hashbits) hashbits = x_hashbits;   // Explicitly set
   else {
@@ -1131,7 +1334,7 @@ void allocate_hashtable_and_heap(docnum_t doccount_estimate) {
     else if (doccount_estimate > 5000000) hashbits = 21;
   }
 
-  word_table = dahash_create((u_char *)"words", hashbits, MAX_WD_LEN, VOCAB_ENTRY_SIZE, (double)0.9, FALSE);
+  ixs->pix.ht = dahash_create((u_char *)"words", hashbits, MAX_WD_LEN, VOCAB_ENTRY_SIZE, (double)0.9, FALSE);
 #ifdef WIN64
   report_memory_usage(stdout, (u_char *)"after creating hash table", NULL);
 #endif
@@ -1141,11 +1344,20 @@ void allocate_hashtable_and_heap(docnum_t doccount_estimate) {
   // space is wasted in partly allocated chunks.
   if (x_bigger_trigger) num_doh_blocks *= 20;    // Have to substantially increase the allowance when indexing whole doc.s
   if (num_doh_blocks < 1) num_doh_blocks = 1;
-  ll_heap = doh_create_heap(num_doh_blocks, DFLT_DOH_BLOCKSIZE); // Each block can hold millions of  postings.
+  ixs->pix.ll_heap = doh_create_heap(num_doh_blocks, DFLT_DOH_BLOCKSIZE); // Each block can hold millions of  postings.
 #ifdef WIN64
   report_memory_usage(stdout, (u_char *)"after initial doh creation", NULL);
 #endif
 
+  if (x_sort_postings_instead > 0) {
+    // Postings will be accumulated and spilled to sorted runs rather than appended to linked lists.
+    // Run files for each indexing state are named after the .if file.
+    u_char *stem = (u_char *)malloc(strlen((char *)fname_if) + 20);
+    if (stem == NULL) error_exit("Malloc failed for sorted run file stem\n");
+    sprintf((char *)stem, "%s.%d", fname_if, (int)(ixs - indexing_states));
+    ixs->pix.runs = create_postings_runs(stem, (u_ll)x_sort_postings_instead * 1000000);
+  }
+
 }
 
 
@@ -1154,9 +1366,216 @@ void allocate_hashtable_and_heap(docnum_t doccount_estimate) {
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM_FILE_HANDLE dt_handle, dahash_table_t *word_table, 
-					   u_int min_wds, u_int max_wds, docnum_t *ignored_docs, docnum_t *gdoccount,
-					   u_ll *gmax_plist_len, size_t *infile_size) {
+static void index_permuted_records(indexing_state_t *ixs, CROSS_PLATFORM_FILE_HANDLE dt_handle,
+				   byte **dt_buf, size_t *dt_buf_used) {
+  // Index the records referenced by ixs->permute[ixs->first_rec] ... ixs->permute[ixs->last_rec - 1],
+  // assigning docnums from ixs->doccount upward.  Doctable entries are saved in ixs->dt_entries if
+  // that's been allocated, otherwise they're written via the doctable buffer.
+  long long docoff;
+  double raw_score;
+  u_char *p;
+  size_t trigger_len;
+  u_int wds = 0;   // wds in the current record
+  u_ll r, pr, dt_ent, qwt, d_signature = 0;
+
+  for (r = ixs->first_rec; r < ixs->last_rec; r++) {
+    if (debug >= 2) printf("indexing record %lld\n", r);
+    pr = ixs->permute[r];
+    p = ixs->recstarts[pr];
+    if (*p < ' ') continue;   // This line is empty, will be ignored.
+    if (min_wds > 0 || max_wds > 0) {
+      // Only do this counting  if limits are being imposed.
+      wds = count_wds_in_trigger(p);  // Returns -1 in case of error
+      if (wds < min_wds || wds > max_wds) {
+	ixs->ignored_docs++;
+	continue;
+      }
+    } 
+    docoff = ixs->recstarts[pr] - ixs->forward;
+    raw_score = split_and_index_record(ixs->recstarts[pr], ixs->doccount, ixs, &d_signature, 
+				       &wds, &trigger_len);
+    if (wds > 0 && raw_score >= score_threshold) {
+      // We ignore records with scores below the frequency threshold and those which have no
+      // indexable words.
+
+      if ((u_ll)docoff > DTE_DOCOFF_MASK2) {
+	ixs->ignored_docs++;
+	continue;   // ----------------------------------------------->
+      }
+
+
+      qwt = (u_ll)quantize_log_score_ratio((double)raw_score, (double)log_max_score);
+      dt_ent = docoff << DTE_DOCOFF_SHIFT;
+      if (wds > DTE_WDCNT_MASK) wds = (int)DTE_WDCNT_MASK;
+      dt_ent |= (wds & DTE_WDCNT_MASK);
+      dt_ent |= ((qwt & DTE_DOCSCORE_MASK2) << DTE_DOCSCORE_SHIFT);
+      dt_ent |= ((d_signature & DTE_DOCBLOOM_MASK2) << DTE_DOCBLOOM_SHIFT);
+      if (ixs->dt_entries != NULL) ixs->dt_entries[ixs->doccount] = dt_ent;
+      else if (!x_minimize_io) buffered_write(dt_handle, dt_buf, HUGEBUFSIZE, dt_buf_used, (byte *)&dt_ent, sizeof(dt_ent), (char *)"doctable entry");
+      ixs->doccount++;
+
+      if (ixs->dt_entries == NULL && ixs->doccount % 10000 == 0) {
+	printf("%11lld\n", ixs->doccount);
+#ifdef WIN64
+	report_memory_usage(stdout, (u_char *)"permuted scanning", NULL);
+#endif
+      }
+    }
+    else ixs->ignored_docs++;
+  }
+}
+
+
+#ifdef WIN64
+static DWORD WINAPI index_records_thread(LPVOID arg) {
+#else
+static void *index_records_thread(void *arg) {
+#endif
+  // Body of an indexing thread.  Build a partial index for this thread's slice of the permuted
+  // records and sort its vocabulary ready for merging.
+  indexing_state_t *ixs = (indexing_state_t *)arg;
+  allocate_hashtable_and_heap(ixs, (docnum_t)(ixs->last_rec - ixs->first_rec));
+  index_permuted_records(ixs, dt_handle, NULL, NULL);
+  if (ixs->pix.runs != NULL) spill_sorted_run(ixs->pix.ht, ixs->pix.runs);
+  sort_partial_index_vocab(&(ixs->pix));
+  return 0;
+}
+
+// The three scanning passes of process_records_in_score_order() are run over newline-aligned 
+// chunks of the .forward file, one per indexing thread.  Each chunk is scanned exactly as the 
+// serial code would scan it, and records are numbered by chunk, so recstarts, scores and the 
+// permutation come out identical whatever the number of threads.
+typedef struct {
+  u_char *start, *limit, *end;  // Scan from start while p < limit.  end is where the first pass actually stopped.
+  u_char *last;                 // End of the .forward file
+  u_char **recstarts;
+  u_int *scores;
+  u_ll *histo;                  // This chunk's histogram of docscores, later its starting positions in permute
+  u_ll *permute;
+  u_ll first_rec, recs, r_wi_maxscore;  // r_wi_maxscore is relative to first_rec
+  double max_score;
+  int pass;
+} scan_chunk_t;
+
+
+static void scan_chunk_for_max_score(scan_chunk_t *sc) {
+  // First pass: Count the number of records in the chunk and find the maximum score
+  u_char *p = sc->start, *ep, *last = sc->last;
+  double score;
+  
+  sc->recs = 0;
+  sc->max_score = 0;
+  sc->r_wi_maxscore = 0;
+  while (p < sc->limit) {
+    while (p < last && *p != '\t') p++;  // Skip the trigger
+    p++;
+    score = strtod((char *)p, (char **)&ep);
+    if (score > sc->max_score) { 
+      sc->max_score = score; 
+      sc->r_wi_maxscore = sc->recs;
+    }
+    p = ep;
+    while (p < last && *p != '\n') p++;  // Skip to end of record.
+    p++;
+    sc->recs++;
+  }
+  sc->end = p;
+}
+
+
+static void scan_chunk_for_scores(scan_chunk_t *sc) {
+  // Second pass: Record the startpoints and make a histogram of quantized log_score ratios
+  u_char *p = sc->start, *ep, *last = sc->last;
+  u_ll r = sc->first_rec;
+  u_int docscore;
+  double score;
+  
+  while (p < sc->end) {
+    sc->recstarts[r] = p;
+    while (p < last && *p != '\t') p++;  // Skip the trigger
+    p++;
+    score = strtod((char *)p, (char **)&ep);
+    docscore = quantize_log_score_ratio(score, log_max_score);
+    sc->histo[docscore]++;   // For counting sort.
+    sc->scores[r] = docscore;
+    p = ep;
+    while (p < last && *p != '\n') p++;  // Skip to end of record.
+    p++;
+    r++;
+  }
+}
+
+
+static void permute_chunk(scan_chunk_t *sc) {
+  // Third pass:  sc->histo[s] holds the position in permute of this chunk's first record with 
+  // docscore s.
+  u_ll r, pos;
+  u_int val;
+  for (r = sc->first_rec; r < sc->first_rec + sc->recs; r++) {
+    val = sc->scores[r];
+    pos = sc->histo[val];
+    sc->permute[pos] = r;
+    sc->histo[val]++;   // A new spot for the next occurrence of val
+  }
+}
+
+
+#ifdef WIN64
+static DWORD WINAPI scan_chunk_thread(LPVOID arg) {
+#else
+static void *scan_chunk_thread(void *arg) {
+#endif
+  scan_chunk_t *sc = (scan_chunk_t *)arg;
+  if (sc->pass == 1) scan_chunk_for_max_score(sc);
+  else if (sc->pass == 2) scan_chunk_for_scores(sc);
+  else permute_chunk(sc);
+  return 0;
+}
+
+
+static void run_scan_pass(scan_chunk_t *chunks, int num_chunks, int pass) {
+  // Run one pass over all the chunks, using a thread per chunk if there's more than one.
+  int t, error_code;
+#ifdef WIN64
+  HANDLE threads[MAX_INDEXING_THREADS];
+#else
+  pthread_t threads[MAX_INDEXING_THREADS];
+#endif
+
+  for (t = 0; t < num_chunks; t++) chunks[t].pass = pass;
+  if (num_chunks == 1) {
+    scan_chunk_thread((void *)chunks);
+    return;  // ----------------------------------->
+  }
+  
+  for (t = 0; t < num_chunks; t++) {
+#ifdef WIN64
+    threads[t] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)scan_chunk_thread, (LPVOID)(chunks + t), 0, NULL);
+    if (threads[t] == NULL) {
+      printf("Error %u: CreateThread() for scanning thread %d\n", GetLastError(), t);
+      exit(1);
+    }
+#else
+    error_code = pthread_create(threads + t, NULL, scan_chunk_thread, (void *)(chunks + t));
+    if (error_code) {
+      printf("Error %d: pthread_create() for scanning thread %d\n", error_code, t);
+      exit(1);
+    }
+#endif
+  }
+  for (t = 0; t < num_chunks; t++) {
+#ifdef WIN64
+    WaitForSingleObject(threads[t], INFINITE);
+    CloseHandle(threads[t]);
+#else
+    pthread_join(threads[t], NULL);
+#endif
+  }
+}
+
+
+static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM_FILE_HANDLE dt_handle,
+					   indexing_state_t *states, int num_states, size_t *infile_size) {
   //  --- Called when processing tab separated, non-score-ordered TSV  files ---
   // 1. Memory map fname_forward
   // 2. Scan it and make an array of all the line starts and a parallel array of the scores.  (Keep track of max score.)
@@ -1164,27 +1583,26 @@ static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM
   // 4. Then re-scan the records in that order and index them.
   //
   // Note that the sort method is a "counting sort".  See https://en.wikipedia.org/wiki/Counting_sort
-  docnum_t doccount = 0;
-  long long docoff;
-  double score, raw_score, max_score = 0;
-  u_char *forward, *last, *p, *ep, **recstarts = NULL;
+  double max_score = 0;
+  u_char *forward, *last, *p, **recstarts = NULL;
   byte *dt_buf = NULL;
-  size_t sighs, scanned = 0, trigger_len, dt_buf_used = 0;
+  size_t sighs, dt_buf_used = 0;
   HANDLE FMH;
   CROSS_PLATFORM_FILE_HANDLE FH;
-  int  error_code = 0, s;
-  u_int *scores = NULL, docscore, wds = 0;   // wds in the current record
-  u_ll max_plist_len = 0, igdocs = 0, *score_histo, *permute = NULL, sum = 0,
-    count, r, r_wi_maxscore = 0, recs = 0, dt_ent, qwt, d_signature = 0, pr;
+  int  error_code = 0, s, t, num_chunks = num_states;
+  u_int *scores = NULL;
+  u_ll *histos, *permute = NULL, sum = 0, count, r, r_wi_maxscore = 0, recs = 0;
+  scan_chunk_t chunks[MAX_INDEXING_THREADS];
   double start, verystart;
 
   start = what_time_is_it();
   verystart = start;
 	
-  score_histo = (u_ll *)malloc((DTE_DOCSCORE_MASK2 + 1) * sizeof(u_ll));  // MAL0707   // Needs to be long longs cos all docs might be the same score
-  if (score_histo == NULL) error_exit("malloc of score_histo failed\n");   // OK - on startup
+  // One histogram per chunk.
+  histos = (u_ll *)malloc(num_chunks * (DTE_DOCSCORE_MASK2 + 1) * sizeof(u_ll));  // MAL0707   // Needs to be long longs cos all docs might be the same score
+  if (histos == NULL) error_exit("malloc of score histograms failed\n");   // OK - on startup
 
-  memset(score_histo, 0, (DTE_DOCSCORE_MASK2 + 1) * sizeof(u_ll));
+  memset(histos, 0, num_chunks * (DTE_DOCSCORE_MASK2 + 1) * sizeof(u_ll));
 
   forward = (u_char *)mmap_all_of(fname_forward, &sighs, FALSE, &FH, &FMH, &error_code);
   if (error_code) {
@@ -1198,28 +1616,53 @@ static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM
     printf("\n\nWarning: .forward file is > %.1fGB. Records beyond %.1fGB will not be indexed.\n\n",
 	   max_forward_GB, max_forward_GB);
 
+  // Divide the file into chunks of roughly equal size, each starting just after a newline.
   p = forward;
+  for (t = 0; t < num_chunks; t++) {
+    chunks[t].start = p;
+    chunks[t].last = last;
+    p = forward + (sighs * (t + 1)) / num_chunks;
+    if (p < chunks[t].start) p = chunks[t].start;
+    if (t < num_chunks - 1 && p > forward) {
+      p--;
+      while (p < last && *p != '\n') p++;
+      if (p < last) p++;
+    }
+    chunks[t].limit = p;
+    chunks[t].histo = histos + t * (DTE_DOCSCORE_MASK2 + 1);
+  }
+  
   // First loop: Count the number of records and find the maximum score
-  do {
-    if (0) printf("Record %llu.  %zu out of %zu\n", recs + 1, scanned, sighs);
+  run_scan_pass(chunks, num_chunks, 1);
+
+  // A record lacking a TAB can run on past the end of its chunk.  If that happens, the 
+  // following chunk is rescanned from where the record actually ended.
+  for (t = 1; t < num_chunks; t++) {
+    if (chunks[t].start != chunks[t - 1].end) {
+      chunks[t].start = chunks[t - 1].end;
+      scan_chunk_for_max_score(chunks + t);
+    }
+  }
 
-    while (p < last && *p != '\t') p++;  // Skip the trigger
-    p++;
-    score = strtod((char *)p, (char **)&ep);
-    if (score > max_score) { 
-      max_score = score; 
-      r_wi_maxscore = recs;
+  for (t = 0; t < num_chunks; t++) {
+    chunks[t].first_rec = recs;
+    if (chunks[t].max_score > max_score) {
+      max_score = chunks[t].max_score;
+      r_wi_maxscore = recs + chunks[t].r_wi_maxscore;
     }
-    p = ep;
-    while (p < last && *p != '\n') p++;  // Skip to end of record.
-    p++;
-    scanned = p - forward;
-    recs++;
-  } while (p < last);
+    recs += chunks[t].recs;
+  }
 
   printf("Sorted-scan first pass elapsed time %.1f sec.\n", what_time_is_it() - start);
   printf("Records scanned: %lld\nMax score: %.3f\n", recs, max_score);
-  log_max_score = log(max_score);
+  // Scores are quantized relative to max_raw_score, which is recorded in the .if header.  It's
+  // normally the max score in the collection, but a delta index must be built with the value
+  // recorded for its main index, so that the static scores in the two are comparable.
+  if (max_raw_score == UNDEFINED_DOUBLE) max_raw_score = max_score;
+  else if (max_score > max_raw_score)
+    printf("Warning: Max score exceeds max_raw_score (%.3f).  Higher scores will be quantized as if equal to it.\n",
+	   max_raw_score);
+  log_max_score = log(max_raw_score);
 
   fflush(stdout);  // Next stage might take ages.  Make sure to show where we're up to
 
@@ -1234,23 +1677,11 @@ static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM
   // Second loop: Record the startpoints and make a histogram of quantized log_score ratios
   printf("Starting second loop.\n");
   start = what_time_is_it();
-  p = forward;
-  recs = 0;
-  do {
-    // Record start point
-    recstarts[recs] = p;
-    while (p < last && *p != '\t') p++;  // Skip the trigger
-    p++;
-    score = strtod((char *)p, (char **)&ep);
-    docscore = quantize_log_score_ratio(score, log_max_score);
-    score_histo[docscore]++;   // For counting sort.
-    scores[recs] = (u_int)docscore;
-    p = ep;
-    while (p < last && *p != '\n') p++;  // Skip to end of record.
-    p++;
-    scanned = p - forward;
-    recs++;
-  } while (p < last);
+  for (t = 0; t < num_chunks; t++) {
+    chunks[t].recstarts = recstarts;
+    chunks[t].scores = scores;
+  }
+  run_scan_pass(chunks, num_chunks, 2);
 
 #ifdef WIN64
   printf("Sorted-scan second pass elapsed time %.1f sec.\n", what_time_is_it() - start);
@@ -1259,23 +1690,26 @@ static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM
   printf("The record with max score is number %llu: ", r_wi_maxscore);
   show_string_upto_nator(recstarts[r_wi_maxscore], '\t', 0);
 
-  if (max_score < 1) { 
+  if (max_raw_score < 1) { 
     printf("Warning: Max value in column 2 less than 1.  Taking action to avoid negative log."); 
     log_max_score = 1;
   }
-  else log_max_score = log((double)max_score);
+  else log_max_score = log(max_raw_score);
 
   fflush(stdout);
-  // Turn the histogram into a sort of cumulative one, where the value in
-  // score_histo[r] records the sum of all the values greater than r, and 
-  // indicates the position of the first occurrence of r in the final scan.
+  // Turn the histograms into a sort of cumulative one, where the value in
+  // chunks[t].histo[r] records the number of records whose value is greater than r,
+  // plus the number of records with value r in earlier chunks.  It 
+  // indicates the position of chunk t's first occurrence of r in the final scan.
   // NOTE: we want descending order
 
   sum = 0;
   for (s = (int) DTE_DOCSCORE_MASK2; s >= 0;  s--) {
-    count = score_histo[s];
-    score_histo[s] = sum;
-    sum += count;
+    for (t = 0; t < num_chunks; t++) {
+      count = chunks[t].histo[s];
+      chunks[t].histo[s] = sum;
+      sum += count;
+    }
   }
 
   printf("Sum = %llu, Recs = %llu\n", sum, recs);
@@ -1285,16 +1719,10 @@ static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM
   for (r = 0; r < recs; r++) {
     permute[r] = -1;  // To enable detection of errors.   I hope this is OK because permute[r] is unsigned
   } 
-  // Third loop: Permute the recstarts array.
+  // Third loop: Permute the recstarts array.  Each chunk fills its own positions.
   start = what_time_is_it();
-  for (r = 0; r < recs; r++) {
-    u_int val;
-    u_ll pos;
-    val = scores[r];
-    pos = score_histo[val];
-    permute[pos] = r;
-    score_histo[val]++;   // A new spot for the next occurrence of val
-  }
+  for (t = 0; t < num_chunks; t++) chunks[t].permute = permute;
+  run_scan_pass(chunks, num_chunks, 3);
 
 
   printf("Sorted-scan third pass elapsed time %.1f sec.\n", what_time_is_it() - start);
@@ -1312,66 +1740,86 @@ static void process_records_in_score_order(u_char *fname_forward, CROSS_PLATFORM
   free((void *)scores);    // FRE101
   scores = NULL;
 
-  // Allocate large in-memory structures based on the actual document count.
-  allocate_hashtable_and_heap((docnum_t)recs);
-
-  // Fourth loop: Do the business in permuted order
+  // Fourth pass: Do the business in permuted order
   start = what_time_is_it();
-  for (r = 0; r < recs; r++) {
-    if (debug >= 2) printf("indexing record %lld\n", r);
-    pr = permute[r];
-    p = recstarts[pr];
-    if (*p < ' ') continue;   // This line is empty, will be ignored.
-    if (min_wds > 0 || max_wds > 0) {
-      // Only do this counting  if limits are being imposed.
-      wds = count_wds_in_trigger(p);  // Returns -1 in case of error
-      if (wds < min_wds || wds > max_wds) {
-	igdocs++;
-	continue;
-      }
-    } 
-    docoff = recstarts[pr] - forward;
-    raw_score = split_and_index_record(recstarts[pr], doccount, &max_plist_len, ll_heap, &d_signature, 
-				       &wds, &trigger_len);
-    if (wds > 0 && raw_score >= score_threshold) {
-      // We ignore records with scores below the frequency threshold and those which have no
-      // indexable words.
+  if (num_states == 1) {
+    // Allocate large in-memory structures based on the actual document count.
+    allocate_hashtable_and_heap(states, (docnum_t)recs);
+    states->forward = forward;
+    states->recstarts = recstarts;
+    states->permute = permute;
+    states->first_rec = 0;
+    states->last_rec = recs;
+    index_permuted_records(states, dt_handle, &dt_buf, &dt_buf_used);
+  }
+  else {
+    // Each thread indexes a contiguous slice of the permuted records into its own hash table and
+    // DOH, numbering documents from zero.  Once they've all finished, their doctable entries are written
+    // in slice order and each partial index is told the docnum of its first document, so that 
+    // docnums come out exactly as they would from serial indexing.
+    docnum_t next_docnum = 0;
+    u_ll slice = (recs + num_states - 1) / num_states, e;
+#ifdef WIN64
+    HANDLE threads[MAX_INDEXING_THREADS];
+#else
+    pthread_t threads[MAX_INDEXING_THREADS];
+#endif
 
-      if ((u_ll)docoff > DTE_DOCOFF_MASK2) {
-	igdocs++;
-	continue;   // ----------------------------------------------->
+    for (t = 0; t < num_states; t++) {
+      states[t].forward = forward;
+      states[t].recstarts = recstarts;
+      states[t].permute = permute;
+      states[t].first_rec = t * slice;
+      if (states[t].first_rec > recs) states[t].first_rec = recs;
+      states[t].last_rec = states[t].first_rec + slice;
+      if (states[t].last_rec > recs) states[t].last_rec = recs;
+      states[t].dt_entries = (u_ll *)malloc((states[t].last_rec - states[t].first_rec + 1) * sizeof(u_ll));  // MAL103
+      if (states[t].dt_entries == NULL) error_exit("Malloc of dt_entries failed");
+#ifdef WIN64
+      threads[t] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)index_records_thread, (LPVOID)(states + t), 0, NULL);
+      if (threads[t] == NULL) {
+	printf("Error %u: CreateThread() for indexing thread %d\n", GetLastError(), t);
+	exit(1);
       }
+#else
+      error_code = pthread_create(threads + t, NULL, index_records_thread, (void *)(states + t));
+      if (error_code) {
+	printf("Error %d: pthread_create() for indexing thread %d\n", error_code, t);
+	exit(1);
+      }
+#endif
+    }
+    printf("%d indexing threads started, each with up to %llu records.\n", num_states, slice);
+    fflush(stdout);
 
-
-      qwt = (u_ll)quantize_log_score_ratio((double)raw_score, (double)log_max_score);
-      dt_ent = docoff << DTE_DOCOFF_SHIFT;
-      if (wds > DTE_WDCNT_MASK) wds = (int)DTE_WDCNT_MASK;
-      dt_ent |= (wds & DTE_WDCNT_MASK);
-      dt_ent |= ((qwt & DTE_DOCSCORE_MASK2) << DTE_DOCSCORE_SHIFT);
-      dt_ent |= ((d_signature & DTE_DOCBLOOM_MASK2) << DTE_DOCBLOOM_SHIFT);
-      if (!x_minimize_io) buffered_write(dt_handle, &dt_buf, HUGEBUFSIZE, &dt_buf_used, (byte *)&dt_ent, sizeof(dt_ent), (char *)"doctable entry");
-      doccount++;
-
-      if (doccount % 10000 == 0) {
-	printf("%11lld\n", doccount);
+    for (t = 0; t < num_states; t++) {
 #ifdef WIN64
-	report_memory_usage(stdout, (u_char *)"permuted scanning", NULL);
+      WaitForSingleObject(threads[t], INFINITE);
+      CloseHandle(threads[t]);
+#else
+      pthread_join(threads[t], NULL);
 #endif
+      states[t].pix.first_docnum = next_docnum;
+      if (!x_minimize_io) {
+	for (e = 0; e < (u_ll)states[t].doccount; e++) 
+	  buffered_write(dt_handle, &dt_buf, HUGEBUFSIZE, &dt_buf_used, (byte *)(states[t].dt_entries + e),
+			 sizeof(u_ll), (char *)"doctable entry");
       }
+      printf("Indexing thread %d: %lld documents from docnum %lld, %zu distinct words.\n",
+	     t, states[t].doccount, next_docnum, states[t].pix.ht->entries_used);
+      next_docnum += states[t].doccount;
+      free(states[t].dt_entries);   // FRE103
+      states[t].dt_entries = NULL;
     }
-    else igdocs++;
   }
 
   printf("Sorted-scan fourth pass elapsed time %.1f sec.\n", what_time_is_it() - start);
 
   free((void *)permute);    // FRE102
   free((void *)recstarts);  // FRE100
-  free((void *)score_histo); // FRE0707
+  free((void *)histos); // FRE0707
   if (!x_minimize_io) buffered_flush(dt_handle, &dt_buf, &dt_buf_used, ".doctable", TRUE); // Frees the buffer and closes the handle
   unmmap_all_of(forward, FH, FMH, sighs);
-  *gdoccount = doccount;
-  *gmax_plist_len = max_plist_len;
-  *ignored_docs = igdocs;
 
   msec_elapsed_list_building = (what_time_is_it() - verystart) * 1000.0;
   printf("Sorted-scan overall elapsed time %.1f sec.\n", msec_elapsed_list_building / 1000.0);
@@ -1504,10 +1952,383 @@ static u_char *get_line(buffer_queue_t *bq, u_char **linebuf, size_t linebufsize
 #endif
 
 
+static u_ll file_order_dt_entry(long long docoff, double raw_score, u_int wds, u_ll d_signature) {
+  // Build the doctable entry for a record indexed in file order.
+  u_ll dt_ent, qwt;
+  qwt = quantize_log_score_ratio(raw_score, log_max_score);
+  dt_ent = docoff << DTE_DOCOFF_SHIFT;
+  if (wds > DTE_WDCNT_MAX) wds = DTE_WDCNT_MAX;  // To cope with reduced DTE_WDCNT_BITS in version 1.3 indexes
+  dt_ent |= (wds & DTE_WDCNT_MASK);
+  dt_ent |= ((qwt & DTE_DOCSCORE_MASK2) << DTE_DOCSCORE_SHIFT);
+  dt_ent |= ((d_signature & DTE_DOCBLOOM_MASK2) << DTE_DOCBLOOM_SHIFT);
+  return dt_ent;
+}
+
+
+#ifndef WIN64
+// Read-ahead pipeline for indexing in file order without mmapping, used if x_tokenizing_threads > 0.
+//
+//   reader -> record splitter -> x_tokenizing_threads tokenizers -> ordered inverter
+//
+// The reader is fill_buffers() from input_buffer_management.c, filling a ring of large I/O 
+// buffers.  The splitter cuts the buffers into records exactly as fgets() into a buffer of 
+// MAX_LINE + 1 bytes would, and packs them into batches.  Each tokenizer takes the next batch and
+// runs split_and_index_record() on its records as usual, but with deferred_words set in its 
+// private indexing state, so that process_a_word_internal() saves each case-folded word and its
+// word position in the batch rather than indexing it.  The main thread takes the tokenized batches
+// in file order, assigns docnums, adds the saved words to the hash table and writes the doctable.
+// Hash table updates therefore occur in exactly the same order as in the serial loop, and the 
+// index is identical.   I/O and tokenizing overlap with hash table updates.
+
+#define PIPELINE_BATCH_RECS 4096
+#define PIPELINE_BATCH_TEXT 1048576   // A batch is passed on once it contains this many bytes of records.
+
+#define BATCH_EMPTY 0
+#define BATCH_SPLIT 1
+#define BATCH_TOKENIZING 2
+#define BATCH_TOKENIZED 3
+
+typedef struct {
+  size_t text_off;      // Where the null-terminated record starts in the batch's text
+  size_t bytes_read;    // What strlen() of the fgets() buffer would have returned
+  size_t words_end;     // Offset in the batch's deferred words just after this record's words
+  double raw_score;
+  u_ll d_signature;
+  u_int wds;
+  BOOL ignored, truncated, incompletely_indexed;
+} pipeline_record_t;
+
+typedef struct {
+  int state, num_recs;
+  BOOL last;            // No more batches follow this one
+  pipeline_record_t *recs;
+  u_char *text;
+  size_t text_used;
+  deferred_words_t words;
+} record_batch_t;
+
+typedef struct {
+  buffer_queue_t *bq;
+  record_batch_t *batches;
+  int num_batches;        // Batch number n is held in batches[n % num_batches]
+  u_ll batches_split, batches_claimed;
+  BOOL splitting_finished, abort;
+  u_int min_wds, max_wds;
+  pthread_mutex_t lock;   // Protects everything above except the contents of batches being worked on
+  pthread_cond_t changed; // Broadcast whenever anything protected by lock changes
+} pipeline_t;
+
+typedef struct {
+  pipeline_t *pl;
+  indexing_state_t ixs;   // Private state, used only for tokenizing
+} tokenizer_t;
+
+
+static record_batch_t *claim_empty_batch(pipeline_t *pl) {
+  // Called by the splitter.  Wait for the next batch in the ring to be emptied by the inverter.
+  // Returns NULL if the pipeline is being shut down.
+  record_batch_t *batch;
+  BOOL aborted;
+  pthread_mutex_lock(&pl->lock);
+  batch = pl->batches + (pl->batches_split % pl->num_batches);
+  while (batch->state != BATCH_EMPTY && !pl->abort) pthread_cond_wait(&pl->changed, &pl->lock);
+  aborted = pl->abort;
+  pthread_mutex_unlock(&pl->lock);
+  if (aborted) return NULL;   // ----------------------------------->
+  batch->num_recs = 0;
+  batch->text_used = 0;
+  batch->words.used = 0;
+  batch->last = FALSE;
+  return batch;
+}
+
+
+static void pass_on_batch(pipeline_t *pl, record_batch_t *batch, BOOL last) {
+  pthread_mutex_lock(&pl->lock);
+  batch->last = last;
+  batch->state = BATCH_SPLIT;
+  pl->batches_split++;
+  if (last) pl->splitting_finished = TRUE;
+  pthread_cond_broadcast(&pl->changed);
+  pthread_mutex_unlock(&pl->lock);
+}
+
+
+static record_batch_t *end_record(pipeline_t *pl, record_batch_t *batch, size_t len) {
+  // The splitter has copied len bytes of a record to the end of batch's text.  Terminate it, and 
+  // pass the batch on if it's full.  Returns the batch to use for the next record, or NULL if
+  // the pipeline is being shut down.
+  pipeline_record_t *rec = batch->recs + batch->num_recs++;
+  rec->text_off = batch->text_used;
+  batch->text[batch->text_used + len] = 0;
+  rec->bytes_read = strlen((char *)batch->text + batch->text_used);
+  batch->text_used += len + 1;
+  if (batch->num_recs >= PIPELINE_BATCH_RECS || batch->text_used >= PIPELINE_BATCH_TEXT) {
+    pass_on_batch(pl, batch, FALSE);
+    batch = claim_empty_batch(pl);
+  }
+  return batch;
+}
+
+
+static void *split_records_thread(void *arg) {
+  // Body of the splitter thread.  Records may span I/O buffers.  A record ends after a linefeed
+  // or after MAX_LINE bytes, whichever comes first.
+  pipeline_t *pl = (pipeline_t *)arg;
+  buffer_queue_t *bq = pl->bq;
+  record_batch_t *batch;
+  u_char *src, *src_end, *nl;
+  size_t line_len = 0, take;
+  int b;
+  BOOL eof;
+
+  batch = claim_empty_batch(pl);
+  if (batch == NULL) return NULL;   // ----------------------------------->
+  while (1) {
+    b = bq->buf2empty;
+    acquire_lock_on_state_of(bq, (byte *)"splitter A");
+    while (bq->buffer_state[b] != BUF_FULL && bq->buffer_state[b] != BUF_EOF && !bq->reading_aborted)
+      wait_for_change_in_state_of(bq);
+    eof = (bq->buffer_state[b] != BUF_FULL);
+    release_lock_on_state_of(bq, (byte *)"splitter A");
+    if (eof) break;
+
+    src = bq->buffers[b];
+    src_end = src + bq->bytes_in_buffer[b];
+    while (src < src_end) {
+      take = MAX_LINE - line_len;
+      if (take > (size_t)(src_end - src)) take = src_end - src;
+      nl = (u_char *)memchr(src, '\n', take);
+      if (nl != NULL) take = nl + 1 - src;
+      memcpy(batch->text + batch->text_used + line_len, src, take);
+      line_len += take;
+      src += take;
+      if (nl != NULL || line_len == MAX_LINE) {
+	batch = end_record(pl, batch, line_len);
+	if (batch == NULL) return NULL;   // ----------------------------------->
+	line_len = 0;
+      }
+    }
+
+    acquire_lock_on_state_of(bq, (byte *)"splitter B");
+    bq->buffer_state[b] = BUF_EMPTY;  // Make this buffer available for filling
+    bq->buf2empty = (b + 1) % bq->queue_depth;  // Move onto next buffer in the ring.
+    signal_change_in_state_of(bq);
+    release_lock_on_state_of(bq, (byte *)"splitter B");
+  }
+
+  if (line_len > 0) {
+    // The file doesn't end with a linefeed.
+    batch = end_record(pl, batch, line_len);
+    if (batch == NULL) return NULL;   // ----------------------------------->
+  }
+  pass_on_batch(pl, batch, TRUE);
+  return NULL;
+}
+
+
+static void tokenize_batch(record_batch_t *batch, indexing_state_t *ixs, u_int min_wds, u_int max_wds) {
+  // Do everything the serial loop in process_records_in_file_order() does with each record, apart
+  // from what depends upon the docnum.
+  pipeline_record_t *rec;
+  u_char *p;
+  size_t trigger_len;
+  int r;
+
+  ixs->deferred_words = &(batch->words);
+  for (r = 0; r < batch->num_recs; r++) {
+    rec = batch->recs + r;
+    p = batch->text + rec->text_off;
+    rec->ignored = FALSE;
+    rec->truncated = FALSE;
+    rec->incompletely_indexed = FALSE;
+    rec->wds = 0;
+    rec->raw_score = 0;
+    if (*p < ' ') rec->ignored = TRUE;   // This line is empty, will be ignored.
+    else if (min_wds > 0 || max_wds > 0) {
+      rec->wds = count_wds_in_trigger(p);
+      if (rec->wds < min_wds || rec->wds > max_wds) rec->ignored = TRUE;
+    }
+    if (!rec->ignored) {
+      ixs->last_trigger_incompletely_indexed = FALSE;
+      rec->raw_score = split_and_index_record(p, 0, ixs, &(rec->d_signature), &(rec->wds), &trigger_len);
+      rec->truncated = ixs->this_trigger_was_truncated;
+      rec->incompletely_indexed = ixs->last_trigger_incompletely_indexed;
+    }
+    rec->words_end = batch->words.used;
+  }
+}
+
+
+static void *tokenize_records_thread(void *arg) {
+  // Body of a tokenizer thread.  Tokenize batches, in whatever order they become available.
+  tokenizer_t *tok = (tokenizer_t *)arg;
+  pipeline_t *pl = tok->pl;
+  record_batch_t *batch;
+
+  while (1) {
+    pthread_mutex_lock(&pl->lock);
+    while (!pl->abort && pl->batches_claimed == pl->batches_split && !pl->splitting_finished)
+      pthread_cond_wait(&pl->changed, &pl->lock);
+    if (pl->abort || pl->batches_claimed == pl->batches_split) {
+      pthread_mutex_unlock(&pl->lock);
+      break;  // ----------------------------------->
+    }
+    batch = pl->batches + (pl->batches_claimed % pl->num_batches);
+    pl->batches_claimed++;
+    batch->state = BATCH_TOKENIZING;
+    pthread_mutex_unlock(&pl->lock);
+
+    tokenize_batch(batch, &(tok->ixs), pl->min_wds, pl->max_wds);
+
+    pthread_mutex_lock(&pl->lock);
+    batch->state = BATCH_TOKENIZED;
+    pthread_cond_broadcast(&pl->changed);
+    pthread_mutex_unlock(&pl->lock);
+  }
+  return NULL;
+}
+
+
+static void index_records_through_pipeline(buffer_queue_t *bq, CROSS_PLATFORM_FILE_HANDLE dt_handle,
+					   byte **dt_buf, size_t *dt_buf_used, indexing_state_t *ixs,
+					   docnum_t max_docs, u_int min_wds, u_int max_wds,
+					   docnum_t *doccount_out, u_ll *igdocs_out) {
+  // The ordered inverter, run by the main thread.  It starts and finishes all the other threads.
+  pipeline_t pl;
+  tokenizer_t *tokenizers;
+  pthread_t reader, splitter, tokenizer_threads[MAX_INDEXING_THREADS];
+  record_batch_t *batch;
+  pipeline_record_t *rec;
+  docnum_t doccount = 0;
+  long long docoff = 0;
+  size_t w, len;
+  u_ll igdocs = 0, batch_num = 0, dt_ent;
+  int t, r, error_code;
+  BOOL finished = FALSE;
+
+  memset(&pl, 0, sizeof(pl));
+  pl.bq = bq;
+  pl.min_wds = min_wds;
+  pl.max_wds = max_wds;
+  pl.num_batches = 2 * x_tokenizing_threads + 2;
+  pl.batches = (record_batch_t *)malloc(pl.num_batches * sizeof(record_batch_t));
+  tokenizers = (tokenizer_t *)malloc(x_tokenizing_threads * sizeof(tokenizer_t));
+  if (pl.batches == NULL || tokenizers == NULL) error_exit("Malloc failed for file order pipeline\n");
+  memset(pl.batches, 0, pl.num_batches * sizeof(record_batch_t));
+  for (t = 0; t < pl.num_batches; t++) {
+    pl.batches[t].state = BATCH_EMPTY;
+    pl.batches[t].recs = (pipeline_record_t *)malloc(PIPELINE_BATCH_RECS * sizeof(pipeline_record_t));
+    pl.batches[t].text = (u_char *)malloc(PIPELINE_BATCH_TEXT + MAX_LINE + 1);
+    if (pl.batches[t].recs == NULL || pl.batches[t].text == NULL) error_exit("Malloc failed for pipeline batch\n");
+  }
+  pthread_mutex_init(&pl.lock, NULL);
+  pthread_cond_init(&pl.changed, NULL);
+
+  error_code = pthread_create(&reader, NULL, fill_buffers, (void *)bq);
+  if (!error_code) error_code = pthread_create(&splitter, NULL, split_records_thread, (void *)&pl);
+  for (t = 0; t < x_tokenizing_threads && !error_code; t++) {
+    memset(tokenizers + t, 0, sizeof(tokenizer_t));
+    tokenizers[t].pl = &pl;
+    tokenizers[t].ixs.cpybuf = (u_char *)malloc(CPYBUF_SIZE + 1);
+    if (tokenizers[t].ixs.cpybuf == NULL) error_exit("Malloc failed for cpybuf\n");
+    error_code = pthread_create(tokenizer_threads + t, NULL, tokenize_records_thread, (void *)(tokenizers + t));
+  }
+  if (error_code) {
+    printf("Error %d: pthread_create() for file order pipeline\n", error_code);
+    exit(1);
+  }
+  printf("Buffer-queue of %d x %u created.  Reader, splitter and %d tokenizing threads started.\n\n",
+	 IBM_BUFFERS_IN_RING, IBM_IOBUFSIZE, x_tokenizing_threads);
+
+  while (!finished) {
+    batch = pl.batches + (batch_num % pl.num_batches);
+    pthread_mutex_lock(&pl.lock);
+    while (batch->state != BATCH_TOKENIZED) pthread_cond_wait(&pl.changed, &pl.lock);
+    pthread_mutex_unlock(&pl.lock);
+
+    w = 0;
+    for (r = 0; r < batch->num_recs; r++) {
+      rec = batch->recs + r;
+      if (rec->ignored) {
+	igdocs++;
+	docoff += rec->bytes_read;
+	continue;   // ------------------------------------------------------>
+      }
+      // Account for the record as split_and_index_record() would have done, and index its words.
+      if (rec->truncated) ixs->truncated_docs++;
+      if (rec->raw_score >= score_threshold) {
+	record_trigger_stats(ixs, rec->wds, rec->incompletely_indexed);
+	if (rec->wds <= 0) ixs->empty_docs++;
+	while (w < rec->words_end) {
+	  len = strlen((char *)batch->words.bytes + w + 1);  // Before add_posting_for_word() can truncate it.
+	  add_posting_for_word(batch->words.bytes + w + 1, doccount, batch->words.bytes[w], ixs);
+	  w += len + 2;
+	}
+      }
+      w = rec->words_end;
+
+      if (rec->wds > 0 && rec->raw_score >= score_threshold) {
+	if ((unsigned long long)docoff > DTE_DOCOFF_MASK2) {
+	  igdocs++;
+	  docoff += rec->bytes_read;
+	  continue;   // ----------------------------------------------->
+	}
+	dt_ent = file_order_dt_entry(docoff, rec->raw_score, rec->wds, rec->d_signature);
+	if (!x_minimize_io) buffered_write(dt_handle, dt_buf, HUGEBUFSIZE, dt_buf_used, (byte *)&dt_ent, sizeof(dt_ent), "doctable entry");
+	doccount++;
+	if (doccount % 10000 == 0) printf("%11lld\n", doccount);
+	if (doccount >= max_docs) {
+	  finished = TRUE;
+	  break;   // ----------------------------------------------->
+	}
+      }
+      else igdocs++;
+      docoff += rec->bytes_read;
+    }
+    if (batch->last) finished = TRUE;
+
+    pthread_mutex_lock(&pl.lock);
+    batch->state = BATCH_EMPTY;
+    pthread_cond_broadcast(&pl.changed);
+    pthread_mutex_unlock(&pl.lock);
+    batch_num++;
+  }
+
+  // Shut everything down.  If we stopped early, the other threads may be waiting for us.
+  pthread_mutex_lock(&pl.lock);
+  pl.abort = TRUE;
+  pthread_cond_broadcast(&pl.changed);
+  pthread_mutex_unlock(&pl.lock);
+  acquire_lock_on_state_of(bq, (byte *)"wrapping up");
+  bq->reading_aborted = TRUE;
+  signal_change_in_state_of(bq);
+  release_lock_on_state_of(bq, (byte *)"wrapping up");
+  pthread_join(splitter, NULL);
+  for (t = 0; t < x_tokenizing_threads; t++) {
+    pthread_join(tokenizer_threads[t], NULL);
+    free(tokenizers[t].ixs.cpybuf);
+  }
+  pthread_join(reader, NULL);
+
+  for (t = 0; t < pl.num_batches; t++) {
+    free(pl.batches[t].recs);
+    free(pl.batches[t].text);
+    free(pl.batches[t].words.bytes);
+  }
+  free(pl.batches);
+  free(tokenizers);
+  pthread_mutex_destroy(&pl.lock);
+  pthread_cond_destroy(&pl.changed);
+  *doccount_out = doccount;
+  *igdocs_out = igdocs;
+}
+#endif
+
+
 static void process_records_in_file_order(u_char *fname_forward, CROSS_PLATFORM_FILE_HANDLE dt_handle,
-					  dahash_table_t *word_table, docnum_t max_docs, u_int min_wds,
-					  u_int max_wds, docnum_t *ignored_docs, docnum_t *gdoccount,
-					  u_ll *gmax_plist_len, size_t *infile_size) {
+					  indexing_state_t *ixs, docnum_t max_docs, u_int min_wds,
+					  u_int max_wds, size_t *infile_size) {
   //  --- Called when processing tab separated, frequency-ordered or frequency-lacking TSV  files ---
   // 1. Memory map fname_forward  OR open for reading using get_line() (above).....  
   // 2. Scan the records in file order and index them.
@@ -1521,13 +2342,14 @@ static void process_records_in_file_order(u_char *fname_forward, CROSS_PLATFORM_
   HANDLE FMH = NULL;
   double start;
   int error_code;
-  u_ll max_plist_len = 0, igdocs = 0, estimated_doccount;
-  u_int wds = 0, qwt;
+  u_ll igdocs = 0, estimated_doccount;
+  u_int wds = 0;
   unsigned long long dt_ent, d_signature;
+  BOOL use_pipeline = FALSE;
+  buffer_queue_t *buffer_queue = NULL;
 #ifdef WIN64
   u_char *fwdbuf = NULL, *linebuf = NULL;
   size_t linebufsize = MAX_LINE;
-  buffer_queue_t *buffer_queue = NULL;
   HANDLE buffer_filler_thread = NULL;
   FH = NULL;
 #else
@@ -1590,26 +2412,44 @@ static void process_records_in_file_order(u_char *fname_forward, CROSS_PLATFORM_
     printf("Buffer-queue of %d x %u created, and buffer-filler thread started.\n\n", IBM_BUFFERS_IN_RING, IBM_IOBUFSIZE);
     Sleep(10);  // Give the filler a chance to start up.
 #else
-    FORWARD = fopen((char *)fname_forward, "rb");
-    if (FORWARD == NULL) {
-      printf("Error: failed to fopen %s\n", fname_forward);
-      exit(1);
+    if (x_tokenizing_threads > 0) {
+      // Records will be read, split and tokenized by other threads.  See index_records_through_pipeline()
+      use_pipeline = TRUE;
+      buffer_queue = create_a_buffer_queue(IBM_BUFFERS_IN_RING, IBM_IOBUFSIZE);  // function will exit if it can't create the queue
+      buffer_queue->infile = open((char *)fname_forward, O_RDONLY);
+      if (buffer_queue->infile < 0) {
+	printf("Error: failed to open %s\n", fname_forward);
+	exit(1);
+      }
+      estimated_doccount = estimate_lines_in_textfile(buffer_queue->infile, *infile_size, 5);
+    } else {
+      FORWARD = fopen((char *)fname_forward, "rb");
+      if (FORWARD == NULL) {
+	printf("Error: failed to fopen %s\n", fname_forward);
+	exit(1);
+      }
+      if (0) printf("File %s opened for indexing.\n", fname_forward);
+      estimated_doccount = estimate_lines_in_textfile(fileno(FORWARD), *infile_size, 5);
     }
-    if (0) printf("File %s opened for indexing.\n", fname_forward);
-    estimated_doccount = estimate_lines_in_textfile(fileno(FORWARD), *infile_size, 5);
     printf("\nEstimated number of records in .forward file (length %zu): %llu\n\n",
 	   *infile_size, estimated_doccount);
 #endif
   }
 
 	
-  allocate_hashtable_and_heap(estimated_doccount);
+  allocate_hashtable_and_heap(ixs, estimated_doccount);
 
 
   start = what_time_is_it();
 
-  // Loop over all the records in sequence and index the triggers.
-  do {
+  if (use_pipeline) {
+#ifndef WIN64
+    index_records_through_pipeline(buffer_queue, dt_handle, &dt_buf, &dt_buf_used, ixs, max_docs, min_wds, max_wds,
+				   &doccount, &igdocs);
+#endif
+  }
+  // Otherwise, loop over all the records in sequence and index the triggers.
+  else do {
     if (x_fileorder_use_mmap) {
       docoff = p - forward;
     } 
@@ -1639,7 +2479,7 @@ static void process_records_in_file_order(u_char *fname_forward, CROSS_PLATFORM_
 	continue;    // ------------------------------------------------------>
       }
     }
-    raw_score = split_and_index_record(p, doccount, &max_plist_len, ll_heap, &d_signature, 
+    raw_score = split_and_index_record(p, doccount, ixs, &d_signature, 
 				       &wds, &trigger_len);
     if (wds > 0 && raw_score >= score_threshold) {
       // We ignore suggestions with scores below the frequency threshold.
@@ -1650,12 +2490,7 @@ static void process_records_in_file_order(u_char *fname_forward, CROSS_PLATFORM_
 	continue;   // ----------------------------------------------->
       }
 
-      qwt = quantize_log_score_ratio(raw_score, log_max_score);
-      dt_ent = docoff << DTE_DOCOFF_SHIFT;
-      if (wds > DTE_WDCNT_MAX) wds = DTE_WDCNT_MAX;  // To cope with reduced DTE_WDCNT_BITS in version 1.3 indexes
-      dt_ent |= (wds & DTE_WDCNT_MASK);
-      dt_ent |= ((qwt & DTE_DOCSCORE_MASK2) << DTE_DOCSCORE_SHIFT);
-      dt_ent |= ((d_signature & DTE_DOCBLOOM_MASK2) << DTE_DOCBLOOM_SHIFT);
+      dt_ent = file_order_dt_entry(docoff, raw_score, wds, d_signature);
       if (!x_minimize_io) buffered_write(dt_handle, &dt_buf, HUGEBUFSIZE, &dt_buf_used, (byte *)&dt_ent, sizeof(dt_ent), "doctable entry");
 
       doccount++;
@@ -1695,8 +2530,7 @@ static void process_records_in_file_order(u_char *fname_forward, CROSS_PLATFORM_
     Sleep(15);  // Give the buffer-filler a chance to wind up.  Delay is in milliseconds
     if (0) printf("Wrapped up!\n");
 #else
-    fclose(FORWARD);
-    free(fgetsbuf);
+    if (FORWARD != NULL) fclose(FORWARD);
 #endif
   }
 
@@ -1706,15 +2540,12 @@ static void process_records_in_file_order(u_char *fname_forward, CROSS_PLATFORM_
   if (x_fileorder_use_mmap) {
     unmmap_all_of(forward, FH, FMH, *infile_size);
   }
-  else {
-#ifdef WIN64
-    destroy_buffer_queue(&buffer_queue);
+  else if (buffer_queue != NULL) destroy_buffer_queue(&buffer_queue);
+#ifndef WIN64
+  free(fgetsbuf);
 #endif
-		
-  }
-  *gdoccount = doccount;
-  *gmax_plist_len = max_plist_len;
-  *ignored_docs = igdocs;
+  ixs->doccount = doccount;
+  ixs->ignored_docs = igdocs;
 }
 
 
@@ -1775,7 +2606,8 @@ static void print_version_and_option_settings() {
   }
 
   if (x_hashbits) printf("Initial hashbits explicitly set to %d.\n", x_hashbits);
-  if (x_hashprobe) printf("Hashtable collisions handled by linear probing.\n");
+  if (x_hashprobe == DAHASH_PROBE_GROUPS) printf("Hashtable collisions handled by probing groups of hash fingerprints.\n");
+  else if (x_hashprobe) printf("Hashtable collisions handled by linear probing.\n");
   else printf("Hashtable collisions handled by relatively prime rehash.\n");
   if (x_minimize_io) printf("Ths run is useful for timing purposes only.  Index files will not be written\n");
   if (x_use_large_pages) printf("An attempt will be made to make use of VM Large Pages\n");
@@ -1953,13 +2785,58 @@ static void write_doc_length_histo_to_file(double *mean, double *stdev) {
 	 highest, *mean, *stdev, tot_postings);
 }
 
+static void create_indexing_states(int how_many) {
+  // Set up the per-thread indexing state.  Hash tables and heaps are allocated later,
+  // when there's a better idea of how many records each state will index.
+  int t;
+  indexing_states = (indexing_state_t *)malloc(how_many * sizeof(indexing_state_t));
+  if (indexing_states == NULL) error_exit("Malloc failed for indexing_states\n");
+  memset(indexing_states, 0, how_many * sizeof(indexing_state_t));
+  num_indexing_states = how_many;
+  for (t = 0; t < how_many; t++) {
+    indexing_states[t].cpybuf = (u_char *)malloc(CPYBUF_SIZE + 1);
+    if (indexing_states[t].cpybuf == NULL) error_exit("Malloc failed for cpybuf\n");
+    if (doc_length_histo != NULL) {
+      indexing_states[t].doc_length_histo = (u_ll *)malloc((MAX_WDS_INDEXED_PER_DOC + 2) * sizeof(u_ll));
+      if (indexing_states[t].doc_length_histo == NULL) error_exit("Malloc failed for per-thread doc_length_histo\n");
+      memset(indexing_states[t].doc_length_histo, 0, (MAX_WDS_INDEXED_PER_DOC + 2) * sizeof(u_ll));
+    }
+  }
+}
+
+
+static void add_up_indexing_states() {
+  // Add the counts from all the indexing states into the globals used for reporting, and 
+  // free the buffers which are no longer needed.
+  int t, l;
+  indexing_state_t *ixs;
+  for (t = 0; t < num_indexing_states; t++) {
+    ixs = indexing_states + t;
+    doccount += ixs->doccount;
+    ignored_docs += ixs->ignored_docs;
+    truncated_docs += ixs->truncated_docs;
+    incompletely_indexed_docs += ixs->incompletely_indexed_docs;
+    empty_docs += ixs->empty_docs;
+    tot_postings += ixs->tot_postings;
+    if (ixs->doc_length_histo != NULL) {
+      for (l = 0; l < MAX_WDS_INDEXED_PER_DOC + 2; l++) doc_length_histo[l] += ixs->doc_length_histo[l];
+      free(ixs->doc_length_histo);
+      ixs->doc_length_histo = NULL;
+    }
+    free(ixs->cpybuf);
+    ixs->cpybuf = NULL;
+  }
+}
+
+
 int main(int argc, char **argv) {
 
   double total_index_size = 0.0, doclen_mean = 0.0, doclen_stdev = 0.0, total_elapsed_time;
   int a;
   size_t infile_size = 0, l1, l2;
   u_char *ap, *p;
-  u_ll max_plist_len = 0, word_table_collisions = 0;
+  u_ll max_plist_len = 0, word_table_collisions = 0, partial_vocab_sizes = 0;
+  partial_index_t *pixes;
   double start = 0, wifstart = 0;
 
 
@@ -2028,6 +2905,35 @@ int main(int argc, char **argv) {
     x_max_docs = DFLT_MAX_DOCS;
   }
 
+  if (x_indexing_threads < 1) x_indexing_threads = 1;
+  if (x_indexing_threads > MAX_INDEXING_THREADS) {
+    x_indexing_threads = MAX_INDEXING_THREADS;
+    printf("Warning:  Too large a value for x_indexing_threads. Setting to %d\n", x_indexing_threads);
+  }
+  if (!sort_records_by_weight && x_indexing_threads > 1) {
+    printf("Warning:  x_indexing_threads > 1 requires sort_records_by_weight.  Indexing will be single-threaded.\n");
+    x_indexing_threads = 1;
+  }
+  if (x_tokenizing_threads < 0) x_tokenizing_threads = 0;
+  if (x_tokenizing_threads > MAX_INDEXING_THREADS) {
+    x_tokenizing_threads = MAX_INDEXING_THREADS;
+    printf("Warning:  Too large a value for x_tokenizing_threads. Setting to %d\n", x_tokenizing_threads);
+  }
+  if (x_tokenizing_threads > 0 && (sort_records_by_weight || x_fileorder_use_mmap)) {
+    printf("Warning:  x_tokenizing_threads is only used when records are read in file order without mmapping.  Ignored.\n");
+    x_tokenizing_threads = 0;
+  }
+#ifdef WIN64
+  if (x_tokenizing_threads > 0) {
+    printf("Warning:  x_tokenizing_threads is not supported on Windows.  Ignored.\n");
+    x_tokenizing_threads = 0;
+  }
+#endif
+  if (x_sort_postings_instead > MAX_SORT_POSTINGS_MILLIONS) {
+    x_sort_postings_instead = MAX_SORT_POSTINGS_MILLIONS;
+    printf("Warning:  Too large a value for x_sort_postings_instead. Setting to %u\n", x_sort_postings_instead);
+  }
+
   if (SB_POSTINGS_PER_RUN && SB_POSTINGS_PER_RUN < 2) SB_POSTINGS_PER_RUN = 2;  //  SB_RUN_LENGTH = 0 is OK
   if (SB_TRIGGER && SB_TRIGGER < 3) SB_TRIGGER = 3;  // To avoid problems when postings lists of length 2 are stored in hash table
 
@@ -2081,6 +2987,10 @@ int main(int argc, char **argv) {
     strcpy((char *)fname_doctable + l, "/QBASH.");
     strcpy((char *)fname_doctable + l + 7, "doctable");
 
+    // QBASHQ loads a QBASH.qbx container in preference to the individual files.
+    if (exists((char *)index_dir, "/QBASH.qbx"))
+      printf("Warning: %s/QBASH.qbx will be stale after this run but QBASHQ will still load it.\n"
+	     "         Re-pack it with QBASH_index_container.exe, or delete it.\n\n", index_dir);
   }
 
 #ifdef WIN64
@@ -2091,6 +3001,15 @@ int main(int argc, char **argv) {
   }
 
   if (x_cpu_affinity >= 0) set_cpu_affinity(x_cpu_affinity);
+#else
+  if (x_use_large_pages) {
+    large_page_minimum = get_huge_page_size();
+    printf("Proceeding to use huge pages for the hash table and linked lists.  Huge page size: %zu bytes.\n",
+	   large_page_minimum);
+  }
+  // On Windows, VirtualAlloc() fails rather than falling back when large pages aren't available,
+  // so the hash table is always malloc()ed there.
+  dahash_set_large_pages(x_use_large_pages, large_page_minimum);
 #endif
 
   if (x_bigger_trigger) {
@@ -2171,14 +3090,17 @@ int main(int argc, char **argv) {
   if (debug) 	setvbuf(stdout, (char *)NULL, _IONBF, 0);  //Only in debug mode for performance reasons.
 
   test_signature_calculation();  // Must come after we define ascii_non_tokens
+  check_ascii_fast_path();  // Likewise
 
-  if (x_hashprobe) dahash_set_probing_method(1);
+  if (x_hashprobe) dahash_set_probing_method(x_hashprobe);
 
 
   print_version_and_option_settings();
 
   calculate_k_table(x_chunk_func);
 
+  create_indexing_states(x_indexing_threads);
+
   fflush(stdout);  // Otherwise it may be ages before any output appears.
 
 
@@ -2200,13 +3122,13 @@ int main(int argc, char **argv) {
       // So process_records_in_score_order() calls 	allocate_hashtable_and_heap() with the actual
       // number of documents.
       printf("About to do score-order scan ...\n");
-      process_records_in_score_order(fname_forward, dt_handle, word_table, min_wds, max_wds,
-				     &ignored_docs, &doccount, &max_plist_len, &infile_size);
+      process_records_in_score_order(fname_forward, dt_handle, indexing_states, num_indexing_states,
+				     &infile_size);
       printf("Returned from process_records_in_score_order()\n");
     } else {
       printf("About to do file-order scan ...\n");
-      process_records_in_file_order(fname_forward, dt_handle, word_table, x_max_docs, min_wds, max_wds,
-				    &ignored_docs, &doccount, &max_plist_len, &infile_size);
+      process_records_in_file_order(fname_forward, dt_handle, indexing_states, x_max_docs, min_wds, max_wds,
+				    &infile_size);
       printf("Returned from process_records_in_file_order()\n");
     }
 
@@ -2215,9 +3137,25 @@ int main(int argc, char **argv) {
 #endif
   // CloseHandle(dt_handle);  Already closed by buffered_flush()
 
+  add_up_indexing_states();
+  pixes = (partial_index_t *)malloc(num_indexing_states * sizeof(partial_index_t));
+  if (pixes == NULL) error_exit("Malloc failed for pixes\n");
+  for (a = 0; a < num_indexing_states; a++) {
+    // Spill whatever is left in the sort accumulator.  (Does nothing if the thread already did.)
+    if (indexing_states[a].pix.runs != NULL)
+      spill_sorted_run(indexing_states[a].pix.ht, indexing_states[a].pix.runs);
+    pixes[a] = indexing_states[a].pix;
+    pixes[a].first_docnum += first_docnum;   // A delta index continues on from the main one.
+    partial_vocab_sizes += pixes[a].ht->entries_used;
+  }
+
   // Show some more stats immediately after the scan.
   printf("Scan finished: Number of documents scanned: %lld\n", doccount);
-  printf("Scan finished: Vocabulary size: %zu\n", word_table->entries_used);
+  if (num_indexing_states > 1)
+    printf("Scan finished: Vocabulary size: %llu (summed over %d unmerged partial indexes)\n",
+	   partial_vocab_sizes, num_indexing_states);
+  else
+    printf("Scan finished: Vocabulary size: %llu\n", partial_vocab_sizes);
 
   if (x_doc_length_histo) {
     // File won't be written if fname_dlh == NULL
@@ -2228,7 +3166,8 @@ int main(int argc, char **argv) {
 
   if (debug) {
     printf("Alphabetic word list\n====================\n");
-    dahash_dump_alphabetic(word_table, ll_heap, show_key, show_count_n_postings);
+    for (a = 0; a < num_indexing_states; a++)
+      dahash_dump_alphabetic(pixes[a].ht, pixes[a].ll_heap, show_key, show_count_n_postings);
     printf("====================\nAlphabetic word list\n");
   }
 
@@ -2236,8 +3175,9 @@ int main(int argc, char **argv) {
   printf("Vocab filename is %s\n", fname_vocab);
 
   // ===============  This is where the inverted file is written ========================
-  total_index_size = write_inverted_file(word_table, fname_vocab, fname_if, ll_heap,
-					 SB_POSTINGS_PER_RUN, SB_TRIGGER, doccount, infile_size, max_plist_len);
+  total_index_size = write_inverted_file(pixes, num_indexing_states, fname_vocab, fname_if,
+					 SB_POSTINGS_PER_RUN, SB_TRIGGER, doccount, infile_size,
+					 &max_plist_len, &vocab_size);
   msec_elapsed_list_traversal = (what_time_is_it() - wifstart) * 1000.0;
   printf("Write-inverted-file elapsed time %.1f sec.\n", msec_elapsed_list_traversal / 1000.0);
 #ifdef WIN64
@@ -2250,10 +3190,7 @@ int main(int argc, char **argv) {
 
 
   printf("Input file of was kosher: %.1fMB\n", (double)infile_size / MEGA);
-  vocab_size = word_table->entries_used;  // Save for reporting at the end
-
-
-  word_table_collisions = word_table->collisions;
+  for (a = 0; a < num_indexing_states; a++) word_table_collisions += pixes[a].ht->collisions;
 
 
   if (CLEAN_UP_BEFORE_EXIT) {
@@ -2262,15 +3199,28 @@ int main(int argc, char **argv) {
 #ifdef WIN64
     report_memory_usage(stdout, (u_char *)"after writing the inverted file, before cleaning up memory", NULL);
 #endif
-    doh_free(&ll_heap);
+    for (a = 0; a < num_indexing_states; a++) {
+      doh_free(&(pixes[a].ll_heap));
+      if (pixes[a].runs != NULL) {
+	free(pixes[a].runs->accumulator);
+	free(pixes[a].runs->fname_stem);
+	free(pixes[a].runs);
+	pixes[a].runs = NULL;
+      }
+    }
 
 #ifdef WIN64 
     report_memory_usage(stdout, (u_char *)"before destroying the hash table", NULL);
 #endif
-    perc = 100.0 * (double)word_table->entries_used / (double)word_table->capacity;
-    printf("The 'word' hash table was doubled %d times.  %zu / %zu entries were used.  I.e. it was %.1f%% full.\n\n",
-	   word_table->times_doubled, word_table->entries_used, word_table->capacity, perc);
-    dahash_destroy(&word_table);
+    for (a = 0; a < num_indexing_states; a++) {
+      perc = 100.0 * (double)pixes[a].ht->entries_used / (double)pixes[a].ht->capacity;
+      printf("The 'word' hash table was doubled %d times.  %zu / %zu entries were used.  I.e. it was %.1f%% full.\n\n",
+	     pixes[a].ht->times_doubled, pixes[a].ht->entries_used, pixes[a].ht->capacity, perc);
+      dahash_destroy(&(pixes[a].ht));
+    }
+    free(pixes);
+    free(indexing_states);
+    indexing_states = NULL;
   }
 #ifdef WIN64
   report_memory_usage(stdout, (u_char *)"at the very end", NULL);
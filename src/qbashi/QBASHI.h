@@ -39,6 +39,7 @@ int ve_pack466(byte *vep, u_int count, u_ll p1, u_ll p2);
 #define LL_NEXT_BYTES_USED_MASK 0X7FFFF
 #define MAX_PAYLOADS ((1 << LL_NEXT_LAST_DOCNUM_SHIFT) / 6)  
 #define SORTABLE_POSTING_SIZE 10 // 4 byte termid, 5 byte docnum, 1 byte wordpos.
+#define MAX_SORT_POSTINGS_MILLIONS 4000  // Keeps accumulator subscripts within a u_int
 
 unsigned long long calculate_signature_from_first_letters(u_char *str, int bits);
 
@@ -47,14 +48,7 @@ unsigned long long calculate_signature_from_first_letters(u_char *str, int bits)
 typedef byte *doh_t;
 #endif
 
-extern doh_t ll_heap;
-void allocate_hashtable_and_heap(docnum_t doccount_estimate);
-
-void process_a_word(u_char *wd, docnum_t doccount, u_int wdpos, u_ll *max_plist_len,
-	doh_t ll_heap);
-
-extern byte *postings_accumulator_for_sort;
-extern u_ll postings_accumulated, chunks_allocated;
+extern u_ll chunks_allocated;
 extern double hashtable_MB, linkedlists_MB;
 
 extern CROSS_PLATFORM_FILE_HANDLE dt_handle;
@@ -66,18 +60,21 @@ extern double msec_elapsed_list_building, msec_elapsed_list_traversal;
 // Variables settable from the command line.
 extern docnum_t x_max_docs;
 extern u_int SB_POSTINGS_PER_RUN, SB_TRIGGER;
-extern docnum_t x_max_docs;
-extern u_int min_wds, max_wds, max_line_prefix, max_line_prefix_postings, x_min_payloads_per_chunk, x_sort_postings_instead;
-extern int head_terms;
-extern int debug, x_hashbits, x_hashprobe, x_chunk_func, x_cpu_affinity;
-extern double x_geo_tile_width;
+extern docnum_t x_max_docs, first_docnum;
+extern u_int min_wds, max_wds, max_line_prefix, max_line_prefix_postings, x_min_payloads_per_chunk, x_sort_postings_instead,
+	x_postings_gather_batch;
+extern int head_terms, x_compression_threads;
+extern int debug, x_hashbits, x_hashprobe, x_chunk_func, x_cpu_affinity, x_indexing_threads,
+  x_tokenizing_threads;
+extern double x_geo_tile_width, x_bitmap_density;
 extern int x_geo_big_tile_factor;
 extern u_char *index_dir, *fname_forward, *fname_if, *fname_doctable, *fname_vocab, *fname_synthetic_docs,
 *other_token_breakers, *language, *x_head_term_percentages, *x_zipf_middle_pieces, *x_synth_dl_segments,
 *x_synth_dl_read_histo;
 extern BOOL sort_records_by_weight, unicode_case_fold, conflate_accents, expect_cp1252, 
   x_use_large_pages, x_fileorder_use_mmap, x_minimize_io, x_2postings_in_vocab,
-  x_use_vbyte_in_chunks, x_bigger_trigger, x_doc_length_histo, x_zipf_generate_terms;
+  x_use_vbyte_in_chunks, x_bigger_trigger, x_doc_length_histo, x_zipf_generate_terms, x_ascii_fast_path,
+  x_front_coded_vocab;
 extern size_t large_page_minimum;
 extern u_ll tot_postings;
 extern 	DWORD pfc_list_build_start, pfc_list_build_end, pfc_list_scan_start, pfc_list_scan_end;
@@ -7,7 +7,8 @@
 // The inverted file consists of an alphabetically sorted vocabulary file
 // QBASH.vocab and the inverted file proper QBASH.if
 //
-// Records in .vocab are (currently) fixed length, consisting of the 
+// Records in .vocab are fixed length (unless x_front_coded_vocab is set, see 
+// shared/front_coded_vocab.h), consisting of the 
 // null terminated word, truncated at MAX_WD_LEN characters, plus a
 // four-byte occurrence count, and an 
 // 8-byte (could eventually shrink it to 5-byte) payload which may be
@@ -38,6 +39,8 @@
 #ifdef WIN64
 #include <tchar.h>
 #include <strsafe.h>
+#else
+#include <pthread.h>
 #endif
 #include <stdio.h>
 #include <stdlib.h>
@@ -50,6 +53,8 @@
 
 #include "../shared/utility_nodeps.h"
 #include "../shared/QBASHER_common_definitions.h"
+#include "../shared/front_coded_vocab.h"
+#include "../shared/bitmap_postings.h"
 #include "QBASHI.h"
 #include "../utils/linked_list.h"
 #include "../utils/dahash.h"
@@ -65,201 +70,1097 @@ static int compare_keys_alphabetic(const void *i, const void*j) {
 	return strcmp(ia, ja);
 }
 
-#if 0
-static int compare_sortable_postings(const void *i, const void*j) {
-	u_ll *iull = (u_ll *)i, *jull = (u_ll *)j;
-	u_short *ius, *jus;
-	if (*iull > *jull) return 1;
-	if (*iull < *jull) return -1;
-	ius = (u_short *)(iull + 1);
-	jus = (u_short *)(jull + 1);
-	if (*ius > *jus) return 1;
-	if (*ius < *jus) return -1;
-	return 0;  // Should never happen
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Functions supporting inversion by sorting (x_sort_postings_instead) rather than by building linked lists           //
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Memory use is the vocabulary hash table plus SORTABLE_POSTING_SIZE + 4 bytes per posting in the 
+// accumulator, regardless of the size of the collection.  The postings themselves spend most of
+// their life in run files on disk.
+
+postings_runs_t *create_postings_runs(u_char *fname_stem, u_ll capacity) {
+  postings_runs_t *runs = (postings_runs_t *)malloc(sizeof(postings_runs_t));
+  if (runs == NULL) error_exit("Malloc failed for postings_runs_t\n");
+  memset(runs, 0, sizeof(postings_runs_t));
+  runs->accumulator = (byte *)malloc(capacity * SORTABLE_POSTING_SIZE);
+  if (runs->accumulator == NULL) error_exit("Malloc failed for postings_accumulator_for_sort\n");
+  runs->capacity = capacity;
+  runs->fname_stem = fname_stem;
+  return runs;
 }
 
-#endif
 
+static u_char *make_run_fname(postings_runs_t *runs, int n) {
+  u_char *fname = (u_char *)malloc(strlen((char *)runs->fname_stem) + 20);
+  if (fname == NULL) error_exit("Malloc failed for run file name\n");
+  else sprintf((char *)fname, "%s.run%d", runs->fname_stem, n);
+  return fname;
+}
 
-static byte sb_run_accumulator[SB_MAX_BYTES_PER_RUN];   // Would need to malloc this if we start multi-threading.
-
-
-
-// The following functions are used in the experimental mode where we sort accumulated postings instead of 
-// building linked lists.
-
-
-#if 0
-static void sort_accumulated_postings(dahash_table_t *ht, LPCSTR fname_vocab, LPCSTR fname_if, doh_t ll_heap,
-	u_int SB_POSTINGS_PER_RUN, u_int SB_TRIGGER, docnum_t doccount, long long fsz) {
-	int termid, prev_termid, p, e;
-	byte *entryp, *vep, **permute, *if_buf = NULL;
-	u_int count;
-	u_ll i, *ullp, ht_off, if_off = 0, termidll, ignore, vocab_file_size, t;
-	u_short *usp;
-	double then;
-	double permute_MB;
-	docnum_t docnum;
-	byte wdpos;
-
-	vocab_file_size = (ht->entries_used * (sizeof(unsigned long long) + sizeof(int) + MAX_WD_LEN + 1));
-
-	printf("About to sort %lld accumulated postings.  Memory used for postings: %.2fMB\n",
-		postings_accumulated, (double)(postings_accumulated * SORTABLE_POSTING_SIZE) / 1000000.0);
-	fflush(stdout);
-	then = what_time_is_it();
-	qsort(postings_accumulator_for_sort, postings_accumulated, SORTABLE_POSTING_SIZE, compare_sortable_postings);
-	printf("Qsort of accumulated postings: elapsed time %.1f sec.\n", what_time_is_it() - then);
-	fflush(stdout);
-
-	// Now scan through the sorted postings and use each distinct termid to update the first pointer 
-	// in the hashtable entry.
-	prev_termid = -1;
-	entryp = postings_accumulator_for_sort;
-	then = what_time_is_it();
-	for (i = 0; i < postings_accumulated; i++) {
-		ullp = (u_ll *)entryp;
-		termid = (u_int)(*ullp  >> 32);
-		if (termid != prev_termid){
-			vep = ((byte *)(ht->table)) + (termid * ht->entry_size);
-			if (0) printf("     %llu/%llu - Termid: %u (%s)\n", i, postings_accumulated, termid, vep);
-			count = ve_get_count(vep);
-			// Store the unchanged count and the index of the first posting for this term in the postings array.
-			ve_pack466(vep, count, i, 0);
-			prev_termid = termid;
-		}
-		entryp += SORTABLE_POSTING_SIZE;
-	}
 
-	printf("Swizzling of pointers in hashtable: elapsed time %.1f sec.\n", what_time_is_it() - then);
-	fflush(stdout);
+void accumulate_sortable_posting(dahash_table_t *ht, postings_runs_t *runs, u_int termid, docnum_t docnum, u_int wdpos) {
+  // Store a posting in the accumulator as a 4-byte termid, a 5-byte little-endian docnum and a
+  // one-byte wdpos.  If the accumulator is full, spill it to a sorted run first.
+  byte *entryp;
+  int b;
+  if (runs->accumulated >= runs->capacity) spill_sorted_run(ht, runs);
+  entryp = runs->accumulator + runs->accumulated * SORTABLE_POSTING_SIZE;
+  memcpy(entryp, &termid, sizeof(u_int));
+  for (b = 4; b < 9; b++) {
+    entryp[b] = (byte)(docnum & 0xFF);
+    docnum >>= 8;
+  }
+  entryp[9] = (byte)wdpos;
+  runs->accumulated++;
+}
 
-	permute = (byte **)malloc(ht->entries_used * sizeof(byte *));  // MAL600
-	if (permute == NULL) {
-		printf("Error: malloc of permute failed in sort_accumulated_postings()\n");
-		exit(1);
-	}
-	permute_MB = (double)(ht->entries_used * sizeof(byte *)) / MEGA;
 
-#ifndef QBASHER_LITE
-	report_memory_usage(stdout, (u_char *)"before writing the inverted file", &pfc_list_scan_start);
-#endif
-	then = what_time_is_it();
-
-	p = 0;
-	ht_off = 0;
-	for (e = 0; e < ht->capacity; e++) {
-		if (((byte *)(ht->table))[ht_off]) {
-			permute[p++] = ((byte *)(ht->table)) + ht_off;
-		}
-		ht_off += ht->entry_size;
+void spill_sorted_run(dahash_table_t *ht, postings_runs_t *runs) {
+  // Write the accumulated postings to a new run file, grouped by term in alphabetic order.  Postings
+  // for a term keep the order in which they were accumulated, i.e. increasing docnum, so a counting
+  // sort on the alphabetic rank of each term is all that's needed.
+  //
+  // Run file format, for each term present:  
+  //     null-terminated term, 4-byte count, count x (5-byte little-endian docnum, 1-byte wdpos)
+  byte **keys, *entryp;
+  u_int *rank, *order, termid, count;
+  u_ll *starts, p, end, ht_off = 0, termidll, ignore;
+  size_t e, v = 0, r;
+  FILE *RUN;
+  u_char *fname;
+  double start;
+
+  if (runs->accumulated == 0) return;
+  start = what_time_is_it();
+  keys = (byte **)malloc((ht->entries_used + 1) * sizeof(byte *));
+  rank = (u_int *)malloc((runs->next_termid + 1) * sizeof(u_int));
+  starts = (u_ll *)calloc(ht->entries_used + 1, sizeof(u_ll));
+  order = (u_int *)malloc(runs->accumulated * sizeof(u_int));
+  if (keys == NULL || rank == NULL || starts == NULL || order == NULL)
+    error_exit("Malloc failed in spill_sorted_run()\n");
+
+  // Alphabetic rank of every term seen so far.  
+  for (e = 0; e < ht->capacity; e++) {
+    if (((byte *)(ht->table))[ht_off]) keys[v++] = ((byte *)(ht->table)) + ht_off;
+    ht_off += ht->entry_size;
+  }
+  qsort(keys, v, sizeof(byte *), compare_keys_alphabetic);
+  for (r = 0; r < v; r++) {
+    ve_unpack466(keys[r] + ht->key_size, &count, &termidll, &ignore);
+    rank[termidll] = (u_int)r;
+  }
+
+  // Counting sort
+  for (p = 0; p < runs->accumulated; p++) {
+    memcpy(&termid, runs->accumulator + p * SORTABLE_POSTING_SIZE, sizeof(u_int));
+    starts[rank[termid] + 1]++;
+  }
+  for (r = 1; r < v; r++) starts[r] += starts[r - 1];
+  for (p = 0; p < runs->accumulated; p++) {
+    memcpy(&termid, runs->accumulator + p * SORTABLE_POSTING_SIZE, sizeof(u_int));
+    order[starts[rank[termid]]++] = (u_int)p;
+  }
+  // Now starts[r] is the end of the postings for the term of rank r
+
+  fname = make_run_fname(runs, runs->num_runs);
+  RUN = fopen((char *)fname, "wb");
+  if (RUN == NULL) {
+    printf("Error: Unable to write to sorted run file %s\n", fname);
+    exit(1);
+  }
+  setvbuf(RUN, NULL, _IOFBF, HUGEBUFSIZE);
+  p = 0;
+  for (r = 0; r < v; r++) {
+    end = starts[r];
+    if (end == p) continue;
+    count = (u_int)(end - p);
+    fwrite(keys[r], strlen((char *)keys[r]) + 1, 1, RUN);
+    fwrite(&count, sizeof(count), 1, RUN);
+    for (; p < end; p++) {
+      entryp = runs->accumulator + (u_ll)order[p] * SORTABLE_POSTING_SIZE;
+      fwrite(entryp + sizeof(u_int), SORTABLE_POSTING_SIZE - sizeof(u_int), 1, RUN);
+    }
+  }
+  if (fclose(RUN) != 0) {
+    printf("Error: Failed to write sorted run file %s\n", fname);
+    exit(1);
+  }
+
+  printf("Sorted run %d: %llu postings written to %s\n", runs->num_runs, runs->accumulated, fname);
+  runs->num_runs++;
+  runs->accumulated = 0;
+  free(fname);
+  free(keys);
+  free(rank);
+  free(starts);
+  free(order);
+  runs->msec_spilling += (what_time_is_it() - start) * 1000.0;
+}
+
+
+static void read_run_term_header(sorted_run_reader_t *rr) {
+  // Read the next term and its count from a sorted run.  At EOF, remaining is left at zero.
+  int c, l = 0;
+  rr->remaining = 0;
+  while ((c = getc(rr->f)) != EOF && c != 0) {
+    if (l < MAX_WD_LEN) rr->term[l++] = (u_char)c;
+  }
+  rr->term[l] = 0;
+  if (c == EOF) return;
+  if (fread(&(rr->remaining), sizeof(u_int), 1, rr->f) != 1) rr->remaining = 0;
+}
+
+
+static void sorted_run_next(sorted_run_reader_t *rr, docnum_t *docnum, int *wdnum) {
+  // Read the next posting for the current term.  Only call when rr->remaining > 0
+  byte posting[SORTABLE_POSTING_SIZE];
+  int b;
+  if (fread(posting, SORTABLE_POSTING_SIZE - sizeof(u_int), 1, rr->f) != 1)
+    error_exit("Error: sorted run file is truncated.\n");
+  *docnum = 0;
+  for (b = 4; b >= 0; b--) {
+    *docnum <<= 8;
+    *docnum |= posting[b];
+  }
+  *wdnum = posting[5];
+  rr->remaining--;
+  if (rr->remaining == 0) read_run_term_header(rr);
+}
+
+
+static void open_sorted_runs(postings_runs_t *runs) {
+  int n;
+  u_char *fname;
+  runs->readers = (sorted_run_reader_t *)malloc((runs->num_runs + 1) * sizeof(sorted_run_reader_t));
+  if (runs->readers == NULL) error_exit("Malloc failed for sorted run readers\n");
+  for (n = 0; n < runs->num_runs; n++) {
+    fname = make_run_fname(runs, n);
+    runs->readers[n].f = fopen((char *)fname, "rb");
+    if (runs->readers[n].f == NULL) {
+      printf("Error: Unable to read sorted run file %s\n", fname);
+      exit(1);
+    }
+    setvbuf(runs->readers[n].f, NULL, _IOFBF, SORTED_RUN_READ_BUFSIZE);
+    read_run_term_header(runs->readers + n);
+    free(fname);
+  }
+}
+
+
+static void close_and_remove_sorted_runs(postings_runs_t *runs) {
+  int n;
+  u_char *fname;
+  for (n = 0; n < runs->num_runs; n++) {
+    fclose(runs->readers[n].f);
+    fname = make_run_fname(runs, n);
+    remove((char *)fname);
+    free(fname);
+  }
+  free(runs->readers);
+  runs->readers = NULL;
+}
+
+
+static byte vocabfile_record[VOCABFILE_REC_LEN + 10], arg_list[IF_HEADER_LEN - 250];
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Functions for reading postings lists back out of one or more partial indexes                                        //
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// When QBASHI indexes with multiple threads, each thread builds a partial index (hash table plus DOH)
+// covering a contiguous range of docnums.  The .vocab and .if are written by merging the sorted
+// vocabularies of the partial indexes and, for each term, concatenating its postings lists in
+// partial index order.  Serial indexing is just the case of a single partial index.
+
+typedef struct {
+  // Iterates over a single postings list, either held in a vocab entry (466 format), in 
+  // a chain of DOH chunks (4552 format), or spread across sorted run files.
+  size_t *header;
+  posting_p *pblock, currptr, tailptr, payloadptr;
+  u_ll inline_postings[2], count_limit_for_current_k;
+  u_int count, taken, chunkno, current_k, payload_bytes_available;
+  docnum_t first_docnum, last_docnum;
+  BOOL in_vocab_entry;
+  postings_runs_t *runs;
+  u_char *key;
+  int run;
+} postings_cursor_t;
+
+
+typedef struct {
+  // Iterates over the concatenation of the postings lists for one term in several partial indexes
+  postings_cursor_t cursors[MAX_INDEXING_THREADS];
+  int members, current;
+  u_int count, taken;
+} merged_postings_t;
+
+
+void sort_partial_index_vocab(partial_index_t *pix) {
+  // Set up pix->permute as an alphabetically sorted array of pointers to the
+  // used entries in pix->ht.  Called by each indexing thread on its own table.
+  dahash_table_t *ht = pix->ht;
+  u_ll ht_off = 0;
+  size_t e;
+
+  pix->permute = (byte **)malloc((ht->entries_used + 1) * sizeof(byte *));  // MAL600
+  if (pix->permute == NULL) error_exit("Error: malloc of permute failed in sort_partial_index_vocab()\n");
+  pix->entries = 0;
+  for (e = 0; e < ht->capacity; e++) {
+    if (((byte *)(ht->table))[ht_off]) {
+      pix->permute[pix->entries++] = ((byte *)(ht->table)) + ht_off;
+    }
+    ht_off += ht->entry_size;
+  }
+
+  qsort(pix->permute, pix->entries, sizeof(byte *), compare_keys_alphabetic);
+}
+
+
+static void postings_cursor_init(postings_cursor_t *pc, partial_index_t *pix, vocab_entry_p vep) {
+  u_ll head, tail;
+  u_short chunk_count;
+
+  pc->count = ve_get_count(vep);
+  pc->taken = 0;
+  pc->first_docnum = pix->first_docnum;
+  pc->last_docnum = 0;
+  pc->runs = pix->runs;
+  if (pc->runs != NULL) {
+    // The postings are in the runs whose current term is this key
+    pc->key = (u_char *)vep - pix->ht->key_size;
+    pc->run = 0;
+    pc->in_vocab_entry = FALSE;
+    return;
+  }
+  if (x_2postings_in_vocab && pc->count < 3) {
+    // The postings are actually in the vocab entry.
+    ve_unpack466(vep, &pc->count, pc->inline_postings, pc->inline_postings + 1);
+    pc->in_vocab_entry = TRUE;
+    return;
+  }
+  pc->in_vocab_entry = FALSE;
+  ve_unpack4552(vep, &pc->count, &head, &tail, &chunk_count);
+  pc->header = (size_t *)pix->ll_heap;
+  pc->pblock = (posting_p *)(pc->header + DOH_HEADER_ENTS);
+  pc->currptr = doh_get_pointer(pix->ll_heap, head);
+  pc->tailptr = doh_get_pointer(pix->ll_heap, tail);
+  pc->payloadptr = pc->currptr;
+  pc->chunkno = 1;  // I assume we start from one.
+  pc->current_k = 1;
+  pc->count_limit_for_current_k = chunk_length_table[pc->current_k];
+  pc->payload_bytes_available = chunk_payload_bytes(chunk_K_table[pc->current_k], pc->chunkno);
+}
+
+
+static BOOL postings_cursor_next(postings_cursor_t *pc, docnum_t *docnum, int *wdnum) {
+  // Get the next posting in the list, with the docnum converted from partial index numbering
+  // to global numbering.  Return FALSE when the list is exhausted.
+  docnum_t d = 0;
+  byte *nextptrptr;
+  u_ll next;
+  int b;
+
+  if (pc->taken >= pc->count) return FALSE;
+
+  if (pc->runs != NULL) {
+    // Runs cover increasing docnum ranges, so read them in order.
+    sorted_run_reader_t *rr = NULL;
+    while (pc->run < pc->runs->num_runs) {
+      rr = pc->runs->readers + pc->run;
+      if (rr->remaining > 0 && !strcmp((char *)rr->term, (char *)pc->key)) break;
+      pc->run++;
+    }
+    if (pc->run >= pc->runs->num_runs) return FALSE;
+    sorted_run_next(rr, &d, wdnum);
+  }
+  else if (pc->in_vocab_entry) {
+    d = pc->inline_postings[pc->taken] >> WDPOS_BITS;
+    *wdnum = (int)(pc->inline_postings[pc->taken] & WDPOS_MASK);
+  }
+  else {
+    while (pc->payloadptr >= (pc->currptr + pc->payload_bytes_available) || pc->payloadptr[0] == 0xFF) {
+      // There are no more postings in the current chunk.
+      if (pc->currptr == pc->tailptr) return FALSE;  // This is how we detect the last chunk
+
+      // We know that this is not the last chunk, so NEXT is actually a pointer
+      nextptrptr = pc->currptr + pc->payload_bytes_available;   // Have to calculate because chunk may have empties
+      next = 0;
+      for (b = (NEXT_POINTER_SIZE - 3); b >= 0; b--) {
+	next <<= 8;
+	next |= nextptrptr[b];
+      }
+      pc->currptr = pc->pblock[next / pc->header[2]] + (next % pc->header[2]);
+      pc->payloadptr = pc->currptr;
+      if (pc->chunkno < 0xFFFF) pc->chunkno++;
+      if (pc->chunkno > pc->count_limit_for_current_k) {
+	pc->current_k++;
+	pc->count_limit_for_current_k = chunk_length_table[pc->current_k];
+	if (pc->chunkno > pc->count_limit_for_current_k) {
+	  error_exit("Chunking stuffed!\n");
 	}
+      }
+      pc->payload_bytes_available = chunk_payload_bytes(chunk_K_table[pc->current_k], pc->chunkno);
+    }
+
+    // Get the wordnum - just a single byte.
+    *wdnum = pc->payloadptr[0];
+    if (x_use_vbyte_in_chunks) {
+      // Get the vbyte-encoded docnum_diff
+      docnum_t docnum_diff = 0;
+      b = 1;
+      do {
+	docnum_diff <<= 7;
+	docnum_diff |= (pc->payloadptr[b] >> 1);  // Continuation bit is LSB
+	b++;
+      } while (!(pc->payloadptr[b - 1] & 1));
+      d = pc->last_docnum + docnum_diff;
+      pc->payloadptr += b;
+    }
+    else {
+      // Get the docnum out of five bytes, written little-endian
+      for (b = 5; b > 0; b--) {
+	d <<= 8;
+	d |= pc->payloadptr[b];
+      }
+      pc->payloadptr += PAYLOAD_SIZE;
+    }
+    pc->last_docnum = d;
+  }
+
+  pc->taken++;
+  *docnum = d + pc->first_docnum;
+  return TRUE;
+}
+
+
+static void postings_cursor_finish(postings_cursor_t *pc) {
+  // Postings beyond the merged count limit are never taken.  Skip any left in sorted runs so 
+  // that every reader is positioned at a term which is still to come.
+  sorted_run_reader_t *rr;
+  docnum_t d;
+  int w;
+  if (pc->runs == NULL) return;
+  for (; pc->run < pc->runs->num_runs; pc->run++) {
+    rr = pc->runs->readers + pc->run;
+    while (rr->remaining > 0 && !strcmp((char *)rr->term, (char *)pc->key))
+      sorted_run_next(rr, &d, &w);
+  }
+}
+
+
+static BOOL merged_postings_next(merged_postings_t *mp, docnum_t *docnum, int *wdnum) {
+  // Get the next posting for the term, moving from one partial index to the next as
+  // each list is exhausted.   Stop after mp->count postings.
+  while (mp->current < mp->members) {
+    if (mp->taken >= mp->count) return FALSE;
+    if (postings_cursor_next(mp->cursors + mp->current, docnum, wdnum)) {
+      mp->taken++;
+      return TRUE;
+    }
+    mp->current++;
+  }
+  return FALSE;
+}
+
+
+static int next_merged_term(partial_index_t *pixes, int num_pixes, size_t *pos, int *members) {
+  // Find the alphabetically lowest key among the next unconsumed entries in the 
+  // permute arrays of the partial indexes.  Record which partial indexes contain it
+  // (in docnum order) in members and return how many there are.  Zero means all done.
+  int i, m = 0, cmp;
+  char *lowest = NULL;
+  for (i = 0; i < num_pixes; i++) {
+    if (pos[i] >= pixes[i].entries) continue;
+    if (lowest == NULL) cmp = -1;
+    else cmp = strcmp((char *)pixes[i].permute[pos[i]], lowest);
+    if (cmp < 0) {
+      lowest = (char *)pixes[i].permute[pos[i]];
+      m = 0;
+      members[m++] = i;
+    }
+    else if (cmp == 0) members[m++] = i;
+  }
+  return m;
+}
+
+
+static u_int merged_count(partial_index_t *pixes, size_t *pos, int *members, int m) {
+  // The number of postings the term will have in the merged index.  Line prefix terms 
+  // are limited in the same way as process_a_word_internal() limits them.
+  int i;
+  u_int count, sum = 0;
+  byte *key = pixes[members[0]].permute[pos[members[0]]];
+  for (i = 0; i < m; i++) {
+    vocab_entry_p vep = pixes[members[i]].permute[pos[members[i]]] + pixes[members[i]].ht->key_size;
+    count = ve_get_count(vep);
+    sum += count;
+  }
+  if (key[0] == '>' && sum > max_line_prefix_postings) sum = max_line_prefix_postings;
+  return sum;
+}
+
+
+static int vbyte_encode_docnum_diff(docnum_t docnum_diff, byte *bytes) {
+  // Encode docnum_diff in big-endian 7-bit groups with the termination bit set in the
+  // LSB of the last byte.  Return the number of bytes used.  Can't be more than 6 (allowing
+  // up to 100 billion)
+  docnum_t limit = 1ULL << 7;
+  int b, bytes_needed = 1;
+  byte bight;
+  while (docnum_diff >= limit) {
+    bytes_needed++;
+    limit <<= 7;
+  }
+  // Need a loop and an array to be able to write the bytes
+  // in order of decreasing significance.
+  for (b = bytes_needed - 1; b >= 0; b--) {
+    bight = docnum_diff & 0x7F;
+    bight <<= 1;
+    bytes[b] = bight;
+    docnum_diff >>= 7;
+  }
+  bytes[bytes_needed - 1] |= 1;   // Set the termination bit on the last byte
+  return bytes_needed;
+}
 
-	qsort(permute, p, sizeof(byte *), compare_keys_alphabetic);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Functions supporting two-phase postings emission                                                                    //
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Following each term's chain of chunks in alphabetical order of terms jumps all over the DOH, and
+// becomes very slow once the heap approaches the size of RAM.  Instead, the merged vocabulary is 
+// taken in batches of alphabetically consecutive terms.  In the gather phase, each term's postings
+// are copied into a contiguous stretch of the batch buffers, visiting the terms in the order of the
+// heap addresses of their first chunks.  In the second phase the lists are compressed and written 
+// in alphabetical order straight out of the batch buffers.
+//
+// The DOH chunks of a list hold its postings in the same form as .if (a wdnum byte followed by a
+// vbyte-compressed docnum gap) so, where a list needs neither skip blocks nor merging nor docnum
+// adjustment, its bytes are simply gathered from the chunks and copied to .if.
+
+typedef struct {
+  byte *key;
+  u_int count, gathered;   // Gathered may be less than count only if the lists are inconsistent
+  int m, first_member;     // This term's partial indexes are member_pix[first_member] ... [first_member + m - 1]
+  u_ll heap_address, start;  // start is the subscript of the first posting in docnums and wdnums
+  BOOL copy_chunks;        // If set, the postings are gathered still compressed, into chunk_bytes[start] onward
+  u_ll copied_bytes;
+  u_ll payload;            // What goes in the .vocab entry: a single posting or an .if offset
+  byte qidf;
+} emission_term_t;
+
+
+typedef struct {
+  emission_term_t *terms, **order;
+  int *member_pix;
+  vocab_entry_p *member_vep;
+  docnum_t *docnums;
+  byte *wdnums, *chunk_bytes;
+  size_t num_terms, terms_capacity, order_capacity, num_members, members_capacity, chunk_bytes_used, chunk_bytes_capacity;
+  u_ll num_postings, postings_capacity, postings_limit, num_copied_postings;
+  u_int SB_TRIGGER;
+} emission_batch_t;
+
+
+static void *grow_array(void *array, size_t *capacity, size_t needed, size_t elt_size, char *label) {
+  // Make sure that array has room for at least needed elements
+  size_t newcap = *capacity;
+  if (needed <= *capacity) return array;
+  if (newcap < 1024) newcap = 1024;
+  while (newcap < needed) newcap *= 2;
+  array = realloc(array, newcap * elt_size);
+  if (array == NULL) {
+    printf("Error: realloc of %s failed in write_inverted_file()\n", label);
+    exit(1);
+  }
+  *capacity = newcap;
+  return array;
+}
 
-	for (e = 0; e < p; e++) {
-		char *key = (char *)(permute[e]);
-		vocab_entry_p vep = ((vocab_entry_p)(((byte *)permute[e]) + ht->key_size));
-		count = ve_get_count(vep);
-		ve_unpack466(vep, &count, &termidll, &ignore);
-		// Postings for this term start at postings_accumulator_for_sort[termidll]
-		entryp = postings_accumulator_for_sort + termidll * SORTABLE_POSTING_SIZE;
-		for (t = 0; t < count; t++) {
-			ullp = (u_ll *)entryp;
-			usp = (u_short *)(ullp + 1);
-			docnum = (*ullp & 0xFFFFFFFFULL << 8) | (*usp >> 8);  // Is this right?????????? should the FFF mask be 64 bit?  Is the order of ops right?
-			wdpos = *usp & 0xFF;
 
+static emission_batch_t *create_emission_batch(u_int millions_of_postings, u_int SB_TRIGGER) {
+  emission_batch_t *eb = (emission_batch_t *)malloc(sizeof(emission_batch_t));  // MAL602
+  if (eb == NULL) error_exit("Error: malloc failed for emission batch");
+  memset(eb, 0, sizeof(emission_batch_t));
+  eb->postings_limit = (u_ll)millions_of_postings * 1000000;
+  eb->SB_TRIGGER = SB_TRIGGER;
+  return eb;
+}
 
-			//
-			//
-			//**** Have to insert the code to write the .iF here 
-			//
-			//
 
-			entryp += SORTABLE_POSTING_SIZE;
-		}
+static void free_emission_batch(emission_batch_t *eb) {
+  free(eb->terms);
+  free(eb->order);
+  free(eb->member_pix);
+  free(eb->member_vep);
+  free(eb->docnums);
+  free(eb->wdnums);
+  free(eb->chunk_bytes);
+  free(eb);   // FRE602
+}
+
+
+static u_ll list_heap_address(partial_index_t *pix, vocab_entry_p vep) {
+  // The address of the first chunk of the list for this vocab entry, or zero if the
+  // postings aren't in the DOH.
+  u_ll head, tail;
+  u_int count;
+  u_short chunk_count;
+  if (pix->runs != NULL) return 0;
+  count = ve_get_count(vep);
+  if (x_2postings_in_vocab && count < 3) return 0;
+  ve_unpack4552(vep, &count, &head, &tail, &chunk_count);
+  return (u_ll)doh_get_pointer(pix->ll_heap, head);
+}
+
+
+static BOOL list_chunks_can_be_copied(emission_batch_t *eb, partial_index_t *pix, vocab_entry_p vep,
+				      u_int count, int m) {
+  // Can the postings list be copied to .if exactly as it's held in the DOH chunks?
+  u_int ve_count;
+  if (m != 1 || pix->runs != NULL || pix->first_docnum != 0 || !x_use_vbyte_in_chunks) return FALSE;
+  if (count <= 1 || (x_2postings_in_vocab && count < 3)) return FALSE;   // Not in the DOH or not written to .if
+  if (eb->SB_TRIGGER > 0 && count >= eb->SB_TRIGGER) return FALSE;    // Will need skip blocks
+  ve_count = ve_get_count(vep);
+  return (ve_count == count);
+}
+
+
+static size_t fill_emission_batch(emission_batch_t *eb, partial_index_t *pixes, int num_pixes, size_t *pos) {
+  // Take terms from the merged vocabulary in alphabetical order until the batch has room for 
+  // at least eb->postings_limit postings or the vocabulary is exhausted.  A batch always contains
+  // at least one term, so a limit of zero gives one term per batch.  Return the number of terms.
+  int i, m, members[MAX_INDEXING_THREADS];
+  emission_term_t *et;
+  size_t cap;
+
+  eb->num_terms = 0;
+  eb->num_members = 0;
+  eb->num_postings = 0;
+  eb->num_copied_postings = 0;
+  eb->chunk_bytes_used = 0;
+  while ((eb->num_terms == 0 || eb->num_postings + eb->num_copied_postings < eb->postings_limit)
+	 && (m = next_merged_term(pixes, num_pixes, pos, members)) > 0) {
+    eb->terms = (emission_term_t *)grow_array(eb->terms, &(eb->terms_capacity), eb->num_terms + 1,
+					      sizeof(emission_term_t), "batch terms");
+    cap = eb->members_capacity;
+    eb->member_pix = (int *)grow_array(eb->member_pix, &cap, eb->num_members + m, sizeof(int), "batch members");
+    eb->member_vep = (vocab_entry_p *)grow_array(eb->member_vep, &(eb->members_capacity), eb->num_members + m,
+						 sizeof(vocab_entry_p), "batch members");
+    et = eb->terms + eb->num_terms++;
+    et->key = pixes[members[0]].permute[pos[members[0]]];
+    et->count = merged_count(pixes, pos, members, m);
+    et->gathered = 0;
+    et->m = m;
+    et->first_member = (int)eb->num_members;
+    et->start = eb->num_postings;
+    for (i = 0; i < m; i++) {
+      partial_index_t *pix = pixes + members[i];
+      eb->member_pix[eb->num_members] = members[i];
+      eb->member_vep[eb->num_members] = (vocab_entry_p)(pix->permute[pos[members[i]]] + pix->ht->key_size);
+      eb->num_members++;
+      pos[members[i]]++;
+    }
+    et->heap_address = list_heap_address(pixes + members[0], eb->member_vep[et->first_member]);
+    et->copy_chunks = list_chunks_can_be_copied(eb, pixes + members[0], eb->member_vep[et->first_member], et->count, m);
+    if (et->copy_chunks) eb->num_copied_postings += et->count;
+    else eb->num_postings += et->count;
+  }
+
+  if (eb->num_postings > eb->postings_capacity) {
+    cap = (size_t)eb->postings_capacity;
+    eb->docnums = (docnum_t *)grow_array(eb->docnums, &cap, (size_t)eb->num_postings, sizeof(docnum_t), "gathered docnums");
+    cap = (size_t)eb->postings_capacity;
+    eb->wdnums = (byte *)grow_array(eb->wdnums, &cap, (size_t)eb->num_postings, sizeof(byte), "gathered wdnums");
+    eb->postings_capacity = cap;
+  }
+  return eb->num_terms;
+}
 
+
+static void copy_list_chunks(emission_batch_t *eb, emission_term_t *et, partial_index_t *pix, vocab_entry_p vep) {
+  // Append the compressed postings in the DOH chunks of a list to eb->chunk_bytes without decoding
+  // them.  Chunks are traversed as in postings_cursor_next().  A chunk's postings end at an 0xFF
+  // wdnum byte or at the end of its payload area.
+  u_ll head, tail, next;
+  u_int count, taken = 0, chunkno = 1, current_k = 1, payload_bytes;
+  u_short chunk_count;
+  byte *currptr, *tailptr, *nextptrptr, *p, *end;
+  int b;
+
+  ve_unpack4552(vep, &count, &head, &tail, &chunk_count);
+  currptr = doh_get_pointer(pix->ll_heap, head);
+  tailptr = doh_get_pointer(pix->ll_heap, tail);
+  et->start = eb->chunk_bytes_used;
+  while (1) {
+    payload_bytes = chunk_payload_bytes(chunk_K_table[current_k], chunkno);
+    p = currptr;
+    end = currptr + payload_bytes;
+    while (p < end && p[0] != 0xFF && taken < count) {
+      p++;   // wdnum
+      while (!(*p++ & 1));  // vbyte gap, terminated by a byte with its LSB set
+      taken++;
+    }
+    eb->chunk_bytes = (byte *)grow_array(eb->chunk_bytes, &(eb->chunk_bytes_capacity),
+					 eb->chunk_bytes_used + (p - currptr), sizeof(byte), "gathered chunk bytes");
+    memcpy(eb->chunk_bytes + eb->chunk_bytes_used, currptr, p - currptr);
+    eb->chunk_bytes_used += (p - currptr);
+    if (currptr == tailptr || taken >= count) break;
+
+    // Not the last chunk, so NEXT is a pointer
+    nextptrptr = end;
+    next = 0;
+    for (b = (NEXT_POINTER_SIZE - 3); b >= 0; b--) {
+      next <<= 8;
+      next |= nextptrptr[b];
+    }
+    currptr = doh_get_pointer(pix->ll_heap, next);
+    if (chunkno < 0xFFFF) chunkno++;
+    if (chunkno > chunk_length_table[current_k]) current_k++;
+  }
+  et->gathered = taken;
+  et->copied_bytes = eb->chunk_bytes_used - et->start;
+}
+
+
+static int compare_heap_addresses(const void *i, const void *j) {
+  emission_term_t *ia = *(emission_term_t **)i, *ja = *(emission_term_t **)j;
+  if (ia->heap_address < ja->heap_address) return -1;
+  if (ia->heap_address > ja->heap_address) return 1;
+  return 0;
+}
+
+
+static void gather_emission_batch(emission_batch_t *eb, partial_index_t *pixes, merged_postings_t *mp,
+				  BOOL alphabetic) {
+  // Copy the postings for every term in the batch into the batch buffers, visiting the
+  // terms in heap address order unless alphabetic is set.  (Sorted runs can only be read
+  // alphabetically.)
+  size_t t;
+  emission_term_t *et;
+  docnum_t docnum;
+  int i, wdnum;
+
+  eb->order = (emission_term_t **)grow_array(eb->order, &(eb->order_capacity), eb->num_terms, sizeof(emission_term_t *), "batch order");
+  for (t = 0; t < eb->num_terms; t++) eb->order[t] = eb->terms + t;
+  if (!alphabetic) qsort(eb->order, eb->num_terms, sizeof(emission_term_t *), compare_heap_addresses);
+
+  for (t = 0; t < eb->num_terms; t++) {
+    et = eb->order[t];
+    if (et->copy_chunks) {
+      copy_list_chunks(eb, et, pixes + eb->member_pix[et->first_member], eb->member_vep[et->first_member]);
+      continue;
+    }
+    for (i = 0; i < et->m; i++) {
+      partial_index_t *pix = pixes + eb->member_pix[et->first_member + i];
+      postings_cursor_init(mp->cursors + i, pix, eb->member_vep[et->first_member + i]);
+    }
+    mp->members = et->m;
+    mp->current = 0;
+    mp->count = et->count;
+    mp->taken = 0;
+    while (merged_postings_next(mp, &docnum, &wdnum)) {
+      eb->docnums[et->start + et->gathered] = docnum;
+      eb->wdnums[et->start + et->gathered] = (byte)wdnum;
+      et->gathered++;
+    }
+    for (i = 0; i < et->m; i++) postings_cursor_finish(mp->cursors + i);
+  }
+}
+
+
+static byte *encode_term_bitmap(bmp_writer_t *bw, emission_batch_t *eb, emission_term_t *et, docnum_t min_docs,
+				docnum_t **scratch, size_t *scratch_capacity, size_t *len) {
+  // If the term occurs in at least min_docs documents, encode its document set for QBASH.bitmaps
+  // and return the buffer to be written, otherwise return NULL.  The postings of a term gathered
+  // still compressed are first decoded into *scratch.
+  docnum_t *docnums, prev = -1, docs = 0;
+  u_ll g;
+
+  if (et->gathered < 2 || (docnum_t)et->gathered < min_docs) return NULL;  // ----------------->
+  if (et->copy_chunks) {
+    byte *cb = eb->chunk_bytes + et->start, *end = cb + et->copied_bytes;
+    docnum_t docnum = 0, gap;
+    *scratch = (docnum_t *)grow_array(*scratch, scratch_capacity, et->gathered, sizeof(docnum_t), "bitmap docnums");
+    for (g = 0; g < et->gathered && cb < end; g++) {
+      cb++;   // wdnum
+      gap = 0;
+      do {
+	gap = (gap << 7) | (*cb >> 1);
+      } while (!(*cb++ & 1));
+      docnum += gap;
+      (*scratch)[g] = docnum;
+    }
+    docnums = *scratch;
+  }
+  else docnums = eb->docnums + et->start;
+
+  for (g = 0; g < et->gathered; g++) {
+    if (docnums[g] != prev) docs++;
+    prev = docnums[g];
+  }
+  if (docs < min_docs) return NULL;  // ----------------->
+  return bmp_encode_term(bw, et->key, docnums, et->gathered, len);
+}
+
+
+// In the second phase, the terms of a batch are split into contiguous ranges with similar 
+// numbers of postings, and each range is compressed into its own buffer by a compression worker.
+// The .if offsets recorded by a worker are relative to the start of its buffer until all the 
+// workers have finished.  Then they're fixed up by adding the sizes of the preceding buffers,
+// the .vocab entries are written, and the buffers are appended to .if in term order.
+
+typedef struct {
+  emission_batch_t *eb;
+  size_t first_term, last_term;   // This worker compresses eb->terms[first_term] ... [last_term - 1]
+  byte *if_bytes;                 // Compressed postings, exactly as they will appear in .if
+  size_t if_used, if_capacity;
+  u_ll max_plist_len, histo[7], postings_lists_with_skip_blocks, tot_skip_blocks_written, max_sb_runs_per_list;
+  u_int SB_POSTINGS_PER_RUN, SB_TRIGGER;
+  byte sb_run_accumulator[SB_MAX_BYTES_PER_RUN];
+} compression_worker_t;
+
+
+static void append_if_bytes(compression_worker_t *cw, byte *data, size_t n) {
+  if (cw->if_used + n > cw->if_capacity)
+    cw->if_bytes = (byte *)grow_array(cw->if_bytes, &(cw->if_capacity), cw->if_used + n, sizeof(byte), "compressed postings");
+  memcpy(cw->if_bytes + cw->if_used, data, n);
+  cw->if_used += n;
+}
+
+
+static void compress_term_range(compression_worker_t *cw) {
+  // Work out the .vocab payload and QIDF of each term in the range and append its compressed 
+  // postings list (if it has more than one posting) to cw->if_bytes.
+  emission_batch_t *eb = cw->eb;
+  size_t t;
+  u_ll *ullp;
+
+  cw->if_used = 0;
+  for (t = cw->first_term; t < cw->last_term; t++) {
+    emission_term_t *et = eb->terms + t;
+    char *key = (char *)et->key;
+    docnum_t last_docnum = 0, docnum_diff = 0, docnum = 0, *docnums = eb->docnums + et->start;
+    byte *wdnums = eb->wdnums + et->start, bight, bytes[8];
+    int wdnum = 0, bytes_needed;
+    u_int g, count = et->count, current_sb_postings_per_run;
+    u_ll list_elts = 0, skip_blocks_written = 0;
+
+    if (debug >= 2) printf("   - %s %u, from %d partial indexes\n", key, count, et->m);
+
+    if (count <= 1) {
+      // There's only one posting, its docnum and wdnum go in the .vocab entry
+      if (et->gathered > 0) {
+	docnum = docnums[0];
+	wdnum = wdnums[0];
+      }
+      et->payload = (docnum << WDPOS_BITS) | (wdnum & WDPOS_MASK);
+      et->qidf = (byte)quantized_idf(cw->max_plist_len * 1.5, count, 0XFF);    // The constant makes the QIDF of the most common term come out to be 1
+      // In this case there's nothing to be written to .if
+      cw->histo[0]++;
+      continue;
+    }
+
+    // There are multiple postings.  The .vocab entry will record the .if offset.
+    et->payload = cw->if_used;
+    et->qidf = (byte)quantized_idf(cw->max_plist_len * 1.05, count, 0XFF);    // The constant makes the QIDF of the most common term come out to be 1
+
+    if (et->copy_chunks) {
+      // Already compressed.  Just tally the posting sizes: a wdnum byte then the vbyte gap.
+      byte *cb = eb->chunk_bytes + et->start;
+      u_ll i = 0, s;
+      append_if_bytes(cw, cb, et->copied_bytes);
+      while (i < et->copied_bytes) {
+	s = i++;
+	while (!(cb[i++] & 1));
+	cw->histo[i - s]++;
+      }
+      continue;
+    }
+
+    if (cw->SB_TRIGGER > 0 && count >= cw->SB_TRIGGER) {  // No skip blocks unless SB_TRIGGER is non-zero
+      // ---------------------------- We're writing skip blocks for this inverted file.  -----------
+      u_int sb_postings_accumulated = 0, sb_bytes_accumulated = SB_BYTES + 1;  // Allow for SB_MARKER and SKIP BLOCK
+      byte *sb_run_accumulator = cw->sb_run_accumulator;
+
+      if (cw->SB_POSTINGS_PER_RUN == 0) {
+	// Dynamic setting of run lengths
+	current_sb_postings_per_run = (u_int)round(sqrt((double)count));
+	// Since the number of postings per run is limited to SB_MAX_COUNT (4096 at present)
+	// we need to limit the run lengths for terms with more than 16 million postings.
+	if (current_sb_postings_per_run > SB_MAX_COUNT) current_sb_postings_per_run = SB_MAX_COUNT;
+      }
+      else current_sb_postings_per_run = cw->SB_POSTINGS_PER_RUN;  // Static setting
+
+      cw->postings_lists_with_skip_blocks++;
+      for (g = 0; g < et->gathered; g++) {
+	docnum = docnums[g];
+	wdnum = wdnums[g];
+	list_elts++;
+	if (docnum > x_max_docs) {
+	  printf("Error in postings for '%s': wdnum=%u, docnum = %llu\n", key, wdnum, docnum);
+	  printf("  -- list_elts=%llu, count = %u\n", list_elts, count);
+	  error_exit("Error: Erroneous docnum encountered while writing inverted file.\n");
+	}
+
+	docnum_diff = docnum - last_docnum;
+	last_docnum = docnum;
+
+	// Write the first byte
+	bight = (byte)(wdnum);
+	if (bight == 255) {
+	  // We've come to the end of the valid postings in this chunk.
+	  // Shouldn't ever happen
+	  error_exit("Error:  invalid wdpos (AXE)\n"); // -------------------------------------------------------------------------------------------------->
+	}
+	sb_run_accumulator[sb_bytes_accumulated++] = bight;
+	bytes_needed = vbyte_encode_docnum_diff(docnum_diff, sb_run_accumulator + sb_bytes_accumulated);
+	sb_bytes_accumulated += bytes_needed;
+	cw->histo[(bytes_needed + 1)]++;
+	sb_postings_accumulated++;
+	if (sb_postings_accumulated >= current_sb_postings_per_run) {
+	  // Need to output SB_MARKER, skipblock and run.
+	  sb_run_accumulator[0] = SB_MARKER;
+	  ullp = (unsigned long long *) (sb_run_accumulator + 1);
+	  if (list_elts >= count) {
+	    // If this run happens to end at the end of the list, write a length of zero.
+	    *ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, 0ULL);
+	  }
+	  else {
+	    *ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, (u_ll)sb_bytes_accumulated);
+	  }
+	  append_if_bytes(cw, sb_run_accumulator, sb_bytes_accumulated);
+	  skip_blocks_written++;
+	  cw->tot_skip_blocks_written++;
+	  sb_postings_accumulated = 0;
+	  sb_bytes_accumulated = SB_BYTES + 1;
+	}
+      }  // End of zooming through the postings for this term
+
+      // May need to write a partial run
+      if (sb_postings_accumulated) {
+	// Need to output SB_MARKER, skipblock and run.
+	sb_run_accumulator[0] = SB_MARKER;
+	ullp = (u_ll *)(sb_run_accumulator + 1);
+	*ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, 0ULL);  // Zero because this is the last one.
+	append_if_bytes(cw, sb_run_accumulator, sb_bytes_accumulated);
+	skip_blocks_written++;
+	cw->tot_skip_blocks_written++;
+      }
+
+      if (skip_blocks_written > cw->max_sb_runs_per_list) cw->max_sb_runs_per_list = skip_blocks_written;
+      // ---------------------------- We've written skip blocks for this inverted file.  -----------
+    }
+    else {
+      // No skip blocks.
+      for (g = 0; g < et->gathered; g++) {
+	docnum = docnums[g];
+	wdnum = wdnums[g];
+	list_elts++;
+	if (docnum > x_max_docs) {
+	  printf("Error in postings for '%s': wdnum=%u, docnum = %llu\n", key, wdnum, docnum);
+	  printf("  -- list_elts=%llu, count = %u\n", list_elts, count);
+	  error_exit("Error: Erroneous docnum encountered while writing inverted file.\n");
 	}
 
-	printf("Writing the .vocab and .if  (except we didn't!) elapsed time: %.1f sec.\n", what_time_is_it() - then);
-	fflush(stdout);
+	// A byte with the wordnum, then the vbyte encoded docnum_diff
+	bytes[0] = (byte)wdnum;
+	docnum_diff = docnum - last_docnum;
+	last_docnum = docnum;
+	bytes_needed = vbyte_encode_docnum_diff(docnum_diff, bytes + 1);
+	if (debug >= 4) printf(" Word '%s': wdnum = %d, docnum = %lld docnumdiff = %lld, bytes_needed = %d\n",
+			       key, wdnum, docnum, docnum_diff, bytes_needed);
+	append_if_bytes(cw, bytes, bytes_needed + 1);
+	cw->histo[bytes_needed + 1]++;
+      }
+    }
+  }
 }
+
+
+#ifdef WIN64
+static DWORD WINAPI compression_thread(LPVOID arg) {
+#else
+static void *compression_thread(void *arg) {
 #endif
+  compress_term_range((compression_worker_t *)arg);
+  return 0;
+}
 
 
-static byte vocabfile_record[VOCABFILE_REC_LEN + 10], arg_list[IF_HEADER_LEN - 250];
+static int assign_term_ranges(emission_batch_t *eb, compression_worker_t *workers, int num_workers) {
+  // Split the terms in the batch into up to num_workers contiguous ranges with roughly equal 
+  // numbers of postings.  Return the number of ranges.
+  u_ll target = (eb->num_postings + eb->num_copied_postings) / num_workers + 1, sum;
+  size_t t = 0;
+  int w = 0;
+  while (w < num_workers && t < eb->num_terms) {
+    workers[w].first_term = t;
+    sum = 0;
+    while (t < eb->num_terms && (sum < target || w == num_workers - 1)) {
+      sum += eb->terms[t].count;
+      t++;
+    }
+    workers[w].last_term = t;
+    w++;
+  }
+  return w;
+}
+
+
+static void run_compression_workers(compression_worker_t *workers, int num_workers) {
+  int w, error_code;
+#ifdef WIN64
+  HANDLE threads[MAX_INDEXING_THREADS];
+#else
+  pthread_t threads[MAX_INDEXING_THREADS];
+#endif
 
-double write_inverted_file(dahash_table_t *ht, u_char *fname_vocab, u_char *fname_if, doh_t ll_heap,
-			   u_int SB_POSTINGS_PER_RUN, u_int SB_TRIGGER, docnum_t doccount, long long fsz, u_ll max_plist_len) {
-  // Sort the keys stored in ht into alphabetic order, then write the .vocab an
-  // .if files
+  if (num_workers == 1) {
+    compress_term_range(workers);
+    return;  // ----------------------------------->
+  }
+
+  for (w = 0; w < num_workers; w++) {
+#ifdef WIN64
+    threads[w] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)compression_thread, (LPVOID)(workers + w), 0, NULL);
+    if (threads[w] == NULL) {
+      printf("Error %u: CreateThread() for compression thread %d\n", GetLastError(), w);
+      exit(1);
+    }
+#else
+    error_code = pthread_create(threads + w, NULL, compression_thread, (void *)(workers + w));
+    if (error_code) {
+      printf("Error %d: pthread_create() for compression thread %d\n", error_code, w);
+      exit(1);
+    }
+#endif
+  }
+  for (w = 0; w < num_workers; w++) {
+#ifdef WIN64
+    WaitForSingleObject(threads[w], INFINITE);
+    CloseHandle(threads[w]);
+#else
+    pthread_join(threads[w], NULL);
+#endif
+  }
+}
+
+
+double write_inverted_file(partial_index_t *pixes, int num_pixes, u_char *fname_vocab, u_char *fname_if,
+			   u_int SB_POSTINGS_PER_RUN, u_int SB_TRIGGER, docnum_t doccount, long long fsz,
+			   u_ll *max_plist_len, u_ll *vocab_size) {
+  // Merge the alphabetically sorted vocabularies of the partial indexes, then write the .vocab and
+  // .if files.
   // 
   // doccount and fsz are passed in only to enable file lengths to be written into the .if header
+  // The longest postings list and the number of distinct terms in the merged index are returned
+  // via max_plist_len and vocab_size.
   // Return size of .if and .vocab files in MB (as a double)
 
-  int b, e, p, interval = 1000, error_code = 0;
-  byte **permute, *vocab_buf = NULL, *if_buf = NULL, qidf = 1;
-  posting_p headptr = NULL, currptr = NULL, nextptr = NULL, tailptr = NULL;    // posting_p is just byte *
-  size_t entry_size, vocab_buf_used = 0, if_buf_used = 0;
-  u_ll ht_off = 0, if_off = 0, list_elts = 0, histo[7] = { 0 }, vocab_file_size,
-								  postings_lists_with_skip_blocks = 0, skip_blocks_written = 0, tot_skip_blocks_written = 0,
-								  max_sb_runs_per_list = 0;
+  int b, i, m, interval = 1000, error_code = 0, members[MAX_INDEXING_THREADS];
+  byte *vocab_buf = NULL, *if_buf = NULL;
+  size_t pos[MAX_INDEXING_THREADS], vocab_buf_used = 0, if_buf_used = 0, e, p;
+  u_ll if_off = 0, histo[7] = { 0 }, vocab_file_size,
+    postings_lists_with_skip_blocks = 0, tot_skip_blocks_written = 0,
+    max_sb_runs_per_list = 0, permute_entries = 0, postings_copied = 0;
   CROSS_PLATFORM_FILE_HANDLE vocab_handle, if_handle;
   double invfile_MB, permute_MB;
   u_char *if_header = NULL;
-  u_short chunk_count = 0;
-  u_int count, current_sb_postings_per_run, chunkno = 1;  // I assume we start from one.
-  u_ll head, tail;
-  size_t *header, blocknum, byteoffset, bytes_used_in_header;
-  posting_p *pblock;
-  BOOL verbose = (debug >= 2);
+  u_int count;
+  size_t *header, bytes_used_in_header;
+  merged_postings_t *mp;
+  emission_batch_t *eb;
+  BOOL verbose = (debug >= 2), alphabetic_gather;
+  double phase_start, gather_secs = 0, write_secs = 0;
+  long long pf_phase_start, gather_faults = 0, write_faults = 0;
+  int batches = 0, w, num_workers, ranges;
+  compression_worker_t *workers;
+  fcv_encoder_t fcv;
+  byte fcv_header[sizeof(fcv_header_t)], fcv_entry[VOCABFILE_REC_LEN], *fcv_trailer;
+  size_t fcv_entry_len, fcv_trailer_len;
+  bmp_writer_t bmp;
+  CROSS_PLATFORM_FILE_HANDLE bitmaps_handle;
+  byte *bitmaps_buf = NULL, *bmp_bytes;
+  size_t bitmaps_buf_used = 0, bmp_len, bmp_scratch_capacity = 0, fname_len;
+  docnum_t *bmp_scratch = NULL, bmp_min_docs = 0;
+  u_char *fname_bitmaps;
 #ifdef WIN64
   vocab_handle = NULL;
   if_handle = NULL;
+  bitmaps_handle = NULL;
 #else
   vocab_handle = -1;
   if_handle = -1;
+  bitmaps_handle = -1;
 #endif
 
-  header = (size_t *)ll_heap;
-  pblock = (posting_p *)(header + DOH_HEADER_ENTS);
-
   if (verbose) printf("write_inverted_file()\n");
 
-
-  if (ht == NULL) {
-    printf("Error: write_inverted_file(): attempt to dump NULL table.\n");
+  if (pixes == NULL || num_pixes < 1 || num_pixes > MAX_INDEXING_THREADS) {
+    printf("Error: write_inverted_file(): invalid set of %d partial indexes.\n", num_pixes);
     exit(1);
   }
 
-  vocab_file_size = ht->entries_used * VOCABFILE_REC_LEN;
-  if (0) printf("CANBERRA: vfs = %zu * %d = %lld\n",
-		ht->entries_used, VOCABFILE_REC_LEN, vocab_file_size);
-
-  entry_size = ht->key_size + ht->val_size;
-  permute = (byte **)malloc(ht->entries_used * sizeof(byte *));  // MAL600
-  permute_MB = (double)(ht->entries_used * sizeof(byte *)) / MEGA;
-
+  mp = (merged_postings_t *)malloc(sizeof(merged_postings_t));
+  if (mp == NULL) error_exit("Error: malloc failed for merged_postings_t");
 
 #ifdef WIN64
   report_memory_usage(stdout, (u_char *)"before writing the inverted file", &pfc_list_scan_start);
 #endif
 
-  // permute is freed at the end of this function
-  p = 0;
-  for (e = 0; e < ht->capacity; e++) {
-    if (((byte *)(ht->table))[ht_off]) {
-      permute[p++] = ((byte *)(ht->table)) + ht_off;
+  // permutes are freed at the end of this function
+  for (i = 0; i < num_pixes; i++) {
+    if (pixes[i].ht == NULL) {
+      printf("Error: write_inverted_file(): attempt to dump NULL table.\n");
+      exit(1);
     }
-    ht_off += ht->entry_size;
+    if (pixes[i].permute == NULL) sort_partial_index_vocab(pixes + i);
+    permute_entries += pixes[i].entries;
   }
-
-  qsort(permute, p, sizeof(byte *), compare_keys_alphabetic);
+  permute_MB = (double)(permute_entries * sizeof(byte *)) / MEGA;
 
   printf("QSORT of vocabulary permuter complete.\n");
 
+  // First pass over the merged vocabulary:  We need the number of distinct terms for the 
+  // header and the longest list for the IDFs before anything is written.  max_plist_len is
+  // calculated the way that process_a_word_internal() used to: lists of three postings
+  // copied out of the vocab entry don't count.
+  memset(pos, 0, sizeof(pos));
+  *max_plist_len = 0;
+  p = 0;
+  while ((m = next_merged_term(pixes, num_pixes, pos, members)) > 0) {
+    count = merged_count(pixes, pos, members, m);
+    if (count > *max_plist_len && (!x_2postings_in_vocab || count > 3)) *max_plist_len = count;
+    for (i = 0; i < m; i++) pos[members[i]]++;
+    p++;
+  }
+  *vocab_size = p;
+
+  if (x_front_coded_vocab) {
+    // The size of a front-coded .vocab depends on the terms, and it's needed for the .if header.
+    // Encode the vocabulary once just to measure it.
+    memset(pos, 0, sizeof(pos));
+    fcv_encoder_init(&fcv, p, fcv_header);
+    while ((m = next_merged_term(pixes, num_pixes, pos, members)) > 0) {
+      vocabfile_entry_packer(vocabfile_record, MAX_WD_LEN + 1, pixes[members[0]].permute[pos[members[0]]], 0, 0, 0);
+      fcv_encode(&fcv, vocabfile_record, fcv_entry);
+      for (i = 0; i < m; i++) pos[members[i]]++;
+    }
+    fcv_trailer = fcv_encoder_finish(&fcv, &fcv_trailer_len);
+    free(fcv_trailer);
+    vocab_file_size = fcv.offset + fcv_trailer_len;
+    printf("Front-coded .vocab will be %llu bytes, rather than %llu.\n", vocab_file_size, (u_ll)p * VOCABFILE_REC_LEN);
+  }
+  else vocab_file_size = p * VOCABFILE_REC_LEN;
+  if (0) printf("CANBERRA: vfs = %zu * %d = %lld\n",
+		p, VOCABFILE_REC_LEN, vocab_file_size);
+  if (num_pixes > 1) printf("Vocabularies of %d partial indexes merged: %zu distinct terms.\n", num_pixes, p);
+
   if (!x_minimize_io) {
     vocab_handle = open_w((char *)fname_vocab, &error_code);
     fflush(stdout);
@@ -286,7 +1187,7 @@ double write_inverted_file(dahash_table_t *ht, u_char *fname_vocab, u_char *fnam
 	    "Size of .forward: %lld\nSize of .dt: %lld\nSize of .vocab: %llu\nTotal postings: %llu\nNumber of documents: %lld\n"
 	    "Vocabulary size: %llu\n%s",
 	    INDEX_FORMAT, INDEX_FORMAT, QBASHER_VERSION, QBASH_META_CHARS, other_token_breakers,
-	    fsz, doccount * DTE_LENGTH, vocab_file_size, tot_postings, doccount, vocab_file_size / VOCABFILE_REC_LEN,
+	    fsz, doccount * DTE_LENGTH, vocab_file_size, tot_postings, doccount, *vocab_size,
 	    arg_list);
 		
     bytes_used_in_header = strlen((char *)if_header);
@@ -300,9 +1201,11 @@ double write_inverted_file(dahash_table_t *ht, u_char *fname_vocab, u_char *fnam
   // Report memory use prior to writing .vocab and .if so we can see what might be 
   // causing slowness at that stage.
   printf("write_inverted_file: permute array occupies %.1f MB\n", permute_MB);
-  printf("write_inverted_file: hash table occupies: %.1fMB\n", (double)ht->capacity * (double)entry_size / MEGA);
-
-  doh_print_usage_report(ll_heap);
+  for (i = 0; i < num_pixes; i++) {
+    printf("write_inverted_file: hash table occupies: %.1fMB\n",
+	   (double)pixes[i].ht->capacity * (double)pixes[i].ht->entry_size / MEGA);
+    doh_print_usage_report(pixes[i].ll_heap);
+  }
   fflush(stdout);
 
 
@@ -311,481 +1214,161 @@ double write_inverted_file(dahash_table_t *ht, u_char *fname_vocab, u_char *fnam
 	 "the hash table and Dave's own heap.  If not, look for a file still memory mapped. If the\n"
 	 "working set size is more than say 90%% of the physical RAM available, the final phase of\n"
 	 "is likely to be very slow because access patterns are random -- apart from the moderating\n"
-	 "effect of chunking.\n\n");
+	 "effects of chunking and of gathering postings in heap address order (x_postings_gather_batch).\n\n");
 
   fflush(stdout);
 
-#if 0
-  if (x_sort_postings_instead > 0) {
-    sort_accumulated_postings(ht, (LPCSTR)fname_vocab, (LPCSTR)fname_if, ll_heap,
-			      SB_POSTINGS_PER_RUN, SB_TRIGGER, doccount, fsz);
+  for (i = 0; i < num_pixes; i++) {
+    if (pixes[i].runs != NULL) {
+      printf("write_inverted_file: partial index %d has %d sorted runs (%.1f sec. spilling)\n",
+	     i, pixes[i].runs->num_runs, pixes[i].runs->msec_spilling / 1000.0);
+      free(pixes[i].runs->accumulator);   // All spilled by now.
+      pixes[i].runs->accumulator = NULL;
+      open_sorted_runs(pixes[i].runs);
+    }
   }
-  else
-#endif
-    {
-      printf("Starting to write out postings and vocab table entries....\n");
-      for (e = 0; e < p; e++) {
-	char *key = (char *)(permute[e]);
-	vocab_entry_p vep = ((vocab_entry_p)(((byte *)permute[e]) + ht->key_size));
-	// The following declarations are to support chunking
-	u_int current_k = 1, K = chunk_K_table[current_k];
-	u_ll count_limit_for_current_k = chunk_length_table[current_k];
-	byte *payloadptr, *nextptrptr;
-	u_ll next;
-
-	// The vocab entry may be packed either 4,6,6 or 4,5,5,2
-	count = ve_get_count(vep);
-	if (x_2postings_in_vocab && count < 3)
-	  ve_unpack466(vep, &count, &head, &tail);     // Head and tail should be 5-byte (or 6-byte) compound references within the DOH
-	else
-	  ve_unpack4552(vep, &count, &head, &tail, &chunk_count);
-
-
-	if (verbose) printf("   - %s %u, %lld, %lld\n", key, count, head, tail);
-	headptr = doh_get_pointer(ll_heap, head);
-	tailptr = doh_get_pointer(ll_heap, tail);
-
-	list_elts = 0;
-
-	if (count <= 1) {
-	  // There's only one posting, write docnum and wdnum into .vocab entry
-	  unsigned long long towrite;
-	  docnum_t docnum;
-	  int wdnum, b;
-	  if (verbose) printf("Single\n");
-	  if (x_2postings_in_vocab) {
-	    //  ---- The posting is actually in the .vocab entry.  head is not actually a list pointer
-	    docnum = head >> WDPOS_BITS;
-	    wdnum = head & WDPOS_MASK;
-	    if (verbose) printf("Extracted single posting (%llu, %u) from the vocab entry for %s.\n", docnum, wdnum, key);
-	  }
-	  else {  // ---- The posting is in a list chunk.  It may be vbyte compressed
-	    // Get the wordnum - just a single byte.
-	    wdnum = headptr[0];
-	    docnum = 0;
-	    if (x_use_vbyte_in_chunks) {
-	      byte bight;
-	      b = 1;
-	      do {
-		bight = headptr[b] >> 1;  // Continuation bit is LSB
-		docnum <<= 7;
-		docnum |= bight;
-		b++;
-	      } while (!(headptr[b - 1] & 1));
-	    }
-	    else {
-	      for (b = 5; b > 0; b--){   // bytes were written little-endian
-		docnum <<= 8;
-		docnum |= headptr[b];
-	      }
-	    }
-	    if (verbose) printf("Extracted single posting (%llu, %u) from the only list chunk for %s.\n", docnum, wdnum, key);
-	  }
-
-	  towrite = (docnum << WDPOS_BITS) | (wdnum & WDPOS_MASK);
-	  qidf = (byte)quantized_idf(max_plist_len * 1.5, count, 0XFF);    // The constant makes the QIDF of the most common term come out to be 1
-	  if (0) printf("  -- count = %u,  idf = %.4f,  qidf = %u\n", count, log(max_plist_len * 1.004008 / (double)count), qidf);
-	  vocabfile_entry_packer(vocabfile_record, MAX_WD_LEN + 1, (byte *)key, count, qidf, towrite);
-	  if (!x_minimize_io) {
-	    buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, vocabfile_record,
-			   VOCABFILE_REC_LEN, "vocab single posting");
-	  }
 
+  // QBASH.bitmaps goes alongside the .if.  A stale one from an earlier indexing run would
+  // be rejected by QBASHQ but it's less confusing to remove it.
+  fname_len = strlen((char *)fname_if);
+  fname_bitmaps = (u_char *)cmalloc(fname_len + 10, (u_char *)"bitmaps filename", FALSE);
+  strcpy((char *)fname_bitmaps, (char *)fname_if);
+  if (fname_len >= 3 && !strcmp((char *)fname_bitmaps + fname_len - 3, ".if")) fname_bitmaps[fname_len - 3] = 0;
+  strcat((char *)fname_bitmaps, ".bitmaps");
+  bmp_writer_init(&bmp);
+  if (x_bitmap_density > 0) {
+    bmp_min_docs = (docnum_t)ceil(x_bitmap_density * (double)doccount);
+    if (bmp_min_docs < 2) bmp_min_docs = 2;
+    if (!x_minimize_io) {
+      bitmaps_handle = open_w((char *)fname_bitmaps, &error_code);
+      if (error_code) {
+	error_exit("Unable to open .bitmaps file for writing.");
+      }
+    }
+  }
+  else remove((char *)fname_bitmaps);
 
-	  // In this case there's nothing to be written to .if
-	  histo[0]++;
-	  if (verbose) printf("Single. done\n");
+  printf("Starting to write out postings and vocab table entries....\n");
+  if (x_front_coded_vocab) {
+    fcv_encoder_init(&fcv, p, fcv_header);
+    if (!x_minimize_io) 
+      buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, fcv_header, sizeof(fcv_header), "vocab header");
+  }
+  eb = create_emission_batch(x_postings_gather_batch, SB_TRIGGER);
+  num_workers = x_compression_threads;
+  if (num_workers < 1) num_workers = 1;
+  if (num_workers > MAX_INDEXING_THREADS) num_workers = MAX_INDEXING_THREADS;
+  workers = (compression_worker_t *)malloc(num_workers * sizeof(compression_worker_t));  // MAL603
+  if (workers == NULL) error_exit("Error: malloc failed for compression workers");
+  memset(workers, 0, num_workers * sizeof(compression_worker_t));
+  for (w = 0; w < num_workers; w++) {
+    workers[w].eb = eb;
+    workers[w].max_plist_len = *max_plist_len;
+    workers[w].SB_POSTINGS_PER_RUN = SB_POSTINGS_PER_RUN;
+    workers[w].SB_TRIGGER = SB_TRIGGER;
+  }
+  alphabetic_gather = (pixes[0].runs != NULL || x_postings_gather_batch == 0);
+  memset(pos, 0, sizeof(pos));
+  e = 0;
+  while (fill_emission_batch(eb, pixes, num_pixes, pos) > 0) {
+    // Phase 1: gather
+    phase_start = what_time_is_it();
+    pf_phase_start = get_page_fault_count();
+    gather_emission_batch(eb, pixes, mp, alphabetic_gather);
+    postings_copied += eb->num_copied_postings;
+    gather_secs += what_time_is_it() - phase_start;
+    gather_faults += get_page_fault_count() - pf_phase_start;
+    batches++;
+
+    // Phase 2: compress term ranges in parallel, then write in alphabetical order
+    phase_start = what_time_is_it();
+    pf_phase_start = get_page_fault_count();
+    ranges = assign_term_ranges(eb, workers, num_workers);
+    run_compression_workers(workers, ranges);
+    for (w = 0; w < ranges; w++) {
+      compression_worker_t *cw = workers + w;
+      size_t t;
+      for (t = cw->first_term; t < cw->last_term; t++, e++) {
+	emission_term_t *et = eb->terms + t;
+	if (et->count > 1) et->payload += if_off;   // Fix up the offset relative to the worker's buffer
+	vocabfile_entry_packer(vocabfile_record, MAX_WD_LEN + 1, et->key, et->count, et->qidf, et->payload);
+	if (x_front_coded_vocab) {
+	  fcv_entry_len = fcv_encode(&fcv, vocabfile_record, fcv_entry);
+	  if (!x_minimize_io)
+	    buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, fcv_entry, fcv_entry_len, "vocab entry");
 	}
-	else {
-	  // There are multiple postings.  
-	  docnum_t last_docnum = 0, docnum_diff = 0, docnum;
-	  u_int payload_bytes_available = K * PAYLOAD_SIZE;
-
-
-	  // Write the .if offset into .vocab
-	  if (verbose) printf("Multiple\n");
-	  qidf = (byte)quantized_idf(max_plist_len * 1.05, count, 0XFF);    // The constant makes the QIDF of the most common term come out to be 1
-	  if (0) printf("  -- count = %u,  idf = %.4f,  qidf = %u\n", count, log(max_plist_len * 1.05 / (double)count), qidf);
-	  vocabfile_entry_packer(vocabfile_record, MAX_WD_LEN + 1, (byte *)key, count, qidf, if_off);
-	  if (!x_minimize_io) {
-	    buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, vocabfile_record,
-			   VOCABFILE_REC_LEN, "vocab if offset");
-	  }
-	  // Then write the postings list entries into .if and update if_off
-	  currptr = headptr;
-	  //printf(" Multiple: e=%d\n", e);
-
-	  if (SB_TRIGGER > 0 && count >= SB_TRIGGER) {  // No skip blocks unless SB_TRIGGER is non-zero
-	    // ---------------------------- We're writing skip blocks for this inverted file.  -----------
-	    u_int sb_postings_accumulated = 0, sb_bytes_accumulated = SB_BYTES + 1;  // Allow for SB_MARKER and SKIP BLOCK
-	    byte bight;
-	    u_ll *ullp, limit;
-	    int wdnum, bytes_needed;
-
-	    if (SB_POSTINGS_PER_RUN == 0) {
-	      // Dynamic setting of run lengths
-	      current_sb_postings_per_run = (u_int)round(sqrt((double)count));
-	      // Since the number of postings per run is limited to SB_MAX_COUNT (4096 at present)
-	      // we need to limit the run lengths for terms with more than 16 million postings.
-	      if (current_sb_postings_per_run > SB_MAX_COUNT) current_sb_postings_per_run = SB_MAX_COUNT;
-	    }
-	    else current_sb_postings_per_run = SB_POSTINGS_PER_RUN;  // Static setting
-
-
-	    if (verbose) printf("Skip blocks.  Count = %u; Current run length = %u\n", count, current_sb_postings_per_run);
-	    skip_blocks_written = 0;
-	    postings_lists_with_skip_blocks++;
-
-	    list_elts = 0;   // How many postings have been written so far.  (compare against count, the nummber to be written)
-	    chunkno = 1;
-	    currptr = headptr;
-	    if (0) printf("Head of list (with skipping) for '%s' is %llu\n", key, head);
-	    while (currptr != NULL) {  // Zooming through the linked list of postings for this term
-	      if (chunkno > count_limit_for_current_k) {
-		current_k++;
-		count_limit_for_current_k = chunk_length_table[current_k];
-		K = chunk_K_table[current_k];
-		payload_bytes_available = K * PAYLOAD_SIZE;
-		if (chunkno > count_limit_for_current_k) {
-		  error_exit("Chunking stuffed!\n");
-		}
-	      }
-	      if (0) printf("'%s' looping through chunks.  chunkno=%u/chunk_count=%u list_elts=%llu, count=%u, K = %u\n", key, chunkno, chunk_count, list_elts, count, K);
-	      // Get all the postings out of the current chunk.
-	      payloadptr = currptr;
-	      while (payloadptr < (currptr + payload_bytes_available)) {
-		if (list_elts >= count) break;
-		// Get the wordnum - just a single byte.
-		wdnum = payloadptr[0];
-		if (wdnum == 0xFF)  {
-		  if (0) printf("Breaking out because of wdnum == 0xFF\n");
-		  break;  // --------------------------------------->
-		}
-		list_elts++;
-
-		if (x_use_vbyte_in_chunks) {
-		  // Get the vbyte-encoded docnum_diff
-		  byte bight;
-		  b = 1;
-		  docnum_diff = 0;
-		  do {
-		    bight = payloadptr[b] >> 1;  // Continuation bit is LSB
-		    docnum_diff <<= 7;
-		    docnum_diff |= bight;
-		    b++;
-		  } while (!(payloadptr[b - 1] & 1));
-		  docnum = last_docnum + docnum_diff;
-		  payloadptr += b;
-		}
-		else {
-		  // Get the docnum out of five bytes
-		  docnum = 0;
-		  for (b = 5; b > 0; b--){
-		    docnum <<= 8;
-		    docnum |= payloadptr[b];
-		  }
-		  payloadptr += PAYLOAD_SIZE;
-		}
-		if (0) printf("Extracted a posting (%llu, %u) from list chunk %d for %s.\n",
-			      docnum, wdnum, chunkno, key);
-
-		if (docnum > x_max_docs) {
-		  printf("Error in postings for '%s': x-th payload out of chunk of %d. wdnum=%u, docnum = %llu\n",
-			 key, K, wdnum, docnum);
-		  printf("  -- list_elts=%llu, count = %u\n", list_elts, count);
-		  error_exit("Error: Erroneous docnum encountered while writing inverted file.\n");
-		}
-
-		// NOTE:  Here we're writing vbytes, no longer reading them.
-		docnum_diff = docnum - last_docnum;
-		last_docnum = docnum;
-		// How many bytes do we need to represent the diff?  Can't be more than 6
-		limit = 1ULL << 7;
-		bytes_needed = 1;
-		while ((unsigned long long) docnum_diff >= limit) {
-		  bytes_needed++;
-		  limit <<= 7;
-		}
-
-		//printf(" Docnumdiff = %lld, bytes_needed = %d ", docnum_diff, bytes_needed);
-		// Write the first byte
-		bight = (byte)(wdnum);
-		if (bight == 255) {
-		  // We've come to the end of the valid postings in this chunk.
-		  // Shouldn't ever happen
-		  error_exit("Error:  invalid wdpos (AXE)\n"); // -------------------------------------------------------------------------------------------------->
-		}
-		sb_run_accumulator[sb_bytes_accumulated++] = bight;
-		// Need a loop and an array to be able to write the bytes
-		// in order of decreasing significance.
-		for (b = bytes_needed - 1; b >= 0; b--) {
-		  bight = docnum_diff & 0x7F;
-		  bight <<= 1;
-		  sb_run_accumulator[sb_bytes_accumulated + b] = bight;
-		  docnum_diff >>= 7;
-		}
-		sb_run_accumulator[sb_bytes_accumulated + bytes_needed - 1] |= 1;  // Signal last byte
-		sb_bytes_accumulated += bytes_needed;
-		histo[(bytes_needed + 1)]++;
-		sb_postings_accumulated++;
-		if (sb_postings_accumulated >= current_sb_postings_per_run) {
-		  // Need to output SB_MARKER, skipblock and run.
-		  sb_run_accumulator[0] = SB_MARKER;
-		  ullp = (unsigned long long *) (sb_run_accumulator + 1);
-		  if (list_elts >= count) {
-		    // If this run happens to end at the end of the list, write a length of zero.
-		    *ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, 0ULL);
-		  }
-		  else {
-		    *ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, (u_ll)sb_bytes_accumulated);
-		  }
-		  if (!x_minimize_io) buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, sb_run_accumulator, sb_bytes_accumulated, "SB full run");
-		  if_off += sb_bytes_accumulated;
-		  skip_blocks_written++;
-		  tot_skip_blocks_written++;
-		  sb_postings_accumulated = 0;
-		  sb_bytes_accumulated = SB_BYTES + 1;
-		}
-	      } // End of looping through payloads in a chunk.
-
-	      if (0) printf(" -- Loop over chunk %u finished. K = %u\n", chunkno, K);
-	      if (chunkno < 0xFFFF) chunkno++;
-	      // Get the next pointer --- Note that the NEXT field is now 6 bytes and is overloaded.  It is a next pointer
-	      // in all but the last chunk.  In the last chunk it contains a packed last_docno (37 bits) plus 
-	      // bytes_used (11 bits).
-
-	      if (currptr == tailptr) {
-		// This is how we detect the end of list now.
-		if (0) printf("Finished last chunk\n");
-		break;  //-------------------------------------------------------------------->  Drop out of loop.
-	      }
-
-	      // We know that NEXT actually is a pointer on this occasion.
-	      nextptrptr = currptr + payload_bytes_available;   // Have to calculate because chunk may have empties
-	      next = 0;
-	      for (b = (NEXT_POINTER_SIZE - 3); b >= 0; b--) {
-		next <<= 8;
-		next |= nextptrptr[b];
-	      }
-	      // We know that this is not the last chunk, so NEXT is actually a pointer
-	      byteoffset = next % header[2];
-	      blocknum = next / header[2];
-	      nextptr = pblock[blocknum] + byteoffset;
-	      currptr = nextptr;
-	      if (0) printf("Moving on to next chunk or next term.  Next = %llu\n", next);
-	    }  // End of zooming through the linked list of postings for this term
-
-	    // May need to write a partial run
-	    if (sb_postings_accumulated) {
-	      // Need to output SB_MARKER, skipblock and run.
-	      sb_run_accumulator[0] = SB_MARKER;
-	      ullp = (u_ll *)(sb_run_accumulator + 1);
-	      *ullp = sb_assemble(docnum, (u_ll)sb_postings_accumulated, 0ULL);  // Zero because this is the last one.
-	      if (!x_minimize_io) buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, sb_run_accumulator, sb_bytes_accumulated, "SB part run");
-	      if_off += sb_bytes_accumulated;
-	      skip_blocks_written++;
-	      tot_skip_blocks_written++;
-	      sb_postings_accumulated = 0;
-	      sb_bytes_accumulated = SB_BYTES + 1;
-	    }
-
-
-	    if (skip_blocks_written > max_sb_runs_per_list) max_sb_runs_per_list = skip_blocks_written;
-	    // ---------------------------- We've written skip blocks for this inverted file.  -----------
-	  }
-	  else {
-	    // This is the old code path, used if we're not doing skip blocks
-	    byte bight, bytes[5];
-	    docnum_t docnum, limit;
-	    int wdnum, bytes_needed;
-
-	    if (verbose) printf("Old code path\n");
-
-	    if (x_2postings_in_vocab  && count < 3) {
-	      // Note that the single posting case (count == 1) is handled specially at the top of this function.
-	      u_int c, p;
-	      u_ll dnwp[2];
-	      if (verbose) printf("Extracting %d postings for %s directly from the hash table entry\n", count, key);
-	      // Unpack the one or two postings into the dnwp array
-	      ve_unpack466(vep, &c, dnwp, dnwp + 1);
-	      last_docnum = 0;
-	      for (p = 0; p < count; p++) {
-		docnum = dnwp[p] >> WDPOS_BITS;
-		wdnum = dnwp[p] & WDPOS_MASK;
-
-		// Write a byte with the wordnum
-		bight = (byte)wdnum;
-		if (!x_minimize_io) buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, &bight, 1, "if wdnum");
-		// Now vbyte encode the docnum_diff
-		docnum_diff = docnum - last_docnum;
-		last_docnum = docnum;
-
-		// How many bytes do we need to represent the diff?  Can't be more than 6 (allowing up to 100 billion)
-		limit = 1ULL << 7;
-		bytes_needed = 1;
-		while (docnum_diff >= limit) {
-		  bytes_needed++;
-		  limit <<= 7;
-		}
-		if (verbose || debug >= 4) printf(" Word '%s': wdnum = %d, docnum = %lld docnumdiff = %lld, bytes_needed = %d\n",
-						  key, bight, docnum, docnum_diff, bytes_needed);
-		// Need a loop and an array to be able to write the bytes
-		// in order of decreasing significance.
-		for (b = bytes_needed - 1; b >= 0; b--) {
-		  bight = docnum_diff & 0x7F;
-		  bight <<= 1;
-		  bytes[b] = bight;
-		  docnum_diff >>= 7;
-		  if (debug >= 4) printf(", (%d, %X)", b, bytes[b]);
-		}
-		bytes[bytes_needed - 1] |= 1;   // Set the termination bit on the last byte
-		if (debug >= 4) printf("\n");
-		if (!x_minimize_io) buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, bytes, bytes_needed, "rest of multiple bytes");
-		if_off += (bytes_needed + 1);
-		histo[bytes_needed + 1]++;
-	      }
-	    }
-	    else {
-	      // No skip blocks, following the chunked linked list.
-	      u_int payload_bytes_available = K * PAYLOAD_SIZE;
-	      chunkno = 1;
-	      currptr = headptr;
-	      if (0) printf("Head of list for '%s' is %llu\n", key, head);
-	      while (currptr != NULL) {
-		if (chunkno > count_limit_for_current_k) {
-		  current_k++;
-		  count_limit_for_current_k = chunk_length_table[current_k];
-		  K = chunk_K_table[current_k];
-		  payload_bytes_available = K * PAYLOAD_SIZE;
-		  if (chunkno > count_limit_for_current_k) {
-		    error_exit("Chunking stuffed!\n");
-		  }
-		}
-		if (0)
-		  printf("'%s' looping through chunks.  chunk_count=%u list_elts=%llu, count=%u, K = %u\n", key, chunk_count, list_elts, count, K);
-
-		// Get all postings out of the current chunk.
-		payloadptr = currptr;
-		while (payloadptr < (currptr + payload_bytes_available)) {
-		  if (list_elts >= count) {
-		    if (0) printf("All needed elements found for %s\n", key);
-		    break;  // The whole list is finished.
-		  }
-		  // Get the wordnum - just a single byte.
-		  wdnum = payloadptr[0];
-		  if (wdnum == 0xFF)  {
-		    if (0) printf("Breaking out because of wdnum == 0xFF\n");
-		    break;  // --------------------------------------->
-		  }
-		  list_elts++;
-
-		  if (x_use_vbyte_in_chunks) {
-		    // Get the vbyte-encoded docnum_diff
-		    byte bight;
-		    b = 1;
-		    docnum_diff = 0;
-		    do {
-		      bight = payloadptr[b] >> 1;  // Continuation bit is LSB
-		      docnum_diff <<= 7;
-		      docnum_diff |= bight;
-		      b++;
-		    } while (!(payloadptr[b - 1] & 1));
-		    docnum = last_docnum + docnum_diff;
-		    payloadptr += b;
-		  }
-		  else {
-		    // Get the docnum out of five bytes
-		    docnum = 0;
-		    for (b = 5; b > 0; b--){
-		      docnum <<= 8;
-		      docnum |= payloadptr[b];
-		    }
-		    payloadptr += PAYLOAD_SIZE;
-		  }
-		  if (0) printf("Extracted a posting (%llu, %u) from list chunk %d for %s.\n",
-				docnum, wdnum, chunkno, key);
-		  if (docnum > x_max_docs) {
-		    printf("Error in postings for '%s': x-th payload out of chunk of %d. wdnum=%u, docnum = %llu\n",
-			   key, K, wdnum, docnum);
-		    printf("  -- list_elts=%llu, count = %u\n", list_elts, count);
-		    error_exit("Error: Erroneous docnum encountered while writing inverted file.\n");
-		  }
-
-		  // Write a byte with the wordnum
-		  bight = (byte)wdnum;
-		  if (!x_minimize_io) buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, &bight, 1, "if wdnum");
-		  // Now vbyte encode the docnum_diff
-		  docnum_diff = docnum - last_docnum;
-		  last_docnum = docnum;
-
-		  // How many bytes do we need to represent the diff?  Can't be more than 5
-		  limit = 1ULL << 7;
-		  bytes_needed = 1;
-		  while (docnum_diff >= limit) {
-		    bytes_needed++;
-		    limit <<= 7;
-		  }
-		  if (0) printf(" Word '%s': wdnum = %d, docnum = %lld docnumdiff = %lld, bytes_needed = %d\n",
-				key, bight, docnum, docnum_diff, bytes_needed);
-		  // Need a loop and an array to be able to write the bytes
-		  // in order of decreasing significance.
-		  for (b = bytes_needed - 1; b >= 0; b--) {
-		    bight = docnum_diff & 0x7F;
-		    bight <<= 1;
-		    bytes[b] = bight;
-		    docnum_diff >>= 7;
-		    if (debug >= 4) printf(", (%d, %X)", b, bytes[b]);
-		  }
-		  bytes[bytes_needed - 1] |= 1;   // Set the termination bit on the last byte
-		  if (debug >= 4) printf("\n");
-		  if (!x_minimize_io) buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, bytes, bytes_needed, "rest of multiple bytes");
-		  if_off += (bytes_needed + 1);
-		  histo[bytes_needed + 1]++;
-		}   // End of loop over payloads in a chunk
-
-		if (0) printf(" -- Loop over chunk %u finished. K = %u\n", chunkno, K);
-		if (chunkno < 0xFFFF) chunkno++;
-
-		// Get the next pointer --- Note that the NEXT field is now 6 bytes and is overloaded.  It is a next pointer
-		// in all but the last chunk. 
-
-		if (currptr == tailptr) {
-		  // This is how we detect the last chunk
-		  if (0) printf("Finished last chunk\n");
-		  break;  //-------------------------------------------------------------------->  Drop out of loop.
-		}
-
-		// We know that this is not the last chunk, so NEXT is actually a pointer
-		nextptrptr = currptr + K * PAYLOAD_SIZE;   // Have to calculate because chunk may have empties
-		next = 0;
-		for (b = (NEXT_POINTER_SIZE - 3); b >= 0; b--) {
-		  next <<= 8;
-		  next |= nextptrptr[b];
-		}
-		byteoffset = next % header[2];
-		blocknum = next / header[2];
-		nextptr = pblock[blocknum] + byteoffset;
-
-		currptr = nextptr;
-
-		if (0) printf("Moving on to next chunk or next term.  Next = %llu\n", next);
-	      }
-	    }
-	  }
+	else if (!x_minimize_io) {
+	  buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, vocabfile_record,
+			 VOCABFILE_REC_LEN, "vocab entry");
+	}
+	if (bmp_min_docs > 0
+	    && (bmp_bytes = encode_term_bitmap(&bmp, eb, et, bmp_min_docs, &bmp_scratch, &bmp_scratch_capacity, &bmp_len)) != NULL) {
+	  if (!x_minimize_io) buffered_write(bitmaps_handle, &bitmaps_buf, HUGEBUFSIZE, &bitmaps_buf_used, bmp_bytes, bmp_len, "term bitmaps");
+	  free(bmp_bytes);
 	}
-
 	if (e && e % interval == 0) {
-	  printf("%d - %s (%u)\n", e, key, count);
+	  printf("%zu - %s (%u)\n", e, (char *)et->key, et->count);
 	  fflush(stdout);
 	  if (e % (10 * interval) == 0)  interval *= 10;
 	}
       }
+      if (!x_minimize_io && cw->if_used > 0) 
+	buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, cw->if_bytes, cw->if_used, "compressed postings");
+      if_off += cw->if_used;
+    }
+    write_secs += what_time_is_it() - phase_start;
+    write_faults += get_page_fault_count() - pf_phase_start;
+  }
+  free_emission_batch(eb);
+
+  if (x_front_coded_vocab) {
+    fcv_trailer = fcv_encoder_finish(&fcv, &fcv_trailer_len);
+    if (fcv.offset + fcv_trailer_len != vocab_file_size) {
+      printf("Error: front-coded .vocab is %llu bytes, not %llu as recorded in the .if header.\n",
+	     fcv.offset + fcv_trailer_len, vocab_file_size);
+      exit(1);
     }
+    if (!x_minimize_io)
+      buffered_write(vocab_handle, &vocab_buf, HUGEBUFSIZE, &vocab_buf_used, fcv_trailer, fcv_trailer_len, "vocab block index");
+    free(fcv_trailer);
+  }
+
+  for (w = 0; w < num_workers; w++) {
+    for (b = 0; b < 7; b++) histo[b] += workers[w].histo[b];
+    postings_lists_with_skip_blocks += workers[w].postings_lists_with_skip_blocks;
+    tot_skip_blocks_written += workers[w].tot_skip_blocks_written;
+    if (workers[w].max_sb_runs_per_list > max_sb_runs_per_list) max_sb_runs_per_list = workers[w].max_sb_runs_per_list;
+    free(workers[w].if_bytes);
+  }
+  free(workers);  // FRE603
+
+  if (x_postings_gather_batch > 0) printf("Postings emitted in %d batches of up to %u million postings.\n", 
+					  batches, x_postings_gather_batch);
+  else printf("Postings emitted one term at a time, in alphabetical order.\n");
+  if (num_workers > 1) printf("  Postings compressed by %d threads.\n", num_workers);
+  printf("  %llu postings copied to .if still compressed, as held in the list chunks.\n", postings_copied);
+  printf("  Gather phase: %.3f sec elapsed;  %lld page faults (soft + hard)\n"
+	 "  Compress and write phase: %.3f sec elapsed;  %lld page faults (soft + hard)\n",
+	 gather_secs, gather_faults, write_secs, write_faults);
+
+  for (i = 0; i < num_pixes; i++) {
+    if (pixes[i].runs != NULL) close_and_remove_sorted_runs(pixes[i].runs);
+  }
 
   // Write the length of the file into the last 8 bytes so we may be able to  tell if it's truncated
   if_off += sizeof(if_off);
   if (!x_minimize_io) buffered_write(if_handle, &if_buf, HUGEBUFSIZE, &if_buf_used, (byte *)&if_off, sizeof(if_off), ".if file length");
 
+  // The bitmaps trailer records the document count and .if size, so QBASHQ can tell whether
+  // a QBASH.bitmaps belongs with the rest of the index.
+  if (bmp_min_docs > 0) {
+    bmp_bytes = bmp_writer_finish(&bmp, doccount, if_off, &bmp_len);
+    if (!x_minimize_io) buffered_write(bitmaps_handle, &bitmaps_buf, HUGEBUFSIZE, &bitmaps_buf_used, bmp_bytes, bmp_len, "bitmaps directory");
+    free(bmp_bytes);
+    printf("Bitmaps written for %llu terms occurring in at least %lld documents.\n", bmp.num_terms, (long long)bmp_min_docs);
+  }
+  free(bmp_scratch);
+
   printf("\nDistribution of postings sizes\n==============================\n");
   printf("  0 bytes: %lld (single posting kept in vocab file)\n", histo[0]);
   for (b = 1; b < 7; b++) {
@@ -800,25 +1383,40 @@ double write_inverted_file(dahash_table_t *ht, u_char *fname_vocab, u_char *fnam
   printf("=====================\n\n");
 
   printf("\nSignificant memory users\n==============================\n");
-  hashtable_MB = (double)ht->capacity * (double)entry_size / MEGA;
-  linkedlists_MB = (double)header[1] * (double)header[2] / MEGA;
-  chunks_allocated = header[4];
+  hashtable_MB = 0;
+  linkedlists_MB = 0;
+  chunks_allocated = 0;
+  for (i = 0; i < num_pixes; i++) {
+    header = (size_t *)pixes[i].ll_heap;
+    hashtable_MB += (double)pixes[i].ht->capacity * (double)pixes[i].ht->entry_size / MEGA;
+    linkedlists_MB += (double)header[1] * (double)header[2] / MEGA;
+    chunks_allocated += header[4];
+  }
   printf("Hash table: %.1fMB\n", hashtable_MB);
   printf("Linked lists: %.1fMB (Total size of the %lld DOH blocks allocated)\n", linkedlists_MB, chunks_allocated);
-  printf("Permute Array: %.1fMB\n", (double)ht->entries_used * (double)sizeof(byte *) / MEGA);
+  printf("Permute Array: %.1fMB\n", permute_MB);
+  if (x_use_large_pages) lp_report_usage(stdout);
   printf("==============================\n\n");
 
   printf("\nIndex files needed for query processing\n=======================================\n");
   printf("QBASH.vocab file:    %8.1fMB\n", (double)vocab_file_size / MEGA);
   printf("QBASH.if file:       %8.1fMB\n", (double)if_off / MEGA);
+  if (bmp_min_docs > 0) printf("QBASH.bitmaps file:  %8.1fMB\n", (double)(bmp.offset + bmp_len) / MEGA);
   // This output block will be completed by the main program.
 
   // Clean up
-  free(permute);    // FRE600
+  for (i = 0; i < num_pixes; i++) {
+    free(pixes[i].permute);    // FRE600
+    pixes[i].permute = NULL;
+    pixes[i].entries = 0;
+  }
+  free(mp);
   if (!x_minimize_io) {
     if (vocab_buf_used > 0) buffered_flush(vocab_handle, &vocab_buf, &vocab_buf_used, ".vocab", TRUE);
     if (if_buf_used > 0) buffered_flush(if_handle, &if_buf, &if_buf_used, ".if", TRUE);
+    if (bmp_min_docs > 0) buffered_flush(bitmaps_handle, &bitmaps_buf, &bitmaps_buf_used, ".bitmaps", TRUE);
   }
+  free(fname_bitmaps);
 
   invfile_MB = ((double)vocab_file_size + (double)if_off) / MEGA;
   return invfile_MB;
@@ -13,5 +13,51 @@ void buffered_write(CROSS_PLATFORM_FILE_HANDLE wh, byte **buffer, size_t buffer_
 	byte *data, size_t bytes2write, char *label);
 
 
-double write_inverted_file(dahash_table_t *vht, u_char *vocab_fname, u_char *if_fname, doh_t ll_heap,
-	u_int SB_POSTINGS_PER_RUN, u_int SB_TRIGGER, docnum_t doccount, long long fsz, u_ll max_plist_len);
+#define MAX_INDEXING_THREADS 64
+#define SORTED_RUN_READ_BUFSIZE 1048576  // Per run, while merging
+
+// With x_sort_postings_instead, postings are not built into linked lists.  Instead they are accumulated
+// as (termid, docnum, wdpos) triples in a fixed size buffer.  Whenever it fills, the buffer is 
+// spilled to a run file, in alphabetic order of term and then in docnum order.  Runs are spilled in 
+// increasing docnum order, so write_inverted_file() can produce each postings list by concatenating
+// the corresponding lists from each run.
+typedef struct {
+	FILE *f;
+	u_char term[MAX_WD_LEN + 1];   // The term whose postings are next to be read
+	u_int remaining;               // How many of its postings have yet to be read.  Zero at EOF
+} sorted_run_reader_t;
+
+typedef struct {
+	byte *accumulator;       // SORTABLE_POSTING_SIZE bytes per posting
+	u_ll capacity, accumulated;
+	u_int next_termid;
+	int num_runs;
+	u_char *fname_stem;      // Run files are called <fname_stem>.run<n>
+	sorted_run_reader_t *readers;   // Only set up while merging the runs
+	double msec_spilling;
+} postings_runs_t;
+
+postings_runs_t *create_postings_runs(u_char *fname_stem, u_ll capacity);
+
+void accumulate_sortable_posting(dahash_table_t *ht, postings_runs_t *runs, u_int termid, docnum_t docnum, u_int wdpos);
+
+void spill_sorted_run(dahash_table_t *ht, postings_runs_t *runs);
+
+
+// A partial index is the vocabulary hash table and postings heap built by one indexing thread
+// over a contiguous range of docnums.  Docnums in its postings lists are numbered from zero, i.e.
+// relative to first_docnum.  Serial indexing produces a single partial index.
+typedef struct {
+	dahash_table_t *ht;
+	doh_t ll_heap;
+	docnum_t first_docnum;
+	byte **permute;    // Alphabetically sorted pointers to the used entries in ht.  NULL until sorted.
+	size_t entries;    // Number of elements in permute
+	postings_runs_t *runs;   // If not NULL, postings are in sorted run files rather than in ll_heap
+} partial_index_t;
+
+void sort_partial_index_vocab(partial_index_t *pix);
+
+double write_inverted_file(partial_index_t *pixes, int num_pixes, u_char *vocab_fname, u_char *if_fname,
+	u_int SB_POSTINGS_PER_RUN, u_int SB_TRIGGER, docnum_t doccount, long long fsz,
+	u_ll *max_plist_len, u_ll *vocab_size);
@@ -33,26 +33,34 @@ arg_t args[] = {
 	{ "expect_cp1252", ABOOL, (void *)&expect_cp1252, "If text is likely to contain CodePage 1252 chars, extended punctuation should be token breaking.)" },
 	{ "min_wds", AINT, (void *)&min_wds, "Records with fewer than this number of words will not be indexed." },
 	{ "max_wds", AINT, (void *)&max_wds, "If greater than zero, records with more than this number of words will not be indexed." },
-	{ "max_raw_score", AFLOAT, (void *)&max_raw_score, "When indexing records in file order, scores in column 2 will be divided by this value." },
+	{ "max_raw_score", AFLOAT, (void *)&max_raw_score, "Static scores in column 2 are quantized relative to this value. Defaults to the largest score (or, in file order, the first). Give a delta index the value recorded for its main index." },
 	{ "score_threshold", AFLOAT, (void *)&score_threshold, "Index only records whose scores in column 2 equals or exceeds the specified value." },
 	{ "sb_run_length", AINT, (void *)&SB_POSTINGS_PER_RUN, "How many compressed postings occur in a run between consecutive skip blocks. Zero means set dynamically." },
 	{ "sb_trigger", AINT, (void *)&SB_TRIGGER, "Skip blocks will only be inserted in a postings list with at least this number of postings.  Zero means no skip blocks." },
 	{ "max_line_prefix", AINT, (void *)&max_line_prefix, "Index prefixes of the first word of a document up to this number of bytes." },
 	{ "max_line_prefix_postings", AINT, (void *)&max_line_prefix_postings, "Limit on how many postings are stored for each line_prefix. Ignored unless max_line_prefix > 0." },
+	{ "first_docnum", AINTLL, (void *)&first_docnum, "Number documents from this value. Set it to the number of docs in a main index to build a delta index for QBASHQ's delta_dir." },
 	{ "debug", AINT, (void *)&debug, "Activate debugging output.  0 - none, 1 - low, 4 - highest. (Not fully implemented.)" },
 #ifndef QBASHER_LITE
 	{ "sort_records_by_weight", ABOOL, (void *)&sort_records_by_weight, "If FALSE, records will be indexed in file order, and col. 2 is assumed to contain integer scores in range 0 - max_raw_score." },
 	{ "x_max_docs", AINTLL, (void *)&x_max_docs, "Stop indexing once this number of records have been indexed. (Incompatible with [default] sort_records_by_weight.)" },
 	{ "x_hashbits", AINT, (void *)&x_hashbits, "Explicitly set the initial size of the vocab hashtable.  " },
-	{ "x_hashprobe", AINT, (void *)&x_hashprobe, "Choose collision handling method.  0 - RPR, 1 - linear probing. " },
-	{ "x_use_large_pages", ABOOL, (void *)&x_use_large_pages, "If true, attempt to use the VM Large Pages mechanism to improve performance. " },
+	{ "x_hashprobe", AINT, (void *)&x_hashprobe, "Choose collision handling method.  0 - RPR, 1 - linear probing, 2 - SIMD probing of groups of hash fingerprints. " },
+	{ "x_use_large_pages", ABOOL, (void *)&x_use_large_pages, "If true, attempt to use the VM Large Pages mechanism to improve performance. On Linux, the hash table and linked lists use MAP_HUGETLB pages if reserved, otherwise transparent huge pages." },
 	{ "x_chunk_func", AINT, (void *)&x_chunk_func, "If non-zero the in-memory linked lists will be chunked using a scheme spedified by number. (Experimental.)" },
 	{ "x_minimize_io", ABOOL, (void *)&x_minimize_io, "If TRUE avoid normal i/o.  I.e. don't write index files. (Use for timing purposes). " },
 	{ "x_2postings_in_vocab", ABOOL, (void *)&x_2postings_in_vocab, "If TRUE store the first two linked list elements in the hash table entry. " },
 	{ "x_use_vbyte_in_chunks", ABOOL, (void *)&x_use_vbyte_in_chunks, "If TRUE the content of chunks for some list chunks may be compressed." },
 	{ "x_min_payloads_per_chunk", AINT, (void *)&x_min_payloads_per_chunk, "If non-zero, chunks will always have room for at least this number of payloads." },
-	//{ "x_sort_postings_instead", AINT, (void *)&x_sort_postings_instead, "If val > 0, linked lists will not be used.  Up to val million postings will be kept and sorted. (Incomplete.)" },
+	{ "x_sort_postings_instead", AINT, (void *)&x_sort_postings_instead, "If val > 0, no linked lists. Postings go to a buffer of val million which is sorted and spilled to a run file when full. Max 4000." },
+	{ "x_postings_gather_batch", AINT, (void *)&x_postings_gather_batch, "Postings lists are copied out of the heap in batches of up to val million postings, in heap address order, then written alphabetically. 0 - no batching." },
+	{ "x_compression_threads", AINT, (void *)&x_compression_threads, "Postings lists are compressed by this many threads, each working on a range of terms. Output is the same as for one thread." },
+	{ "x_indexing_threads", AINT, (void *)&x_indexing_threads, "Records sorted by weight are scanned and indexed by this many threads into private vocabularies, then merged. Docnums are as for one thread." },
+	{ "x_tokenizing_threads", AINT, (void *)&x_tokenizing_threads, "If > 0 and records are read in file order without mmapping, a reader, a record splitter and this many tokenizing threads feed the main thread.  (Not on Windows.)  The index is unchanged." },
 	{ "x_cpu_affinity", AINT, (void *)&x_cpu_affinity, "The number of the core QBASHI should run on. If not in process mask, will try higher numbers." },
+	{ "x_ascii_fast_path", ABOOL, (void *)&x_ascii_fast_path, "Split and case-fold pure ASCII triggers with a vectorized fast path. The words indexed are the same either way." },
+	{ "x_front_coded_vocab", ABOOL, (void *)&x_front_coded_vocab, "Write QBASH.vocab as front-coded blocks of terms with a block index, instead of fixed-length records. Smaller, and read by QBASHQ either way." },
+	{ "x_bitmap_density", AFLOAT, (void *)&x_bitmap_density, "Terms occurring in at least this fraction of documents also get a bitmap of their documents in QBASH.bitmaps, used by QBASHQ to skip and count without decoding postings. 0 - none." },
 	{ "x_bigger_trigger", ABOOL, (void *)&x_bigger_trigger, "Allow the indexing of more than 255 words per record." },
 	{ "x_doc_length_histo", ABOOL, (void *)&x_doc_length_histo, "Whether to create QBASH.doclenhist, a histogram of document lengths. (Only applicable if index_dir is defined.)" },
 	{ "x_geo_tile_width", AFLOAT, (void *)&x_geo_tile_width, "The width of geo-spatial tiles in km. If zero, no tiling." },
@@ -156,7 +164,7 @@ int store_arg_values(u_char *buffer, size_t buflen, BOOL show_experimentals) {
 			sprintf((char *)one_arg + l, "%lld", *(long long *)args[a].valueptr);
 			break;
 		case AFLOAT:
-			sprintf((char *)one_arg + l, "%.3g", *(double *)args[a].valueptr);
+			sprintf((char *)one_arg + l, "%.15g", *(double *)args[a].valueptr);  // Enough to read back max_raw_score exactly
 			break;
 		default:
 		  break;  // Impossible, but needed to stop compiler whinging
@@ -10,19 +10,23 @@
 #include <time.h>
 #include <fcntl.h>
 #include <math.h>
+#ifndef WIN64
+#include <errno.h>
+#include <unistd.h>
+#endif
 
 #include "../shared/utility_nodeps.h"
 #include "../shared/QBASHER_common_definitions.h"
 #include "QBASHI.h"
 #include "input_buffer_management.h"
 
-#if defined(WIN64) && !defined(QBASHER_LITE) // None of the code in this module is compiled for the LITE version or in non-windows
+#if !defined(QBASHER_LITE) // None of the code in this module is compiled for the LITE version
 
 buffer_queue_t *create_a_buffer_queue(int number_of_buffers, size_t buffer_size){
 	int b;
 	buffer_queue_t *bq;
 	
-	if (0) printf("create_a_bq(%d, %I64d) sizeof(bq) = %I64d\n", number_of_buffers, buffer_size, sizeof(buffer_queue_t));
+	if (0) printf("create_a_bq(%d, %zd) sizeof(bq) = %zd\n", number_of_buffers, buffer_size, sizeof(buffer_queue_t));
 
 	bq = (buffer_queue_t *)malloc(sizeof(buffer_queue_t));
 	if (bq == NULL) error_exit("malloc failed for buffer_queue in create_a_buffer_queue()\n");
@@ -46,8 +50,15 @@ buffer_queue_t *create_a_buffer_queue(int number_of_buffers, size_t buffer_size)
 		bq->bytes_in_buffer[b] = 0;
 	}
 
+#ifdef WIN64
 	bq->buffer_control_mutex = CreateMutex(NULL, FALSE, NULL);  // To synchronise alteration of BQ metadata.  Initially not owned.
 	if (bq->buffer_control_mutex == NULL) error_exit("Fatal Error: Can't create bq->buffer_control_mutex\n");   // OK - this happens once at start-up
+#else
+	if (pthread_mutex_init(&bq->buffer_control_mutex, NULL)) error_exit("Fatal Error: Can't create bq->buffer_control_mutex\n");   // OK - this happens once at start-up
+	if (pthread_cond_init(&bq->buffer_state_changed, NULL)) error_exit("Fatal Error: Can't create bq->buffer_state_changed\n");   // OK - this happens once at start-up
+	bq->infile = -1;
+	bq->reading_aborted = FALSE;
+#endif
 
 	return bq;
 }
@@ -63,8 +74,14 @@ void destroy_buffer_queue(buffer_queue_t **bqp) {
 	free(bq->buffer_state);
 	free(bq->bytes_in_buffer);
 	free(bq->buffers);
+#ifdef WIN64
 	CloseHandle(bq->buffer_control_mutex);
 	CloseHandle(bq->infile);
+#else
+	pthread_mutex_destroy(&bq->buffer_control_mutex);
+	pthread_cond_destroy(&bq->buffer_state_changed);
+	if (bq->infile >= 0) close(bq->infile);
+#endif
 	free(*bqp);
 	if (0) printf("Buffer queue destroyed!\n");
 }
@@ -72,6 +89,7 @@ void destroy_buffer_queue(buffer_queue_t **bqp) {
 
 
 
+#ifdef WIN64
 int WINAPI fill_buffers(LPVOID vbq) {
 	// This function will be called once only for each infile and will continue to loop until EOF is reached on
 	// that file.
@@ -164,4 +182,93 @@ void release_lock_on_state_of(buffer_queue_t *bq, byte *msg) {
 	}
 }
 
+#else
+
+void *fill_buffers(void *vbq) {
+	// pthreads version of the above.  Rather than polling with Sleep(), the filler waits on the
+	// buffer_state_changed condition variable until the buffer it is supposed to fill has been
+	// emptied, and broadcasts on it whenever it changes the state of a buffer.   Each buffer is
+	// filled by a single read(), which may return less than a full buffer if reading from a pipe.
+	//
+	//                                  *** It runs in its own thread. ***
+	buffer_queue_t *bq = (buffer_queue_t *)vbq;
+	int b;
+	ssize_t red;
+
+	while (1) {
+		acquire_lock_on_state_of(bq, (byte *)"fill_buffers A");
+		b = bq->buf2fill;
+		while (bq->buffer_state[b] != BUF_EMPTY && !bq->reading_aborted) wait_for_change_in_state_of(bq);
+		if (bq->reading_aborted) {
+			release_lock_on_state_of(bq, (byte *)"fill_buffers A");
+			break;  // ---------------------------->
+		}
+		bq->buffer_state[b] = BUF_FILLING;  // Filling
+		release_lock_on_state_of(bq, (byte *)"fill_buffers A");
+
+		do {
+			red = read(bq->infile, bq->buffers[b], bq->buffer_size);
+		} while (red < 0 && errno == EINTR);
+		if (red < 0) {
+			printf("Error code: %d\n", errno);
+			error_exit("I/O error A in fill_buffers()");    // OK - probably better to fail if we've only indexed part of the data
+		}
+		bq->bytes_in_buffer[b] = (size_t)red;
+
+		if (0) printf("FILLER: Bytes read into buffer %d: %zd\n", b, bq->bytes_in_buffer[b]);
+
+		acquire_lock_on_state_of(bq, (byte *)"fill_buffers B");
+		if (red == 0) {
+			bq->buffer_state[b] = BUF_EOF;  // EOF
+			signal_change_in_state_of(bq);
+			release_lock_on_state_of(bq, (byte *)"fill_buffers B");
+			break;  // --------------------------------------------------------------------->
+		}
+		bq->buffer_state[b] = BUF_FULL;  // Full
+		bq->buf2fill = (b + 1) % bq->queue_depth;  // Move to the next buffer in the ring and carry on.
+		signal_change_in_state_of(bq);
+		release_lock_on_state_of(bq, (byte *)"fill_buffers B");
+	}  // end of loop indefinitely
+
+	// Only get here on EOF or when reading is aborted
+	if (0) printf("FILLER: Reached EOF or Reading aborted.\n");
+	return NULL;
+}
+
+
+void acquire_lock_on_state_of(buffer_queue_t *bq, byte *msg) {
+	int code;
+	if (0) printf("acquire %s\n", msg);
+	code = pthread_mutex_lock(&bq->buffer_control_mutex);
+	if (code) {
+		fprintf(stderr, "Error code %d from pthread_mutex_lock() %s\n", code, msg);
+		error_exit("Error waiting for Mutex.\n");
+	}
+}
+
+
+void release_lock_on_state_of(buffer_queue_t *bq, byte *msg) {
+	int code;
+	if (0) printf("Releasing %s\n", msg);
+	code = pthread_mutex_unlock(&bq->buffer_control_mutex);
+	if (code) {
+		fprintf(stderr, "Error code %d from pthread_mutex_unlock() %s\n", code, msg);
+		error_exit("Error in pthread_mutex_unlock.\n");
+	}
+}
+
+
+void wait_for_change_in_state_of(buffer_queue_t *bq) {
+	// Must be called with the lock held.  The lock is released while waiting and held again on return.
+	pthread_cond_wait(&bq->buffer_state_changed, &bq->buffer_control_mutex);
+}
+
+
+void signal_change_in_state_of(buffer_queue_t *bq) {
+	// Must be called with the lock held, after changing buffer_state[] or reading_aborted.
+	pthread_cond_broadcast(&bq->buffer_state_changed);
+}
+
+#endif  // WIN64
+
 #endif
@@ -2,6 +2,7 @@
 // Licensed under the MIT license.
 
 #ifndef WIN64
+#include <pthread.h>
 #define WINAPI 
 typedef void *LPVOID;
 #endif
@@ -13,8 +14,15 @@ typedef void *LPVOID;
 
 typedef struct {
 	// These items are set on creation and never changed.
+#ifdef WIN64
 	HANDLE buffer_control_mutex;
 	HANDLE infile;
+#else
+	pthread_mutex_t buffer_control_mutex;
+	pthread_cond_t buffer_state_changed;  // Broadcast whenever buffer_state[] changes, so nobody need poll
+	int infile;
+	BOOL reading_aborted;   // Set (under the lock) to make the filler, and anyone waiting on it, give up
+#endif
 	int queue_depth;
 	size_t buffer_size;
 	byte **buffers;
@@ -38,7 +46,15 @@ buffer_queue_t *create_a_buffer_queue(int number_of_buffers, size_t buffer_size)
 
 void destroy_buffer_queue(buffer_queue_t **bqp);
 
+#ifdef WIN64
 int WINAPI fill_buffers(LPVOID vbq);
+#else
+void *fill_buffers(void *vbq);
+
+void wait_for_change_in_state_of(buffer_queue_t *bq);
+
+void signal_change_in_state_of(buffer_queue_t *bq);
+#endif
 
 void acquire_lock_on_state_of(buffer_queue_t *bq, byte *msg);
 
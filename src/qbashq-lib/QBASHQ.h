@@ -36,6 +36,11 @@
 #define MAX_QLINE 4097
 #define MAX_WDS_IN_QUERY 32  // terms_matched_bits are stored in a u_int (assumed 32 bits)
 #define MAX_RELAX 4          // The maximum allowable relaxation_level.  Determines array size in qex
+#define RELAXED_EVALUATOR_AUTO 0        // Values of x_relaxed_evaluator
+#define RELAXED_EVALUATOR_CANDIDATES 1
+#define RELAXED_EVALUATOR_WINDOWS 2
+#define NUM_COST_FEATURES 6             // Inputs to the query cost predictor in query_planner.c
+#define DFLT_COST_MODEL "0,1,0,0,0,0"   // Coefficients of the cost features:  just the planner's estimate
 #define MAX_ERROR_EXPLANATION 100
 #define PARTIAL_CHAR '/'
 #define RANK_ONLY_CHAR '~'
@@ -94,6 +99,18 @@ enum {
   COUNT_BLOM,   // Check a candidate against a Bloom filter
 };
 
+#define NUM_STAGES 7  // Must match stage_names in stage_timing.c
+
+enum {
+  STAGE_PARSE,        // process_query_text(), including substitutions
+  STAGE_SETUP,        // Candidate generation query, cost prediction and saat_setup()
+  STAGE_RELAXED_AND,  // saat_relaxed_and(), apart from candidate checks
+  STAGE_CHECKS,       // possibly_record_candidate()
+  STAGE_RERANK,       // rerank_and_record() or classifier(), apart from what_to_show()
+  STAGE_PRESENT,      // what_to_show(), and choosing the results to return in handle_multi_query()
+  STAGE_TOTAL,        // The whole of handle_multi_query()
+};
+
 // Definition of a structure to facilitate recording and display of
 // operation counts.  Such counts can provide 
 // a basis for deterministic timeouts.  label and cost are only 
@@ -112,7 +129,11 @@ typedef struct {
 
 
 
-byte *lookup_word(u_char *wd, byte *vocab, size_t vsz, int debug);
+byte *lookup_word(u_char *wd, byte *vocab, size_t vsz, byte *entry_buf, int debug);
+
+int possibly_store_in_order(double *cf_coeffs, long long candid8, double degree_of_match,
+			    candidate_t *candidates, int max_to_show, int *recorded,
+			    u_int terms_matched_bits, byte match_flags, double *FV);
 
 byte *get_doc(unsigned long long *docent, byte *forward, int *doclen_inwords, size_t fsz);
 
@@ -127,7 +148,7 @@ u_char *what_to_show(long long docoff, byte *doc, int *showlen, int displaycol,
 // ************************************************************************************************************ //
 
 
-typedef struct {
+typedef struct index_environment_struct {
   // Declarations of all the index structures.
   // Handles for the memory mapped index files: H for the mapped file and MH for the mapping
   CROSS_PLATFORM_FILE_HANDLE doctable_H, forward_H, index_H, vocab_H ;
@@ -135,10 +156,39 @@ typedef struct {
   byte *doctable, *vocab, *index, *forward,
     *other_token_breakers;
   size_t dsz, vsz, isz, fsz;
+  // If the index was loaded from a QBASH.qbx container, the four pointers above point into this
+  // single mapping and the individual handles are unused.
+  CROSS_PLATFORM_FILE_HANDLE container_H;
+  HANDLE container_MH;
+  byte *container;
+  size_t csz;
+  // Optional QBASH.bitmaps (see shared/bitmap_postings.h), mapped from its own file or found in
+  // the container.  NULL if there isn't one.
+  CROSS_PLATFORM_FILE_HANDLE bitmaps_H;
+  HANDLE bitmaps_MH;
+  byte *bitmaps;
+  size_t bsz;
+  BOOL bitmaps_in_container;
   double index_format_d;
   BOOL expect_cp1252;
+  docnum_t first_docnum;   // From first_docnum= in the .if header.  Zero except in a delta index.
+  double max_raw_score;    // From max_raw_score= in the .if header:  what static scores were quantized against.
+                           // UNDEFINED_DOUBLE if unknown, as in sorted indexes built before version 1.5.166.
+  BOOL sorted_by_weight;   // Unless sort_records_by_weight=FALSE in the .if header
+
+  // A delta index, built with first_docnum equal to the number of documents in this one, may be
+  // stacked on top.  Docnums >= delta_first_docnum refer to its .doctable and .forward, and its 
+  // postings lists are chained onto ours by saat_setup().  Tombstones is a bitmap of deleted docnums
+  // across both, or NULL.
+  struct index_environment_struct *delta;
+  docnum_t delta_first_docnum, tombstone_limit;
+  byte *tombstones;
 } index_environment_t;
 
+
+unsigned long long *get_dtent(index_environment_t *ixenv, docnum_t docnum, byte **forward, size_t *fsz);
+BOOL is_tombstoned(index_environment_t *ixenv, docnum_t docnum);
+
 // Next define an options environment for running one or more queries.  The same object can be used
 // for multiple queries as long as they use the same options.
 
@@ -146,16 +196,18 @@ typedef struct {
   // ---- Settable options.
   void **vptra;  // Array of pointers to the value variables.  Set up in setup_valueptr_array()
   BOOL auto_partials, auto_line_prefix, warm_indexes, display_parsed_query,
-    x_batch_testing, chatty;
+    x_batch_testing, chatty, x_willneed_postings, x_verify_container_checksums,
+    x_bitmap_postings, x_prefetch, x_query_planner, x_stage_timing, x_cost_based_shortening;
   u_char *partial_query, *index_dir, *fname_forward, *fname_if, *fname_doctable, *fname_vocab,
     *fname_query_batch, *fname_output, *fname_config, *fname_substitution_rules,
-    *fname_segment_rules, *object_store_files, *language;
+    *fname_segment_rules, *object_store_files, *language, *delta_dir, *x_cost_model, *fname_query_trace;
   double rr_coeffs[NUM_COEFFS], cf_coeffs[NUM_CF_COEFFS], classifier_threshold;
   int relaxation_level, max_to_show, max_candidates_to_consider, max_length_diff, 
     timeout_kops, timeout_msec, displaycol, extracol, query_streams, duplicate_handling,
     classifier_mode, classifier_min_words, classifier_max_words, classifier_longest_wdlen_min,
     x_max_span_length, query_shortening_threshold, street_address_processing, street_specs_col,
-    debug, x_show_qtimes;
+    debug, x_show_qtimes, x_hint_forward, x_hint_if, x_hint_vocab, x_hint_doctable, x_relaxed_evaluator,
+    cost_limit_kops, query_trace_sampling;
   double segment_intent_multiplier;
   double classifier_stop_thresh1, classifier_stop_thresh2;
   double location_lat, location_long, geo_filter_radius;
@@ -163,6 +215,7 @@ typedef struct {
   // ---- Derived from settable options
   BOOL scoring_needed, report_match_counts_only;
   FILE *query_output;  // File used to output debug and status information plus query and results
+  FILE *query_trace;   // JSON lines traces of sampled queries, if file_query_trace was given.  Otherwise NULL.
   // With static linking, it must be owned by the API library not by the main
   // program -- see msdn.microsoft.com/en-us/library/ms235460
   // By default this is the library's stdout
@@ -177,6 +230,7 @@ typedef struct {
   double inthebeginning;
   u_char slowest_q[MAX_QLINE];
   long long queries_run, queries_without_answer, query_timeout_count, global_idf_lookups;
+  long long op_count_totals[NUM_OPS];  // Over all the queries.  Unlike the counts above, safely updated by concurrent queries.
   double total_elapsed_msec_d, max_elapsed_msec_d;
   int elapsed_msec_histo[ELAPSED_MSEC_BUCKETS];
 
@@ -204,6 +258,8 @@ QBASHQ_API int run_bagsim_tests();
 
 QBASHQ_API void report_query_response_times(query_processing_environment_t *qoenv);
 
+QBASHQ_API void dump_stage_histograms(FILE *out);
+
 QBASHQ_API void terse_show(query_processing_environment_t *qoenv, u_char **returned_strings, double *corresponding_scores, int how_many_results);
 
 QBASHQ_API void experimental_show(query_processing_environment_t *qoenv, u_char *qstr,
@@ -224,6 +280,10 @@ QBASHQ_API int handle_multi_query(index_environment_t *ixenv, query_processing_e
 				  u_char *multi_query_string, u_char ***returned_results,
 				  double **corresponding_scores, BOOL *timed_out);
 
+QBASHQ_API int handle_labelled_multi_query(index_environment_t *ixenv, query_processing_environment_t *qoenv,
+					   u_char *multi_query_string, u_char *label, u_char ***returned_results,
+					   double **corresponding_scores, BOOL *timed_out);
+
 QBASHQ_API u_char *extract_result_at_rank(u_char **returned_results, double *scores, int rank, int *length, double *score);   // Just a convenience for C# access.
 
 QBASHQ_API void free_results_memory(u_char ***result_strings, double **corresponding_scores, int num_results);
@@ -247,6 +307,8 @@ QBASHQ_API void show_mode_settings(query_processing_environment_t *qoenv);
 
 QBASHQ_API void report_milestone(query_processing_environment_t *qoenv);
 
+QBASHQ_API long long report_op_count_totals(query_processing_environment_t *qoenv, FILE *out);
+
 QBASHQ_API void unload_query_processing_environment(query_processing_environment_t **qoenvp, 
 						    BOOL report_final_memory_usage, BOOL full_clean);
 
@@ -284,6 +346,11 @@ QBASHQ_API int NativeExecuteQueryAsync(LPWSTR query, query_processing_environmen
 #define SHORTEN_REPEATED 2
 #define SHORTEN_ALL_DIGITS 4
 #define SHORTEN_HIGH_FREQ 8
+#define SHORTEN_LOW_COST 16
+
+#define ROUTED_RELAXATION 1   // Ways in which a query predicted to be too expensive has been degraded
+#define ROUTED_SHORTENING 2
+#define ROUTED_TIMEOUT 4
 
 typedef struct {
   u_char *query, qcopy[MAX_QLINE + 1], query_as_processed[MAX_QLINE + 1],
@@ -310,7 +377,22 @@ typedef struct {
   double segment_intent_multiplier;
   int street_number;
   double start_time;   // Time of day when execution of this query started.
+  long long start_page_faults;  // Process page fault count when execution of this query started.
   u_char shortening_codes;  
+  // Predicted cost of the plans actually run, the features the predictions were made from, and the
+  // routing codes.  Summed or ORed over the query variants, like the op_counts.  cost_predicted
+  // is set if a prediction was made for any variant.
+  double predicted_kops, cost_features[NUM_COST_FEATURES];
+  u_char routing_codes;
+  BOOL cost_predicted;
+  double stage_elapsed[NUM_STAGES];   // Seconds spent in each stage, if time_stages
+  BOOL time_stages, traced;   // Set if x_stage_timing or if the query was chosen for tracing, respectively
+  int candidates_per_block[MAX_RELAX + 1];  // Sum over the query variants of candidates_recorded[]
+  // With a delta index, the relaxed evaluators are run first over the main index, stopping at docnum
+  // evaluation_limit, then over the delta, whose candidates are recorded after the first
+  // candidates_phase_base[rb] in each result block.  See saat_relaxed_and().
+  docnum_t evaluation_limit;
+  int candidates_phase_base[MAX_RELAX + 1];
 } book_keeping_for_one_query_t;
 
 
@@ -108,11 +108,17 @@
 #include "../utils/latlong.h"
 #include "../utils/street_addresses.h"
 #include "QBASHQ.h"
+#include "../shared/bitmap_postings.h"
 #include "saat.h"
 #include "../shared/substitutions.h"
+#include "../shared/index_container.h"
+#include "../shared/front_coded_vocab.h"
 #include "arg_parser.h"
 #include "classification.h"
 #include "query_shortening.h"
+#include "query_planner.h"
+#include "stage_timing.h"
+#include "query_trace.h"
 
 
 // Shifts and masks calculated from the DTE_*_BITS definitions in QBASHI.h  (Set once from load_query_processing_environment()).
@@ -278,25 +284,23 @@ static BOOL normalise(double *coeffs, int nc) {
 // -----------------------------------------------------------------------------------
 
 
+// Labels and costs of the basic operations, in the order of the COUNT_ enum in QBASHQ.h
+static char *op_count_labels[NUM_OPS] = {
+	"postings_decompressed", "postings_skips", "prima_facie_candidates", "candidates_considered",
+	"scores_calculated_from_text", "partial_checks", "rank_only_checks", "term_lookup", "Check_Bloom_filter"
+};
+
+static int op_count_costs[NUM_OPS] = {
+	1, 1, 1, 1, 1000, 100, 100, 1, 1   // COUNT_SCOR also includes classifier calls
+};
+
+
 static void setup_for_op_counting(book_keeping_for_one_query_t *qex) {
-	strcpy(qex->op_count[COUNT_DECO].label, "postings_decompressed");
-	qex->op_count[COUNT_DECO].cost = 1;
-	strcpy(qex->op_count[COUNT_SKIP].label, "postings_skips");
-	qex->op_count[COUNT_SKIP].cost = 1;
-	strcpy(qex->op_count[COUNT_ACAN].label, "prima_facie_candidates");
-	qex->op_count[COUNT_ACAN].cost = 1;
-	strcpy(qex->op_count[COUNT_CONS].label, "candidates_considered");
-	qex->op_count[COUNT_CONS].cost = 1;
-	strcpy(qex->op_count[COUNT_SCOR].label, "scores_calculated_from_text");
-	qex->op_count[COUNT_SCOR].cost = 1000;  // COUNT_SCOR also includes classifier calls
-	strcpy(qex->op_count[COUNT_PART].label, "partial_checks");
-	qex->op_count[COUNT_PART].cost = 100;
-	strcpy(qex->op_count[COUNT_ROLY].label, "rank_only_checks");
-	qex->op_count[COUNT_ROLY].cost = 100;
-	strcpy(qex->op_count[COUNT_TLKP].label, "term_lookup");
-	qex->op_count[COUNT_TLKP].cost = 1;
-	strcpy(qex->op_count[COUNT_BLOM].label, "Check_Bloom_filter");
-	qex->op_count[COUNT_BLOM].cost = 1;
+	int c;
+	for (c = 0; c < NUM_OPS; c++) {
+		strcpy(qex->op_count[c].label, op_count_labels[c]);
+		qex->op_count[c].cost = op_count_costs[c];
+	}
 }
 
 
@@ -335,6 +339,22 @@ static void display_op_counts(query_processing_environment_t *qoenv, book_keepin
 }
 
 
+long long report_op_count_totals(query_processing_environment_t *qoenv, FILE *out) {
+	// Like display_op_counts(), but for the totals over all the queries handled with qoenv.
+	// Returns the total cost.
+	int c;
+	long long total_cost = 0;
+	fprintf(out, "\n------------ Total counts for basic operations and total cost -------------\n");
+	for (c = 0; c < NUM_OPS; c++) {
+		fprintf(out, "%s(cost = %d): %lld\n", op_count_labels[c], op_count_costs[c], qoenv->op_count_totals[c]);
+		total_cost += qoenv->op_count_totals[c] * op_count_costs[c];
+	}
+	fprintf(out, "Total cost = %lld\n", total_cost);
+	fprintf(out, "-------------------------------------------------------------------------\n");
+	return total_cost;
+}
+
+
 static void display_cost_stats(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex, int timeout_kops,
 	int tl_returned, u_char **tl_suggestions) {
 	// Display op count and timeout info.  In format similar to that requested by Developer2
@@ -347,10 +367,26 @@ static void display_cost_stats(query_processing_environment_t *qoenv, book_keepi
 
 	timed_out = 'N';
 	if (timeout_kops > 0 && total_cost > 1000 * timeout_kops) { timed_out = 'Y'; }
-	fprintf(qoenv->query_output, "QTIMES:  timedOut= %c Cost=%10d  postingsExamined= %10d primaFacieCandidates= %10d candidatesScored= %5d  suggestionsReturned= %3d Elapsed_msec= %8.3f\n",
+	if ((qex->routing_codes & ROUTED_TIMEOUT) && qex->timed_out) { timed_out = 'Y'; }
+	fprintf(qoenv->query_output, "QTIMES:  timedOut= %c Cost=%10d  postingsExamined= %10d primaFacieCandidates= %10d candidatesScored= %5d  suggestionsReturned= %3d Elapsed_msec= %8.3f pageFaults= %6lld",
 		timed_out, total_cost, qex->op_count[COUNT_DECO].count,
 		qex->op_count[COUNT_ACAN].count, qex->op_count[COUNT_SCOR].count, tl_returned,
-		1000.0 * (what_time_is_it() - qex->start_time));
+		1000.0 * (what_time_is_it() - qex->start_time),
+		get_page_fault_count() - qex->start_page_faults);
+	if (qex->cost_features[0] > 0.0) {
+		// A prediction was made for each query variant.  Show it and the plan it led to, and log
+		// the features with the actual cost, as training data for scripts/fit_query_cost_model.pl
+		u_char route[4] = { 0 };
+		int pos = 0;
+		if ((qex->routing_codes & ROUTED_RELAXATION)) route[pos++] = 'R';
+		if ((qex->routing_codes & ROUTED_SHORTENING)) route[pos++] = 'S';
+		if ((qex->routing_codes & ROUTED_TIMEOUT)) route[pos++] = 'T';
+		if (pos == 0) route[pos++] = '-';
+		fprintf(qoenv->query_output, " predictedCost=%10.0f route= %s\nQCOSTS: actualKops= %.3f features=",
+			1000.0 * qex->predicted_kops, route, (double)total_cost / 1000.0);
+		for (c = 0; c < NUM_COST_FEATURES; c++) fprintf(qoenv->query_output, " %.4g", qex->cost_features[c]);
+	}
+	fprintf(qoenv->query_output, "\n");
 }
 
 static int isduplicate(char *s1, char *s2, int debug) {
@@ -428,6 +464,27 @@ byte *get_doc(unsigned long long *docent, byte *forward, int *doclen_inwords, si
 }
 
 
+unsigned long long *get_dtent(index_environment_t *ixenv, docnum_t docnum, byte **forward, size_t *fsz) {
+	// Return a pointer to the doctable entry for docnum, and set forward and fsz to describe the 
+	// .forward file it references.  Docnums beyond the end of the main index belong to the delta.
+	if (ixenv->delta != NULL && docnum >= ixenv->delta_first_docnum) {
+		*forward = ixenv->delta->forward;
+		*fsz = ixenv->delta->fsz;
+		return (unsigned long long *)(ixenv->delta->doctable + (docnum - ixenv->delta_first_docnum) * DTE_LENGTH);
+	}
+	*forward = ixenv->forward;
+	*fsz = ixenv->fsz;
+	return (unsigned long long *)(ixenv->doctable + docnum * DTE_LENGTH);
+}
+
+
+BOOL is_tombstoned(index_environment_t *ixenv, docnum_t docnum) {
+	// Has docnum been deleted, i.e. is it listed in QBASH.tombstones?
+	return (ixenv->tombstones != NULL && docnum < ixenv->tombstone_limit
+		&& (ixenv->tombstones[docnum >> 3] & (1 << (docnum & 7))));
+}
+
+
 
 void show_doc(byte *doctable, byte *forward, size_t fsz, saat_control_t *pl_blok) {
 	// Print the trigger of the document referenced by the SAAT control block, enclosed in braces
@@ -453,9 +510,14 @@ void show_doc(byte *doctable, byte *forward, size_t fsz, saat_control_t *pl_blok
 void terse_show(query_processing_environment_t *qoenv, u_char **returned_strings,
 	double *corresponding_scores, int how_many_results) {
 	// Given an array of result strings, and a corresponding array of scores, print one result per line
-	// comprising the suggestion and the score, with a tab between them.
+	// comprising the suggestion and the score, with a tab between them.  In the max_to_show == 0
+	// special case there are no results, and how_many_results is the count of full matches.
 	int r;
 	u_char *p;
+	if (qoenv->report_match_counts_only) {
+		fprintf(qoenv->query_output, "%d\n", how_many_results);
+		return;
+	}
 	for (r = 0; r < how_many_results; r++) {
 		p = returned_strings[r];
 		while (*p && *p != '\n' && *p != '\r') {
@@ -714,18 +776,24 @@ static int show_postings(byte *doctable, byte *index, byte *forward,
 
 
 
-byte *lookup_word(u_char *wd, byte *vocab, size_t vsz, int debug) {
+byte *lookup_word(u_char *wd, byte *vocab, size_t vsz, byte *entry_buf, int debug) {
 	// Search for wd in vocab using binary search.
 	// Return a pointer to the vocab entry, or NULL if not found.
+	// If vocab is front-coded (see front_coded_vocab.h) the entry is decoded into entry_buf,
+	// which must have room for VOCABFILE_REC_LEN bytes, and entry_buf is returned.  Otherwise
+	// the pointer is into vocab itself.
 	byte key[VOCABFILE_REC_LEN], *found_item;  // MAL0004 
 	u_ll occs, payload;
 	byte qidf;
 	strncpy((char *)key, (char *)wd, MAX_WD_LEN + 1);
 	if (debug >= 1) printf("Looking up %s among %lld vocab objects of size %d.\n", key,
-		(long long)(vsz / VOCABFILE_REC_LEN), VOCABFILE_REC_LEN);
-	found_item = (byte *)bsearch(key, vocab, vsz / VOCABFILE_REC_LEN, VOCABFILE_REC_LEN,
-		(int(*)(const void *, const void *))
-		strcmp);
+		(long long)vocab_term_count(vocab, vsz), VOCABFILE_REC_LEN);
+	if (vocab_is_front_coded(vocab, vsz))
+		found_item = fcv_lookup(wd, vocab, vsz, entry_buf);
+	else
+		found_item = (byte *)bsearch(key, vocab, vsz / VOCABFILE_REC_LEN, VOCABFILE_REC_LEN,
+			(int(*)(const void *, const void *))
+			strcmp);
 	if (debug >= 1) {
 		if (found_item == NULL) {
 			printf("   NOT FOUND: '%s'\n", wd);
@@ -1172,9 +1240,12 @@ static void rerank_and_record(query_processing_environment_t *qoenv, book_keepin
 	docnum_t d;
 	double score_from_doctable, bm25score = 0.0, penalty_multiplier = score_multiplier;
 	unsigned long long *dtent;  // Excluding the signature part
+	byte *dforward;   // The forward file of whichever index (main or delta) holds the current candidate
+	size_t dfsz;
 	candidate_t *candidates, *contiguous_array_of_candidates;
 	byte *rank_only_counts = NULL;
 	BOOL zapadupe;
+	double started;
 
 	if (0) printf("\nArriving in r_and_r() with tl_returned = %d\n\n",
 		qex->tl_returned);
@@ -1226,7 +1297,7 @@ static void rerank_and_record(query_processing_environment_t *qoenv, book_keepin
 		// Assign scores to all the candidates at this level of relaxation
 		for (r = 0; r < qex->candidates_recorded[rb]; r++) {
 			d = candidates[r].doc;
-			dtent = (unsigned long long *)(doctable + (d * DTE_LENGTH));
+			dtent = get_dtent(qoenv->ixenv, d, &dforward, &dfsz);
 			dwd_cnt = (int)(*dtent & DTE_WDCNT_MASK);
 			if (0) printf("dwd_cnt = %d\n", dwd_cnt);
 			// NOTE that in version 1.3+ indexes, only 5 bits are used to store document length in words, although up
@@ -1242,7 +1313,7 @@ static void rerank_and_record(query_processing_environment_t *qoenv, book_keepin
 					fprintf(qoenv->query_output, "  rerank_and_record(): candidate %d, doc %lld, score_from_dt= %.4f, plier = %.4f\n",
 						r, d, score_from_doctable, penalty_multiplier);
 				candidates[r].score = score_from_doctable * penalty_multiplier;  // Default, will be used if no complex scoring
-				doc = get_doc(dtent, forward, &doclen_inwords, fsz);
+				doc = get_doc(dtent, dforward, &doclen_inwords, dfsz);
 				if (doc == NULL) {
 					// This is an error condition which shouldn't occur but which must be handled
 					// Set score to negative which may push this result output of the top-k
@@ -1258,7 +1329,7 @@ static void rerank_and_record(query_processing_environment_t *qoenv, book_keepin
 				if (qoenv->scoring_needed) {
 					if (qoenv->debug >= 3) {
 						fprintf(qoenv->query_output, "  rerank_and_record(): about to call score().  Fwd Offset = %lld\n",
-							(long long)(doc - forward));
+							(long long)(doc - dforward));
 						fprintf(qoenv->query_output, "  rerank_and_record(): dwds = %d, qwd_cnt = %d\n",
 							(int)(*dtent & DTE_WDCNT_MASK), qex->qwd_cnt);
 					}
@@ -1336,13 +1407,16 @@ static void rerank_and_record(query_processing_environment_t *qoenv, book_keepin
 		if (zapadupe) break;
 
 		// -------------- Working out what to show  ----------------
-		dtent = (unsigned long long *)(doctable + (d * DTE_LENGTH));
+		dtent = get_dtent(qoenv->ixenv, d, &dforward, &dfsz);
 		if (qoenv->debug >= 2) fprintf(qoenv->query_output, "  rerank_and_record(): %d, %lld\n", r, d);
-		doc = get_doc(dtent, forward, &doclen_inwords, fsz);
+		doc = get_doc(dtent, dforward, &doclen_inwords, dfsz);
 		if (0) printf("doclen_inwords = %d\n", doclen_inwords);
 		if (doc != NULL) {
 			int showlen = 0;
-			u_char *what2show = what_to_show((long long)(doc - forward), doc, &showlen, qoenv->displaycol, bmlp);
+			u_char *what2show;
+			started = stage_timer_start(qex);
+			what2show = what_to_show((long long)(doc - dforward), doc, &showlen, qoenv->displaycol, bmlp);
+			stage_timer_stop(qex, STAGE_PRESENT, started);
 			if (what2show != NULL) {  // Could be NULL in case of memory failure in what_to_show()
 
 				if (qoenv->debug >= 2) fprintf(qoenv->query_output, "Recording candidate %d (doc %lld, with score %.3f) in slot %d.\n",
@@ -1440,7 +1514,7 @@ static BOOL isprefixmatch(u_char *qstring, u_char *dstring) {
 
 
 
-static int possibly_store_in_order(double *cf_coeffs, long long candid8, double degree_of_match,
+int possibly_store_in_order(double *cf_coeffs, long long candid8, double degree_of_match,
 	candidate_t *candidates, int max_to_show, int *recorded,
 	u_int terms_matched_bits, byte match_flags, double *FV) {
 	// This function is used only in classifier modes.
@@ -1626,7 +1700,12 @@ int possibly_record_candidate(query_processing_environment_t *qoenv,
 	candidates[*recorded].terms_matched_bits = 0;
 
 	if (qex->rank_only_cnt) rank_only_counts = qex->rank_only_countsa[result_block_to_use];
-	dtent = (unsigned long long *)(doctable + candid8 * DTE_LENGTH);
+	if (is_tombstoned(qoenv->ixenv, candid8)) {
+		if (explain_rejection)
+			fprintf(qoenv->query_output, "possibly_record_candidate(): Rejection reason 'deleted'\n");
+		return 0; // 0 -------------------------------------------->
+	}
+	dtent = get_dtent(qoenv->ixenv, candid8, &forward, &fsz);   // forward may now be that of the delta index
 	candid8_length = (int)(*dtent & DTE_WDCNT_MASK);
 	if (0) printf("candid8_length = %d\n", candid8_length);
 	d_signature = (*dtent >> DTE_DOCBLOOM_SHIFT); // No need for masking cos Bloom is Most Sig, and zeroes are shifted in from left.
@@ -1679,9 +1758,18 @@ int possibly_record_candidate(query_processing_environment_t *qoenv,
 	if (qoenv->relaxation_level == 0 && qex->cg_qwd_cnt == qex->qwd_cnt) {
 		// Can maybe think through how to do this while relaxing, but haven't done so yet.
 		// Also skip this section if the query has been shortened.
-		BOOL abandon_repcheck = FALSE;
+		BOOL abandon_repcheck = FALSE, words_only = TRUE;
 		int rslt, w, wpos[WDPOS_MASK] = { 0 };
 		for (w = 0; w < qex->tl_saat_blocks_used; w++) {
+			if (pl_blox[w].type != SAAT_WORD) words_only = FALSE;
+		}
+		for (w = 0; w < qex->tl_saat_blocks_used; w++) {
+			// Distinct top level words can't share a position, so the positions of words in bitmap
+			// mode are only needed if there's a phrase or disjunction they might be repeated in.
+			if (pl_blox[w].bitmap_mode) {
+				if (words_only) continue;
+				saat_sync_positions(qoenv->query_output, pl_blox + w, index, qex->op_count, qoenv->debug);
+			}
 			if (qoenv->debug >= 2)
 				fprintf(qoenv->query_output,
 					"possibly_record_candidate(): Repcheck: qwd %d/%d, wpos[%d] = %d\n",
@@ -1766,10 +1854,10 @@ int possibly_record_candidate(query_processing_environment_t *qoenv,
 		// Copy trigger to dc_copy, converting to lower case
 
 
-		utf8_lowering_ncopy(dc_copy, doc, dc_len);  // This function avoids a potential problem
-															// when dc_copy ends with an incomplete UTF-8
-															// sequence.  
-		if (qoenv->conflate_accents) utf8_remove_accents(dc_copy);
+		// These functions avoid a potential problem when dc_copy ends with an incomplete UTF-8
+		// sequence.  
+		if (qoenv->conflate_accents) utf8_lowering_unaccenting_ncopy(dc_copy, doc, dc_len);
+		else utf8_lowering_ncopy(dc_copy, doc, dc_len);
 		dc_copy[dc_len] = 0;
 
 		if (qoenv->debug >= 3) fprintf(qoenv->query_output, "possibly_record_candidate(): dc_copy is '%s'\n", dc_copy);
@@ -2491,10 +2579,10 @@ static int process_query_text(query_processing_environment_t *qoenv, book_keepin
 
 	// Make a lower cased copy of the query text.
 	if (0) printf("Before lowering: '%s'\n", qex->query);
-	len = utf8_lowering_ncopy(qex->qcopy, qex->query, MAX_QLINE);  // This function avoids a potential problem
-															  // when dc_copy ends with an incomplete UTF-8
-															  // sequence.  
-	if (qoenv->conflate_accents) utf8_remove_accents(qex->qcopy);
+	// These functions avoid a potential problem when dc_copy ends with an incomplete UTF-8
+	// sequence.  
+	if (qoenv->conflate_accents) len = utf8_lowering_unaccenting_ncopy(qex->qcopy, qex->query, MAX_QLINE);
+	else len = utf8_lowering_ncopy(qex->qcopy, qex->query, MAX_QLINE);
 	qex->qcopy[MAX_QLINE] = 0;
 	if (0) printf("After lowering: '%s'\n", qex->qcopy);
 	q = qex->qcopy;
@@ -2716,8 +2804,8 @@ static int process_query(query_processing_environment_t *qoenv, book_keeping_for
 	//  
 	//  Returns zero on success and a negative error cqde (see error_explanations.cpp) otherwise.
 
-	int terms_not_present = 0, error_code = 0;
-	double penalty_multiplier_for_partial_matches = 0.1;
+	int terms_not_present = 0, error_code = 0, rb;
+	double penalty_multiplier_for_partial_matches = 0.1, started, excluded;
 	saat_control_t *plists;
 
 	if (qex->qwd_cnt == 0) return(-41);   // ----------------------------------------------->
@@ -2741,6 +2829,7 @@ static int process_query(query_processing_environment_t *qoenv, book_keeping_for
 
 	// Possibly reduce the number of terms used in candidate generation
 
+	started = stage_timer_start(qex);
 	create_candidate_generation_query(qoenv, qex);
 	// Now make sure the shortened query is not too short.  Be more lenient if
 	// vertical intent has been signaled
@@ -2755,6 +2844,7 @@ static int process_query(query_processing_environment_t *qoenv, book_keeping_for
 		if ((qex->shortening_codes & SHORTEN_REPEATED)) shortening_code[pos++] = 'R';
 		if ((qex->shortening_codes & SHORTEN_ALL_DIGITS)) shortening_code[pos++] = '9';
 		if ((qex->shortening_codes & SHORTEN_HIGH_FREQ)) shortening_code[pos++] = 'H';
+		if ((qex->shortening_codes & SHORTEN_LOW_COST)) shortening_code[pos++] = 'C';
 
 		fprintf(qoenv->query_output,
 			"Query used for candidate generation is {%s}; Original query was {%s}. Shortening code: {%s}\n",
@@ -2764,6 +2854,7 @@ static int process_query(query_processing_environment_t *qoenv, book_keeping_for
 
 
 	plists = saat_setup(qoenv, qex, &terms_not_present, &error_code);
+	stage_timer_stop(qex, STAGE_SETUP, started);
 
 	if (error_code < 0) {
 		// An error return from saat_setup()
@@ -2789,9 +2880,14 @@ static int process_query(query_processing_environment_t *qoenv, book_keeping_for
 		//       and because the old saat_and() achieved only half the throughput because its algorithms
 		//       for choosing candidates and advancing had not been optimized in the way the relaxed
 		//       version have been.
+		started = stage_timer_start(qex);
+		excluded = qex->stage_elapsed[STAGE_CHECKS];
 		saat_relaxed_and(qoenv->query_output, qoenv, qex, plists, forward,
 			index, doctable, fsz, &error_code);
+		stage_timer_stop(qex, STAGE_RELAXED_AND, started);
+		qex->stage_elapsed[STAGE_RELAXED_AND] -= qex->stage_elapsed[STAGE_CHECKS] - excluded;
 		if (error_code < -200000) return(error_code);
+		for (rb = 0; rb <= MAX_RELAX; rb++) qex->candidates_per_block[rb] += qex->candidates_recorded[rb];
 
 		if (qoenv->report_match_counts_only) {
 			// Special behaviour triggered by max_to_show == 0
@@ -2799,6 +2895,8 @@ static int process_query(query_processing_environment_t *qoenv, book_keeping_for
 			return 0;   // ---------------------------------------------------------->
 		}
 
+		started = stage_timer_start(qex);
+		excluded = qex->stage_elapsed[STAGE_PRESENT];
 		if (qoenv->classifier_mode > 0) {
 			// ---- we're classifying ----
 			classifier(qoenv, qex, forward, doctable, fsz, score_multiplier);
@@ -2821,6 +2919,8 @@ static int process_query(query_processing_environment_t *qoenv, book_keeping_for
 			//  int tl_returned;    - A count of the number of results returned.
 
 		}
+		stage_timer_stop(qex, STAGE_RERANK, started);
+		qex->stage_elapsed[STAGE_RERANK] -= qex->stage_elapsed[STAGE_PRESENT] - excluded;
 
 		if (qoenv->debug >= 1) printf("process_query() --> tl_returned = %d\n", qex->tl_returned);
 	}
@@ -3080,6 +3180,15 @@ static u_char *check_if_header(index_environment_t *ixenv, query_processing_envi
 			}
 			free(value);
 
+			// first_docnum is non-zero only for a delta index.
+			value = (u_char *)strstr((char *)if_in_memory, "\nfirst_docnum=");
+			if (value != NULL) ixenv->first_docnum = (docnum_t)strtoll((char *)value + 14, NULL, 10);
+			ixenv->max_raw_score = UNDEFINED_DOUBLE;
+			value = (u_char *)strstr((char *)if_in_memory, "\nmax_raw_score=");
+			if (value != NULL) ixenv->max_raw_score = strtod((char *)value + 15, NULL);
+			if (ixenv->max_raw_score >= UNDEFINED_DOUBLE) ixenv->max_raw_score = UNDEFINED_DOUBLE;  // Recorded unset
+			ixenv->sorted_by_weight = (strstr((char *)if_in_memory, "\nsort_records_by_weight=FALSE") == NULL);
+
 			line = (u_char *)strstr((char *)line, "expect_cp1252=");
 			if (line != NULL) {
 				value = line + 14;
@@ -3107,6 +3216,66 @@ static u_char *check_if_header(index_environment_t *ixenv, query_processing_envi
 	return(version);
 }
 
+static int map_index_container(query_processing_environment_t *qoenv, index_environment_t *ixenv,
+	u_char *fname, BOOL verbose) {
+	// Map a QBASH.qbx container (see shared/index_container.h) with a single mmap and point the four
+	// index structures at its sections, which are exact copies of the individual files.  Return 0 or
+	// a negative error code.  Caller will unmap the container if there's an error.
+	int error_code = 0;
+
+	ixenv->container = (byte *)mmap_all_of(fname, &(ixenv->csz), verbose, &(ixenv->container_H),
+		&(ixenv->container_MH), &error_code);
+	if (error_code < 0) {
+		ixenv->container = NULL;
+		return error_code;  // -------------------------------->
+	}
+	error_code = qbx_check_header(ixenv->container, ixenv->csz);
+	if (error_code < 0) return error_code;  // -------------------------------->
+	if (qoenv->x_verify_container_checksums) {
+		error_code = qbx_verify_checksums(ixenv->container, verbose);
+		if (error_code < 0) return error_code;  // -------------------------------->
+	}
+
+	ixenv->forward = qbx_find_section(ixenv->container, ".forward", &(ixenv->fsz));
+	ixenv->index = qbx_find_section(ixenv->container, ".if", &(ixenv->isz));
+	ixenv->vocab = qbx_find_section(ixenv->container, ".vocab", &(ixenv->vsz));
+	ixenv->doctable = qbx_find_section(ixenv->container, ".doctable", &(ixenv->dsz));
+	if (ixenv->forward == NULL || ixenv->index == NULL || ixenv->vocab == NULL || ixenv->doctable == NULL)
+		return -200089;  // -------------------------------->
+	if (verbose) qbx_print_toc(qoenv->query_output, ixenv->container);
+	return 0;
+}
+
+
+static int load_bitmaps(index_environment_t *ixenv, u_char *fname, u_char *suffix, BOOL verbose) {
+	// Find the optional QBASH.bitmaps, either as a section of the container or alongside the other
+	// index files, and check that it was written with this .doctable and .if.  It's not an error
+	// for there to be none.  Return 0 or a negative error code.
+	//
+	// A container packed without a .bitmaps section may still have a loose QBASH.bitmaps beside
+	// it, so fall back to that.  bmp_check() rejects one left over from a different index.
+	int error_code = 0;
+
+	ixenv->bitmaps_in_container = FALSE;
+	if (ixenv->container != NULL) {
+		ixenv->bitmaps = qbx_find_section(ixenv->container, ".bitmaps", &(ixenv->bsz));
+		if (ixenv->bitmaps != NULL) ixenv->bitmaps_in_container = TRUE;
+	}
+	if (ixenv->bitmaps == NULL) {
+		strcpy((char *)suffix, ".bitmaps");
+		if (!exists((char *)fname, "")) return 0;  // -------------------------------->
+		ixenv->bitmaps = (byte *)mmap_all_of(fname, &(ixenv->bsz), verbose, &(ixenv->bitmaps_H),
+			&(ixenv->bitmaps_MH), &error_code);
+		if (error_code < 0) {
+			ixenv->bitmaps = NULL;
+			return error_code;  // -------------------------------->
+		}
+	}
+	if (ixenv->bitmaps == NULL) return 0;  // -------------------------------->
+	return bmp_check(ixenv->bitmaps, ixenv->bsz, ixenv->dsz / DTE_LENGTH, ixenv->isz);
+}
+
+
 static u_char *open_and_check_index_set(query_processing_environment_t *qoenv,
 	index_environment_t *ixenv,
 	u_char *index_stem, size_t stemlen,
@@ -3115,28 +3284,36 @@ static u_char *open_and_check_index_set(query_processing_environment_t *qoenv,
 	// This version of the function is used in Case 1, where an index_dir is specified. index_stem
 	// comprises <index_dir>/QBASH, and has room to append up to 29 characters.
 	// Open all four QBASH index files and read them into memory.  Return pointers to the
-	// memory blocks and the sizes.
+	// memory blocks and the sizes.  If there's a QBASH.qbx container, it takes precedence
+	// over the individual files and is mapped instead.
 	// Stem is usually "QBASH".
 	u_char *fname = index_stem, *suffix, *other_token_breakers = NULL, *version, unknown[] = "<unknown>";
 
 	suffix = index_stem + stemlen;
 
-	strcpy((char *)suffix, ".forward");
-	ixenv->forward = (byte *)mmap_all_of(fname, &(ixenv->fsz), verbose, &(ixenv->forward_H),
-		&(ixenv->forward_MH), error_code);
-	if (*error_code < 0) return NULL;  // -------------------------------->
-	strcpy((char *)suffix, ".if");
-	ixenv->index = (byte *)mmap_all_of(fname, &(ixenv->isz), verbose, &(ixenv->index_H),
-		&(ixenv->index_MH), error_code);
-	if (*error_code < 0) return NULL;  // -------------------------------->
-	strcpy((char *)suffix, ".vocab");
-	ixenv->vocab = (byte *)mmap_all_of(fname, &(ixenv->vsz), verbose, &(ixenv->vocab_H),
-		&(ixenv->vocab_MH), error_code);
-	if (*error_code < 0) return NULL;  // -------------------------------->
-	strcpy((char *)suffix, ".doctable");
-	ixenv->doctable = (byte *)mmap_all_of(fname, &ixenv->dsz, verbose, &ixenv->doctable_H,
-		&(ixenv->doctable_MH), error_code);
-	if (*error_code < 0) return NULL;  // -------------------------------->
+	strcpy((char *)suffix, QBX_SUFFIX);
+	if (exists((char *)fname, "")) {
+		*error_code = map_index_container(qoenv, ixenv, fname, verbose);
+		if (*error_code < 0) return NULL;  // -------------------------------->
+	}
+	else {
+		strcpy((char *)suffix, ".forward");
+		ixenv->forward = (byte *)mmap_all_of(fname, &(ixenv->fsz), verbose, &(ixenv->forward_H),
+			&(ixenv->forward_MH), error_code);
+		if (*error_code < 0) return NULL;  // -------------------------------->
+		strcpy((char *)suffix, ".if");
+		ixenv->index = (byte *)mmap_all_of(fname, &(ixenv->isz), verbose, &(ixenv->index_H),
+			&(ixenv->index_MH), error_code);
+		if (*error_code < 0) return NULL;  // -------------------------------->
+		strcpy((char *)suffix, ".vocab");
+		ixenv->vocab = (byte *)mmap_all_of(fname, &(ixenv->vsz), verbose, &(ixenv->vocab_H),
+			&(ixenv->vocab_MH), error_code);
+		if (*error_code < 0) return NULL;  // -------------------------------->
+		strcpy((char *)suffix, ".doctable");
+		ixenv->doctable = (byte *)mmap_all_of(fname, &ixenv->dsz, verbose, &ixenv->doctable_H,
+			&(ixenv->doctable_MH), error_code);
+		if (*error_code < 0) return NULL;  // -------------------------------->
+	}
 
 	if (qoenv->use_substitutions) {
 		strcpy((char *)suffix, ".substitution_rules");
@@ -3160,6 +3337,10 @@ static u_char *open_and_check_index_set(query_processing_environment_t *qoenv,
 	if (version == NULL) version = unknown;
 	if (*error_code < 0) return NULL;  // -------------------------------->
 
+	*error_code = load_bitmaps(ixenv, fname, suffix, verbose);
+	*suffix = 0;  // Back to the bare stem
+	if (*error_code < 0) return NULL;  // -------------------------------->
+
 	if (verbose || qoenv->debug >= 1) {
 		display_ascii_non_tokens();
 		test_normalize_delimiters(ascii_non_tokens);
@@ -3309,7 +3490,7 @@ int warmup_indexes(query_processing_environment_t *qoenv, index_environment_t *i
 static book_keeping_for_one_query_t *load_book_keeping_for_one_query(query_processing_environment_t *qoenv,
 	int *error_code) {
 	book_keeping_for_one_query_t *qex;
-	int t, rl, rbn = MAX_RELAX + 1;
+	int t, rl, rbn = MAX_RELAX + 1, slots;
 
 	// Called once per multi-query
 
@@ -3347,9 +3528,19 @@ static book_keeping_for_one_query_t *load_book_keeping_for_one_query(query_proce
 	qex->vertical_intent_signaled = FALSE;
 	qex->segment_intent_multiplier = 1.0;
 	qex->query_contains_operators = FALSE;
+	qex->candidate_generation_query[0] = 0;  // A query without words never creates one
 	qex->full_match_count = 0;
 	qex->street_number = -1;
 	qex->start_time = what_time_is_it();
+	qex->start_page_faults = get_page_fault_count();
+	qex->predicted_kops = 0.0;
+	memset(qex->cost_features, 0, NUM_COST_FEATURES * sizeof(double));
+	qex->routing_codes = 0;
+	qex->cost_predicted = FALSE;
+	memset(qex->stage_elapsed, 0, NUM_STAGES * sizeof(double));
+	qex->time_stages = qoenv->x_stage_timing;
+	qex->traced = FALSE;  // May be set in handle_labelled_multi_query()
+	memset(qex->candidates_per_block, 0, (MAX_RELAX + 1) * sizeof(int));
 
 	memset(qex->candidates_recorded, 0, (MAX_RELAX + 1) * sizeof(int));
 
@@ -3377,9 +3568,12 @@ static book_keeping_for_one_query_t *load_book_keeping_for_one_query(query_proce
 			return NULL;  // ----------------------------------------------------------->
 		}
 
+		// With a delta index, the main and delta parts may each fill a result block.  See saat_relaxed_and()
+		slots = qoenv->max_candidates_to_consider;
+		if (qoenv->ixenv != NULL && qoenv->ixenv->delta != NULL) slots *= 2;
 		for (rl = 0; rl < rbn; rl++) {
-			if (0) printf("Mallocing for result block %d (%d elements)\n", rl, qoenv->max_candidates_to_consider);
-			qex->candidatesa[rl] = (candidate_t *)malloc(sizeof(candidate_t) * qoenv->max_candidates_to_consider);  // MAL0010
+			if (0) printf("Mallocing for result block %d (%d elements)\n", rl, slots);
+			qex->candidatesa[rl] = (candidate_t *)malloc(sizeof(candidate_t) * slots);  // MAL0010
 			if (qex->candidatesa[rl] == NULL) {
 				int fi;
 				for (fi = 0; fi < rl; fi++) free(qex->candidatesa[fi]);
@@ -3393,9 +3587,9 @@ static book_keeping_for_one_query_t *load_book_keeping_for_one_query(query_proce
 				*error_code = -220044;
 				return NULL;  // ----------------------------------------------------------->
 			}
-			memset(qex->candidatesa[rl], 0, sizeof(candidate_t) * qoenv->max_candidates_to_consider);
+			memset(qex->candidatesa[rl], 0, sizeof(candidate_t) * slots);
 
-			qex->rank_only_countsa[rl] = (byte *)malloc(sizeof(byte) * qoenv->max_candidates_to_consider);  // MAL0011
+			qex->rank_only_countsa[rl] = (byte *)malloc(sizeof(byte) * slots);  // MAL0011
 			if (qex->rank_only_countsa[rl] == NULL) {
 				fprintf(qoenv->query_output, "Warning: Malloc failure (rank_only_countsa[%d]) in load_book_keeping...()\n", rl);
 				int fi;
@@ -3410,7 +3604,7 @@ static book_keeping_for_one_query_t *load_book_keeping_for_one_query(query_proce
 				*error_code = -220045;
 				return NULL;  // ----------------------------------------------------------->
 			}
-			memset(qex->rank_only_countsa[rl], 0, sizeof(byte) * qoenv->max_candidates_to_consider);
+			memset(qex->rank_only_countsa[rl], 0, sizeof(byte) * slots);
 		}
 	}
 	return qex;
@@ -3451,9 +3645,9 @@ static void unload_book_keeping_for_one_query(book_keeping_for_one_query_t **qex
 
 int test_postings_list(u_char *word, byte *doctable, byte *index, byte *forward, size_t fsz,
 	byte *vocab, size_t vsz, int max_to_show) {
-	byte *dicent;
+	byte *dicent, entry_buf[VOCABFILE_REC_LEN];
 	int ec = 0, verbose = 1;
-	dicent = lookup_word(word, vocab, vsz, 0);
+	dicent = lookup_word(word, vocab, vsz, entry_buf, 0);
 	if (dicent == NULL) {
 		if (verbose) printf("Test_postings_list: Word '%s' not found in vocab\n", word);
 		return(0);  // Not fatal because the test words are in English but the index may not be. --------------->
@@ -3479,6 +3673,69 @@ void print_qbasher_version(FILE *f) {
 
 
 
+static int route_by_predicted_cost(query_processing_environment_t **local_qenvp, query_processing_environment_t *qoenv,
+	book_keeping_for_one_query_t *qex) {
+	// Predict the cost of the query before any postings are touched.  If it's more than cost_limit_kops,
+	// degrade the plan, in order of increasing damage to the results, until the prediction is within
+	// the limit:  first lower the relaxation level, then shorten the query, and as a last resort run
+	// it with a timeout of cost_limit_kops.  The options are copied the first time one is changed,
+	// as for per-query options.  Returns zero or a negative error code.
+	query_processing_environment_t *local_qenv = *local_qenvp;
+	double predicted, features[NUM_COST_FEATURES];
+	int limit = local_qenv->cost_limit_kops, threshold, error_code = 0, f;
+
+	create_candidate_generation_query(local_qenv, qex);
+	predicted = plan_predict_kops(local_qenv, qex, features);
+	if (limit > 0 && predicted > (double)limit) {
+		if (local_qenv == qoenv) {
+			local_qenv = (query_processing_environment_t *)malloc(sizeof(query_processing_environment_t));  // MAL1954
+			if (local_qenv == NULL) {
+				if (qoenv->debug >= 1) fprintf(qoenv->query_output, "Warning: Malloc failed in route_by_predicted_cost().  Query won't be routed\n");
+				local_qenv = qoenv;
+				error_code = -20038;  // Not fatal
+			}
+			else {
+				memcpy(local_qenv, qoenv, sizeof(query_processing_environment_t));
+				error_code = initialize_qoenv_mappings(local_qenv);  // Must set up the option mappings vector.
+				if (error_code < -200000) {
+					free(local_qenv);
+					return(error_code);  // Fatal ------------------------------------>
+				}
+				*local_qenvp = local_qenv;  // Caller is responsible for unloading it.  FRE1954
+			}
+		}
+		if (local_qenv != qoenv) {
+			while (predicted > (double)limit && local_qenv->relaxation_level > 0) {
+				local_qenv->relaxation_level--;
+				qex->routing_codes |= ROUTED_RELAXATION;
+				predicted = plan_predict_kops(local_qenv, qex, features);
+			}
+			threshold = qex->cg_qwd_cnt;
+			while (predicted > (double)limit && threshold > 1) {
+				if (qex->cg_qwd_cnt < threshold) threshold = qex->cg_qwd_cnt;
+				local_qenv->query_shortening_threshold = --threshold;
+				create_candidate_generation_query(local_qenv, qex);
+				qex->routing_codes |= ROUTED_SHORTENING;
+				predicted = plan_predict_kops(local_qenv, qex, features);
+			}
+			if (predicted > (double)limit && (local_qenv->timeout_kops == 0 || local_qenv->timeout_kops > limit)) {
+				local_qenv->timeout_kops = limit;
+				qex->routing_codes |= ROUTED_TIMEOUT;
+			}
+			if (local_qenv->debug >= 1 || local_qenv->display_parsed_query)
+				fprintf(local_qenv->query_output, "Routed to relaxation_level=%d query_shortening_threshold=%d timeout_kops=%d. "
+					"Predicted cost %.1f kops, limit %d\n", local_qenv->relaxation_level,
+					local_qenv->query_shortening_threshold, local_qenv->timeout_kops, predicted, limit);
+		}
+	}
+
+	qex->predicted_kops += predicted;
+	qex->cost_predicted = TRUE;
+	for (f = 0; f < NUM_COST_FEATURES; f++) qex->cost_features[f] += features[f];
+	return error_code;
+}
+
+
 static int handle_one_query(index_environment_t *ixenv, query_processing_environment_t *qoenv,
 	book_keeping_for_one_query_t *qex, u_char *query_string, u_char *options_string,
 	double score_multiplier, u_char **returned_results, double *corresponding_scores,
@@ -3502,18 +3759,20 @@ static int handle_one_query(index_environment_t *ixenv, query_processing_environ
 	//  9. Check whether we need to score candidates and normalise coefficients
 	//  10. Process query text and exit on empty query or error
 	//  11. In classifier modes, validate settings and bail out if answer can't be yes.
-	//  --> HMQ 12. Allocate memory and deal with failures unless we want result_counts only
-	//  13. Call process_query() and check for errors
+	//  12. Predict the cost of the query and, if it's too high, route it to a cheaper plan
+	//  --> HMQ 13. Allocate memory and deal with failures unless we want result_counts only
+	//  14. Call process_query() and check for errors
 	//  -----------------------------------------------------------------------
-	//  --> HMQ 14. Sort results, eliminate adjacent duplicates and set up result and score arrays
-	//  --> HMQ 15. If required, display query processing statistics
-	//  --> HMQ 16. Clean up and return results and scores
+	//  --> HMQ 15. Sort results, eliminate adjacent duplicates and set up result and score arrays
+	//  --> HMQ 16. If required, display query processing statistics
+	//  --> HMQ 17. Clean up and return results and scores
 
 	//     **** VITAL:  It is the callers responsibility to call free_results_memory()  !!!!
 	//     **** VITAL:  to avoid memory leaks.                                          !!!!
 
 	int error_code = 0, words_in_query = 0;
 	query_processing_environment_t *local_qenv = NULL;
+	double started;
 
 	if (re_match((u_char *)EASTER_EGG_PATTERN, query_string,
 		PCRE2_CASELESS, qoenv->debug)) {
@@ -3643,7 +3902,9 @@ static int handle_one_query(index_environment_t *ixenv, query_processing_environ
 	local_qenv->scoring_needed = normalise(local_qenv->rr_coeffs, NUM_COEFFS);
 	normalise(local_qenv->cf_coeffs, NUM_CF_COEFFS);
 
+	started = stage_timer_start(qex);
 	words_in_query = process_query_text(local_qenv, qex);
+	stage_timer_stop(qex, STAGE_PARSE, started);
 	if (0) printf("Query text processed.  words_in_query = %d\n", words_in_query);
 	if (words_in_query == 0) {
 		// unload_book_keeping_for_one_query(&qex);  Don't do this in multi-query environment
@@ -3663,6 +3924,17 @@ static int handle_one_query(index_environment_t *ixenv, query_processing_environ
 		}
 	}
 
+	// The prediction is also made for traced queries, so that it can be compared with the actual cost.
+	if (planning_possible(local_qenv) && (local_qenv->cost_limit_kops > 0 || local_qenv->x_show_qtimes || qex->traced)) {
+		started = stage_timer_start(qex);
+		error_code = route_by_predicted_cost(&local_qenv, qoenv, qex);
+		stage_timer_stop(qex, STAGE_SETUP, started);
+		if (error_code < -200000) {
+			if (local_qenv != qoenv) unload_query_processing_environment(&local_qenv, FALSE, FALSE);  // FRE1953
+			return(error_code);  // -------------------------------------------->
+		}
+	}
+
 	// 2. Call process_query()
 	if (0) printf("calling process_query()\n");
 	error_code = process_query(local_qenv, qex, ixenv->doctable, ixenv->vocab, ixenv->index,
@@ -3753,13 +4025,14 @@ static int handle_one_query(index_environment_t *ixenv, query_processing_environ
 
 
 
-int handle_multi_query(index_environment_t *ixenv, query_processing_environment_t *qoenv,
-	u_char *multi_query_string, u_char ***returned_results,
+int handle_labelled_multi_query(index_environment_t *ixenv, query_processing_environment_t *qoenv,
+	u_char *multi_query_string, u_char *label, u_char ***returned_results,
 	double **corresponding_scores, BOOL *timed_out) {
 
 	// This is the one-and-only interface to QBASHER query processing.  What is sent in
 	// is a multi-query string (MQS) as described in the comment immediately above.  As
-	// noted in that comment, the MQS may in fact be just a single query.
+	// noted in that comment, the MQS may in fact be just a single query.  label may be
+	// NULL.  It is only used in the query trace, if this query is chosen for tracing.
 	//
 	// This function:
 	//   1. Allocates storage for returned_results and corresponding_scores.
@@ -3777,8 +4050,8 @@ int handle_multi_query(index_environment_t *ixenv, query_processing_environment_
 	BOOL isadupe, explain = (qoenv->debug >= 1);
 	book_keeping_for_one_query_t *qex = NULL;
 	// local variables corresponding to the last two parameters
-	u_char **lrr = NULL, *p, *q, *query, *options, *weight, *post_test;
-	double *lcs = NULL, qweight = 1.0;
+	u_char **lrr = NULL, *p, *q, *query, *options, *weight, *post_test, *mqs_copy = NULL;
+	double *lcs = NULL, qweight = 1.0, started;
 	int rslt_count = 0, shown = 0, i, j, error_code;
 	size_t clen;
 
@@ -3799,6 +4072,9 @@ int handle_multi_query(index_environment_t *ixenv, query_processing_environment_
 
 	setup_for_op_counting(qex);
 
+	// handle_one_query() would only set this after the allocation below
+	if (qoenv->max_to_show == 0) qoenv->report_match_counts_only = TRUE;
+
 	if (!qoenv->report_match_counts_only) {
 		// Don't allocate memory if we're in the max_to_show == 0 special case
 
@@ -3833,6 +4109,12 @@ int handle_multi_query(index_environment_t *ixenv, query_processing_environment_
 		}
 	}
 
+	qex->traced = choose_query_for_tracing(qoenv);
+	if (qex->traced) {
+		qex->time_stages = TRUE;
+		mqs_copy = make_a_copy_of(multi_query_string);  // Because splitting alters the original.  MAL2021
+	}
+
 	// ------------ This is where we split up the multi-query string -----------------------------
 
 	p = multi_query_string;
@@ -3928,7 +4210,7 @@ int handle_multi_query(index_environment_t *ixenv, query_processing_environment_
 
 	// -----------   Clean up and present results -------------------------------------------->
 
-
+	started = stage_timer_start(qex);
 
 
 
@@ -3998,10 +4280,20 @@ int handle_multi_query(index_environment_t *ixenv, query_processing_environment_
 
 		qex->tl_returned = shown;
 	}
+	stage_timer_stop(qex, STAGE_PRESENT, started);
 
 
 	// 8. Clean up.
 
+	if (qex->time_stages) {
+		qex->stage_elapsed[STAGE_TOTAL] = what_time_is_it() - qex->start_time;
+		if (qoenv->x_stage_timing) record_stage_times(qex);
+	}
+	if (qex->traced) {
+		write_query_trace(qoenv, qex, mqs_copy, label, shown);
+		if (mqs_copy != NULL) free(mqs_copy);  // FRE2021
+	}
+
 	if (qoenv->x_show_qtimes || explain) {
 		if (qoenv->x_show_qtimes > 1) display_op_counts(qoenv, qex);  // Note: the op_counts are zeroed in handle_one_query()
 		display_cost_stats(qoenv, qex, qoenv->timeout_kops, qex->tl_returned, qex->tl_suggestions);
@@ -4016,6 +4308,8 @@ int handle_multi_query(index_environment_t *ixenv, query_processing_environment_
 		}
 	}
 
+	for (i = 0; i < NUM_OPS; i++) ATOMIC_ADD_LL(qoenv->op_count_totals[i], (long long)qex->op_count[i].count);
+
 	if (qex->timed_out) {
 		if (explain) printf("TIMED OUT: %s\n", qex->query_as_processed);
 		*timed_out = TRUE;
@@ -4032,6 +4326,15 @@ int handle_multi_query(index_environment_t *ixenv, query_processing_environment_
 }
 
 
+int handle_multi_query(index_environment_t *ixenv, query_processing_environment_t *qoenv,
+	u_char *multi_query_string, u_char ***returned_results,
+	double **corresponding_scores, BOOL *timed_out) {
+	// For callers with no query labels.
+	return handle_labelled_multi_query(ixenv, qoenv, multi_query_string, NULL, returned_results,
+		corresponding_scores, timed_out);
+}
+
+
 
 
 void free_results_memory(u_char ***result_strings, double **corresponding_scores, int num_results) {
@@ -4095,6 +4398,19 @@ static int split_filelist_arg(query_processing_environment_t *qoenv, u_char *pFi
 
 
 
+static BOOL memory_usage_reports_wanted(query_processing_environment_t *qoenv) {
+	// Memory usage summaries have always been part of the Windows output.  Linux output has never
+	// included them, and scripts parse it, so there they're only shown when debugging, or when
+	// access hints are in use and their effect on page faults is of interest.
+#ifdef WIN64
+	return TRUE;
+#else
+	return (qoenv->debug || qoenv->x_hint_forward != ACCESS_HINT_NONE || qoenv->x_hint_if != ACCESS_HINT_NONE
+		|| qoenv->x_hint_vocab != ACCESS_HINT_NONE || qoenv->x_hint_doctable != ACCESS_HINT_NONE);
+#endif
+}
+
+
 int finalize_query_processing_environment(query_processing_environment_t *qoenv, BOOL verbose,
 	BOOL explain_errors) {
 	// set up all the derived variables, open files etc.
@@ -4137,6 +4453,11 @@ int finalize_query_processing_environment(query_processing_environment_t *qoenv,
 		}
 	}
 
+	if (qoenv->fname_query_trace != NULL) {
+		qoenv->query_trace = fopen((char *)qoenv->fname_query_trace, "w");
+		if (qoenv->query_trace == NULL) return -200093;
+	}
+
 	if (qoenv->max_length_diff == IUNDEF) {
 		// In classifier_modes 2 and 4, the classification score is based on sums of IDF values.  When the queries are short
 		// and the records are long, QPS rates and latencies deteriorate, sometimes very dramatically (factor of 100 in QPS)
@@ -4169,8 +4490,9 @@ int finalize_query_processing_environment(query_processing_environment_t *qoenv,
 		fprintf(qoenv->query_output, "Feature weighting coefficients: %.3f %.3f %.3f %.3f %.3f %.3f %.3f %.3f\n",
 			qoenv->rr_coeffs[0], qoenv->rr_coeffs[1], qoenv->rr_coeffs[2], qoenv->rr_coeffs[3],
 			qoenv->rr_coeffs[4], qoenv->rr_coeffs[5], qoenv->rr_coeffs[6], qoenv->rr_coeffs[7]);
-#ifdef WIN64		
-		report_memory_usage(qoenv->query_output, "near the very beginning", NULL);
+#ifndef QBASHER_LITE
+		if (memory_usage_reports_wanted(qoenv))
+			report_memory_usage(qoenv->query_output, (u_char *)"near the very beginning", NULL);
 #endif
 	}
 
@@ -4249,6 +4571,150 @@ void show_mode_settings(query_processing_environment_t *qoenv) {
 
 
 
+static void apply_index_access_hint(query_processing_environment_t *qoenv, byte *mem, size_t sighs,
+	int hint, char *label, BOOL verbose) {
+	int rslt;
+	if (hint == ACCESS_HINT_NONE || mem == NULL) return;
+	rslt = apply_access_hint(mem, sighs, (access_hint_t)hint);
+	if (rslt < 0) fprintf(qoenv->query_output, "Warning: access hint '%s' not accepted for %s (error %d)\n",
+		access_hint_names[hint], label, rslt);
+	else if (verbose) fprintf(qoenv->query_output, "Access hint '%s' applied to %s\n",
+		access_hint_names[hint], label);
+}
+
+
+static void load_tombstones(query_processing_environment_t *qoenv, index_environment_t *ixenv, u_char *fname,
+	BOOL verbose) {
+	// QBASH.tombstones is an optional text file listing deleted docnums, one per line.  They may 
+	// be in either the main or the delta index.  Deleted docs are set in a bitmap, and
+	// is_tombstoned() stops them being recorded or counted as matches.  Invalid lines are ignored.
+	FILE *TF;
+	u_char line[100];
+	docnum_t d, count = 0;
+
+	TF = fopen((char *)fname, "rb");
+	if (TF == NULL) return;   // No tombstones
+	ixenv->tombstone_limit = ixenv->delta_first_docnum + (docnum_t)(ixenv->delta->dsz / DTE_LENGTH);
+	ixenv->tombstones = (byte *)malloc(ixenv->tombstone_limit / 8 + 1);
+	if (ixenv->tombstones == NULL) {
+		fclose(TF);
+		ixenv->tombstone_limit = 0;
+		return;
+	}
+	memset(ixenv->tombstones, 0, ixenv->tombstone_limit / 8 + 1);
+	while (fgets((char *)line, 100, TF) != NULL) {
+		if (!isdigit(line[0])) continue;
+		d = (docnum_t)strtoll((char *)line, NULL, 10);
+		if (d >= ixenv->tombstone_limit) continue;
+		ixenv->tombstones[d >> 3] |= (byte)(1 << (d & 7));
+		count++;
+	}
+	fclose(TF);
+	if (verbose) fprintf(qoenv->query_output, "%lld tombstones loaded from %s\n", count, fname);
+}
+
+
+static int load_delta_index(query_processing_environment_t *qoenv, index_environment_t *ixenv, BOOL verbose) {
+	// Map the index files in qoenv->delta_dir and stack them on top of the main index in ixenv.
+	// The delta must have been built with first_docnum equal to the number of docs in the main 
+	// index and with the same token breaking rules.  Return 0 or a negative error code.
+	index_environment_t *delta;
+	u_char *index_stem, *suffix, *other_token_breakers = NULL, *version;
+	double N = qoenv->N, avdoclen = qoenv->avdoclen;
+	int error_code = 0;
+
+	delta = (index_environment_t *)malloc(sizeof(index_environment_t));   // MAL802
+	index_stem = (u_char *)malloc(strlen((char *)qoenv->delta_dir) + 30);
+	if (delta == NULL || index_stem == NULL) {
+		free(delta);
+		free(index_stem);
+		return -220087;
+	}
+	memset(delta, 0, sizeof(index_environment_t));
+	delta->expect_cp1252 = TRUE;
+	ixenv->delta = delta;
+	ixenv->delta_first_docnum = (docnum_t)(ixenv->dsz / DTE_LENGTH);
+
+	sprintf((char *)index_stem, "%s/QBASH", qoenv->delta_dir);
+	suffix = index_stem + strlen((char *)index_stem);
+	strcpy((char *)suffix, QBX_SUFFIX);
+	if (exists((char *)index_stem, "")) {
+		error_code = map_index_container(qoenv, delta, index_stem, verbose);
+	}
+	else {
+		strcpy((char *)suffix, ".forward");
+		delta->forward = (byte *)mmap_all_of(index_stem, &(delta->fsz), verbose, &(delta->forward_H),
+			&(delta->forward_MH), &error_code);
+		if (error_code >= 0) {
+			strcpy((char *)suffix, ".if");
+			delta->index = (byte *)mmap_all_of(index_stem, &(delta->isz), verbose, &(delta->index_H),
+				&(delta->index_MH), &error_code);
+		}
+		if (error_code >= 0) {
+			strcpy((char *)suffix, ".vocab");
+			delta->vocab = (byte *)mmap_all_of(index_stem, &(delta->vsz), verbose, &(delta->vocab_H),
+				&(delta->vocab_MH), &error_code);
+		}
+		if (error_code >= 0) {
+			strcpy((char *)suffix, ".doctable");
+			delta->doctable = (byte *)mmap_all_of(index_stem, &(delta->dsz), verbose, &(delta->doctable_H),
+				&(delta->doctable_MH), &error_code);
+		}
+	}
+	if (error_code < 0) {
+		// Caller will unmap whatever was mapped.
+		free(index_stem);
+		return error_code;  // -------------------------------->
+	}
+
+	*suffix = 0;
+	version = check_if_header(delta, qoenv, &other_token_breakers, index_stem, &error_code);
+	free(version);
+	if (error_code >= 0 && delta->first_docnum != ixenv->delta_first_docnum) {
+		if (verbose) fprintf(qoenv->query_output, "Error: delta index starts at docnum %lld but main index has %lld docs.\n",
+			delta->first_docnum, ixenv->delta_first_docnum);
+		error_code = -200085;
+	}
+	// Static scores in the two indexes are only comparable if they were quantized against the same
+	// max_raw_score.  Indexes which don't record it can't be checked.
+	if (error_code >= 0 && delta->max_raw_score != UNDEFINED_DOUBLE && ixenv->max_raw_score != UNDEFINED_DOUBLE
+		&& fabs(delta->max_raw_score - ixenv->max_raw_score) > 1.0e-9 * fabs(ixenv->max_raw_score)) {
+		if (verbose) fprintf(qoenv->query_output, "Error: delta index scores were quantized against max_raw_score=%.15g but "
+			"the main index's against %.15g.  Rebuild the delta with QBASHI max_raw_score=%.15g\n",
+			delta->max_raw_score, ixenv->max_raw_score, ixenv->max_raw_score);
+		error_code = -200094;
+	}
+	if (error_code >= 0 && (other_token_breakers == NULL || ixenv->other_token_breakers == NULL
+		|| strcmp((char *)other_token_breakers, (char *)ixenv->other_token_breakers))) {
+		error_code = -200086;
+	}
+	free(other_token_breakers);
+	if (error_code < 0) {
+		free(index_stem);
+		return error_code;  // -------------------------------->
+	}
+
+	// check_if_header() has set N and avdoclen for the delta alone.  Combine them with the main index's.
+	if (qoenv->N > 0 && N > 0) {
+		qoenv->avdoclen = (avdoclen * N + qoenv->avdoclen * qoenv->N) / (N + qoenv->N);
+		qoenv->N += N;
+	}
+
+	apply_index_access_hint(qoenv, delta->forward, delta->fsz, qoenv->x_hint_forward, "delta .forward", verbose);
+	apply_index_access_hint(qoenv, delta->index, delta->isz, qoenv->x_hint_if, "delta .if", verbose);
+	apply_index_access_hint(qoenv, delta->vocab, delta->vsz, qoenv->x_hint_vocab, "delta .vocab", verbose);
+	apply_index_access_hint(qoenv, delta->doctable, delta->dsz, qoenv->x_hint_doctable, "delta .doctable", verbose);
+
+	strcpy((char *)suffix, ".tombstones");
+	load_tombstones(qoenv, ixenv, index_stem, verbose);
+
+	if (verbose) fprintf(qoenv->query_output, "Delta index loaded from %s: docnums %lld - %lld\n", qoenv->delta_dir,
+		ixenv->delta_first_docnum, ixenv->delta_first_docnum + (docnum_t)(delta->dsz / DTE_LENGTH) - 1);
+	free(index_stem);
+	return 0;
+}
+
+
 index_environment_t *load_indexes(query_processing_environment_t *qoenv, BOOL verbose, BOOL run_tests,
 	int *error_code) {
 	// No longer Chdir to the index directory  -  it's not threadsafe
@@ -4278,8 +4744,16 @@ index_environment_t *load_indexes(query_processing_environment_t *qoenv, BOOL ve
 	ixenv->vocab = NULL;
 	ixenv->index = NULL;
 	ixenv->forward = NULL;
+	ixenv->container = NULL;
+	ixenv->bitmaps = NULL;
+	ixenv->bitmaps_in_container = FALSE;
 	ixenv->other_token_breakers = NULL;
 	ixenv->expect_cp1252 = TRUE;
+	ixenv->first_docnum = 0;
+	ixenv->delta = NULL;
+	ixenv->delta_first_docnum = 0;
+	ixenv->tombstones = NULL;
+	ixenv->tombstone_limit = 0;
 
 
 	if (qoenv->index_dir != NULL) {
@@ -4322,15 +4796,31 @@ index_environment_t *load_indexes(query_processing_environment_t *qoenv, BOOL ve
 		return NULL;
 	}
 
+	if (qoenv->delta_dir != NULL) {
+		*error_code = load_delta_index(qoenv, ixenv, verbose);
+		if (*error_code < -200000) {
+			unload_indexes(&ixenv);
+			return NULL;
+		}
+	}
 
 	// - - - - - - - - - - - - - - - - - - - - - - - Common to both cases - - - - - - - - - - - - - - - - - - - - - - -
 
+	// Apply per-file access hints.  The four files are accessed very differently: binary search
+	// in .vocab, random probes into .doctable and .forward, and sequential scans within each
+	// postings list in .if.  A rejected hint is reported but is not an error.
+	apply_index_access_hint(qoenv, ixenv->forward, ixenv->fsz, qoenv->x_hint_forward, ".forward", verbose);
+	apply_index_access_hint(qoenv, ixenv->index, ixenv->isz, qoenv->x_hint_if, ".if", verbose);
+	apply_index_access_hint(qoenv, ixenv->vocab, ixenv->vsz, qoenv->x_hint_vocab, ".vocab", verbose);
+	apply_index_access_hint(qoenv, ixenv->doctable, ixenv->dsz, qoenv->x_hint_doctable, ".doctable", verbose);
+
 
 	if (verbose) {
 		fprintf(qoenv->query_output, "Indexes loaded.\n");
 		if (ascii_non_tokens[0x92]) printf("CP-1252 punctuation causes breaks\n");
-#ifdef WIN64
-		report_memory_usage(qoenv->query_output, "After mapping all the files but before running anything", NULL);
+#ifndef QBASHER_LITE
+		if (memory_usage_reports_wanted(qoenv))
+			report_memory_usage(qoenv->query_output, (u_char *)"After mapping all the files but before running anything", NULL);
 #endif
 	}
 	return ixenv;
@@ -4340,6 +4830,23 @@ index_environment_t *load_indexes(query_processing_environment_t *qoenv, BOOL ve
 void unload_indexes(index_environment_t **ixenvp) {
 	index_environment_t *ixenv = *ixenvp;
 	if (ixenv == NULL) return;
+	if (ixenv->delta != NULL) unload_indexes(&(ixenv->delta));   // RECURSION
+	if (ixenv->tombstones != NULL) {
+		free(ixenv->tombstones);
+		ixenv->tombstones = NULL;
+	}
+	if (ixenv->container != NULL) {
+		// All four index structures are within the one mapping
+		unmmap_all_of(ixenv->container, ixenv->container_H, ixenv->container_MH, ixenv->csz);
+		ixenv->doctable = NULL;
+		ixenv->forward = NULL;
+		ixenv->index = NULL;
+		ixenv->vocab = NULL;
+		if (ixenv->bitmaps_in_container) ixenv->bitmaps = NULL;
+	}
+	if (ixenv->bitmaps != NULL) {
+		unmmap_all_of(ixenv->bitmaps, ixenv->bitmaps_H, ixenv->bitmaps_MH, ixenv->bsz);
+	}
 	if (ixenv->doctable != NULL) {
 		unmmap_all_of(ixenv->doctable, ixenv->doctable_H, ixenv->doctable_MH, ixenv->dsz);
 	}
@@ -4389,14 +4896,19 @@ void unload_query_processing_environment(query_processing_environment_t **qoenvp
 		}
 
 	}
-#ifdef WIN64
-	if (report_final_memory_usage) report_memory_usage(qoenv->query_output, "at the very end", NULL);
+#ifndef QBASHER_LITE
+	if (report_final_memory_usage && memory_usage_reports_wanted(qoenv))
+		report_memory_usage(qoenv->query_output, (u_char *)"at the very end", NULL);
 #endif
 	if (full_clean && qoenv->query_output != stdout) {
 		//close qoenv-> query output file, unless it's stdout
 		fclose(qoenv->query_output);
 		qoenv->query_output = NULL;
 	}
+	if (full_clean && qoenv->query_trace != NULL) {
+		fclose(qoenv->query_trace);
+		qoenv->query_trace = NULL;
+	}
 
 	if (full_clean) free_options_memory(qoenv);
 	if (qoenv->vptra != NULL) free(qoenv->vptra);
@@ -45,7 +45,7 @@
 //   6. Later in the same function assign the new value to a good default, or remove an obsolete
 //	    assignment.
 
-#define NUMBER_OF_ARGS 64
+#define NUMBER_OF_ARGS 81
 
 arg_t args[] = {
   // ------------- If you edit these initialisations, be sure to follow the INSTRUCTIONS above --------------
@@ -114,7 +114,24 @@ arg_t args[] = {
   /* 60 */{ "street_address_processing", AINT, FALSE, 0, 10000, "if > 0, delete suite part and street number from query. If > 1, reject candidates for which this street number is not valid." },
   /* 61 */{ "street_specs_col", AINT, FALSE, 0, 10000, "The column in the .forward file containing a list specifying valid street numbers for this doc (assumed to be a street)." },
   /* 62 */{ "query_shortening_threshold", AINT, FALSE, 0, 100, "Queries with more terms than the given value will be shortened to this length. 0 => no shortening" },
-  /* 63 */{ "", AEOL, FALSE, 0, 0, "" }
+  /* 63 */{ "x_hint_forward", AINT, TRUE, 0, 3, "Access hint (madvise) for the mapped .forward file: 0 - none, 1 - random, 2 - sequential, 3 - transparent huge pages." },
+  /* 64 */{ "x_hint_if", AINT, TRUE, 0, 3, "Access hint (madvise) for the mapped .if file: 0 - none, 1 - random, 2 - sequential, 3 - transparent huge pages." },
+  /* 65 */{ "x_hint_vocab", AINT, TRUE, 0, 3, "Access hint (madvise) for the mapped .vocab file: 0 - none, 1 - random, 2 - sequential, 3 - transparent huge pages." },
+  /* 66 */{ "x_hint_doctable", AINT, TRUE, 0, 3, "Access hint (madvise) for the mapped .doctable file: 0 - none, 1 - random, 2 - sequential, 3 - transparent huge pages." },
+  /* 67 */{ "x_willneed_postings", ABOOL, FALSE, 0, 0, "If TRUE, saat_setup() asks the OS to start reading in the postings lists of the query terms (MADV_WILLNEED)." },
+  /* 68 */{ "delta_dir", ASTRING, TRUE, 0, 0, "Directory containing a delta index built with QBASHI first_docnum=<docs in main index> and the main index's max_raw_score. Searched along with the main index. May contain QBASH.tombstones." },
+  /* 69 */{ "x_verify_container_checksums", ABOOL, FALSE, 0, 0, "If TRUE and the index is a QBASH.qbx container, the checksums of all its sections are verified at load time.  (Reads the whole container.)" },
+  /* 70 */{ "x_bitmap_postings", ABOOL, FALSE, 0, 0, "If TRUE and the index has a QBASH.bitmaps, the document bitmaps of very common words are used to skip and to count matches, instead of decoding their postings." },
+  /* 71 */{ "x_relaxed_evaluator", AINT, FALSE, 0, 2, "How relaxed matches are found: 0 - choose by estimated cost, 1 - candidate at a time, 2 - a window of documents at a time (if no word positions are needed and there's no timeout)." },
+  /* 72 */{ "x_prefetch", ABOOL, FALSE, 0, 0, "If TRUE, saat_relaxed_and() prefetches the postings of lists about to be skipped, and doctable entries of candidates.  Only worthwhile when the index is much bigger than the CPU caches." },
+  /* 73 */{ "x_query_planner", ABOOL, FALSE, 0, 0, "If TRUE, the order in which terms are checked is chosen by costs estimated from frequencies and query structure.  Otherwise by frequency alone." },
+  /* 74 */{ "cost_limit_kops", AINT, FALSE, 0, 1000000, "If non zero, queries whose cost is predicted to exceed this are run with lower relaxation, then shortened, then with timeout_kops no more than this." },
+  /* 75 */{ "x_cost_model", ASTRING, FALSE, 0, 0, "Comma separated coefficients of the query cost predictor.  See QCOSTS: in x_show_qtimes output, and scripts/fit_query_cost_model.pl" },
+  /* 76 */{ "x_stage_timing", ABOOL, TRUE, 0, 0, "If TRUE, the time taken by each stage of query processing is recorded in histograms, printed as STAGE_ lines at the end of a batch or on SIGUSR1." },
+  /* 77 */{ "file_query_trace", ASTRING, TRUE, 0, 0, "The name of a file to which a JSON object describing the processing of each sampled query will be written, one per line." },
+  /* 78 */{ "query_trace_sampling", AINT, TRUE, 1, 1000000000, "If file_query_trace is given, one query in this many, chosen at random, is traced." },
+  /* 79 */{ "x_cost_based_shortening", ABOOL, FALSE, 0, 0, "If TRUE, query shortening drops the words whose removal most reduces the planner's estimate of cost, rather than the most frequent ones.  Shortening code C." },
+  /* 80 */{ "", AEOL, FALSE, 0, 0, "" }
 };
 
 
@@ -188,6 +205,23 @@ int initialize_qoenv_mappings(query_processing_environment_t *qoenv) {
   vptra[60] = (void *)&(qoenv->street_address_processing);
   vptra[61] = (void *)&(qoenv->street_specs_col);
   vptra[62] = (void *)&(qoenv->query_shortening_threshold);
+  vptra[63] = (void *)&(qoenv->x_hint_forward);
+  vptra[64] = (void *)&(qoenv->x_hint_if);
+  vptra[65] = (void *)&(qoenv->x_hint_vocab);
+  vptra[66] = (void *)&(qoenv->x_hint_doctable);
+  vptra[67] = (void *)&(qoenv->x_willneed_postings);
+  vptra[68] = (void *)&(qoenv->delta_dir);
+  vptra[69] = (void *)&(qoenv->x_verify_container_checksums);
+  vptra[70] = (void *)&(qoenv->x_bitmap_postings);
+  vptra[71] = (void *)&(qoenv->x_relaxed_evaluator);
+  vptra[72] = (void *)&(qoenv->x_prefetch);
+  vptra[73] = (void *)&(qoenv->x_query_planner);
+  vptra[74] = (void *)&(qoenv->cost_limit_kops);
+  vptra[75] = (void *)&(qoenv->x_cost_model);
+  vptra[76] = (void *)&(qoenv->x_stage_timing);
+  vptra[77] = (void *)&(qoenv->fname_query_trace);
+  vptra[78] = (void *)&(qoenv->query_trace_sampling);
+  vptra[79] = (void *)&(qoenv->x_cost_based_shortening);
   return 0;
 } 
 
@@ -201,6 +235,7 @@ void set_qoenv_defaults(query_processing_environment_t *qoenv) {
   qoenv->fname_doctable = NULL;
   qoenv->fname_substitution_rules = NULL;
   qoenv->fname_segment_rules = NULL;
+  qoenv->delta_dir = NULL;
   qoenv->fname_query_batch = NULL;
   qoenv->fname_output = NULL;
   qoenv->partial_query = NULL;
@@ -256,11 +291,28 @@ void set_qoenv_defaults(query_processing_environment_t *qoenv) {
   qoenv->street_address_processing = 0;
   qoenv->street_specs_col = 5;  
   qoenv->query_shortening_threshold = 0;  // No shortening.
+  qoenv->x_hint_forward = ACCESS_HINT_NONE;
+  qoenv->x_hint_if = ACCESS_HINT_NONE;
+  qoenv->x_hint_vocab = ACCESS_HINT_NONE;
+  qoenv->x_hint_doctable = ACCESS_HINT_NONE;
+  qoenv->x_willneed_postings = FALSE;
+  qoenv->x_verify_container_checksums = FALSE;
+  qoenv->x_bitmap_postings = TRUE;
+  qoenv->x_relaxed_evaluator = RELAXED_EVALUATOR_AUTO;
+  qoenv->x_prefetch = FALSE;
+  qoenv->x_query_planner = TRUE;
+  qoenv->cost_limit_kops = 0;  // No routing by predicted cost.
+  qoenv->x_cost_model = make_a_copy_of((u_char *)DFLT_COST_MODEL);
+  qoenv->x_stage_timing = FALSE;
+  qoenv->fname_query_trace = NULL;
+  qoenv->query_trace_sampling = 1;
+  qoenv->x_cost_based_shortening = FALSE;
 
   // Not directly settable
   qoenv->scoring_needed = TRUE;
   qoenv->report_match_counts_only = FALSE;
   qoenv->query_output = stdout;
+  qoenv->query_trace = NULL;
   qoenv->substitutions_hash = NULL;
   qoenv->segment_rules_hash = NULL;
 
@@ -269,6 +321,8 @@ void set_qoenv_defaults(query_processing_environment_t *qoenv) {
   qoenv->queries_run = 0;
   qoenv->query_timeout_count = 0;
   qoenv->global_idf_lookups = 0;
+  for (i = 0; i < NUM_OPS; i++)
+    qoenv->op_count_totals[i] = 0;
   qoenv->total_elapsed_msec_d = 0.0;
   qoenv->max_elapsed_msec_d = 0.0;
   for (i = 0; i < ELAPSED_MSEC_BUCKETS; i++)
@@ -22,6 +22,7 @@
 #include "../utils/dahash.h"
 #include "QBASHQ.h"
 #include "classification.h"
+#include "stage_timing.h"
 
 #if 0  //  Slated for removal
 
@@ -352,16 +353,17 @@ double get_global_idf(query_processing_environment_t *qoenv, u_char *wd) {
   // Since version 1.5.0 we use a field in the .vocab file to get a quantized idf and make no use at
   // all of the .global_idfs file.
 
-  byte *vocab_entry, lwd[MAX_WD_LEN + 1];
+  byte *vocab_entry, entry_buf[VOCABFILE_REC_LEN], lwd[MAX_WD_LEN + 1];
   double idf, N;
   u_ll ig1, ig2;
   byte qidf; 
 
   N = (double)(qoenv->ixenv->dsz / DTE_LENGTH);  // Relatively quick way to determine no. of documents
+  if (qoenv->ixenv->delta != NULL) N += (double)(qoenv->ixenv->delta->dsz / DTE_LENGTH);
   strncpy((char *)lwd, (char *)wd, MAX_WD_LEN);
   lwd[MAX_WD_LEN] = 0;
 
-  vocab_entry = lookup_word(wd, qoenv->ixenv->vocab, qoenv->ixenv->vsz, qoenv->debug);
+  vocab_entry = lookup_word(wd, qoenv->ixenv->vocab, qoenv->ixenv->vsz, entry_buf, qoenv->debug);
   if (vocab_entry == NULL) idf = log(N);   // Same as a term which occurs only once.
   else { 
     vocabfile_entry_unpacker(vocab_entry, MAX_WD_LEN + 1, &ig1, &qidf, &ig2);
@@ -1115,8 +1117,9 @@ void classifier(query_processing_environment_t *local_qenv, book_keeping_for_one
   int r, s, doclen_inwords, showlen, rb, best_rb, total_candidates = 0, *pos_in_rb;
   unsigned long long *dtent;  // Excluding the signature part
   docnum_t d;
-  byte *doc, *what2show, *details = NULL;
-  double best_score, highest_score;
+  byte *doc, *what2show, *details = NULL, *dforward;
+  size_t dfsz;
+  double best_score, highest_score, started;
 
 
   if (0) local_qenv->debug = 2;
@@ -1162,18 +1165,20 @@ void classifier(query_processing_environment_t *local_qenv, book_keeping_for_one
 
     s = pos_in_rb[best_rb];
     d = candidates_to_use[s].doc;
-    dtent = (unsigned long long *)(doctable + (d * DTE_LENGTH));
-    doc = get_doc(dtent, forward, &doclen_inwords, fsz);
+    dtent = get_dtent(local_qenv->ixenv, d, &dforward, &dfsz);
+    doc = get_doc(dtent, dforward, &doclen_inwords, dfsz);
     details = code_flags_and_terms_which_matched(local_qenv, qex, candidates_to_use + s, doc);
     if (local_qenv->debug >= 1) printf("Details:  %s\n", details);
+    started = stage_timer_start(qex);
     if (local_qenv->include_result_details) {
-      what2show = what_to_show((long long)(doc - forward), doc, &showlen, local_qenv->displaycol, details);
+      what2show = what_to_show((long long)(doc - dforward), doc, &showlen, local_qenv->displaycol, details);
       if (0) printf("    what2show: %s\n", what2show);
       if (details != NULL) free(details);
       details = NULL;
     }
     else
-      what2show = what_to_show((long long)(doc - forward), doc, &showlen, local_qenv->displaycol, NULL);
+      what2show = what_to_show((long long)(doc - dforward), doc, &showlen, local_qenv->displaycol, NULL);
+    stage_timer_stop(qex, STAGE_PRESENT, started);
     if (what2show != NULL)  {  // Could be NULL in case of memory failure in what_to_show
       qex->tl_docids[qex->tl_returned] = d;
       qex->tl_suggestions[qex->tl_returned] = what2show;  // That's in malloced storage (MAL2006)
@@ -42,7 +42,7 @@
 #include "../utils/dahash.h"
 #include "QBASHQ.h"
 
-#define MAX_QBASHER_DEFINED_ERROR_CODE 83
+#define MAX_QBASHER_DEFINED_ERROR_CODE 95
 
 // Severity (0, 1, 2) * 100000 + Category (0, 1, 2, 3, 4) * 10000 + error number % 10000
 // 
@@ -134,6 +134,18 @@ err_desc_t error_code_explanations[] = {
 	{ 220081, "Object Store: malloc failure for segment_rules in NativeInitializeSharedFiles().\n" },
 	{ 220082, "Object Store: malloc failure for subsitution_rules in NativeInitializeSharedFiles().\n" },
 	{ 40083, "Language lookup failed while loading segment or substitution rules.\n" },
+	{ 130084, "madvise() rejected an access hint in apply_access_hint().  Mapping still usable.\n" },
+	{ 200085, "Delta index first_docnum is not the number of documents in the main index.\n" },
+	{ 200086, "Delta index was built with different Other_token_breakers from the main index.\n" },
+	{ 220087, "Failed to allocate memory for delta index environment or tombstones in load_delta_index().\n" },
+	{ 200088, "Index container: bad magic number, unsupported format version or corrupt table of contents.\n" },
+	{ 200089, "Index container: a required section is missing or a section lies outside the container.\n" },
+	{ 200090, "Index container: section checksum mismatch.\n" },
+	{ 220091, "Failed to allocate memory in qbx_pack().\n" },
+	{ 200092, "QBASH.bitmaps is corrupt or wasn't written with this .doctable and .if.\n" },
+	{ 200093, "Unable to open file_query_trace for writing.\n" },
+	{ 200094, "Delta index scores were quantized against a different max_raw_score from the main index.\n" },
+	{ 220095, "Failed to allocate memory for merging main and delta candidates in saat_relaxed_and().\n" },
 };
 
 
@@ -0,0 +1,440 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// A cost-based planner for relaxed AND queries.  See query_planner.h.
+//
+// The model, in the units of the op_count costs:
+//   - A word occurring n times in a collection of N documents is taken to be in a document with
+//     probability 1 - exp(-n/N).  Checking a candidate against it costs one skip, plus decoding the
+//     postings passed over since the previous candidate:  n / candidates of them, but no more than
+//     half a skip block run, which QBASHI makes sqrt(n) postings long.
+//   - A phrase is expected to occur T * product(n_i / T) times, where T is the total number of
+//     postings, but no more often than its rarest word.  Checking a candidate costs a skip for each
+//     word plus a positional check for each.
+//   - A disjunction occurs as often as all of its children together, and is absent from a document
+//     only if all of its children are.  Checking a candidate costs the sum of checking the children.
+//   - Every document containing one of the m + 1 rarest terms becomes a candidate, and the terms are
+//     checked in the evaluation order until more than m are found to be missing.
+//   - Each match is considered and (if scores are needed) scored, until max_candidates_to_consider
+//     have been, at which point the candidate loop is expected to stop early.
+//
+// For a strict AND (m = 0), checking terms in increasing order of cost / (1 - selectivity)
+// minimises the expected cost of checking a candidate.  The same order is used as a starting point
+// when m > 0, and improved by swapping adjacent terms.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef WIN64
+#include <windows.h>
+#endif
+
+#include "../shared/QBASHER_common_definitions.h"
+#include "../shared/utility_nodeps.h"
+#include "../utils/dahash.h"
+#include "QBASHQ.h"
+#include "../shared/bitmap_postings.h"
+#include "saat.h"
+#include "query_planner.h"
+
+#define NEGLIGIBLE_PROBABILITY 1e-12
+#define MAX_ORDER_REFINEMENT_PASSES 4
+
+typedef struct {
+  // Accumulates the estimate for a phrase or disjunction one child at a time.
+  BOOL phrase;
+  int children, lists;
+  double occurrences, min_occurrences, probe_cost, postings, none;  // none:  probability that no child is present
+} combination_t;
+
+
+BOOL planning_possible(query_processing_environment_t *qoenv) {
+  // The planner needs the collection statistics from the .if header, which very old indexes lack.
+  return (qoenv->x_query_planner && qoenv->N >= 1.0 && qoenv->N < UNDEFINED_DOUBLE
+	  && qoenv->avdoclen > 0.0 && qoenv->avdoclen < UNDEFINED_DOUBLE);
+}
+
+
+static void estimate_word(query_processing_environment_t *qoenv, double occurrences, plan_estimate_t *est) {
+  est->occurrences = occurrences;
+  est->selectivity = 1.0 - exp(-occurrences / qoenv->N);
+  est->probe_cost = 1.0;
+  est->postings = occurrences;
+  est->lists = 1;
+}
+
+
+static void combination_start(combination_t *cmb, BOOL phrase) {
+  memset(cmb, 0, sizeof(combination_t));
+  cmb->phrase = phrase;
+  cmb->none = 1.0;
+}
+
+
+static void combination_add(query_processing_environment_t *qoenv, combination_t *cmb, plan_estimate_t *child) {
+  double total_postings = qoenv->N * qoenv->avdoclen;
+  if (cmb->phrase) {
+    if (cmb->children == 0) {
+      cmb->occurrences = total_postings;
+      cmb->min_occurrences = child->occurrences;
+    }
+    else if (child->occurrences < cmb->min_occurrences) cmb->min_occurrences = child->occurrences;
+    cmb->occurrences *= child->occurrences / total_postings;
+    cmb->probe_cost += child->probe_cost + 1.0;
+  }
+  else {
+    cmb->occurrences += child->occurrences;
+    cmb->probe_cost += child->probe_cost;
+    cmb->none *= (1.0 - child->selectivity);
+  }
+  cmb->postings += child->postings;
+  cmb->lists += child->lists;
+  cmb->children++;
+}
+
+
+static void combination_finish(query_processing_environment_t *qoenv, combination_t *cmb, plan_estimate_t *est) {
+  est->probe_cost = cmb->probe_cost;
+  est->postings = cmb->postings;
+  est->lists = cmb->lists;
+  if (cmb->phrase) {
+    est->occurrences = (cmb->occurrences < cmb->min_occurrences) ? cmb->occurrences : cmb->min_occurrences;
+    est->selectivity = 1.0 - exp(-est->occurrences / qoenv->N);
+  }
+  else {
+    est->occurrences = cmb->occurrences;
+    est->selectivity = (cmb->children > 0) ? 1.0 - cmb->none : 0.0;
+  }
+}
+
+
+void plan_estimate_node(query_processing_environment_t *qoenv, saat_control_t *blok, plan_estimate_t *est) {
+  // Estimate for a term whose control block has been set up by saat_setup()
+  combination_t cmb;
+  plan_estimate_t child;
+  int c;
+
+  if (blok->type == SAAT_WORD) {
+    estimate_word(qoenv, (blok->dicent == NULL) ? 0.0 : (double)blok->occurrence_count, est);
+    return;  // ----------------->
+  }
+  combination_start(&cmb, (blok->type == SAAT_PHRASE));
+  for (c = 0; c < blok->num_children; c++) {
+    plan_estimate_node(qoenv, blok->children + c, &child);
+    combination_add(qoenv, &cmb, &child);
+  }
+  combination_finish(qoenv, &cmb, est);
+}
+
+
+static double occurrences_of_word(query_processing_environment_t *qoenv, u_char *wd) {
+  // Occurrences in the main index plus any delta index, as saat_skipto() will traverse both.
+  byte *vocab_entry, entry_buf[VOCABFILE_REC_LEN], qidf;
+  u_ll occurrence_count, payload;
+  double rslt = 0.0;
+
+  vocab_entry = lookup_word(wd, qoenv->ixenv->vocab, qoenv->ixenv->vsz, entry_buf, qoenv->debug);
+  if (vocab_entry != NULL) {
+    vocabfile_entry_unpacker(vocab_entry, MAX_WD_LEN + 1, &occurrence_count, &qidf, &payload);
+    rslt += (double)occurrence_count;
+  }
+  if (qoenv->ixenv->delta != NULL) {
+    vocab_entry = lookup_word(wd, qoenv->ixenv->delta->vocab, qoenv->ixenv->delta->vsz, entry_buf, qoenv->debug);
+    if (vocab_entry != NULL) {
+      vocabfile_entry_unpacker(vocab_entry, MAX_WD_LEN + 1, &occurrence_count, &qidf, &payload);
+      rslt += (double)occurrence_count;
+    }
+  }
+  return rslt;
+}
+
+
+static u_char *estimate_string(query_processing_environment_t *qoenv, u_char *p, plan_estimate_t *est) {
+  // Estimate for the word, "phrase" or [disjunction] starting at p, and return a pointer to the
+  // character after it.  Phrases and disjunctions may be nested within each other, as in saat_setup().
+  combination_t cmb;
+  plan_estimate_t child;
+  u_char wd[MAX_WD_LEN + 1], closer;
+  size_t len = 0;
+
+  if (*p == '"' || *p == '[') {
+    closer = (*p == '"') ? '"' : ']';
+    combination_start(&cmb, (*p == '"'));
+    p++;
+    while (*p && *p != closer) {
+      if (*p == ' ') p++;
+      else {
+	p = estimate_string(qoenv, p, &child);
+	combination_add(qoenv, &cmb, &child);
+      }
+    }
+    if (*p) p++;
+    combination_finish(qoenv, &cmb, est);
+    return p;  // ----------------->
+  }
+
+  while (*p && *p != ' ' && *p != '"' && *p != '[' && *p != ']') {
+    if (len < MAX_WD_LEN) wd[len++] = *p;   // Indexed words are truncated to MAX_WD_LEN
+    p++;
+  }
+  wd[len] = 0;
+  if (len == 0) {
+    // A stray closing bracket or quote.  saat_setup() will reject the term.
+    estimate_word(qoenv, 0.0, est);
+    return p + 1;  // ----------------->
+  }
+  estimate_word(qoenv, occurrences_of_word(qoenv, wd), est);
+  return p;
+}
+
+
+void plan_estimate_term_string(query_processing_environment_t *qoenv, u_char *term, plan_estimate_t *est) {
+  // Estimate for a top level query term, before its control block has been set up.
+  estimate_string(qoenv, term, est);
+}
+
+
+static double expected_candidates(plan_estimate_t *est, int t, int m, double N) {
+  // The documents containing any of the m + 1 rarest terms.
+  double selectivities[MAX_WDS_IN_QUERY], tmp, rslt = 0.0;
+  int k, l;
+
+  for (k = 0; k < t; k++) selectivities[k] = est[k].selectivity;
+  for (k = 1; k < t; k++) {
+    for (l = k; l > 0 && selectivities[l] < selectivities[l - 1]; l--) {
+      tmp = selectivities[l];
+      selectivities[l] = selectivities[l - 1];
+      selectivities[l - 1] = tmp;
+    }
+  }
+  for (k = 0; k <= m; k++) rslt += selectivities[k] * N;
+  if (rslt > N) rslt = N;
+  if (rslt < 1.0) rslt = 1.0;
+  return rslt;
+}
+
+
+static void costs_of_checking(plan_estimate_t *est, int t, double candidates, double *costs) {
+  // Set costs[k] to the expected op cost of checking a candidate against term k
+  double per_list, decodes;
+  int k;
+
+  for (k = 0; k < t; k++) {
+    costs[k] = est[k].probe_cost;
+    if (est[k].lists < 1) continue;
+    per_list = est[k].postings / est[k].lists;
+    decodes = per_list / candidates;
+    if (decodes > sqrt(per_list) / 2.0) decodes = sqrt(per_list) / 2.0;
+    costs[k] += decodes * est[k].lists;
+  }
+}
+
+
+static double expected_checking_cost(plan_estimate_t *est, double *costs, int t, int m, int *order) {
+  // The expected op cost of checking a candidate against the t terms in the given order, stopping
+  // as soon as more than m of them are missing.
+  double missing[MAX_WDS_IN_QUERY + 1], reached, p, rslt = 0.0;
+  int k, j;
+
+  missing[0] = 1.0;
+  for (j = 1; j <= m; j++) missing[j] = 0.0;
+  for (k = 0; k < t; k++) {
+    reached = 0.0;
+    for (j = 0; j <= m; j++) reached += missing[j];
+    if (reached < NEGLIGIBLE_PROBABILITY) break;
+    rslt += reached * costs[order[k]];
+    p = est[order[k]].selectivity;
+    for (j = m; j > 0; j--) missing[j] = missing[j] * p + missing[j - 1] * (1.0 - p);
+    missing[0] *= p;
+  }
+  return rslt;
+}
+
+
+static double rank_of(plan_estimate_t *est, double cost) {
+  if (est->selectivity > 1.0 - NEGLIGIBLE_PROBABILITY) return UNDEFINED_DOUBLE;  // ----------------->
+  return cost / (1.0 - est->selectivity);
+}
+
+
+void plan_evaluation_order(query_processing_environment_t *qoenv, plan_estimate_t *est, int t, int m, int *order) {
+  // Set order to the sequence in which saat_relaxed_and() should check the t terms of a candidate.
+  // m is the number of terms which may be missing.
+  double costs[MAX_WDS_IN_QUERY], best, cost;
+  int k, l, tmp, pass;
+  BOOL improved = TRUE;
+
+  if (m < 0) m = 0;
+  if (m > t - 1) m = t - 1;
+  costs_of_checking(est, t, expected_candidates(est, t, m, qoenv->N), costs);
+  for (k = 0; k < t; k++) order[k] = k;
+  // Insertion sort by rank, keeping query order among equals.
+  for (k = 1; k < t; k++) {
+    for (l = k; l > 0 && rank_of(est + order[l], costs[order[l]]) < rank_of(est + order[l - 1], costs[order[l - 1]]); l--) {
+      tmp = order[l];
+      order[l] = order[l - 1];
+      order[l - 1] = tmp;
+    }
+  }
+  if (m == 0) return;  // ----------------->  Already optimal
+
+  best = expected_checking_cost(est, costs, t, m, order);
+  for (pass = 0; improved && pass < MAX_ORDER_REFINEMENT_PASSES; pass++) {
+    improved = FALSE;
+    for (k = 0; k < t - 1; k++) {
+      tmp = order[k];
+      order[k] = order[k + 1];
+      order[k + 1] = tmp;
+      cost = expected_checking_cost(est, costs, t, m, order);
+      if (cost < best - NEGLIGIBLE_PROBABILITY) {
+	best = cost;
+	improved = TRUE;
+      }
+      else {
+	order[k + 1] = order[k];
+	order[k] = tmp;
+      }
+    }
+  }
+}
+
+
+double plan_expected_kops(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+			  plan_estimate_t *est, int t, int m, int *order, double *candidates, double *matches) {
+  // Return the expected kop_cost() of evaluating the t terms in the given order, with up to m
+  // missing.  If they're not NULL, also set the expected numbers of candidates and matches.
+  double present[MAX_WDS_IN_QUERY + 1], costs[MAX_WDS_IN_QUERY], N = qoenv->N,
+    cands, mats = 0.0, fraction = 1.0, considered, cost;
+  int k, l, u;
+
+  if (m < 0) m = 0;
+  if (m > t - 1) m = t - 1;
+  u = t - m;
+  cands = expected_candidates(est, t, m, N);
+  costs_of_checking(est, t, cands, costs);
+
+  // Matches:  the documents containing at least u terms.  present[j] is the probability that j of
+  // the terms considered so far are present.
+  present[0] = 1.0;
+  for (k = 0; k < t; k++) {
+    present[k + 1] = 0.0;
+    for (l = k + 1; l > 0; l--) present[l] = present[l] * (1.0 - est[k].selectivity) + present[l - 1] * est[k].selectivity;
+    present[0] *= (1.0 - est[k].selectivity);
+  }
+  for (l = u; l <= t; l++) mats += present[l] * N;
+
+  considered = mats;
+  if (!qoenv->report_match_counts_only && !qoenv->classifier_mode
+      && mats > (double)qoenv->max_candidates_to_consider) {
+    considered = (double)qoenv->max_candidates_to_consider;
+    fraction = considered / mats;
+  }
+
+  // Skips and decodes both have a cost of one in setup_for_op_counting()
+  cost = fraction * cands * (qex->op_count[COUNT_ACAN].cost
+			     + expected_checking_cost(est, costs, t, m, order) * qex->op_count[COUNT_SKIP].cost);
+  cost += considered * qex->op_count[COUNT_CONS].cost;
+  if (!qoenv->report_match_counts_only && (qoenv->scoring_needed || qoenv->classifier_mode))
+    cost += considered * qex->op_count[COUNT_SCOR].cost;
+
+  if (candidates != NULL) *candidates = fraction * cands;
+  if (matches != NULL) *matches = mats;
+  return cost / 1000.0;
+}
+
+
+static void append_label(saat_control_t *blok, char *buf, size_t size) {
+  // Append a printable version of the term controlled by blok to buf, which has room for size bytes.
+  // setup_phrase_node() sorts the words of a phrase by frequency, so they're put back in order.
+  size_t len = strlen(buf);
+  int c, k, next;
+
+  if (len + 1 >= size) return;  // ----------------->
+  if (blok->type == SAAT_WORD) {
+    snprintf(buf + len, size - len, "%s", (blok->dicent == NULL) ? "<absent>" : (char *)blok->dicent);
+    return;  // ----------------->
+  }
+  snprintf(buf + len, size - len, "%s", (blok->type == SAAT_PHRASE) ? "\"" : "[");
+  for (c = 0; c < blok->num_children; c++) {
+    next = c;
+    if (blok->type == SAAT_PHRASE) {
+      for (k = 0; k < blok->num_children; k++)
+	if (blok->children[k].offset_within_phrase == c) next = k;
+    }
+    if (c > 0) {
+      len = strlen(buf);
+      snprintf(buf + len, size - len, " ");
+    }
+    append_label(blok->children + next, buf, size);
+  }
+  len = strlen(buf);
+  snprintf(buf + len, size - len, "%s", (blok->type == SAAT_PHRASE) ? "\"" : "]");
+}
+
+
+void plan_display(FILE *out, query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+		  saat_control_t *pl_blox, plan_estimate_t *est, int t, int m, int *order, BOOL windows) {
+  // Print the plan chosen for a query, for display_parsed_query.
+  char label[MAX_QLINE + 1];
+  double kops, candidates, matches, costs[MAX_WDS_IN_QUERY];
+  int k;
+
+  kops = plan_expected_kops(qoenv, qex, est, t, m, order, &candidates, &matches);
+  costs_of_checking(est, t, expected_candidates(est, t, (m < t - 1) ? m : t - 1, qoenv->N), costs);
+  fprintf(out, "Query plan: %s evaluation, up to %d of %d terms missing.  Estimated cost %.1f kops, "
+	  "%.0f candidates, %.0f matches\n", windows ? "window-at-a-time" : "candidate-at-a-time", m, t,
+	  kops, candidates, matches);
+  for (k = 0; k < t; k++) {
+    label[0] = 0;
+    append_label(pl_blox + order[k], label, sizeof(label));
+    fprintf(out, "   %2d: {%s}  occurrences %.0f, selectivity %.6f, cost of checking %.1f\n", k + 1, label,
+	    est[order[k]].occurrences, est[order[k]].selectivity, costs[order[k]]);
+  }
+}
+
+
+double plan_predict_kops(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex, double *features) {
+  // Predict the kop_cost() of running the candidate generation query in qex, before any postings are
+  // touched, and fill in the NUM_COST_FEATURES features the prediction is made from:
+  //   0 - one, 1 - the planner's expected kops, 2 - thousands of postings in the lists of the terms,
+  //   3 - words within disjunctions, 4 - the relaxation level, 5 - the number of partial words.
+  // The prediction is the dot product of the features with the coefficients in x_cost_model, which
+  // may be fitted to the QCOSTS: lines of a query log by scripts/fit_query_cost_model.pl.
+  plan_estimate_t est[MAX_WDS_IN_QUERY];
+  int order[MAX_WDS_IN_QUERY], t = 0, u, v, k, m = qoenv->relaxation_level;
+  double coeff, rslt = 0.0;
+  u_char *p, *q;
+
+  memset(features, 0, NUM_COST_FEATURES * sizeof(double));
+  features[0] = 1.0;
+  for (u = 0; u < qex->cg_qwd_cnt; u++) {
+    // Repetitions of a word share a single control block in saat_setup()
+    v = u;
+    if (qex->cg_qterms[u][0] != '"' && qex->cg_qterms[u][0] != '[') {
+      for (v = 0; v < u; v++) if (!strcmp((char *)qex->cg_qterms[u], (char *)qex->cg_qterms[v])) break;
+    }
+    if (v < u) continue;
+    plan_estimate_term_string(qoenv, qex->cg_qterms[u], est + t);
+    features[2] += est[t].postings / 1000.0;
+    if (qex->cg_qterms[u][0] == '[') features[3] += (double)est[t].lists;
+    t++;
+  }
+  if (t > 0) {
+    plan_evaluation_order(qoenv, est, t, m, order);
+    features[1] = plan_expected_kops(qoenv, qex, est, t, m, order, NULL, NULL);
+  }
+  features[4] = (double)m;
+  features[5] = (double)qex->partial_cnt;
+
+  p = qoenv->x_cost_model;
+  for (k = 0; p != NULL && *p && k < NUM_COST_FEATURES; k++) {
+    coeff = strtod((char *)p, (char **)&q);
+    if (q == p) break;  // Not a number.  Missing coefficients are zero.
+    rslt += coeff * features[k];
+    p = q;
+    while (*p == ',' || *p == ' ') p++;
+  }
+  if (rslt < 0.0) rslt = 0.0;
+  return rslt;
+}
@@ -0,0 +1,36 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// A simple cost-based planner for saat_relaxed_and().  The occurrence count, selectivity and cost of
+// checking a candidate are estimated for each term in the query, whether it's a word, a phrase
+// or a disjunction.  From them, an evaluation order and the expected kop_cost() of the query are
+// derived.  Terms are assumed to occur independently of each other.
+//
+// The planner's estimate, with some other features of the query, also drives a predictor of the
+// cost of a whole query, used to route queries predicted to be expensive to a cheaper plan.
+
+typedef struct {
+  double occurrences;    // Estimated number of occurrences of the term in the collection
+  double selectivity;    // Estimated probability that a document contains the term
+  double probe_cost;     // Estimated op cost of checking whether a candidate contains the term, apart
+                         // from decoding the postings skipped over
+  double postings;       // Total length of the postings lists of the words in the term
+  int lists;             // Number of those lists
+} plan_estimate_t;
+
+
+BOOL planning_possible(query_processing_environment_t *qoenv);
+
+void plan_estimate_node(query_processing_environment_t *qoenv, saat_control_t *blok, plan_estimate_t *est);
+
+void plan_estimate_term_string(query_processing_environment_t *qoenv, u_char *term, plan_estimate_t *est);
+
+void plan_evaluation_order(query_processing_environment_t *qoenv, plan_estimate_t *est, int t, int m, int *order);
+
+double plan_expected_kops(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+			  plan_estimate_t *est, int t, int m, int *order, double *candidates, double *matches);
+
+void plan_display(FILE *out, query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+		  saat_control_t *pl_blox, plan_estimate_t *est, int t, int m, int *order, BOOL windows);
+
+double plan_predict_kops(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex, double *features);
@@ -13,6 +13,9 @@
 #include "../shared/QBASHER_common_definitions.h"
 #include "../utils/dahash.h"
 #include "QBASHQ.h"
+#include "../shared/bitmap_postings.h"
+#include "saat.h"
+#include "query_planner.h"
 #include "query_shortening.h"
 
 
@@ -49,6 +52,84 @@ static int cmp_freak(const void *ip, const void *jp, void *context) {
 #endif
 
 
+#define NEGLIGIBLE_KOPS 0.001  // Estimated costs closer than this are taken to be equal
+
+
+static BOOL is_single_word(u_char *term) {
+  return (*term != '"' && *term != '[');
+}
+
+
+static double cost_of_shortened_query(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+				      plan_estimate_t *est, BOOL *in_plan, int skip) {
+  // Return the planner's estimate of the kops to run the candidate generation query comprising the
+  // terms whose in_plan is set, other than term skip.  For speed, the terms are put in the order
+  // which would be optimal for a strict AND.
+  plan_estimate_t selected[MAX_WDS_IN_QUERY];
+  int order[MAX_WDS_IN_QUERY], t = 0, u;
+
+  for (u = 0; u < qex->qwd_cnt; u++) if (in_plan[u] && u != skip) selected[t++] = est[u];
+  if (t == 0) return UNDEFINED_DOUBLE;  // ----------------->
+  plan_evaluation_order(qoenv, selected, t, 0, order);
+  return plan_expected_kops(qoenv, qex, selected, t, qoenv->relaxation_level, order, NULL, NULL);
+}
+
+
+static void zap_cheapest_terms(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+			       BOOL *zap, int *distinct_terms, BOOL explain) {
+  // Repeatedly remove the single word whose removal leads to the lowest expected cost, until the
+  // query is short enough.  Among words whose removal costs the same, remove the most frequent, which
+  // carries the least information.  As with the frequency heuristic, stop short of the threshold if
+  // we're close to it and removing another word wouldn't make the query cheaper.
+  plan_estimate_t est[MAX_WDS_IN_QUERY];
+  BOOL in_plan[MAX_WDS_IN_QUERY];
+  double current_cost, cost, best_cost = 0.0;
+  int u, v, best;
+
+  for (u = 0; u < qex->qwd_cnt; u++) {
+    // Repetitions of a word share a single control block in saat_setup(), so only the first is planned.
+    in_plan[u] = !zap[u];
+    if (in_plan[u] && is_single_word(qex->qterms[u])) {
+      for (v = 0; v < u; v++) {
+	if (in_plan[v] && !strcmp((char *)qex->qterms[u], (char *)qex->qterms[v])) {
+	  in_plan[u] = FALSE;
+	  break;
+	}
+      }
+    }
+    if (in_plan[u]) plan_estimate_term_string(qoenv, qex->qterms[u], est + u);
+  }
+
+  current_cost = cost_of_shortened_query(qoenv, qex, est, in_plan, -1);
+  while (*distinct_terms > qoenv->query_shortening_threshold) {
+    best = -1;
+    for (v = 0; v < qex->qwd_cnt; v++) {
+      if (!in_plan[v] || !is_single_word(qex->qterms[v])) continue;  // Never zap phrases or disjunctions
+      cost = cost_of_shortened_query(qoenv, qex, est, in_plan, v);
+      if (best < 0 || cost < best_cost - NEGLIGIBLE_KOPS
+	  || (cost < best_cost + NEGLIGIBLE_KOPS && est[v].occurrences > est[best].occurrences)) {
+	best = v;
+	best_cost = cost;
+      }
+    }
+    if (best < 0) break;
+    if (qex->cg_qwd_cnt <= (qoenv->query_shortening_threshold + 2) && best_cost > current_cost - NEGLIGIBLE_KOPS) break;
+    in_plan[best] = FALSE;
+    for (u = best; u < qex->qwd_cnt; u++) {
+      if (!zap[u] && !strcmp((char *)qex->qterms[u], (char *)qex->qterms[best])) {
+	zap[u] = TRUE;
+	--qex->cg_qwd_cnt;
+      }
+    }
+    qex->shortening_codes |= SHORTEN_LOW_COST;
+    if (explain) printf("     Zapped term %d (occurrences %.0f).  Estimated cost %.1f kops, was %.1f\n",
+			best, est[best].occurrences, best_cost, current_cost);
+    current_cost = best_cost;
+    --*distinct_terms;
+  }
+}
+
+
 void create_candidate_generation_query(query_processing_environment_t *qoenv,
 					      book_keeping_for_one_query_t *qex) {
   // If query shortening is not in force, just make cg_qterms a copy of qterms.
@@ -59,10 +140,12 @@ void create_candidate_generation_query(query_processing_environment_t *qoenv,
   //    2. *** NO LONGER DONE, BECAUSE IT'S NOW FASTER TO LEAVE THEM IN.  Remove repeated words
   //    3. Remove words which are all digits
   //    4. Remove the words with the highest occurrence frequency (subject to a
-  //       minimum frequency.)
+  //       minimum frequency.)  Or with x_cost_based_shortening, the words whose removal
+  //       most reduces the planner's estimate of the cost of the query.  That may be the
+  //       rarest word, so it's not the default.
   // 
   int t, u, distinct_terms = 0;
-  byte *vocab_entry;
+  byte *vocab_entry, entry_buf[VOCABFILE_REC_LEN];
   u_char *r, *w;
   BOOL explain = (qoenv->debug >= 1), repeated;
   qex->shortening_codes = 0;
@@ -138,7 +221,7 @@ void create_candidate_generation_query(query_processing_environment_t *qoenv,
       for (u = 0; u < qex->qwd_cnt; u++) {
 	wd = qex->qterms[u];
 	if (*wd == '"' || *wd == '[') continue;  // Never zap phrases or disjunctions
-	vocab_entry = lookup_word(wd, qoenv->ixenv->vocab, qoenv->ixenv->vsz, qoenv->debug);
+	vocab_entry = lookup_word(wd, qoenv->ixenv->vocab, qoenv->ixenv->vsz, entry_buf, qoenv->debug);
 	if (vocab_entry == NULL) {
 	  // Term not found.  Zap it!
 	  zap[u] = TRUE;
@@ -171,7 +254,12 @@ void create_candidate_generation_query(query_processing_environment_t *qoenv,
       }
 
 
-      if (distinct_terms > qoenv->query_shortening_threshold) {
+      if (distinct_terms > qoenv->query_shortening_threshold && qoenv->x_cost_based_shortening
+	  && planning_possible(qoenv)) {
+	//    4. Remove the words which most reduce the planner's estimate of the cost of the query
+	zap_cheapest_terms(qoenv, qex, zap, &distinct_terms, explain);
+      }
+      else if (distinct_terms > qoenv->query_shortening_threshold) {
 	//    4. Remove the words with the highest occurrence frequency
 #ifdef WIN64
 	// Annoying that Windows, MacOS and Linux don't agree on how to do reentrant qsort.
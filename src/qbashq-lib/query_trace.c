@@ -0,0 +1,124 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Per-query traces in JSON lines format.  See query_trace.h.
+//
+// Each trace is formatted in a buffer of its own and written with a single fputs(), so that lines
+// written by different query streams don't interleave.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN64
+#include <windows.h>
+#endif
+
+#include "../shared/QBASHER_common_definitions.h"
+#include "../shared/utility_nodeps.h"
+#include "../utils/dahash.h"
+#include "QBASHQ.h"
+#include "stage_timing.h"
+#include "query_trace.h"
+
+#define TRACE_FIXED_LEN 4096   // Ample for everything in a trace except the query strings
+
+static volatile long queries_considered = 0;
+
+
+BOOL choose_query_for_tracing(query_processing_environment_t *qoenv) {
+  // Hash a count of the queries considered so far with the SplitMix64 finalizer.  Unlike rand(),
+  // this is safe to call from multiple query streams.
+  u_ll h;
+
+  if (qoenv->query_trace == NULL) return FALSE;  // ----------------->
+  if (qoenv->query_trace_sampling <= 1) return TRUE;  // ----------------->
+  h = (u_ll)(unsigned long)ATOMIC_INCREMENT(queries_considered) * 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+  h ^= h >> 31;
+  return (h % (u_ll)qoenv->query_trace_sampling) == 0;
+}
+
+
+static u_char *append_json_string(u_char *w, u_char *s) {
+  // Write s at w as a quoted JSON string, or null if s is NULL.  Return the position after it.
+  // At most 6 * strlen(s) + 2 bytes are written.
+  if (s == NULL) {
+    strcpy((char *)w, "null");
+    return w + 4;  // ----------------->
+  }
+  *w++ = '"';
+  while (*s) {
+    if (*s == '"' || *s == '\\') {
+      *w++ = '\\';
+      *w++ = *s;
+    }
+    else if (*s < ' ') {
+      sprintf((char *)w, "\\u%04x", *s);
+      w += 6;
+    }
+    else *w++ = *s;
+    s++;
+  }
+  *w++ = '"';
+  return w;
+}
+
+
+void write_query_trace(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+		       u_char *multi_query_string, u_char *label, int results) {
+  // Write the trace of a query which has finished.  A failure to allocate the buffer just loses the trace.
+  u_char *buf, *w, route[4] = { 0 }, shortening[6] = { 0 };
+  size_t len;
+  long long total_cost = 0;
+  int c, pos;
+
+  len = 6 * (strlen((char *)qex->query_as_processed) + strlen((char *)qex->candidate_generation_query))
+    + TRACE_FIXED_LEN;
+  if (multi_query_string != NULL) len += 6 * strlen((char *)multi_query_string);
+  if (label != NULL) len += 6 * strlen((char *)label);
+  buf = (u_char *)malloc(len);  // MAL2020
+  if (buf == NULL) return;  // ----------------->
+
+  for (c = 0; c < NUM_OPS; c++) total_cost += qex->op_count[c].count * qex->op_count[c].cost;
+  pos = 0;
+  if ((qex->routing_codes & ROUTED_RELAXATION)) route[pos++] = 'R';
+  if ((qex->routing_codes & ROUTED_SHORTENING)) route[pos++] = 'S';
+  if ((qex->routing_codes & ROUTED_TIMEOUT)) route[pos++] = 'T';
+  pos = 0;
+  if ((qex->shortening_codes & SHORTEN_NOEXIST)) shortening[pos++] = 'X';
+  if ((qex->shortening_codes & SHORTEN_REPEATED)) shortening[pos++] = 'R';
+  if ((qex->shortening_codes & SHORTEN_ALL_DIGITS)) shortening[pos++] = '9';
+  if ((qex->shortening_codes & SHORTEN_HIGH_FREQ)) shortening[pos++] = 'H';
+  if ((qex->shortening_codes & SHORTEN_LOW_COST)) shortening[pos++] = 'C';
+
+  w = buf;
+  w += sprintf((char *)w, "{\"start_time\":%.6f,\"label\":", qex->start_time);
+  w = append_json_string(w, label);
+  strcpy((char *)w, ",\"query\":");
+  w = append_json_string(w + strlen((char *)w), multi_query_string);
+  strcpy((char *)w, ",\"processed_query\":");
+  w = append_json_string(w + strlen((char *)w), qex->query_as_processed);
+  strcpy((char *)w, ",\"cg_query\":");
+  w = append_json_string(w + strlen((char *)w), qex->candidate_generation_query);
+  w += sprintf((char *)w, ",\"shortening\":\"%s\",\"results\":%d,\"timed_out\":%s,\"cost\":%lld,\"ops\":{",
+	       shortening, results, qex->timed_out ? "true" : "false", total_cost);
+  for (c = 0; c < NUM_OPS; c++)
+    w += sprintf((char *)w, "%s\"%s\":%d", c ? "," : "", qex->op_count[c].label, qex->op_count[c].count);
+  strcpy((char *)w, "},\"stages_usec\":{");
+  w += strlen((char *)w);
+  for (c = 0; c < NUM_STAGES; c++)
+    w += sprintf((char *)w, "%s\"%s\":%.1f", c ? "," : "", stage_names[c], qex->stage_elapsed[c] * 1000000.0);
+  strcpy((char *)w, "},\"candidates_per_block\":[");
+  w += strlen((char *)w);
+  for (c = 0; c <= MAX_RELAX; c++)
+    w += sprintf((char *)w, "%s%d", c ? "," : "", qex->candidates_per_block[c]);
+  strcpy((char *)w, "]");
+  w += strlen((char *)w);
+  if (qex->cost_predicted)
+    w += sprintf((char *)w, ",\"predicted_kops\":%.3f,\"route\":\"%s\"", qex->predicted_kops, route);
+  strcpy((char *)w, "}\n");
+
+  fputs((char *)buf, qoenv->query_trace);
+  free(buf);  // FRE2020
+}
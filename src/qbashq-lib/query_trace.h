@@ -0,0 +1,18 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Per-query traces.  With file_query_trace=<path>, queries are chosen at random, one in
+// query_trace_sampling, and for each one chosen a JSON object describing how it was processed is
+// written to the file as a single line.  The traces are intended to be left on in production and
+// mined offline, e.g. for the features common to slow queries.
+//
+// Where a multi-query has several variants, processed_query and cg_query are those of the last
+// variant run, while the op counts, stage times and candidates are totals over all the variants.
+// predicted_kops and route are left out if no cost prediction could be made, e.g. with
+// x_query_planner=FALSE or an index whose .if header lacks the collection statistics.
+// Strings are written as they are, apart from JSON escapes.  They are assumed to be UTF-8.
+
+BOOL choose_query_for_tracing(query_processing_environment_t *qoenv);
+
+void write_query_trace(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+		       u_char *multi_query_string, u_char *label, int results);
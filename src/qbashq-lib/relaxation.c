@@ -22,7 +22,10 @@
 #include "../shared/utility_nodeps.h"
 #include "../utils/dahash.h"
 #include "QBASHQ.h"
+#include "../shared/bitmap_postings.h"
 #include "saat.h"
+#include "query_planner.h"
+#include "stage_timing.h"
 
 
 #if 0  // Not used any more
@@ -135,6 +138,18 @@ static inline long long nCr(int n, int r) {
 
 #endif   // No longer used but might be useful in future
 
+static inline int lowest_bit(u_ll word) {
+  // word must be non-zero
+#ifdef WIN64
+  unsigned long i;
+  _BitScanForward64(&i, word);
+  return (int)i;
+#else
+  return __builtin_ctzll(word);
+#endif
+}
+
+
 static inline int count_one_bits(unsigned int x) {
 	int cnt = 0;
 	while (x) {
@@ -145,10 +160,471 @@ static inline int count_one_bits(unsigned int x) {
 }
 
 
-void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
-		      saat_control_t *pl_blox, byte *forward, byte *index, byte *doctable, size_t fsz,
-		      int *error_code) {
-  // Implements relaxed saat functionality
+static BOOL check_timeouts(FILE *out, query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+			   int total_recorded, int candidates_considered, int skips) {
+  // Check both the deterministic and the elapsed time timeouts, if in force.  Return TRUE if the
+  // query has timed out.
+  if (qoenv->timeout_kops > 0) {
+    if (qoenv->debug >= 1) fprintf(out, "Checking timeout %d v %d\n",
+				   kop_cost(qex), qoenv->timeout_kops);
+    if (kop_cost(qex) > qoenv->timeout_kops) {
+      qex->timed_out = TRUE;
+      qoenv->query_timeout_count++;
+      if (qoenv->debug >= 1) {
+	fprintf(out, "Timed out!(%s). Total recorded = %d.  Timeout KOPS: %d\n", 
+		qex->query_as_processed, total_recorded, qoenv->timeout_kops);
+	fprintf(out, "candidates considered: %d; skips = %d\n", candidates_considered, skips);
+      }
+      return TRUE;  // TIMEOUT  ------------------------------>
+    }
+  }
+
+  if (qoenv->timeout_msec > 0) {
+    double elapsed = 1000.0 * (what_time_is_it() - qex->start_time);
+    if (0) printf("           ----- Checking msec timeout %.0f v. %d -----\n",
+		  elapsed, qoenv->timeout_msec);
+    if (elapsed > (double)qoenv->timeout_msec) {
+      qex->timed_out = TRUE;
+      qoenv->query_timeout_count++;
+      if (qoenv->debug >= 1) {
+	fprintf(out, "Timed out!(%s). Total recorded = %d.  Timeout msec: %d\n", 
+		qex->query_as_processed, total_recorded, qoenv->timeout_msec);
+	fprintf(out, "candidates considered: %d; skips = %d\n", candidates_considered, skips);
+      }
+      return TRUE;  // TIMEOUT  ------------------------------>
+    }
+  }
+  return FALSE;
+}
+
+
+static BOOL block_full(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex, int rb) {
+  // Each part of a main index plus delta may fill a result block.  See saat_relaxed_and().
+  return (qex->candidates_recorded[rb] - qex->candidates_phase_base[rb] >= qoenv->max_candidates_to_consider);
+}
+
+
+static BOOL record_prima_facie_match(FILE *out, query_processing_environment_t *qoenv,
+				     book_keeping_for_one_query_t *qex, saat_control_t *pl_blox,
+				     byte *forward, byte *index, byte *doctable, size_t fsz,
+				     int candid8, docnum_t candidoc, int terms_missing, u_int terms_matched_bits,
+				     int *relaxation, int *total_recorded, int candidates_considered, int skips) {
+  // Called by both relaxed evaluators for a document candidoc which matches all but terms_missing of the
+  // top-level terms, where terms_missing <= *relaxation.  candid8 is the term whose list is positioned
+  // on candidoc, or -1 if none is.  In this function we: 
+  //   1. Possibly record the candidate in a result blocks.  
+  //   2. When we record a result, we check:
+  //      a. Whether this result block is now full,
+  //      b. If so, whether we can now reduce the relaxation level (*relaxation),
+  //      c. If so, whether we have now finished.
+  // Return TRUE if the evaluator should stop.
+  int k, it_was_recorded, rb_to_use, m = *relaxation, rbn = qoenv->relaxation_level + 1;
+  u_int rbit;
+  BOOL finished;
+  double started;
+
+  rb_to_use = terms_missing;
+
+  if (qoenv->report_match_counts_only) {
+    //  --------------------- Special behaviour activated when max_to_show == 0 ------------------
+    if (terms_missing == 0 && !is_tombstoned(qoenv->ixenv, candidoc)) {
+      qex->full_match_count++;  // Only count full matches of live documents.
+      if (0) printf("FMC:  %lld\n", qex->full_match_count);
+    }
+  } else if (!block_full(qoenv, qex, rb_to_use) || qoenv->classifier_mode) {  // ..................................  Test on RB .....
+    // Acceptable degree of  match, and we haven't filled up all the slots at this level of
+    // match, or we're doing the classifier pseudo-heap thing.
+
+    if (qoenv->debug >= 1) {
+      byte *doc;
+      u_char *p;
+      int dc_len;
+      byte *dforward;
+      size_t dfsz;
+      fprintf(out, "Match found in saat_relaxed_and(): rb_to_use = %d, candid8 = %d\n", rb_to_use, candid8);
+      fprintf(out, "       Match with %d terms missing [terms_matched bits = %X, m = %d, rb_to_use = %d] is %lld (%d): ",
+	      terms_missing, terms_matched_bits, m, rb_to_use, candidoc, candid8);
+      doc = get_doc(get_dtent(qoenv->ixenv, candidoc, &dforward, &dfsz), dforward, &dc_len, dfsz);
+      if (doc == NULL) {
+	fprintf(out, " NULL (error)\n");
+      }
+      else {
+	fprintf(out, "[off = %llx] ", (long long)(doc - dforward));
+	p = (u_char *)doc;
+	show_string_upto_nator(p, '\n', 0);
+      }
+    }
+    if (qoenv->debug >= 1) printf("About to P_R candidate in RB[%d]: %d\n",
+				  rb_to_use, qex->candidates_recorded[rb_to_use]);
+
+
+    if (0) {
+      byte *doc;
+      u_char *p;
+      int dc_len;
+      doc = get_doc((unsigned long long *)(doctable + candidoc * DTE_LENGTH), forward, &dc_len, fsz);
+      if (doc == NULL) {
+	printf("CANDIDATE: NULL (error)\n");
+      } else {
+	printf("CANDIDATE: [docno = %lld, off = %llx] ", candidoc, (long long)(doc - forward));
+	p = (u_char *)doc;
+	show_string_upto_nator(p, '\n', 0);
+      }
+    }
+
+
+
+    // If we're doing BM25 scoring we need to compute the TFs of each query term
+    if (qoenv->rr_coeffs[5] > 0.0) {
+      rbit = 1;
+      for (k = 0; k < qex->tl_saat_blocks_used; k++) {
+	int tftmp = 0;
+	if (terms_matched_bits & rbit)
+	  tftmp = saat_get_tf(out, pl_blox + k, index, qex->op_count, qoenv->debug);
+	if (0) printf("Query term %d, tf = %d\n", k, tftmp);
+	pl_blox[k].tf = tftmp;
+	rbit <<= 1;
+      }
+    }
+
+    started = stage_timer_start(qex);
+    it_was_recorded =
+      possibly_record_candidate(qoenv, qex, pl_blox, forward, index, doctable,
+				fsz, candidoc, 
+				rb_to_use, terms_matched_bits);
+    stage_timer_stop(qex, STAGE_CHECKS, started);
+    if (0) printf("Done P_R candidate\n");
+
+    if (it_was_recorded) {
+      int stopping_condition = 2;
+
+      //  ------------------------ Stopping condition rules are different in CLASSIFIER MODES ------------------------------------
+      if (qoenv->classifier_mode) {
+	// There are two different early termination conditions, one which applies to the highest scoring candidate
+	// (slot 0 in result block 0) and the other to the lowest candidate in the most relaxed result block
+	candidate_t *candies;
+	if (qoenv->classifier_stop_thresh1 < 1.0) {
+	  candies = qex->candidatesa[rb_to_use];
+	  if (candies[0].score > qoenv->classifier_stop_thresh1) return TRUE;  // classifier ----------------------------->
+	}
+
+	if (qoenv->classifier_stop_thresh2 < 1.0 && rb_to_use == (rbn -1)) {
+	  // We have to apply this test to all the result blocks
+	  // We only terminate if all the result blocks are fully populated and none have a score below
+	  // thresh2.
+	  int r;
+	  BOOL no_lower_score_found = TRUE;
+	  for (r = 0; r < rbn; r++) {
+	    candies = qex->candidatesa[r];
+	    if (0) printf("THRESH2: Checking result block %d. Lowest score = %.3f\n",
+			  r, candies[qoenv->max_to_show - 1].score);
+	    if (candies[qoenv->max_to_show - 1].score <= qoenv->classifier_stop_thresh2) {
+	      no_lower_score_found = FALSE;
+	      break;
+	    }
+	  }
+	  if (no_lower_score_found) {
+	    if (0) printf("THRESH2: We're going to abandon ship\n");
+	    return TRUE;  // classifier -------------->
+	  }
+	}
+      }
+      else {  // .................................. If not classifier mode .......................
+	(*total_recorded)++;
+	if (qoenv->debug >= 1) fprintf(out, "saat_relaxed_and(): match with %d terms missing recorded in rb %d. tot rec: %d\n",
+				       terms_missing, rb_to_use, *total_recorded);
+
+	// Have we finished by finding the required number of results?
+
+	if (stopping_condition == 0 || m == 0) {
+	  // Stop when the first tier is full
+	  if (block_full(qoenv, qex, 0)) {
+	    if (qoenv->debug >= 1) fprintf(out, "Stopping: candidates considered: %d; skips = %d\n",
+					   candidates_considered, skips);
+	    return TRUE;  // FILLED ALL THE FULL MATCH SLOTS -------------------------------------------------------------->
+	  }
+	}
+#if 0
+	else if (stopping_condition == 1) {
+	  // Stop when total matches reaches required level
+	  if (total_recorded >= qoenv->max_candidates_to_consider) {
+	    if (qoenv->debug >= 1) fprintf(out, "candidates considered: %d; skips = %d\n",
+					   candidates_considered, skips);
+	    return TRUE;  // GOT ENOUGH RESULTS ----------------------->
+	  }
+	}
+#endif
+	else {  //  -------------- Non-trivial stopping condition 
+	  finished = TRUE;
+
+	  if (block_full(qoenv, qex, rb_to_use)) {
+	    // We've just filled up a result list.  Can we now tighten up the relaxation level?
+	    if (m && rb_to_use == m) {
+	      if (qoenv->debug >= 1) fprintf(out, "Shrinking relaxation_level to %d\n", m - 1);
+	      (*relaxation)--;
+	    }
+	  }
+
+	  for (k = 0; k < rbn; k++) {
+	    if (0) fprintf(out, "Result block %d - recorded = %d / %d\n",
+			   k, qex->candidates_recorded[k], qoenv->max_candidates_to_consider);
+	    if (!block_full(qoenv, qex, k)) {
+	      finished = FALSE;
+	      break;
+	    }
+	    if (0) fprintf(out, "result block = %d; matches recorded  = %d\n", k, qex->candidates_recorded[k]);
+	  }
+	  if (finished) {
+	    if (qoenv->debug >= 1)
+	      fprintf(out, "Stopping: candidates considered: %d; skips = %d.  Got enough results.\n",
+		      candidates_considered, skips);
+	    return TRUE;  // FILLED ALL THE SLOTS AT ALL THE LEVELS ----------------->
+	  }
+	}   //  -------------- Non-trivial stopping condition
+
+	// =============== Can we ease off on the relaxation level? ================================
+	// Reducing the relaxation level once we've recorded enough weaker matches seems to pay off,
+	// at least for relaxation_levels of 2 or more.   E.g. for relaxaton_level=3 it increases QPS
+	// from an average of 100.7 to 122.4 (+22%) and for RL=2 from 567 to 722 (+27%)  The effect would probably be
+	// bigger for longer queries.
+      }
+    }  // ..................................  End of if (it_was_recorded) .....
+    else if (0) fprintf(out, "It was NOT recorded.\n");
+  }  // .................................. End of complex if (rb >= 0 ....)  .......................
+  return FALSE;
+}
+
+
+// The window evaluator decodes a range of docnums at a time from every top-level postings list,
+// accumulating a match count and a term bitmask for each document in the window.  The counts are
+// then scanned for documents which match enough terms.  The window starts small, because most
+// queries which stop early do so within the first few hundred candidates, and doubles up to
+// RELAXED_WINDOW_MAX.
+#define RELAXED_WINDOW_MIN 256
+#define RELAXED_WINDOW_MAX 4096   // At most 64 x 64, for the summary bitmap
+
+// Relative costs used to choose between the evaluators.  The candidate evaluator checks every list
+// and selects the next pivot for each candidate, which costs about t x (m + 1) comparisons.  The window
+// evaluator decodes the postings of the m + 1 shortest lists, probes the other lists for each document
+// found, and has some overhead for every window.  Calibrated with scripts/qbash_relaxed_timing_check.pl
+#define CANDIDATE_COST_PER_COMPARISON 0.5
+#define WINDOW_COST_PER_POSTING 1.0
+#define WINDOW_COST_PER_WINDOW 1.0
+
+
+static long long estimated_postings(saat_control_t *blok) {
+  // A rough estimate of the number of postings in the list of a top-level term:  the occurrence
+  // count of a word, the rarest word in a phrase, or the total over a disjunction.
+  long long rslt = 0, c;
+  int k;
+  if (blok->type == SAAT_WORD) return blok->occurrence_count;  // ----------------->
+  for (k = 0; k < blok->num_children; k++) {
+    c = estimated_postings(blok->children + k);
+    if (blok->type == SAAT_DISJUNCTION) rslt += c;
+    else if (k == 0 || c < rslt) rslt = c;
+  }
+  return rslt;
+}
+
+
+static BOOL window_evaluator_is_cheaper(query_processing_environment_t *qoenv, saat_control_t *pl_blox,
+					int t, int m) {
+  // The window evaluator is only usable when possibly_record_candidate() doesn't need the lists
+  // to be positioned within the candidate, i.e. there's no repetition check and no BM25, and
+  // when there's no timeout:  ops are charged and timeouts checked per window rather than per
+  // candidate, so a query would time out at a different point.  If both can be used, choose
+  // the one with the lower estimated cost.  Every match appears in at
+  // least one of the m + 1 shortest lists, so the number of postings in those lists, e, is taken
+  // as the number of candidates for both evaluators.
+  long long postings[MAX_WDS_IN_QUERY], e = 0, windows, tmp;
+  double candidate_cost, window_cost;
+  int k, l;
+
+  if (qoenv->relaxation_level == 0 || qoenv->rr_coeffs[5] > 0.0 || t < 2 || m < 1) return FALSE;  // ----------------->
+  if (qoenv->timeout_kops > 0 || qoenv->timeout_msec > 0) return FALSE;  // ----------------->
+  if (qoenv->x_relaxed_evaluator == RELAXED_EVALUATOR_WINDOWS) return TRUE;  // ----------------->
+  if (qoenv->x_relaxed_evaluator != RELAXED_EVALUATOR_AUTO || qoenv->classifier_mode) return FALSE;  // ----------------->
+
+  for (k = 0; k < t; k++) postings[k] = estimated_postings(pl_blox + k);
+  for (k = 0; k < t - 1; k++) {
+    for (l = k + 1; l < t; l++) {
+      if (postings[l] < postings[k]) {
+	tmp = postings[l];
+	postings[l] = postings[k];
+	postings[k] = tmp;
+      }
+    }
+  }
+  for (k = 0; k <= m; k++) e += postings[k];
+  windows = (long long)(qoenv->ixenv->dsz / DTE_LENGTH) / RELAXED_WINDOW_MAX + 1;
+  if (windows > e) windows = e;
+
+  candidate_cost = CANDIDATE_COST_PER_COMPARISON * (double)e * (double)t * (double)(m + 1);
+  window_cost = WINDOW_COST_PER_POSTING * (double)e * (double)(t - m)
+    + WINDOW_COST_PER_WINDOW * (double)windows * (double)t;
+  if (qoenv->debug >= 1) printf("Relaxed evaluator costs:  candidates %.0f, windows %.0f\n", candidate_cost, window_cost);
+  return (window_cost < candidate_cost);
+}
+
+
+static void saat_relaxed_windows(FILE *out, query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+				 saat_control_t *pl_blox, byte *forward, byte *index, byte *doctable, size_t fsz,
+				 int m, int *error_code) {
+  // Window-at-a-time alternative to the candidate-at-a-time loop in saat_relaxed_and(), finding the same
+  // documents in the same order, and recording them in the same way.  m is the number of terms
+  // which may be missing, so a match must contain at least u = t - m terms.
+  //
+  // A match can't be missing from all of the m + 1 shortest lists (the essential lists), so within
+  // a window every posting of the essential lists is decoded and counted, and the other lists are
+  // only probed at the documents found, in order of increasing length.  A document is dropped as
+  // soon as it can no longer reach u.  The next window starts at the lowest curdoc of the essential
+  // lists.
+  //
+  // present[] is a bitmap of the documents in the window which are still in contention, so that
+  // they can be visited in docnum order by bit scanning, and bit h of summary is set if present[h]
+  // may be non-zero.  Postings are usually sparse within a window, so nothing may cost anything
+  // per document in the window.  counts[] and masks[] are zero except for the documents in present[].
+  byte counts[RELAXED_WINDOW_MAX];
+  u_int masks[RELAXED_WINDOW_MAX];
+  u_ll present[RELAXED_WINDOW_MAX / 64], bits, summary, words;
+  long long postings[MAX_WDS_IN_QUERY];
+  int order[MAX_WDS_IN_QUERY], t = qex->tl_saat_blocks_used, k, l, h, u, essential, exhausted, tmp,
+    total_recorded = 0, candidates_considered = 0, skips = 0, window_docs = RELAXED_WINDOW_MIN,
+    w, bit, terms_missing;
+  docnum_t window_start, window_end, candidoc;
+  u_int rbit;
+  saat_control_t *blok;
+
+  if (qoenv->debug >= 1) fprintf(out, "saat_relaxed_windows(): %d terms, up to %d missing\n", t, m);
+  memset(counts, 0, sizeof(counts));
+  memset(masks, 0, sizeof(masks));
+  memset(present, 0, sizeof(present));
+  for (k = 0; k < t; k++) {
+    order[k] = k;
+    postings[k] = estimated_postings(pl_blox + k);
+  }
+  for (k = 1; k < t; k++) {
+    tmp = order[k];
+    for (l = k; l > 0 && postings[order[l - 1]] > postings[tmp]; l--) order[l] = order[l - 1];
+    order[l] = tmp;
+  }
+
+  while (1) {
+    u = t - m;
+    essential = m + 1;
+    exhausted = 0;
+    window_start = CURDOC_EXHAUSTED;
+    for (k = 0; k < t; k++) {
+      blok = pl_blox + order[k];
+      if (blok->curdoc == CURDOC_EXHAUSTED) exhausted++;
+      else if (k < essential && blok->curdoc < window_start) window_start = blok->curdoc;
+    }
+    if (window_start >= qex->evaluation_limit || exhausted > m) {
+      if (qoenv->debug >= 1) fprintf(out, "Exhaustion(W): candidates considered: %d; skips = %d\n",
+				     candidates_considered, skips);
+      return;  // TOO MANY LISTS EXHAUSTED ---------------------------------------->
+    }
+    window_end = window_start + window_docs;
+    if (window_end > qex->evaluation_limit) window_end = qex->evaluation_limit;
+    summary = 0;
+
+    // ------------- Count every posting in the window from the essential lists ---------------
+    for (k = 0; k < essential; k++) {
+      l = order[k];
+      blok = pl_blox + l;
+      rbit = 1 << (t - l - 1);
+      while (blok->curdoc < window_end) {
+	w = (int)(blok->curdoc - window_start);
+	present[w >> 6] |= 1ULL << (w & 63);
+	summary |= 1ULL << (w >> 6);
+	counts[w]++;
+	masks[w] |= rbit;
+	saat_skipto(out, blok, l, blok->curdoc + 1, DONT_CARE, index, qex->op_count, qoenv->debug, error_code);
+	if (*error_code < -200000) return;  // ------------------------------------->
+	skips++;
+      }
+    }
+
+    // ------------- Probe the other lists at the documents still in contention ---------------
+    for (k = essential; k < t; k++) {
+      l = order[k];
+      blok = pl_blox + l;
+      rbit = 1 << (t - l - 1);
+      for (words = summary; words; words &= words - 1) {
+	h = lowest_bit(words);
+	bits = present[h];
+	while (bits) {
+	  bit = lowest_bit(bits);
+	  bits &= bits - 1;
+	  w = h * 64 + bit;
+	  if (counts[w] + t - k < u) {
+	    // Can't reach u even if all the remaining lists contain it.
+	    present[h] &= ~(1ULL << bit);
+	    counts[w] = 0;
+	    masks[w] = 0;
+	    continue;
+	  }
+	  candidoc = window_start + w;
+	  if (blok->curdoc < candidoc) {
+	    saat_skipto(out, blok, l, candidoc, DONT_CARE, index, qex->op_count, qoenv->debug, error_code);
+	    if (*error_code < -200000) return;  // ------------------------------------->
+	    skips++;
+	  }
+	  if (blok->curdoc == candidoc) {
+	    counts[w]++;
+	    masks[w] |= rbit;
+	  }
+	}
+      }
+    }
+
+    // ------------- Record the documents matching at least u terms, in docnum order ---------------
+    if (qoenv->x_prefetch && !qoenv->report_match_counts_only) {
+      // Their doctable entries are read by possibly_record_candidate()
+      byte *dforward;
+      size_t dfsz;
+      for (words = summary; words; words &= words - 1) {
+	h = lowest_bit(words);
+	for (bits = present[h]; bits; bits &= bits - 1) {
+	  w = h * 64 + lowest_bit(bits);
+	  if (counts[w] >= u) PREFETCH(get_dtent(qoenv->ixenv, window_start + w, &dforward, &dfsz));
+	}
+      }
+    }
+    for (words = summary; words; words &= words - 1) {
+      h = lowest_bit(words);
+      bits = present[h];
+      present[h] = 0;
+      while (bits) {
+	bit = lowest_bit(bits);
+	bits &= bits - 1;
+	w = h * 64 + bit;
+	terms_missing = t - counts[w];
+	counts[w] = 0;
+	candidates_considered++;
+	qex->op_count[COUNT_ACAN].count += t;
+	// m may have shrunk since the window was started
+	if (terms_missing <= m
+	    && record_prima_facie_match(out, qoenv, qex, pl_blox, forward, index, doctable, fsz, -1,
+					window_start + w, terms_missing, masks[w], &m, &total_recorded,
+					candidates_considered, skips))
+	  return;  // ENOUGH RESULTS OR CLASSIFIER THRESHOLD REACHED ----------------------------------->
+	masks[w] = 0;
+      }
+    }
+
+    if ((qoenv->timeout_kops > 0 || qoenv->timeout_msec > 0)
+	&& check_timeouts(out, qoenv, qex, total_recorded, candidates_considered, skips))
+      return;  // TIMEOUT  ------------------------------>
+    if (window_docs < RELAXED_WINDOW_MAX) window_docs *= 2;
+  }
+}
+
+
+static void saat_relaxed_part(FILE *out, query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+			      saat_control_t *pl_blox, byte *forward, byte *index, byte *doctable, size_t fsz,
+			      BOOL delta_part, int *error_code) {
+  // Implements relaxed saat functionality, over docnums below qex->evaluation_limit
   //  - attempts to insert up to max_candidates_to_consider candidates into the candidates array
   //  - Returns zero if there are no words in the query (obviously)
   //  - Returns zero if there are more than MAX_WDS_IN_QUERY words
@@ -162,11 +638,12 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
   // pl_blox is the array of control blocks for the top-level terms.  It has qwd_cnt elements.  For brevity,
   // let's call qwd_cnt 'q' and that top-level terms are numbered from 0 to q-1
   // This function uses two permutation arrays to reorder pl_blox
-  //	 - fpermute reorders the terms by increasing collection frequency.  Notes:
+  //	 - fpermute is the order in which the terms are checked against a candidate.  Notes:
   //	     a. This permutation is calculated only once
-  //       b. This permutation is ineffective for queries containing disjunctions and phrases
-  //		 c. If such terms are encountered fpermute order is sort of undefined
-  //       d. Maybe phrases should be put at head of list (assume low frequency) and disjunctions at tail (assume high freq, high cost)
+  //       b. With x_query_planner, it minimises the expected cost of checking a candidate, estimated
+  //          from the frequencies and structure of words, phrases and disjunctions.  (See query_planner.c)
+  //		 c. Otherwise it's by increasing collection frequency, which is ineffective for queries containing
+  //          disjunctions and phrases, because their order is left sort of undefined.
   //   - tpermute reorders terms by increasing index of the document they currently reference.  Notes:
   //       e. This permutation is currently calculated each time a new candidate is considered. 
   //	     f. Re-calculation of tpermute definitely pays off by reducing the number of calls to saat_skipto() and
@@ -198,16 +675,19 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
   //         we may repeatedly accept d.
   //
   //	   S4: Select a new candidate.  Recompute tpermute and use tpermute[q-m-1] as the next candidate
+  //
+  // When most candidates fail, as they do at higher relaxation levels on long queries, it can be cheaper to
+  // decode all the lists a window at a time instead.  See saat_relaxed_windows().
 
   int total_recorded = 0, k, l, candid8, code = 0, t = qex->tl_saat_blocks_used, pivot,
     curdoc_ranking[MAX_WDS_IN_QUERY], fpermute[MAX_WDS_IN_QUERY], u, m = qoenv->relaxation_level,
-    terms_missing, terms_exhausted = 0, it_was_recorded, candidates_considered = 0, skips = 0,
-    rbn = qoenv->relaxation_level + 1, rb_to_use;
+    terms_missing, terms_exhausted = 0, candidates_considered = 0, skips = 0;
 
   docnum_t candidoc;
   long long possibles = 0;  // For enforcing a timeout on this thread.
   u_int rbit, terms_matched_bits;
-  BOOL finished = FALSE;
+  BOOL finished = FALSE, use_windows;
+  plan_estimate_t plan_est[MAX_WDS_IN_QUERY];
 
   *error_code = 0;
   if (qoenv->debug >=2)
@@ -242,21 +722,46 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
 
   pivot = u - 1; 
 
+  if (qoenv->report_match_counts_only && qoenv->classifier_mode == 0 && t <= BMP_MAX_INTERSECTION_TERMS
+      && qoenv->ixenv->tombstones == NULL) {
+    // If every term is a word in bitmap mode, the full matches can be counted by ANDing the bitmaps.
+    // (Not when there are tombstones:  the bitmaps include deleted documents.)
+    bmp_directory_entry_t *bitmap_terms[MAX_WDS_IN_QUERY];
+    for (l = 0; l < t; l++) {
+      if (!pl_blox[l].bitmap_mode) break;
+      bitmap_terms[l] = pl_blox[l].bitmap_cursor.term;
+    }
+    if (l == t) {
+      qex->full_match_count += bmp_count_intersection(qoenv->ixenv->bitmaps, bitmap_terms, t);
+      if (qoenv->debug >= 1) fprintf(out, "Full matches counted from bitmaps: %lld\n", qex->full_match_count);
+      return;  // ----------------------------------->
+    }
+  }
+
+  for (l = 0; l < qex->tl_saat_blocks_used; l++) fpermute[l] = l;
+  use_windows = window_evaluator_is_cheaper(qoenv, pl_blox, t, m);
+  if (t > 1 && planning_possible(qoenv)) {
+    // fpermute is the order which minimises the expected cost of checking a candidate
+    for (l = 0; l < t; l++) plan_estimate_node(qoenv, pl_blox + l, plan_est + l);
+    plan_evaluation_order(qoenv, plan_est, t, m, fpermute);
+    if (qoenv->display_parsed_query && !delta_part) plan_display(out, qoenv, qex, pl_blox, plan_est, t, m, fpermute, use_windows);
+  }
+  else if (qex->cg_qwd_cnt > 1) {
+    sort_terms_by_freq(out, qex->tl_saat_blocks_used, fpermute, pl_blox);  // This ordering is static
+  }
+
+  if (use_windows) {
+    saat_relaxed_windows(out, qoenv, qex, pl_blox, forward, index, doctable, fsz, m, error_code);
+    return;  // ----------------------------------->
+  }
+
   if (qoenv->debug >= 2)
     fprintf(out, "saat_relaxed_and().  qex->cg_qwd_cnt = %d. R_level was %d, is %d.  "
 	    "Min terms = %d.  Looking for up to %d candidates.\n", 
 	    qex->cg_qwd_cnt, qoenv->relaxation_level, m, u,
 	    qoenv->max_candidates_to_consider);
-  for (l = 0; l < qex->tl_saat_blocks_used; l++) {
-    fpermute[l] = l;
-    curdoc_ranking[l] = l;
-  }
-
-  if (qex->cg_qwd_cnt > 1) {
-    // 12 July 2017:  I don't understand why one sort is followed by another
-    sort_terms_by_freq(out, qex->tl_saat_blocks_used, fpermute, pl_blox);  // This ordering is static
-    sort_terms_by_curdoc(out, qex->tl_saat_blocks_used, curdoc_ranking, pl_blox);
-  }
+  for (l = 0; l < qex->tl_saat_blocks_used; l++) curdoc_ranking[l] = l;
+  if (qex->cg_qwd_cnt > 1) sort_terms_by_curdoc(out, qex->tl_saat_blocks_used, curdoc_ranking, pl_blox);
   // First candidate is the m-th highest docnum referenced by a plist control block  (the pivot)
   // That candidate is curdoc_ranking[u - 1] i.e 
   candid8 = curdoc_ranking[pivot];
@@ -264,7 +769,7 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
 		candid8, pivot, t, m, u);
 
 
-  if (pl_blox[candid8].curdoc == CURDOC_EXHAUSTED) {
+  if (pl_blox[candid8].curdoc >= qex->evaluation_limit) {
     if (qoenv->debug >= 1)
       fprintf(out, "Exhaustion(A): candidates considered: %d; skips = %d\n", candidates_considered, skips);
     return;  // No matches possible
@@ -301,6 +806,15 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
     terms_exhausted = 0;
     terms_matched_bits = 0;
     candidoc = pl_blox[candid8].curdoc;
+    if (qoenv->x_prefetch) {
+      // Start fetching the doctable entry which possibly_record_candidate() will read if this is a match,
+      // and the postings of all the lists which are about to be skipped, before waiting for any of them.
+      byte *dforward;
+      size_t dfsz;
+      if (!qoenv->report_match_counts_only) PREFETCH(get_dtent(qoenv->ixenv, candidoc, &dforward, &dfsz));
+      for (k = 0; k < t; k++) if (pl_blox[k].curdoc < candidoc) saat_prefetch(pl_blox + k, candidoc, FALSE);
+      for (k = 0; k < t; k++) if (pl_blox[k].curdoc < candidoc) saat_prefetch(pl_blox + k, candidoc, TRUE);
+    }
     for (k = 0; k < qex->tl_saat_blocks_used; k++) {     // ---------------  loop through all the postings lists ----------------
       l = fpermute[k];      // Using curdoc_ranking here rather than fpermute reduces throughput by a factor of 2.6 
       // on a test set of 10000 queries using relaxation_level=0
@@ -355,179 +869,11 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
     //  =======================================================================================
 
     if (terms_missing <= m) {   //  ............... Prima facie acceptable candidate found  ................
-
-      // In this code block we: 
-      //   1. Possibly record the candidate in a result blocks.  
-      //   2. When we record a result, we check:
-      //      a. Whether this result block is now full,
-      //      b. If so, whether we can now reduce the relaxation level,
-      //      c. If so, whether we have now finished.
-			 
-      rb_to_use = terms_missing;
-
-      if (qoenv->report_match_counts_only) {
-	//  --------------------- Special behaviour activated when max_to_show == 0 ------------------
-	if (terms_missing == 0) {
-	  qex->full_match_count++;  // Only count full matches.
-	  if (0) printf("FMC:  %lld\n", qex->full_match_count);
-	}
-      } else if (qex->candidates_recorded[rb_to_use] < qoenv->max_candidates_to_consider || qoenv->classifier_mode) {  // ..................................  Test on RB .....
-	// Acceptable degree of  match, and we haven't filled up all the slots at this level of
-	// match, or we're doing the classifier pseudo-heap thing.
-
-	if (qoenv->debug >= 1) {
-	  byte *doc;
-	  u_char *p;
-	  int dc_len;
-	  fprintf(out, "Match found in saat_relaxed_and(): rb_to_use = %d, candid8 = %d\n", rb_to_use, candid8);
-	  fprintf(out, "       Match with %d terms missing [terms_matched bits = %X, m = %d, rb_to_use = %d] is %lld (%d): ",
-		  terms_missing, terms_matched_bits, m, rb_to_use, pl_blox[candid8].curdoc, candid8);
-	  doc = get_doc((unsigned long long *)(doctable + pl_blox[candid8].curdoc * DTE_LENGTH), forward, &dc_len, fsz);
-	  if (doc == NULL) {
-	    fprintf(out, " NULL (error)\n");
-	  }
-	  else {
-	    fprintf(out, "[off = %llx] ", (long long)(doc - forward));
-	    p = (u_char *)doc;
-	    show_string_upto_nator(p, '\n', 0);
-	  }
-	}
-	if (qoenv->debug >= 1) printf("About to P_R candidate in RB[%d]: %d\n",
-				      rb_to_use, qex->candidates_recorded[rb_to_use]);
-
-
-	if (0) {
-	  byte *doc;
-	  u_char *p;
-	  int dc_len;
-	  doc = get_doc((unsigned long long *)(doctable + pl_blox[candid8].curdoc * DTE_LENGTH), forward, &dc_len, fsz);
-	  if (doc == NULL) {
-	    printf("CANDIDATE: NULL (error)\n");
-	  } else {
-	    printf("CANDIDATE: [docno = %lld, off = %llx] ", pl_blox[candid8].curdoc, (long long)(doc - forward));
-	    p = (u_char *)doc;
-	    show_string_upto_nator(p, '\n', 0);
-	  }
-	}
-	  
-
-	  
-	// If we're doing BM25 scoring we need to compute the TFs of each query term
-	if (qoenv->rr_coeffs[5] > 0.0) {
-	  rbit = 1;
-	  for (k = 0; k < qex->tl_saat_blocks_used; k++) {
-	    int tftmp = 0;
-	    if (terms_matched_bits & rbit)
-	      tftmp = saat_get_tf(out, pl_blox + k, index, qex->op_count, qoenv->debug);
-	    if (0) printf("Query term %d, tf = %d\n", k, tftmp);
-	    pl_blox[k].tf = tftmp;
-	    rbit <<= 1;
-	  }
-	}
-
-	it_was_recorded =
-	  possibly_record_candidate(qoenv, qex, pl_blox, forward, index, doctable,
-				    fsz, pl_blox[candid8].curdoc, 
-				    rb_to_use, terms_matched_bits);
-	if (0) printf("Done P_R candidate\n");
-
-	if (it_was_recorded) {
-	  int stopping_condition = 2;
-
-	  //  ------------------------ Stopping condition rules are different in CLASSIFIER MODES ------------------------------------
-	  if (qoenv->classifier_mode) {
-	    // There are two different early termination conditions, one which applies to the highest scoring candidate
-	    // (slot 0 in result block 0) and the other to the lowest candidate in the most relaxed result block
-	    candidate_t *candies;
-	    if (qoenv->classifier_stop_thresh1 < 1.0) {
-	      candies = qex->candidatesa[rb_to_use];
-	      if (candies[0].score > qoenv->classifier_stop_thresh1) return;  // classifier ----------------------------->
-	    }
-
-	    if (qoenv->classifier_stop_thresh2 < 1.0 && rb_to_use == (rbn -1)) {
-	      // We have to apply this test to all the result blocks
-	      // We only terminate if all the result blocks are fully populated and none have a score below
-	      // thresh2.
-	      int r;
-	      BOOL no_lower_score_found = TRUE;
-	      for (r = 0; r < rbn; r++) {
-		candies = qex->candidatesa[r];
-		if (0) printf("THRESH2: Checking result block %d. Lowest score = %.3f\n",
-			      r, candies[qoenv->max_to_show - 1].score);
-		if (candies[qoenv->max_to_show - 1].score <= qoenv->classifier_stop_thresh2) {
-		  no_lower_score_found = FALSE;
-		  break;
-		}
-	      }
-	      if (no_lower_score_found) {
-		if (0) printf("THRESH2: We're going to abandon ship\n");
-		return;  // classifier -------------->
-	      }
-	    }
-	  }
-	  else {  // .................................. If not classifier mode .......................
-	    total_recorded++;
-	    if (qoenv->debug >= 1) fprintf(out, "saat_relaxed_and(): match with %d terms missing recorded in rb %d. tot rec: %d\n",
-					   terms_missing, rb_to_use, total_recorded);
-
-	    // Have we finished by finding the required number of results?
-
-	    if (stopping_condition == 0 || m == 0) {
-	      // Stop when the first tier is full
-	      if (qex->candidates_recorded[0] >= qoenv->max_candidates_to_consider) {
-		if (qoenv->debug >= 1) fprintf(out, "Stopping: candidates considered: %d; skips = %d\n",
-					       candidates_considered, skips);
-		return;  // FILLED ALL THE FULL MATCH SLOTS -------------------------------------------------------------->
-	      }
-	    }
-#if 0
-	    else if (stopping_condition == 1) {
-	      // Stop when total matches reaches required level
-	      if (total_recorded >= qoenv->max_candidates_to_consider) {
-		if (qoenv->debug >= 1) fprintf(out, "candidates considered: %d; skips = %d\n",
-					       candidates_considered, skips);
-		return;  // GOT ENOUGH RESULTS ----------------------->
-	      }
-	    }
-#endif
-	    else {  //  -------------- Non-trivial stopping condition 
-	      finished = TRUE;
-		
-	      if (qex->candidates_recorded[rb_to_use] >= qoenv->max_candidates_to_consider) {
-		// We've just filled up a result list.  Can we now tighten up the relaxation level?
-		if (m && rb_to_use == m) {
-		  if (qoenv->debug >= 1) fprintf(out, "Shrinking relaxation_level to %d\n", m - 1);
-		  m--;
-		}
-	      }
-
-	      for (k = 0; k < rbn; k++) {
-		if (0) fprintf(out, "Result block %d - recorded = %d / %d\n",
-			       k, qex->candidates_recorded[k], qoenv->max_candidates_to_consider);
-		if (qex->candidates_recorded[k] < qoenv->max_candidates_to_consider) {
-		  finished = FALSE;
-		  break;
-		}
-		if (0) fprintf(out, "result block = %d; matches recorded  = %d\n", k, qex->candidates_recorded[k]);
-	      }
-	      if (finished) {
-		if (qoenv->debug >= 1)
-		  fprintf(out, "Stopping: candidates considered: %d; skips = %d.  Got enough results.\n",
-			  candidates_considered, skips);
-		return;  // FILLED ALL THE SLOTS AT ALL THE LEVELS ----------------->
-	      }
-	    }   //  -------------- Non-trivial stopping condition
-
-	    // =============== Can we ease off on the relaxation level? ================================
-	    // Reducing the relaxation level once we've recorded enough weaker matches seems to pay off,
-	    // at least for relaxation_levels of 2 or more.   E.g. for relaxaton_level=3 it increases QPS
-	    // from an average of 100.7 to 122.4 (+22%) and for RL=2 from 567 to 722 (+27%)  The effect would probably be
-	    // bigger for longer queries.
-	  }
-	}  // ..................................  End of if (it_was_recorded) .....
-	else if (0) fprintf(out, "It was NOT recorded.\n");
-      }  // .................................. End of complex if (rb >= 0 ....)  .......................
-    }  //  ...............End of  Prima facie acceptable candidate found  ................
+      if (record_prima_facie_match(out, qoenv, qex, pl_blox, forward, index, doctable, fsz, candid8, candidoc,
+				   terms_missing, terms_matched_bits, &m, &total_recorded,
+				   candidates_considered, skips))
+	return;  // ENOUGH RESULTS OR CLASSIFIER THRESHOLD REACHED ----------------------------------->
+    }
 
     //  =============== Step 3:  Advance all the terms referencing the current candidate  =============
 
@@ -653,7 +999,7 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
       }
     }
 
-    if (pl_blox[candid8].curdoc == CURDOC_EXHAUSTED) {
+    if (pl_blox[candid8].curdoc >= qex->evaluation_limit) {
       if (qoenv->debug >= 1)
 	fprintf(out, "Exhaustion: candidates considered: %d; skips = %d\n", candidates_considered, skips);
       return;  // No matches possible
@@ -664,39 +1010,9 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
     possibles++;
 
     // If in force, check both deterministic and elapsed time timeouts every tenth possible.
-    if ((qoenv->timeout_kops > 0 || qoenv->timeout_msec > 0) && (possibles % 10) == 0) {
-      if (qoenv->timeout_kops > 0) {
-	if (qoenv->debug >= 1) fprintf(out, "Checking timeout %d v %d\n",
-				       kop_cost(qex), qoenv->timeout_kops);
-	if (kop_cost(qex) > qoenv->timeout_kops) {
-	  qex->timed_out = TRUE;
-	  qoenv->query_timeout_count++;
-	  if (qoenv->debug >= 1) {
-	    fprintf(out, "Timed out!(%s). Total recorded = %d.  Timeout KOPS: %d\n", 
-		    qex->query_as_processed, total_recorded, qoenv->timeout_kops);
-	    fprintf(out, "candidates considered: %d; skips = %d\n", candidates_considered, skips);
-	  }
-	  return;  // TIMEOUT  ------------------------------>
-	}
-      }
-
-      if (qoenv->timeout_msec > 0) {
-	double elapsed = 1000.0 * (what_time_is_it() - qex->start_time);
-	if (0) printf("           ----- Checking msec timeout %.0f v. %d -----\n",
-		      elapsed, qoenv->timeout_msec);
-	if (elapsed > (double)qoenv->timeout_msec) {
-	  qex->timed_out = TRUE;
-	  qoenv->query_timeout_count++;
-	  if (qoenv->debug >= 1) {
-	    fprintf(out, "Timed out!(%s). Total recorded = %d.  Timeout msec: %d\n", 
-		    qex->query_as_processed, total_recorded, qoenv->timeout_msec);
-	    fprintf(out, "candidates considered: %d; skips = %d\n", candidates_considered, skips);
-	  }
-	  return;  // TIMEOUT  ------------------------------>
-	}
-
-      }
-    }
+    if ((qoenv->timeout_kops > 0 || qoenv->timeout_msec > 0) && (possibles % 10) == 0
+	&& check_timeouts(out, qoenv, qex, total_recorded, candidates_considered, skips))
+      return;  // TIMEOUT  ------------------------------>
 
   }  // -----------------------  End of while (!finished) -- the big outer loop --------------------------------
 
@@ -704,8 +1020,92 @@ void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_kee
   return;
 }
 
+static double static_score(query_processing_environment_t *qoenv, docnum_t doc) {
+  byte *dforward;
+  size_t dfsz;
+  return get_score_from_dtent(*get_dtent(qoenv->ixenv, doc, &dforward, &dfsz));
+}
+
 
+static int merge_main_and_delta_candidates(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex) {
+  // Result block rb holds the candidates recorded from the main index in [0, candidates_phase_base[rb]),
+  // followed by those recorded from the delta.  Each run is in decreasing order of static score.  A single
+  // index would have recorded the first max_candidates_to_consider of the two runs merged, taking the main
+  // index's first among equal scores, because the main index's records precede the delta's.
+  int rb, i, j, n = 0, main_end, delta_end, capacity = 2 * qoenv->max_candidates_to_consider;
+  candidate_t *merged;
+  byte *merged_counts = NULL;
+
+  merged = (candidate_t *)malloc(capacity * sizeof(candidate_t));   // MAL1120
+  if (qex->rank_only_cnt) merged_counts = (byte *)malloc(capacity);   // MAL1121
+  if (merged == NULL || (qex->rank_only_cnt && merged_counts == NULL)) {
+    free(merged);
+    free(merged_counts);
+    return -220095;  // ----------------------------------->
+  }
+
+  for (rb = 0; rb <= qoenv->relaxation_level; rb++) {
+    main_end = qex->candidates_phase_base[rb];
+    delta_end = qex->candidates_recorded[rb];
+    if (main_end == 0 || main_end == delta_end) continue;  // Nothing to merge
+    i = 0;
+    j = main_end;
+    for (n = 0; n < qoenv->max_candidates_to_consider && (i < main_end || j < delta_end); n++) {
+      if (j >= delta_end || (i < main_end && static_score(qoenv, qex->candidatesa[rb][i].doc)
+			     >= static_score(qoenv, qex->candidatesa[rb][j].doc))) {
+	if (merged_counts != NULL) merged_counts[n] = qex->rank_only_countsa[rb][i];
+	memcpy(merged + n, qex->candidatesa[rb] + i++, sizeof(candidate_t));
+      } else {
+	if (merged_counts != NULL) merged_counts[n] = qex->rank_only_countsa[rb][j];
+	memcpy(merged + n, qex->candidatesa[rb] + j++, sizeof(candidate_t));
+      }
+    }
+    memcpy(qex->candidatesa[rb], merged, n * sizeof(candidate_t));
+    if (merged_counts != NULL) memcpy(qex->rank_only_countsa[rb], merged_counts, n);
+    qex->candidates_recorded[rb] = n;
+  }
+  free(merged);
+  free(merged_counts);
+  return 0;
+}
 
 
+void saat_relaxed_and(FILE *out, query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
+		      saat_control_t *pl_blox, byte *forward, byte *index, byte *doctable, size_t fsz,
+		      int *error_code) {
+  // Stopping once the result blocks are full relies on docnum order being static score order.  With a
+  // delta index stacked on the main one, that's only true within each part, so the delta's best documents
+  // would never be considered.  If both parts were sorted by weight, each is evaluated in turn with its own
+  // quota of candidates, and the two lots are merged as a single index would have recorded them.  The
+  // classifier and match counting consider every match anyway.
+  index_environment_t *ixenv = qoenv->ixenv;
+  int l, code;
+
+  memset(qex->candidates_phase_base, 0, sizeof(qex->candidates_phase_base));
+  qex->evaluation_limit = CURDOC_EXHAUSTED;
+  if (ixenv->delta == NULL || !ixenv->sorted_by_weight || !ixenv->delta->sorted_by_weight
+      || qoenv->classifier_mode || qoenv->report_match_counts_only) {
+    saat_relaxed_part(out, qoenv, qex, pl_blox, forward, index, doctable, fsz, FALSE, error_code);
+    return;  // ----------------------------------->
+  }
 
+  qex->evaluation_limit = ixenv->delta_first_docnum;
+  saat_relaxed_part(out, qoenv, qex, pl_blox, forward, index, doctable, fsz, FALSE, error_code);
+  qex->evaluation_limit = CURDOC_EXHAUSTED;
+  if (*error_code < -200000 || qex->timed_out) return;  // ----------------------------------->
 
+  for (l = 0; l < qex->tl_saat_blocks_used; l++) {
+    if (pl_blox[l].curdoc < ixenv->delta_first_docnum) {
+      saat_skipto(out, pl_blox + l, l, ixenv->delta_first_docnum, DONT_CARE, index, qex->op_count,
+		  qoenv->debug, error_code);
+      if (*error_code < -200000) return;  // ----------------------------------->
+    }
+  }
+  if (qoenv->debug >= 1) fprintf(out, "saat_relaxed_and(): moving on to the delta index\n");
+  memcpy(qex->candidates_phase_base, qex->candidates_recorded, sizeof(qex->candidates_phase_base));
+  saat_relaxed_part(out, qoenv, qex, pl_blox, forward, index, doctable, fsz, TRUE, error_code);
+  if (*error_code < -200000) return;  // ----------------------------------->
+  code = merge_main_and_delta_candidates(qoenv, qex);
+  if (code < 0) *error_code = code;
+  memset(qex->candidates_phase_base, 0, sizeof(qex->candidates_phase_base));
+}
@@ -20,6 +20,7 @@
 #include "../shared/QBASHER_common_definitions.h"
 #include "../utils/dahash.h"
 #include "QBASHQ.h"
+#include "../shared/bitmap_postings.h"
 #include "saat.h"
 
 
@@ -77,7 +78,7 @@
 //        D. Increment the indexpointer to the next SB_MARKER byte and keep going.
 
 static int setup_phrase_node(FILE *out, u_char *term, saat_control_t *blok, byte *index, byte *vocab, size_t vsz,
-			     int *terms_not_present, op_count_t *op_count, double N, int debug);   // Forward decln
+			     index_environment_t *delta, int *terms_not_present, op_count_t *op_count, double N, int debug);   // Forward decln
 
 
 static int leaf_peek_tf(byte *ixptr, docnum_t docno) {
@@ -118,11 +119,62 @@ static int leaf_peek_tf(byte *ixptr, docnum_t docno) {
 }
 
 
+static void leaf_start_list(FILE *out, saat_control_t *blok, byte *dicent, byte *index, int debug) {
+  // Position blok on the first posting of the list described by vocab entry dicent, whose
+  // payload (if not the posting itself) is an offset into index.  Used both for the main
+  // list and for the continuation of it in a delta index.  Docnums in a delta index already
+  // continue on from those in the main index, so curdoc is set absolutely in both cases.
+  u_ll docgap;
+  byte bight, last, qidf;
+  u_ll payload;
+
+  vocabfile_entry_unpacker(dicent, MAX_WD_LEN + 1, (u_ll *)&blok->occurrence_count, &qidf, &payload);
+  if (blok->occurrence_count == 1) {
+    // The posting is kept in the vocab table
+    blok->curpsting = NULL;
+    blok->curdoc = payload;
+    blok->curwpos = (int)(blok->curdoc & WDPOS_MASK);
+    blok->curdoc >>= WDPOS_BITS;
+    blok->posting_num = 1;
+    if (0) printf("Extracted single posting: doc = %lld , wpos=%d\n", blok->curdoc, blok->curwpos);
+  }
+  else {
+    // payload references a chunk of the index file
+    byte *ixptr = index + payload;
+
+    // ----- HANDLE SKIP BLOCK HERE ------
+    // Just skip over it.
+    if (*ixptr == SB_MARKER) {
+      if (debug >= 2) fprintf(out, "setup_word_node() - skipping skipblock\n");
+      ixptr += (SB_BYTES + 1);
+    }
+
+    blok->curwpos = *ixptr;  // Word pos is now a full byte.
+    // Docgap is encoded in big-endian vbyte with LSB in each byte signalling whether this is the
+    // last byte or not.
+    ixptr++;
+    docgap = 0;
+    do {
+      docgap <<= 7;
+      bight = *ixptr++;
+      last = bight & 1;
+      bight >>= 1;
+      docgap |= bight;
+    } while (!last);
+    blok->curdoc = docgap;
+    blok->curpsting = ixptr;
+    blok->posting_num = 1;
+  }
+}
+
+
 static int setup_word_node(FILE *out, u_char *word, saat_control_t *blok, byte *index, byte *vocab, size_t vsz,
-			   int *terms_not_present, op_count_t *op_count, double N, int debug) {
+			   index_environment_t *delta, int *terms_not_present, op_count_t *op_count, double N, int debug) {
   // A word node must be a leaf in the query tree.  It has no children but controls the processing
   // of a single postings list.  This function looks up the word and, if found, sets up blok to
   // reference both the vocab entry and the postings list.
+  // If there is a delta index, the word is looked up there too.  If it occurs in both, the delta
+  // list is recorded in blok so that saat_skipto() can carry on into it when the main one runs out.
   // Return 0 on success, -ve on error  (No errors defined yet.)
 
   size_t len;
@@ -132,6 +184,9 @@ static int setup_word_node(FILE *out, u_char *word, saat_control_t *blok, byte *
   blok->num_children = 0;
   blok->children = NULL;
   blok->repetition_count = 1;  // How many times this word is repeated within the query.
+  blok->delta_dicent = NULL;
+  blok->delta_index = NULL;
+  blok->bitmap_mode = FALSE;
 
   len = strlen((char *)word);
   if (len > MAX_WD_LEN) {
@@ -140,8 +195,31 @@ static int setup_word_node(FILE *out, u_char *word, saat_control_t *blok, byte *
   }
 
 
-  blok->dicent = lookup_word(word, vocab, vsz, debug);
+  // dicent and delta_dicent always point to the blok's own copies of the vocab entries, so that
+  // they remain valid whichever .vocab layout they were looked up in.
+  blok->dicent = lookup_word(word, vocab, vsz, blok->vocab_entry, debug);
+  if (blok->dicent != NULL) {
+    memmove(blok->vocab_entry, blok->dicent, VOCABFILE_REC_LEN);
+    blok->dicent = blok->vocab_entry;
+  }
   op_count[COUNT_TLKP].count++;
+  if (delta != NULL) {
+    byte *delta_dicent = lookup_word(word, delta->vocab, delta->vsz, blok->delta_vocab_entry, debug);
+    op_count[COUNT_TLKP].count++;
+    if (delta_dicent != NULL) {
+      if (blok->dicent == NULL) {
+	// Only in the delta.  Treat its list as though it were the main one.
+	memmove(blok->vocab_entry, delta_dicent, VOCABFILE_REC_LEN);
+	blok->dicent = blok->vocab_entry;
+	index = delta->index;
+      }
+      else {
+	memmove(blok->delta_vocab_entry, delta_dicent, VOCABFILE_REC_LEN);
+	blok->delta_dicent = blok->delta_vocab_entry;
+	blok->delta_index = delta->index;
+      }
+    }
+  }
   if (blok->dicent == NULL) {
     // If one word is not found no suggestion can be made
     blok->exhausted = TRUE;
@@ -150,49 +228,13 @@ static int setup_word_node(FILE *out, u_char *word, saat_control_t *blok, byte *
     if (debug >= 1) fprintf(out, " setup_word_node(): No matches for '%s'.\n", word);
   }
   else {
-    u_ll docgap;
-    byte bight, last, qidf;
-    u_ll payload;
+    u_ll occurrence_count, payload;
+    byte qidf;
 
-    vocabfile_entry_unpacker(blok->dicent, MAX_WD_LEN + 1, (u_ll *)&blok->occurrence_count, &qidf, &payload);
+    vocabfile_entry_unpacker(blok->dicent, MAX_WD_LEN + 1, &occurrence_count, &qidf, &payload);
     blok->qidf = qidf;
     blok->exhausted = FALSE;
-    if (blok->occurrence_count == 1) {
-      // The posting is kept in the vocab table
-      blok->curpsting = NULL;
-      blok->curdoc = payload;
-      blok->curwpos = (int)(blok->curdoc & WDPOS_MASK);
-      blok->curdoc >>= WDPOS_BITS;
-      blok->posting_num = 1;
-      if (0) printf("Extracted single posting: doc = %lld , wpos=%d\n", blok->curdoc, blok->curwpos);
-    }
-    else {
-      // payload references a chunk of the index file
-      byte *ixptr = index + payload;
-
-      // ----- HANDLE SKIP BLOCK HERE ------
-      // Just skip over it.
-      if (*ixptr == SB_MARKER) {
-	if (debug >= 2) fprintf(out, "setup_word_node() - skipping skipblock\n");
-	ixptr += (SB_BYTES + 1);
-      }
-
-      blok->curwpos = *ixptr;  // Word pos is now a full byte.
-      // Docgap is encoded in big-endian vbyte with LSB in each byte signalling whether this is the
-      // last byte or not.
-      ixptr++;
-      docgap = 0;
-      do {
-	docgap <<= 7;
-	bight = *ixptr++;
-	last = bight & 1;
-	bight >>= 1;
-	docgap |= bight;
-      } while (!last);
-      blok->curdoc = docgap;
-      blok->curpsting = ixptr;
-      blok->posting_num = 1;
-    }
+    leaf_start_list(out, blok, blok->dicent, index, debug);
   }
   if (debug >= 2)
     fprintf(out, "SAAT block set up for word '%s'.  Referencing (%lld, %d).\n",
@@ -207,7 +249,7 @@ static int setup_word_node(FILE *out, u_char *word, saat_control_t *blok, byte *
 //   2. The (curdoc, curwpos) of a disjunction is the minimum of those of its descendants
 
 static int setup_disjunction_node(FILE *out, u_char *interm, saat_control_t *blok, byte *index, byte *vocab, size_t vsz,
-				  int *terms_not_present, op_count_t *op_count, double N, int debug) {
+				  index_environment_t *delta, int *terms_not_present, op_count_t *op_count, double N, int debug) {
   // Return 0 on success, -ve on error  (No errors defined yet.)
   u_char *term, *p, *start, savep;
   int children = 0, ltnp = 0, code;  // lntp - Local terms not present
@@ -280,7 +322,7 @@ static int setup_disjunction_node(FILE *out, u_char *interm, saat_control_t *blo
       savep = *p;
       *p = 0;
       child = blok->children + children;
-      code = setup_phrase_node(out, start, child, index, vocab, vsz, &ltnp, op_count, N, debug);
+      code = setup_phrase_node(out, start, child, index, vocab, vsz, delta, &ltnp, op_count, N, debug);
       *p = savep;
       if (code < 0) return(code);  // ------------------------------------------>
       children++;
@@ -290,7 +332,7 @@ static int setup_disjunction_node(FILE *out, u_char *interm, saat_control_t *blo
       savep = *p;
       *p = 0;
       child = blok->children + children;
-      code = setup_word_node(out, start, child, index, vocab, vsz, &ltnp, op_count, N, debug);
+      code = setup_word_node(out, start, child, index, vocab, vsz, delta, &ltnp, op_count, N, debug);
       *p = savep;
       if (code < 0) return(code);  // ------------------------------------------>
       children++;
@@ -337,10 +379,10 @@ static int freq_comparator(const void *bloki, const void *blokj)  {
 
 
 static int setup_phrase_node(FILE *out, u_char *interm, saat_control_t *blok, byte *index, byte *vocab, size_t vsz,
-			     int *terms_not_present, op_count_t *op_count, double N, int debug) {
+			     index_environment_t *delta, int *terms_not_present, op_count_t *op_count, double N, int debug) {
   // Return 0 on success, -ve on error
   u_char *p, *start, savep, *term;
-  int children = 0, ltnp = 0, error_code = 0;  // lntp - Local terms not present
+  int children = 0, ltnp = 0, error_code = 0, k;  // lntp - Local terms not present
 	
   blok->type = SAAT_PHRASE;
   blok->exhausted = FALSE;  // Assume the best
@@ -403,7 +445,7 @@ static int setup_phrase_node(FILE *out, u_char *interm, saat_control_t *blok, by
       savep = *p;
       *p = 0;
       setup_disjunction_node(out, start, blok->children + children, index, vocab,
-			     vsz, &ltnp, op_count, N, debug);
+			     vsz, delta, &ltnp, op_count, N, debug);
       *p = savep;
       children++;
     }
@@ -412,7 +454,7 @@ static int setup_phrase_node(FILE *out, u_char *interm, saat_control_t *blok, by
       savep = *p;
       *p = 0;
       setup_word_node(out, start, blok->children + children, index, vocab, vsz,
-		      &ltnp, op_count, N, debug);
+		      delta, &ltnp, op_count, N, debug);
       *p = savep;
       children++;
     }
@@ -421,6 +463,11 @@ static int setup_phrase_node(FILE *out, u_char *interm, saat_control_t *blok, by
 
   // Now sort the children in increasing frequency order with non-terminals at the end.
   qsort(blok->children, children, sizeof(saat_control_t), freq_comparator);
+  // The children have moved, so their dicent pointers must follow their copies of the vocab entries
+  for (k = 0; k < children; k++) {
+    if (blok->children[k].dicent != NULL) blok->children[k].dicent = blok->children[k].vocab_entry;
+    if (blok->children[k].delta_dicent != NULL) blok->children[k].delta_dicent = blok->children[k].delta_vocab_entry;
+  }
 
 
   // This term is not present if any of its children are not present
@@ -507,6 +554,35 @@ static BOOL find_and_update_prior_instance(u_char *qword, saat_control_t *blox,
 }
 
 
+// Postings are a wpos byte plus a vbyte docgap, usually one or two bytes.  Used only to
+// size the range we ask the OS to read ahead, so it doesn't need to be exact.
+#define EST_BYTES_PER_POSTING 3
+
+static void advise_postings_range(saat_control_t *blok, byte *index, size_t isz) {
+  // Recursively walk the query tree, issuing a WILLNEED hint for the estimated extent of
+  // the postings list of each word which isn't held in the .vocab entry.
+  u_ll payload, occurrence_count;
+  size_t len;
+  byte qidf;
+  int c;
+
+  if (blok->type == SAAT_WORD) {
+    if (blok->dicent == NULL || blok->curpsting == NULL) return;  // Not found, or postings in .vocab
+    if (blok->curpsting < index || blok->curpsting >= index + isz) return;  // Postings in the delta index
+    vocabfile_entry_unpacker(blok->dicent, MAX_WD_LEN + 1, &occurrence_count, &qidf, &payload);
+    if (payload >= isz) return;
+    len = (size_t)occurrence_count * EST_BYTES_PER_POSTING
+      + (size_t)(occurrence_count / SB_MAX_COUNT + 1) * (SB_BYTES + 1);
+    if (payload + len > isz) len = isz - payload;
+    apply_access_hint(index + payload, len, ACCESS_HINT_WILLNEED);
+  }
+  else {
+    for (c = 0; c < blok->num_children; c++)
+      advise_postings_range(blok->children + c, index, isz);
+  }
+}
+
+
 saat_control_t *saat_setup(query_processing_environment_t *qoenv, book_keeping_for_one_query_t *qex,
 			   int *terms_not_present, int *error_code) {
 
@@ -553,18 +629,19 @@ saat_control_t *saat_setup(query_processing_environment_t *qoenv, book_keeping_f
   for (w = 0; w < qex->cg_qwd_cnt; w++) {
     blox[w].type = SAAT_NOT_USED;  // Make sure all blocks have a type.
     blox[w].num_children = 0;      // and don't have children unless they're given them.
+    blox[w].bitmap_mode = FALSE;
     
     if (qoenv->debug >= 2)
       fprintf(qoenv->query_output, " saat_setup(): Setting up control block for '%s'\n", qex->cg_qterms[w]);
 
     if (qex->cg_qterms[w][0] == '[') {
       *error_code = setup_disjunction_node(qoenv->query_output, qex->cg_qterms[w], blox + n, index, vocab,
-					   vsz, &tnp, qex->op_count, qoenv->N, qoenv->debug);
+					   vsz, qoenv->ixenv->delta, &tnp, qex->op_count, qoenv->N, qoenv->debug);
       n++;
     }
     else if (qex->cg_qterms[w][0] == '"') {
       *error_code = setup_phrase_node(qoenv->query_output, qex->cg_qterms[w], blox + n, index, vocab, vsz,
-				      &tnp, qex->op_count, qoenv->N, qoenv->debug);
+				      qoenv->ixenv->delta, &tnp, qex->op_count, qoenv->N, qoenv->debug);
       n++;
     }
     else {
@@ -574,7 +651,7 @@ saat_control_t *saat_setup(query_processing_environment_t *qoenv, book_keeping_f
       seen_before = find_and_update_prior_instance(qex->cg_qterms[w], blox, n);
       if (!seen_before) {
 	*error_code = setup_word_node(qoenv->query_output, qex->cg_qterms[w], blox + n, index, vocab, vsz,
-				      &tnp, qex->op_count, qoenv->N, qoenv->debug);
+				      qoenv->ixenv->delta, &tnp, qex->op_count, qoenv->N, qoenv->debug);
 	n++;
       }
 
@@ -587,6 +664,11 @@ saat_control_t *saat_setup(query_processing_environment_t *qoenv, book_keeping_f
   qex->tl_saat_blocks_used = n;
   if (0) printf("  . SAAT blocks used: %d\n", qex->tl_saat_blocks_used);
 
+  if (qoenv->x_willneed_postings) {
+    // Get the OS started on reading in all the lists before we begin traversing them.
+    for (w = 0; w < n; w++) advise_postings_range(blox + w, index, qoenv->ixenv->isz);
+  }
+
   // Modify the repetition counts in the case of relaxation. 
   if (qoenv->relaxation_level > 0) {
     for (w = 0; w < n; w++) {
@@ -601,7 +683,7 @@ saat_control_t *saat_setup(query_processing_environment_t *qoenv, book_keeping_f
   // when the first posting doesn't satisfy the repetition count.
   for (w = 0; w < n; w++) {
     if (!blox[w].exhausted && blox[w].type == SAAT_WORD && blox[w].repetition_count > 1) {
-      if (blox[w].curpsting == NULL) {
+      if (blox[w].curpsting == NULL && blox[w].delta_dicent == NULL) {
 	// The first one or two postings may be stored in the .vocab table
 	if (qoenv->debug >= 1) printf("Postings in .vocab entry.  Occurrence count = %lld\n", blox[w].occurrence_count);
 	if (blox[w].occurrence_count == 2) {
@@ -618,6 +700,22 @@ saat_control_t *saat_setup(query_processing_environment_t *qoenv, book_keeping_f
     }
   }
 
+  // Top level words with a bitmap in QBASH.bitmaps are skipped through using it.  Not if the
+  // word must be repeated within a document, because then postings must be counted, nor if its
+  // list continues into a delta index, which has no bitmaps.
+  if (qoenv->x_bitmap_postings && qoenv->ixenv->bitmaps != NULL) {
+    bmp_directory_entry_t *de;
+    for (w = 0; w < n; w++) {
+      if (blox[w].type != SAAT_WORD || blox[w].exhausted || blox[w].repetition_count > 1
+	  || blox[w].curpsting == NULL || blox[w].delta_dicent != NULL) continue;
+      de = bmp_lookup_term(qoenv->ixenv->bitmaps, qoenv->ixenv->bsz, blox[w].dicent);
+      if (de == NULL) continue;
+      bmp_cursor_init(&(blox[w].bitmap_cursor), qoenv->ixenv->bitmaps, de);
+      blox[w].positional_curdoc = blox[w].curdoc;
+      blox[w].bitmap_mode = TRUE;
+    }
+  }
+
   *terms_not_present = tnp;
   return blox;
 }
@@ -998,6 +1096,57 @@ int saat_advance_within_doc(FILE *out, saat_control_t *blok, byte *index, op_cou
 
 
 
+void saat_sync_positions(FILE *out, saat_control_t *blok, byte *index, op_count_t *op_count, int debug) {
+  // If blok is a word in bitmap mode whose positional cursor has been left behind, decode its
+  // postings up to the first one in curdoc, which the bitmap says is there.  Must be called before
+  // curwpos, curpsting or posting_num of a top level word are used.
+  docnum_t target;
+  int error_code;
+
+  if (blok->type != SAAT_WORD || !blok->bitmap_mode || blok->exhausted
+      || blok->positional_curdoc == blok->curdoc) return;  // ----------------->
+  target = blok->curdoc;
+  blok->curdoc = blok->positional_curdoc;
+  blok->bitmap_mode = FALSE;
+  saat_skipto(out, blok, -1, target, DONT_CARE, index, op_count, debug, &error_code);
+  blok->bitmap_mode = TRUE;
+  blok->positional_curdoc = blok->curdoc;
+  if (debug >= 2 && blok->curdoc != target)
+    fprintf(out, "saat_sync_positions(): bitmap and postings disagree at %lld\n", target);
+}
+
+
+void saat_prefetch(saat_control_t *blok, docnum_t desired_docnum, BOOL follow_skips) {
+  // Prefetch the index bytes which saat_skipto(blok, desired_docnum) will read first, so that the
+  // fetches for several lists can be in flight at once, rather than each skipto() waiting in turn.
+  // Call for all the lists first with follow_skips FALSE, then again with it TRUE.  The second
+  // time, a skip block at the current position (which should now be arriving) is read, and if the
+  // target lies beyond its run, the next skip block is prefetched as well.
+  byte *ixptr;
+  u_ll sb;
+  int c;
+
+  if (blok->exhausted || blok->curdoc >= desired_docnum) return;  // ----------------->
+  if (blok->type != SAAT_WORD) {
+    for (c = 0; c < blok->num_children; c++)
+      saat_prefetch(blok->children + c, desired_docnum, follow_skips);
+    return;  // ----------------->
+  }
+  if (blok->bitmap_mode) {
+    if (!follow_skips) bmp_cursor_prefetch(&(blok->bitmap_cursor), desired_docnum);
+    return;  // ----------------->
+  }
+  // At the end of the list there may be nothing mapped beyond curpsting.
+  if (blok->posting_num >= blok->occurrence_count) return;  // ----------------->
+  ixptr = blok->curpsting;
+  if (!follow_skips) PREFETCH(ixptr);
+  else if (*ixptr == SB_MARKER) {
+    sb = *(u_ll *)(ixptr + 1);
+    if (desired_docnum > sb_get_lastdocnum(sb) && sb_get_length(sb) > 0) PREFETCH(ixptr + sb_get_length(sb));
+  }
+}
+
+
 int saat_get_tf(FILE *out, saat_control_t *blok, byte *index, op_count_t *op_count, int debug) {
   // It is assumed that saat_relaxed_and() has found a match and that blok describes the first
   // posting within the matching document.  We repeatedly call saat_advance_within_doc() to count
@@ -1007,6 +1156,7 @@ int saat_get_tf(FILE *out, saat_control_t *blok, byte *index, op_count_t *op_cou
   // least one) is returned.
   int tf = 1;
   if (debug) printf("saat_get_tf()\n");
+  saat_sync_positions(out, blok, index, op_count, debug);
   
   while (saat_advance_within_doc(out, blok, index, op_count, debug) == 1) {
     tf++;
@@ -1127,6 +1277,27 @@ int saat_skipto(FILE *out, saat_control_t *blok, int blokno, docnum_t desired_do
   else {
     // ==================== LEAF ========================================================
 
+    if (blok->bitmap_mode && desired_wpos == DONT_CARE) {
+      // Find the next document in the bitmap and leave the postings alone.  See saat_sync_positions()
+      docnum_t d;
+      op_count[COUNT_SKIP].count++;
+      d = bmp_cursor_skipto(&(blok->bitmap_cursor), desired_docnum);
+      if (d == BMP_EXHAUSTED) {
+	blok->exhausted = TRUE;
+	blok->curdoc = CURDOC_EXHAUSTED;
+	if (explain) fprintf(out, "T%d Bitmap exhausted\n", blokno);
+	return -1;  // ------------------------------------------------------------>
+      }
+      blok->curdoc = d;
+      if (explain) fprintf(out, "T%d Bitmap skipto(doc %lld) reached doc %lld\n", blokno, desired_docnum, d);
+      return (d == desired_docnum) ? 0 : 1;  // ------------------------------------------------------------>
+    }
+    if (blok->bitmap_mode) {
+      // A word position is wanted, so carry on with the postings from here on.
+      saat_sync_positions(out, blok, index, op_count, debug);
+      blok->bitmap_mode = FALSE;
+    }
+
     // The occurrence frequency for this term enables us to monitor list exhaustion. 
 
     if (explain) {
@@ -1141,6 +1312,13 @@ int saat_skipto(FILE *out, saat_control_t *blok, int blokno, docnum_t desired_do
 	   || (blok->type == SAAT_WORD && blok->repetition_count > 1
 	       && leaf_peek_tf(blok->curpsting, blok->curdoc) < blok->repetition_count)) {
       if (blok->posting_num >= blok->occurrence_count) {
+	if (blok->delta_dicent != NULL) {
+	  // Main list used up.  Carry on into the delta list.
+	  if (explain) fprintf(out, "    Moving on to delta postings\n");
+	  leaf_start_list(out, blok, blok->delta_dicent, blok->delta_index, debug);
+	  blok->delta_dicent = NULL;
+	  continue;
+	}
 	blok->exhausted = TRUE;
 	blok->curdoc = CURDOC_EXHAUSTED;
 	if (explain) fprintf(out, "    Exhausted\n");
@@ -1172,6 +1350,12 @@ int saat_skipto(FILE *out, saat_control_t *blok, int blokno, docnum_t desired_do
 	  sb_length = sb_get_length(*sbp);
 	  if (sb_length == 0) {
 	    // The target is not in the current run and there are no more runs
+	    if (blok->delta_dicent != NULL) {
+	      if (debug >= 3) fprintf(out, "    SAAT_SKIPTO: Moving on to delta postings.\n");
+	      leaf_start_list(out, blok, blok->delta_dicent, blok->delta_index, debug);
+	      blok->delta_dicent = NULL;
+	      continue;
+	    }
 	    blok->exhausted = TRUE;
 	    blok->curdoc = CURDOC_EXHAUSTED;
 	    if (debug >= 3) fprintf(out, "    SAAT_SKIPTO: Exhausted (sb_length == 0 in skip block).\n");
@@ -17,6 +17,8 @@ typedef struct saat_struct{
   int repetition_count; //                             [ONLY FOR SAAT_WORD] - tf within query.
   long long occurrence_count;   //                     [ONLY FOR SAAT_WORD]
   byte *curpsting;  // Pointer to current posting      [ONLY FOR SAAT_WORD]
+  byte *delta_dicent;  // Delta vocab entry whose postings follow the main ones [ONLY FOR SAAT_WORD]
+  byte *delta_index;   // .if of the delta index, base for delta_dicent's payload [ONLY FOR SAAT_WORD]
   int offset_within_phrase;  // 0 for first word       [ONLY FOR SAAT_PHRASE]
   long long posting_num;  // Index of last decoded posting in postings list, counting
   // from one for easy comparison with no. occurrences [ONLY FOR SAAT_WORD]
@@ -25,6 +27,14 @@ typedef struct saat_struct{
   BOOL exhausted;         // Set when we attempt to advance beyond the end of the list
   int num_children;       //                            [0 FOR SAAT_WORD]
   struct saat_struct *children;  // An array of immediate descendents [FOR ALL BUT SAAT_WORD]
+  byte vocab_entry[VOCABFILE_REC_LEN];  // Copies of the vocab entries, since those looked up in a
+  byte delta_vocab_entry[VOCABFILE_REC_LEN]; // front-coded .vocab are decoded.  [ONLY FOR SAAT_WORD]
+  // In bitmap mode, saat_skipto() moves curdoc through the term's document bitmap without decoding
+  // postings.  curwpos, curpsting and posting_num are left describing positional_curdoc until
+  // saat_sync_positions() brings them up to date.   [ONLY FOR TOP LEVEL SAAT_WORD]
+  BOOL bitmap_mode;
+  bmp_cursor_t bitmap_cursor;
+  docnum_t positional_curdoc;
 } saat_control_t;
 
 
@@ -65,8 +75,12 @@ saat_control_t *saat_setup(query_processing_environment_t *qoenv, book_keeping_f
 
 int saat_advance_within_doc(FILE *out, saat_control_t *pl_blok, byte *index, op_count_t *op_count, int debug);
 
+void saat_sync_positions(FILE *out, saat_control_t *blok, byte *index, op_count_t *op_count, int debug);
+
 int saat_get_tf(FILE *out, saat_control_t *blok, byte *index, op_count_t *op_count, int debug);
 
+void saat_prefetch(saat_control_t *blok, docnum_t desired_docnum, BOOL follow_skips);
+
 int saat_skipto(FILE *out, saat_control_t *pl_blok, int blokno, docnum_t desired_docnum, int desired_wpos,
 	byte *index, op_count_t *op_count, int debug, int *error_code);
 
@@ -0,0 +1,162 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Per-stage latency histograms.  See stage_timing.h.
+//
+// Each thread's histograms are allocated the first time it records a query, and registered in
+// thread_histograms[] so that dump_stage_histograms() can merge them.  Nothing is locked:  a
+// dump taken while queries are running may miss the queries in progress.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN64
+#include <windows.h>
+#endif
+
+#include "../shared/QBASHER_common_definitions.h"
+#include "../shared/utility_nodeps.h"
+#include "../utils/dahash.h"
+#include "QBASHQ.h"
+#include "stage_timing.h"
+
+char *stage_names[NUM_STAGES] = {
+  "parse", "setup", "relaxed_and", "candidate_checks", "rerank", "present", "total"
+};
+
+static stage_histograms_t *thread_histograms[MAX_TIMED_THREADS] = { NULL };
+static volatile long threads_registered = 0;
+static THREAD_LOCAL stage_histograms_t *my_histograms = NULL;
+
+
+double stage_timer_start(book_keeping_for_one_query_t *qex) {
+  if (!qex->time_stages) return 0.0;  // ----------------->
+  return what_time_is_it();
+}
+
+
+void stage_timer_stop(book_keeping_for_one_query_t *qex, int stage, double started) {
+  // Add the time since started, as returned by stage_timer_start(), to the query's total for the stage.
+  if (!qex->time_stages) return;  // ----------------->
+  qex->stage_elapsed[stage] += what_time_is_it() - started;
+}
+
+
+static int bucket_of(u_ll usec) {
+  int e = LLH_SUB_BUCKET_BITS;
+
+  if (usec < LLH_SUB_BUCKETS) return (int)usec;  // ----------------->
+  while (e < LLH_MAX_EXPONENT && (usec >> (e + 1)) != 0) e++;
+  if ((usec >> (e + 1)) != 0) return LLH_BUCKETS - 1;  // Off the scale ----------------->
+  return LLH_SUB_BUCKETS * (e - LLH_SUB_BUCKET_BITS + 1) + (int)((usec >> (e - LLH_SUB_BUCKET_BITS)) - LLH_SUB_BUCKETS);
+}
+
+
+static u_ll bucket_lower_bound(int b, u_ll *width) {
+  int e, sub;
+
+  if (b < LLH_SUB_BUCKETS) {
+    *width = 1;
+    return (u_ll)b;  // ----------------->
+  }
+  e = b / LLH_SUB_BUCKETS + LLH_SUB_BUCKET_BITS - 1;
+  sub = b % LLH_SUB_BUCKETS;
+  *width = 1ULL << (e - LLH_SUB_BUCKET_BITS);
+  return (u_ll)(LLH_SUB_BUCKETS + sub) << (e - LLH_SUB_BUCKET_BITS);
+}
+
+
+void record_stage_times(book_keeping_for_one_query_t *qex) {
+  // Record the stage times of a query which has finished in this thread's histograms.
+  int s;
+  long slot;
+  u_ll usec;
+
+  if (my_histograms == NULL) {
+    slot = ATOMIC_INCREMENT(threads_registered) - 1;
+    if (slot >= MAX_TIMED_THREADS) {
+      // Share the histograms of the last slot, once they exist.  Counts may occasionally be lost.
+      my_histograms = thread_histograms[MAX_TIMED_THREADS - 1];
+      if (my_histograms == NULL) return;  // ----------------->
+    }
+    else {
+      my_histograms = (stage_histograms_t *)calloc(1, sizeof(stage_histograms_t));
+      if (my_histograms == NULL) return;  // Timing is not essential ----------------->
+      thread_histograms[slot] = my_histograms;
+    }
+  }
+
+  for (s = 0; s < NUM_STAGES; s++) {
+    if (qex->stage_elapsed[s] < 0.0) qex->stage_elapsed[s] = 0.0;  // Clock adjustments
+    usec = (u_ll)(qex->stage_elapsed[s] * 1000000.0 + 0.5);
+    my_histograms->counts[s][bucket_of(usec)]++;
+    my_histograms->total_usec[s] += usec;
+    if (usec > my_histograms->max_usec[s]) my_histograms->max_usec[s] = usec;
+  }
+}
+
+
+static u_ll percentile(u_ll *counts, u_ll total, double fraction, u_ll max_usec) {
+  // Return the upper bound of the bucket containing the given fraction of the samples, but
+  // no more than the largest sample.
+  u_ll cumulative = 0, lower, width;
+  int b;
+
+  for (b = 0; b < LLH_BUCKETS; b++) {
+    cumulative += counts[b];
+    if (cumulative > 0 && (double)cumulative >= fraction * (double)total) {
+      lower = bucket_lower_bound(b, &width);
+      if (lower + width - 1 < max_usec) return lower + width - 1;  // ----------------->
+      break;
+    }
+  }
+  return max_usec;
+}
+
+
+void dump_stage_histograms(FILE *out) {
+  // Merge the histograms of all the threads and print them in a tab-separated form:
+  //   STAGE_SUMMARY <stage> queries= <n> mean_usec= <m> p50= <v> p90= <v> p99= <v> p999= <v> max= <v>
+  //   STAGE_BUCKET <stage> <lowest usec> <highest usec> <count>    (non-empty buckets only)
+  stage_histograms_t *merged;
+  long t, threads = threads_registered;
+  int s, b;
+  u_ll queries, lower, width;
+
+  if (threads > MAX_TIMED_THREADS) threads = MAX_TIMED_THREADS;
+  merged = (stage_histograms_t *)calloc(1, sizeof(stage_histograms_t));
+  if (merged == NULL) {
+    fprintf(out, "Warning: Malloc failed in dump_stage_histograms()\n");
+    return;  // ----------------->
+  }
+  for (t = 0; t < threads; t++) {
+    if (thread_histograms[t] == NULL) continue;
+    for (s = 0; s < NUM_STAGES; s++) {
+      for (b = 0; b < LLH_BUCKETS; b++) merged->counts[s][b] += thread_histograms[t]->counts[s][b];
+      merged->total_usec[s] += thread_histograms[t]->total_usec[s];
+      if (thread_histograms[t]->max_usec[s] > merged->max_usec[s]) merged->max_usec[s] = thread_histograms[t]->max_usec[s];
+    }
+  }
+
+  for (s = 0; s < NUM_STAGES; s++) {
+    queries = 0;
+    for (b = 0; b < LLH_BUCKETS; b++) queries += merged->counts[s][b];
+    if (queries == 0) continue;
+    fprintf(out, "STAGE_SUMMARY\t%s\tqueries=\t%llu\tmean_usec=\t%.1f\tp50=\t%llu\tp90=\t%llu\tp99=\t%llu\tp999=\t%llu\tmax=\t%llu\n",
+	    stage_names[s], queries, (double)merged->total_usec[s] / (double)queries,
+	    percentile(merged->counts[s], queries, 0.5, merged->max_usec[s]),
+	    percentile(merged->counts[s], queries, 0.9, merged->max_usec[s]),
+	    percentile(merged->counts[s], queries, 0.99, merged->max_usec[s]),
+	    percentile(merged->counts[s], queries, 0.999, merged->max_usec[s]),
+	    merged->max_usec[s]);
+  }
+  for (s = 0; s < NUM_STAGES; s++) {
+    for (b = 0; b < LLH_BUCKETS; b++) {
+      if (merged->counts[s][b] == 0) continue;
+      lower = bucket_lower_bound(b, &width);
+      fprintf(out, "STAGE_BUCKET\t%s\t%llu\t%llu\t%llu\n", stage_names[s], lower, lower + width - 1,
+	      merged->counts[s][b]);
+    }
+  }
+  free(merged);
+}
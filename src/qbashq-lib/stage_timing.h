@@ -0,0 +1,42 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Per-stage latency histograms.  With x_stage_timing=TRUE, the time spent in each stage of
+// processing a query (see the STAGE_ enum in QBASHQ.h) is accumulated in the query's book-keeping,
+// then recorded in log-linear histograms of microseconds.  Stages are also timed for queries
+// which are traced (see query_trace.h), whether or not x_stage_timing is set.  Each thread records into its own
+// histograms, which are merged whenever they are dumped.
+//
+// The histograms are log-linear:  values below LLH_SUB_BUCKETS microseconds have a bucket each,
+// and every power of two above that is divided into LLH_SUB_BUCKETS equal buckets, so the width of
+// a bucket is never more than 1/LLH_SUB_BUCKETS of its lower bound.
+
+#define LLH_SUB_BUCKET_BITS 4
+#define LLH_SUB_BUCKETS (1 << LLH_SUB_BUCKET_BITS)
+#define LLH_MAX_EXPONENT 36     // 2^36 microseconds is about 19 hours.  Longer times go in the last bucket.
+#define LLH_BUCKETS (LLH_SUB_BUCKETS * (LLH_MAX_EXPONENT - LLH_SUB_BUCKET_BITS + 2))
+#define MAX_TIMED_THREADS 128   // Any more threads share the histograms of the last one
+
+#ifdef WIN64
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_INCREMENT(x) InterlockedIncrement(&(x))
+#define ATOMIC_ADD_LL(x, n) InterlockedExchangeAdd64(&(x), (n))
+#else
+#define THREAD_LOCAL _Thread_local
+#define ATOMIC_INCREMENT(x) __sync_add_and_fetch(&(x), 1)
+#define ATOMIC_ADD_LL(x, n) __sync_add_and_fetch(&(x), (n))
+#endif
+
+typedef struct {
+  u_ll counts[NUM_STAGES][LLH_BUCKETS];
+  u_ll max_usec[NUM_STAGES], total_usec[NUM_STAGES];
+} stage_histograms_t;
+
+extern char *stage_names[NUM_STAGES];
+
+
+double stage_timer_start(book_keeping_for_one_query_t *qex);
+
+void stage_timer_stop(book_keeping_for_one_query_t *qex, int stage, double started);
+
+void record_stage_times(book_keeping_for_one_query_t *qex);
@@ -5,6 +5,10 @@
 // index, consisting of files (QBASH.doctable, .vocab, .if, .forward).  It uses
 // the QBASHQ-LIB library.
 
+#ifndef WIN64
+#define _POSIX_C_SOURCE 200809L  // For sigaction()
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +29,7 @@
 #else
 #include <pthread.h>
 #include <time.h>  // For nanosleep()
+#include <signal.h>
 #endif
 
 #include "../shared/unicode.h"
@@ -40,6 +45,15 @@
 
 long long input_offset = 0;   // Byte offset into the file of input queries
 
+#ifndef WIN64
+// With x_stage_timing, sending SIGUSR1 causes the stage histograms to be dumped after the current query.
+static volatile sig_atomic_t stage_histograms_wanted = 0;
+
+static void request_stage_histograms(int sig) {
+  stage_histograms_wanted = 1;
+}
+#endif
+
 
 #define MAX_QUERY_PARALLELISM 100
 
@@ -148,8 +162,8 @@ static void WINAPI thread_run_query(PTP_CALLBACK_INSTANCE instance, void *contex
   // may be set in options_string.  Options set there, only affect a local qoenv which only lives for the
   // duration of the query.  When we return from that handle_multi_query(), ms->qoenv still refers to the
   // global version which means we can correctly record response time statistics.
-  how_many_results = handle_multi_query(mscon->ixenv, mscon->qoenv, qopstring,
-				      &returned_results, &corresponding_scores, &timed_out);
+  how_many_results = handle_labelled_multi_query(mscon->ixenv, mscon->qoenv, qopstring, mscon->query_label,
+						 &returned_results, &corresponding_scores, &timed_out);
   if (0) printf("returned from h_m_q() with %d results\n", how_many_results);
   // WaitForSingleObject apparently assigns the mutex to us when it stops timing out.
   while ((code = WaitForSingleObject(h_output_mutex, 5L)) == WAIT_TIMEOUT)   // The timeout is in milliseconds
@@ -294,8 +308,8 @@ static void *pthread_run_queries(void *control) {
       // duration of the query.  When we return from the handle_multi_query() call, ms->qoenv still refers to the
       // global version which means we can correctly record response time statistics.
 
-       how_many_results = handle_multi_query(mscon->ixenv, mscon->qoenv, qopstring,
-					  &returned_results, &corresponding_scores, &timed_out);
+       how_many_results = handle_labelled_multi_query(mscon->ixenv, mscon->qoenv, qopstring, query_label,
+						      &returned_results, &corresponding_scores, &timed_out);
 
 
       // To present results we need to grab a lock on the output stream     
@@ -583,7 +597,24 @@ int main(int argc, char **argv) {
     }
 
 
+#ifndef WIN64
+    if (qoenv->x_stage_timing) {
+      // SA_RESTART so that the signal doesn't make fgets() fail and end the batch.
+      struct sigaction action;
+      memset(&action, 0, sizeof(action));
+      action.sa_handler = request_stage_histograms;
+      action.sa_flags = SA_RESTART;
+      sigaction(SIGUSR1, &action, NULL);
+    }
+#endif
+
     while (fgets((char *)qline, MAX_QLINE, query_stream) != NULL) {
+#ifndef WIN64
+      if (stage_histograms_wanted) {
+	stage_histograms_wanted = 0;
+	dump_stage_histograms(qoenv->query_output);
+      }
+#endif
       q = qline;
       while (*q && isspace(*q)) q++;
 
@@ -738,8 +769,8 @@ int main(int argc, char **argv) {
 	  mqs_copy = make_a_copy_of(multiqstr);
 
 	query_started = what_time_is_it();
-	how_many_results = handle_multi_query(ixenv, qoenv, multiqstr,
-					      &returned_results, &corresponding_scores, &timed_out);
+	how_many_results = handle_labelled_multi_query(ixenv, qoenv, multiqstr, query_label,
+						       &returned_results, &corresponding_scores, &timed_out);
 
 	if (qoenv->chatty) {
 	  present_results(qoenv, mqs_copy, query_label, returned_results, corresponding_scores, 
@@ -815,6 +846,7 @@ int main(int argc, char **argv) {
       report_query_response_times(qoenv);
       fprintf(qoenv->query_output, "Milestone: Input file offset (approximate): %lld\n", input_offset);
     }
+    if (qoenv->x_stage_timing) dump_stage_histograms(qoenv->query_output);
 
   }
 
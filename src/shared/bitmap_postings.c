@@ -0,0 +1,324 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Functions for writing QBASH.bitmaps and for skipping through and intersecting the document
+// sets it holds.  See bitmap_postings.h for the format.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN64
+#include <windows.h>
+#include <intrin.h>
+#endif
+
+#include "utility_nodeps.h"
+#include "QBASHER_common_definitions.h"
+#include "bitmap_postings.h"
+
+
+static int lowest_bit(u_ll word) {
+  // word must be non-zero
+#ifdef WIN64
+  unsigned long i;
+  _BitScanForward64(&i, word);
+  return (int)i;
+#else
+  return __builtin_ctzll(word);
+#endif
+}
+
+
+static int one_bits(u_ll word) {
+#ifdef WIN64
+  return (int)__popcnt64(word);
+#else
+  return __builtin_popcountll(word);
+#endif
+}
+
+
+static size_t container_data_len(u_int cardinality) {
+  if (cardinality > BMP_ARRAY_MAX) return BMP_CONTAINER_WORDS * sizeof(u_ll);
+  return ((cardinality * sizeof(u_short) + 7) / 8) * 8;
+}
+
+
+void bmp_writer_init(bmp_writer_t *bw) {
+  memset(bw, 0, sizeof(bmp_writer_t));
+}
+
+
+byte *bmp_encode_term(bmp_writer_t *bw, u_char *term, docnum_t *docnums, u_ll count, size_t *len) {
+  // Encode the document set of term, given as the docnums of its count postings in increasing order
+  // (a docnum is repeated if the term occurs more than once in a document).  Return a malloced
+  // buffer of *len bytes which the caller must write to the file next, and free.
+  bmp_directory_entry_t *de;
+  bmp_container_t *containers;
+  byte *buf, *data;
+  u_ll p, docs = 0;
+  u_int num_containers = 0, c, key, prev_key = 0, filled = 0;
+  docnum_t prev_docnum = -1;
+  size_t header_len, data_len = 0;
+
+  // First pass:  count the containers and the documents in each.
+  for (p = 0; p < count; p++) {
+    if (docnums[p] == prev_docnum) continue;
+    key = (u_int)(docnums[p] >> BMP_CONTAINER_BITS);
+    if (num_containers == 0 || key != prev_key) num_containers++;
+    prev_key = key;
+    prev_docnum = docnums[p];
+  }
+  header_len = num_containers * sizeof(bmp_container_t);
+  containers = (bmp_container_t *)cmalloc(header_len + 1, (u_char *)"bitmap containers", FALSE);
+  memset(containers, 0, header_len);
+  c = 0;
+  prev_docnum = -1;
+  for (p = 0; p < count; p++) {
+    if (docnums[p] == prev_docnum) continue;
+    key = (u_int)(docnums[p] >> BMP_CONTAINER_BITS);
+    if (containers[c].cardinality > 0 && key != containers[c].key) c++;
+    containers[c].key = key;
+    containers[c].cardinality++;
+    prev_docnum = docnums[p];
+  }
+  for (c = 0; c < num_containers; c++) {
+    containers[c].offset = bw->offset + header_len + data_len;
+    data_len += container_data_len(containers[c].cardinality);
+    docs += containers[c].cardinality;
+  }
+
+  // Second pass:  fill in the containers.
+  *len = header_len + data_len;
+  buf = (byte *)cmalloc(*len + 1, (u_char *)"bitmap term buffer", FALSE);
+  memset(buf, 0, *len);
+  memcpy(buf, containers, header_len);
+  c = 0;
+  data = buf + header_len;
+  prev_docnum = -1;
+  for (p = 0; p < count; p++) {
+    u_int low;
+    if (docnums[p] == prev_docnum) continue;
+    key = (u_int)(docnums[p] >> BMP_CONTAINER_BITS);
+    if (key != containers[c].key) {
+      data += container_data_len(containers[c].cardinality);
+      c++;
+      filled = 0;
+    }
+    low = (u_int)(docnums[p] & (BMP_CONTAINER_DOCS - 1));
+    if (containers[c].cardinality > BMP_ARRAY_MAX) ((u_ll *)data)[low >> 6] |= (1ULL << (low & 63));
+    else ((u_short *)data)[filled++] = (u_short)low;
+    prev_docnum = docnums[p];
+  }
+  free(containers);
+
+  if (bw->num_terms >= bw->capacity) {
+    bw->capacity = bw->capacity == 0 ? 64 : bw->capacity * 2;
+    bw->directory = (bmp_directory_entry_t *)realloc(bw->directory, bw->capacity * sizeof(bmp_directory_entry_t));
+    if (bw->directory == NULL) error_exit("Error: realloc of bitmap directory failed\n");
+  }
+  de = bw->directory + bw->num_terms++;
+  memset(de, 0, sizeof(bmp_directory_entry_t));
+  strncpy((char *)de->term, (char *)term, MAX_WD_LEN);
+  de->offset = bw->offset;
+  de->docs = docs;
+  de->num_containers = num_containers;
+  bw->offset += *len;
+  return buf;
+}
+
+
+byte *bmp_writer_finish(bmp_writer_t *bw, u_ll num_docs, u_ll if_size, size_t *len) {
+  // Return a malloced buffer holding the directory and the trailer, which the caller must write
+  // after the last term, and free.
+  size_t dir_len = bw->num_terms * sizeof(bmp_directory_entry_t);
+  byte *buf;
+  bmp_trailer_t *trailer;
+
+  *len = dir_len + sizeof(bmp_trailer_t);
+  buf = (byte *)cmalloc(*len, (u_char *)"bitmap directory", FALSE);
+  if (dir_len > 0) memcpy(buf, bw->directory, dir_len);
+  trailer = (bmp_trailer_t *)(buf + dir_len);
+  memset(trailer, 0, sizeof(bmp_trailer_t));
+  memcpy(trailer->magic, BMP_MAGIC, sizeof(trailer->magic));
+  trailer->num_terms = bw->num_terms;
+  trailer->num_docs = num_docs;
+  trailer->if_size = if_size;
+  trailer->directory_offset = bw->offset;
+  free(bw->directory);
+  bw->directory = NULL;
+  return buf;
+}
+
+
+int bmp_check(byte *bitmaps, size_t bsz, u_ll num_docs, u_ll if_size) {
+  // Check that bitmaps is intact and was written along with an index of num_docs documents whose
+  // .if is if_size bytes.  Return 0 or -200092.
+  bmp_trailer_t *trailer;
+
+  if (bsz < sizeof(bmp_trailer_t)) return -200092;  // ----------------->
+  trailer = (bmp_trailer_t *)(bitmaps + bsz - sizeof(bmp_trailer_t));
+  if (memcmp(trailer->magic, BMP_MAGIC, sizeof(trailer->magic))
+      || trailer->num_docs != num_docs || trailer->if_size != if_size
+      || trailer->directory_offset + trailer->num_terms * sizeof(bmp_directory_entry_t) + sizeof(bmp_trailer_t) != bsz)
+    return -200092;  // ----------------->
+  return 0;
+}
+
+
+bmp_directory_entry_t *bmp_lookup_term(byte *bitmaps, size_t bsz, u_char *term) {
+  // Binary search the directory of a checked QBASH.bitmaps.  Return NULL if the term has no bitmap.
+  bmp_trailer_t *trailer = (bmp_trailer_t *)(bitmaps + bsz - sizeof(bmp_trailer_t));
+  bmp_directory_entry_t *directory = (bmp_directory_entry_t *)(bitmaps + trailer->directory_offset);
+  long long lo = 0, hi = (long long)trailer->num_terms - 1, mid;
+  int cmp;
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    cmp = strncmp((char *)directory[mid].term, (char *)term, MAX_WD_LEN + 1);
+    if (cmp == 0) return directory + mid;  // ----------------->
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return NULL;
+}
+
+
+void bmp_cursor_init(bmp_cursor_t *bc, byte *bitmaps, bmp_directory_entry_t *de) {
+  bc->bitmaps = bitmaps;
+  bc->term = de;
+  bc->containers = (bmp_container_t *)(bitmaps + de->offset);
+  bc->num_containers = de->num_containers;
+  bc->c = 0;
+  bc->a = 0;
+}
+
+
+void bmp_cursor_prefetch(bmp_cursor_t *bc, docnum_t docnum) {
+  // Prefetch the container data which bmp_cursor_skipto(bc, docnum) will read first, if docnum is
+  // in the current container.
+  u_int key = (u_int)(docnum >> BMP_CONTAINER_BITS);
+  bmp_container_t *ct;
+  byte *data;
+
+  if (bc->c >= bc->num_containers || bc->containers[bc->c].key != key) return;  // ----------------->
+  ct = bc->containers + bc->c;
+  data = bc->bitmaps + ct->offset;
+  if (ct->cardinality > BMP_ARRAY_MAX) PREFETCH(data + ((docnum & (BMP_CONTAINER_DOCS - 1)) >> 6) * sizeof(u_ll));
+  else PREFETCH(data + bc->a * sizeof(u_short));
+}
+
+
+docnum_t bmp_cursor_skipto(bmp_cursor_t *bc, docnum_t docnum) {
+  // Return the lowest docnum >= docnum in the term's set, or BMP_EXHAUSTED.  Calls must be made
+  // with non-decreasing docnums, since the cursor never moves backwards.
+  u_int key = (u_int)(docnum >> BMP_CONTAINER_BITS), low, i;
+  bmp_container_t *ct;
+  byte *data;
+
+  while (bc->c < bc->num_containers && bc->containers[bc->c].key < key) {
+    bc->c++;
+    bc->a = 0;
+  }
+  while (bc->c < bc->num_containers) {
+    ct = bc->containers + bc->c;
+    data = bc->bitmaps + ct->offset;
+    low = (ct->key == key) ? (u_int)(docnum & (BMP_CONTAINER_DOCS - 1)) : 0;
+    if (ct->cardinality > BMP_ARRAY_MAX) {
+      // Look a whole word at a time for the next one bit.
+      u_ll *words = (u_ll *)data, word;
+      i = low >> 6;
+      word = words[i] & (~0ULL << (low & 63));
+      while (1) {
+	if (word) return ((docnum_t)ct->key << BMP_CONTAINER_BITS) | ((docnum_t)i << 6) | lowest_bit(word);  // ----------------->
+	if (++i >= BMP_CONTAINER_WORDS) break;
+	word = words[i];
+      }
+    }
+    else {
+      // Everything before array[bc->a] is less than low, since skiptos are monotonic.  Gallop
+      // forward from there, because successive skiptos are usually close together, then do a lower
+      // bound binary search.
+      u_short *array = (u_short *)data;
+      u_int lo = bc->a, hi, step = 1, mid;
+      while (lo + step < ct->cardinality && array[lo + step - 1] < low) {
+	lo += step;
+	step <<= 1;
+      }
+      hi = lo + step;
+      if (hi > ct->cardinality) hi = ct->cardinality;
+      while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (array[mid] < low) lo = mid + 1;
+	else hi = mid;
+      }
+      if (lo < ct->cardinality) {
+	bc->a = lo;
+	return ((docnum_t)ct->key << BMP_CONTAINER_BITS) | array[lo];  // ----------------->
+      }
+    }
+    bc->c++;
+    bc->a = 0;
+  }
+  return BMP_EXHAUSTED;
+}
+
+
+static void container_to_words(byte *bitmaps, bmp_container_t *ct, u_ll *words) {
+  u_int a;
+  u_short *array;
+
+  if (ct->cardinality > BMP_ARRAY_MAX) {
+    memcpy(words, bitmaps + ct->offset, BMP_CONTAINER_WORDS * sizeof(u_ll));
+    return;  // ----------------->
+  }
+  memset(words, 0, BMP_CONTAINER_WORDS * sizeof(u_ll));
+  array = (u_short *)(bitmaps + ct->offset);
+  for (a = 0; a < ct->cardinality; a++) words[array[a] >> 6] |= (1ULL << (array[a] & 63));
+}
+
+
+u_ll bmp_count_intersection(byte *bitmaps, bmp_directory_entry_t **terms, int num_terms) {
+  // Count the documents which contain all of the terms, by ANDing and counting the one bits
+  // of the containers which all the terms have in common.
+  bmp_container_t *containers[BMP_MAX_INTERSECTION_TERMS], *ct;
+  u_int c[BMP_MAX_INTERSECTION_TERMS] = { 0 }, key;
+  u_ll acc[BMP_CONTAINER_WORDS], words[BMP_CONTAINER_WORDS], count = 0;
+  int t, w;
+  BOOL in_all;
+
+  if (num_terms < 1 || num_terms > BMP_MAX_INTERSECTION_TERMS) return 0;  // ----------------->
+  for (t = 0; t < num_terms; t++) containers[t] = (bmp_container_t *)(bitmaps + terms[t]->offset);
+
+  for (c[0] = 0; c[0] < terms[0]->num_containers; c[0]++) {
+    key = containers[0][c[0]].key;
+    in_all = TRUE;
+    for (t = 1; t < num_terms; t++) {
+      while (c[t] < terms[t]->num_containers && containers[t][c[t]].key < key) c[t]++;
+      if (c[t] >= terms[t]->num_containers) return count;  // No more common containers ----------------->
+      if (containers[t][c[t]].key != key) {
+	in_all = FALSE;
+	break;
+      }
+    }
+    if (!in_all) continue;
+    if (num_terms == 1) {
+      count += containers[0][c[0]].cardinality;
+      continue;
+    }
+    container_to_words(bitmaps, containers[0] + c[0], acc);
+    for (t = 1; t < num_terms; t++) {
+      ct = containers[t] + c[t];
+      if (ct->cardinality > BMP_ARRAY_MAX) {
+	u_ll *bits = (u_ll *)(bitmaps + ct->offset);
+	for (w = 0; w < BMP_CONTAINER_WORDS; w++) acc[w] &= bits[w];
+      }
+      else {
+	container_to_words(bitmaps, ct, words);
+	for (w = 0; w < BMP_CONTAINER_WORDS; w++) acc[w] &= words[w];
+      }
+    }
+    for (w = 0; w < BMP_CONTAINER_WORDS; w++) count += one_bits(acc[w]);
+  }
+  return count;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Bitmap postings for very high frequency terms.  If QBASHI is run with x_bitmap_density=<d>
+// it writes QBASH.bitmaps alongside QBASH.if, representing the set of documents containing each
+// term which occurs in at least a fraction d of the documents.  The positional postings lists
+// in .if are unchanged.  QBASHQ uses the bitmaps to skip and to count matches without decoding
+// postings, and only goes to the positional lists when word positions are actually needed.
+//
+// The document sets are compressed Roaring-style:  the docnum range is divided into chunks
+// of BMP_CONTAINER_DOCS documents and each non-empty chunk of a term is a container.  A container
+// holding more than BMP_ARRAY_MAX documents is a bitmap of BMP_CONTAINER_WORDS 64-bit words,
+// otherwise it is a sorted array of the low 16 bits of its docnums.
+//
+// QBASH.bitmaps is:
+//   - for each term, in alphabetical order, an array of bmp_container_t followed by the data
+//     of the containers, each padded to a multiple of eight bytes
+//   - the directory:  a bmp_directory_entry_t for each term, binary searched in place
+//   - a bmp_trailer_t, which identifies the index the bitmaps belong to.
+
+#define BMP_MAGIC "QBBMAP1"   // 8 bytes including the null
+#define BMP_CONTAINER_BITS 16
+#define BMP_CONTAINER_DOCS (1 << BMP_CONTAINER_BITS)
+#define BMP_CONTAINER_WORDS (BMP_CONTAINER_DOCS / 64)
+#define BMP_ARRAY_MAX 4096    // Above this, a bitmap container is smaller than an array
+#define BMP_EXHAUSTED -1LL
+#define BMP_MAX_INTERSECTION_TERMS 32   // Same as MAX_WDS_IN_QUERY
+
+typedef struct {
+  u_int key;           // Docnum >> BMP_CONTAINER_BITS
+  u_int cardinality;   // Number of documents in the container
+  u_ll offset;         // Of the container data, from the start of the file
+} bmp_container_t;
+
+
+typedef struct {
+  u_char term[MAX_WD_LEN + 1];
+  u_ll offset;         // Of the term's array of containers, from the start of the file
+  u_ll docs;           // Number of documents containing the term
+  u_int num_containers, unused;
+} bmp_directory_entry_t;
+
+
+typedef struct {
+  char magic[8];
+  u_ll num_terms, num_docs, if_size, directory_offset;
+} bmp_trailer_t;
+
+
+typedef struct {
+  // Accumulates the directory while the bitmaps are written out by the caller.
+  u_ll offset, num_terms, capacity;
+  bmp_directory_entry_t *directory;
+} bmp_writer_t;
+
+
+typedef struct {
+  // Position within the document set of one term, for bmp_cursor_skipto().
+  byte *bitmaps;
+  bmp_directory_entry_t *term;
+  bmp_container_t *containers;
+  u_int num_containers, c;
+  u_int a;   // Within an array container, the subscript of the last docnum returned
+} bmp_cursor_t;
+
+
+void bmp_writer_init(bmp_writer_t *bw);
+
+byte *bmp_encode_term(bmp_writer_t *bw, u_char *term, docnum_t *docnums, u_ll count, size_t *len);
+
+byte *bmp_writer_finish(bmp_writer_t *bw, u_ll num_docs, u_ll if_size, size_t *len);
+
+int bmp_check(byte *bitmaps, size_t bsz, u_ll num_docs, u_ll if_size);
+
+bmp_directory_entry_t *bmp_lookup_term(byte *bitmaps, size_t bsz, u_char *term);
+
+void bmp_cursor_init(bmp_cursor_t *bc, byte *bitmaps, bmp_directory_entry_t *de);
+
+void bmp_cursor_prefetch(bmp_cursor_t *bc, docnum_t docnum);
+
+docnum_t bmp_cursor_skipto(bmp_cursor_t *bc, docnum_t docnum);
+
+u_ll bmp_count_intersection(byte *bitmaps, bmp_directory_entry_t **terms, int num_terms);
@@ -0,0 +1,247 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Functions for writing and reading the front-coded .vocab layout (see front_coded_vocab.h), and
+// for iterating over prefix ranges of terms in either .vocab layout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN64
+#include <windows.h>
+#endif
+
+#include "utility_nodeps.h"
+#include "QBASHER_common_definitions.h"
+#include "front_coded_vocab.h"
+
+
+void fcv_encoder_init(fcv_encoder_t *fe, u_ll num_terms, byte *header) {
+  // Set up to encode num_terms terms and fill in the sizeof(fcv_header_t) bytes of header.
+  fcv_header_t *h = (fcv_header_t *)header;
+  u_ll num_blocks = (num_terms + FCV_BLOCK_TERMS - 1) / FCV_BLOCK_TERMS;
+
+  memset(fe, 0, sizeof(fcv_encoder_t));
+  fe->num_terms = num_terms;
+  fe->offset = sizeof(fcv_header_t);
+  fe->block_index = (fcv_block_index_entry_t *)cmalloc((num_blocks + 1) * sizeof(fcv_block_index_entry_t),
+						       (u_char *)"front-coded vocab block index", FALSE);
+  memset(h, 0, sizeof(fcv_header_t));
+  memcpy(h->magic, FCV_MAGIC, sizeof(h->magic));
+  h->block_terms = FCV_BLOCK_TERMS;
+  h->num_terms = num_terms;
+  h->num_blocks = num_blocks;
+}
+
+
+size_t fcv_encode(fcv_encoder_t *fe, byte *record, byte *entry) {
+  // Encode the next standard .vocab record into entry, which must have room for VOCABFILE_REC_LEN
+  // bytes, and return the number of bytes used.
+  u_char *term = record;
+  size_t len = strlen((char *)term), shared = 0, e = 0;
+
+  if (len > MAX_WD_LEN) len = MAX_WD_LEN;
+  if (fe->terms_added % FCV_BLOCK_TERMS == 0) {
+    fcv_block_index_entry_t *bie = fe->block_index + fe->terms_added / FCV_BLOCK_TERMS;
+    memset(bie->first_term, 0, MAX_WD_LEN + 1);
+    memcpy(bie->first_term, term, len);
+    bie->offset = fe->offset;
+  }
+  else {
+    while (shared < len && term[shared] == fe->prev_term[shared]) shared++;
+  }
+  entry[e++] = (byte)((shared << 4) | (len - shared));
+  memcpy(entry + e, term + shared, len - shared);
+  e += len - shared;
+  memcpy(entry + e, record + MAX_WD_LEN + 1, VOCABFILE_INFO_LEN);
+  e += VOCABFILE_INFO_LEN;
+
+  memcpy(fe->prev_term, term, len);
+  fe->prev_term[len] = 0;
+  fe->terms_added++;
+  fe->offset += e;
+  return e;
+}
+
+
+byte *fcv_encoder_finish(fcv_encoder_t *fe, size_t *trailer_len) {
+  // Return a malloced trailer comprising the padding and the block index, and its length.
+  // Caller must write it after the last entry, and free it.
+  u_ll num_blocks = (fe->num_terms + FCV_BLOCK_TERMS - 1) / FCV_BLOCK_TERMS;
+  size_t padding = (size_t)((8 - fe->offset % 8) % 8), index_len = num_blocks * sizeof(fcv_block_index_entry_t);
+  byte *trailer;
+
+  if (fe->terms_added != fe->num_terms) {
+    printf("Error: %llu terms were encoded in the front-coded vocab, but %llu were expected.\n",
+	   fe->terms_added, fe->num_terms);
+    exit(1);
+  }
+  *trailer_len = padding + index_len;
+  trailer = (byte *)cmalloc(*trailer_len + 1, (u_char *)"front-coded vocab trailer", FALSE);
+  memset(trailer, 0, padding);
+  memcpy(trailer + padding, fe->block_index, index_len);
+  free(fe->block_index);
+  fe->block_index = NULL;
+  return trailer;
+}
+
+
+BOOL vocab_is_front_coded(byte *vocab, size_t vsz) {
+  return (vsz >= sizeof(fcv_header_t) && !memcmp(vocab, FCV_MAGIC, sizeof(FCV_MAGIC)));
+}
+
+
+u_ll vocab_term_count(byte *vocab, size_t vsz) {
+  if (vocab_is_front_coded(vocab, vsz)) return ((fcv_header_t *)vocab)->num_terms;
+  return vsz / VOCABFILE_REC_LEN;
+}
+
+
+static fcv_block_index_entry_t *block_index_of(byte *vocab, size_t vsz) {
+  fcv_header_t *h = (fcv_header_t *)vocab;
+  return (fcv_block_index_entry_t *)(vocab + vsz - h->num_blocks * sizeof(fcv_block_index_entry_t));
+}
+
+
+static u_ll find_block(byte *vocab, size_t vsz, u_char *key) {
+  // Binary search the block index for the last block whose first term is <= key.  Return
+  // block zero if key precedes all the terms.
+  fcv_header_t *h = (fcv_header_t *)vocab;
+  fcv_block_index_entry_t *bi = block_index_of(vocab, vsz);
+  long long lo = 0, hi = (long long)h->num_blocks - 1, mid, rslt = 0;
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    if (strncmp((char *)bi[mid].first_term, (char *)key, MAX_WD_LEN + 1) <= 0) {
+      rslt = mid;
+      lo = mid + 1;
+    }
+    else hi = mid - 1;
+  }
+  return (u_ll)rslt;
+}
+
+
+static byte *decode_entry(byte *p, byte *record) {
+  // Decode the front-coded entry at p into a standard record, whose term field must still hold
+  // the previous term in the block.  Return a pointer to the next entry.
+  size_t shared = *p >> 4, suffix_len = *p & 0xF;
+  p++;
+  memcpy(record + shared, p, suffix_len);
+  memset(record + shared + suffix_len, 0, MAX_WD_LEN + 1 - shared - suffix_len);
+  p += suffix_len;
+  memcpy(record + MAX_WD_LEN + 1, p, VOCABFILE_INFO_LEN);
+  return p + VOCABFILE_INFO_LEN;
+}
+
+
+byte *fcv_lookup(u_char *wd, byte *vocab, size_t vsz, byte *record) {
+  // Look up wd in a front-coded .vocab.  If it's found, decode its entry into record (VOCABFILE_REC_LEN
+  // bytes) in the standard layout and return record, otherwise return NULL.  Only the block
+  // index and a single block are touched.
+  fcv_header_t *h = (fcv_header_t *)vocab;
+  u_char key[MAX_WD_LEN + 1];
+  byte *p;
+  u_ll b, t, terms_in_block;
+  int cmp;
+
+  // Indexed words are truncated to MAX_WD_LEN, so a longer wd can't match.
+  if (h->num_terms == 0 || strlen((char *)wd) > MAX_WD_LEN) return NULL;  // ----------------->
+  strcpy((char *)key, (char *)wd);
+  b = find_block(vocab, vsz, key);
+  p = vocab + block_index_of(vocab, vsz)[b].offset;
+  terms_in_block = h->num_terms - b * h->block_terms;
+  if (terms_in_block > h->block_terms) terms_in_block = h->block_terms;
+  for (t = 0; t < terms_in_block; t++) {
+    p = decode_entry(p, record);
+    cmp = strcmp((char *)record, (char *)key);
+    if (cmp == 0) return record;  // ----------------->
+    if (cmp > 0) break;
+  }
+  return NULL;
+}
+
+
+void vocab_iterator_start(vocab_iterator_t *it, byte *vocab, size_t vsz, u_char *prefix) {
+  // Position it on the first term in vocab which is >= prefix.  An empty prefix iterates
+  // over the whole vocabulary.
+  u_ll lo, hi, mid;
+
+  memset(it, 0, sizeof(vocab_iterator_t));
+  it->vocab = vocab;
+  it->vsz = vsz;
+  strncpy((char *)it->prefix, (char *)prefix, MAX_WD_LEN);
+  it->prefix_len = strlen((char *)it->prefix);
+  it->front_coded = vocab_is_front_coded(vocab, vsz);
+  if (it->front_coded) {
+    fcv_header_t *h = (fcv_header_t *)vocab;
+    u_ll b;
+    if (h->num_terms == 0) return;  // ----------------->
+    b = find_block(vocab, vsz, it->prefix);
+    it->next = vocab + block_index_of(vocab, vsz)[b].offset;
+    it->terms_left = h->num_terms - b * h->block_terms;
+    // Skip the terms in the block which precede the prefix.  The term field of the record
+    // must follow along, because the entries are front-coded.  The first term >= prefix is
+    // left to be decoded again by vocab_iterator_next(), which gives the same result because
+    // the prefix it shares with its predecessor is also a prefix of itself.
+    while (it->terms_left > 0) {
+      byte *p = decode_entry(it->next, it->record);
+      if (strcmp((char *)it->record, (char *)it->prefix) >= 0) break;
+      it->next = p;
+      it->terms_left--;
+    }
+  }
+  else {
+    // Lower bound binary search over the fixed-length records
+    lo = 0;
+    hi = vsz / VOCABFILE_REC_LEN;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (strcmp((char *)vocab + mid * VOCABFILE_REC_LEN, (char *)it->prefix) < 0) lo = mid + 1;
+      else hi = mid;
+    }
+    it->next = vocab + lo * VOCABFILE_REC_LEN;
+    it->terms_left = vsz / VOCABFILE_REC_LEN - lo;
+  }
+}
+
+
+byte *vocab_iterator_next(vocab_iterator_t *it) {
+  // Return the next term's record in the standard layout, or NULL if there are no more terms
+  // starting with the prefix.  The record is only valid until the next call.
+  byte *record;
+
+  if (it->terms_left == 0) return NULL;  // ----------------->
+  if (it->front_coded) {
+    it->next = decode_entry(it->next, it->record);
+    record = it->record;
+  }
+  else {
+    record = it->next;
+    it->next += VOCABFILE_REC_LEN;
+  }
+  if (it->prefix_len > 0 && strncmp((char *)record, (char *)it->prefix, it->prefix_len)) {
+    it->terms_left = 0;
+    return NULL;  // ----------------->
+  }
+  it->terms_left--;
+  return record;
+}
+
+
+byte *vocab_to_standard_records(byte *vocab, size_t vsz, size_t *standard_size) {
+  // Return a malloced copy of a .vocab of either layout in the standard fixed-length layout,
+  // and its size.  For programs which process the whole vocabulary by record number.
+  vocab_iterator_t it;
+  byte *records, *r, *w;
+
+  *standard_size = vocab_term_count(vocab, vsz) * VOCABFILE_REC_LEN;
+  records = (byte *)cmalloc(*standard_size + 1, (u_char *)"standard vocab records", FALSE);
+  w = records;
+  vocab_iterator_start(&it, vocab, vsz, (u_char *)"");
+  while ((r = vocab_iterator_next(&it)) != NULL) {
+    memcpy(w, r, VOCABFILE_REC_LEN);
+    w += VOCABFILE_REC_LEN;
+  }
+  return records;
+}
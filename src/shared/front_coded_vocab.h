@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// An alternative layout for the .vocab file, written by QBASHI if x_front_coded_vocab=TRUE.
+//
+// Records in the standard .vocab are VOCABFILE_REC_LEN bytes:  the term zero-padded to MAX_WD_LEN + 1
+// bytes, followed by VOCABFILE_INFO_LEN bytes of occurrence count, QIDF and payload.  Most terms are
+// short and share a prefix with their predecessor, so most of the file is padding.
+//
+// A front-coded .vocab is:
+//   - a fcv_header_t
+//   - blocks of FCV_BLOCK_TERMS consecutive terms (the last block may have fewer).  Each entry is a
+//     byte holding the length of the prefix shared with the previous term in the block (high nybble)
+//     and the length of the rest of the term (low nybble), then the rest of the term, then the
+//     VOCABFILE_INFO_LEN bytes of info exactly as in the standard record.  The first term in a block
+//     shares nothing, so blocks can be decoded independently.
+//   - zero padding to a multiple of eight bytes
+//   - the block index:  the first term and file offset of every block, in fixed-size entries which
+//     are binary searched in place.
+//
+// A front-coded .vocab can't be mistaken for a standard one because no term starts with the byte 0xFF.
+
+#if MAX_WD_LEN > 15
+#error "Front-coded vocab entries need MAX_WD_LEN to fit in a nybble"
+#endif
+
+#define FCV_MAGIC "\xFF" "QBFCV1"   // 8 bytes including the null
+#define FCV_BLOCK_TERMS 16
+
+typedef struct {
+  char magic[8];
+  u_int block_terms, unused;
+  u_ll num_terms, num_blocks;
+} fcv_header_t;
+
+
+typedef struct {
+  u_char first_term[MAX_WD_LEN + 1];
+  u_ll offset;    // Of the block, from the start of the file
+} fcv_block_index_entry_t;
+
+
+typedef struct {
+  // Encodes records in the standard layout, presented in alphabetical order, as a front-coded .vocab.
+  // The caller writes out the header, the entries and the trailer.
+  u_ll num_terms, terms_added, offset;
+  u_char prev_term[MAX_WD_LEN + 1];
+  fcv_block_index_entry_t *block_index;
+} fcv_encoder_t;
+
+
+typedef struct {
+  // Iterates in alphabetical order over the terms in either .vocab layout which start with a prefix.
+  byte *vocab, *next;
+  size_t vsz;
+  BOOL front_coded;
+  u_ll terms_left;
+  u_char prefix[MAX_WD_LEN + 1];
+  size_t prefix_len;
+  byte record[VOCABFILE_REC_LEN];  // A front-coded entry is decoded into this
+} vocab_iterator_t;
+
+
+void fcv_encoder_init(fcv_encoder_t *fe, u_ll num_terms, byte *header);
+
+size_t fcv_encode(fcv_encoder_t *fe, byte *record, byte *entry);
+
+byte *fcv_encoder_finish(fcv_encoder_t *fe, size_t *trailer_len);
+
+BOOL vocab_is_front_coded(byte *vocab, size_t vsz);
+
+u_ll vocab_term_count(byte *vocab, size_t vsz);
+
+byte *fcv_lookup(u_char *wd, byte *vocab, size_t vsz, byte *record);
+
+void vocab_iterator_start(vocab_iterator_t *it, byte *vocab, size_t vsz, u_char *prefix);
+
+byte *vocab_iterator_next(vocab_iterator_t *it);
+
+byte *vocab_to_standard_records(byte *vocab, size_t vsz, size_t *standard_size);
@@ -0,0 +1,177 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Functions for writing, checking and reading QBASHER index containers.  See index_container.h
+// for the format.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef WIN64
+#include <windows.h>
+#endif
+
+#include "utility_nodeps.h"
+#include "index_container.h"
+#include "../imported/Fowler-Noll-Vo-hash/fnv.h"
+
+#define PACKING_BUFFER_SIZE (16 * 1048576)
+
+
+static u_ll round_up_to_page(u_ll offset) {
+  return (offset + QBX_PAGE_SIZE - 1) & ~((u_ll)QBX_PAGE_SIZE - 1);
+}
+
+
+int qbx_pack(u_char *container_name, u_char **fnames, u_char **section_names, int num_sections, BOOL verbose) {
+  // Write a container called container_name comprising the num_sections files named in fnames.  The
+  // sections are named in section_names.  All the input files are mapped and checksummed first,
+  // so that the header can be written before the sections.  Return 0 or a negative error code.
+  qbx_header_t *header;
+  CROSS_PLATFORM_FILE_HANDLE *H, wh;
+  HANDLE *MH;
+  byte **inmem, *buffer = NULL, zeroes[QBX_PAGE_SIZE] = { 0 };
+  size_t *sighs, bytes_in_buffer = 0;
+  u_ll offset;
+  int s, error_code = 0;
+
+  if (sizeof(qbx_header_t) > QBX_PAGE_SIZE) return -200088;
+  if (num_sections < 1 || num_sections > QBX_MAX_SECTIONS) return -200089;   // ----------------->
+  for (s = 0; s < num_sections; s++) {
+    if (strlen((char *)section_names[s]) >= QBX_MAX_SECTION_NAME) return -200089;   // ----------------->
+  }
+
+  header = (qbx_header_t *)malloc(QBX_PAGE_SIZE);
+  inmem = (byte **)malloc(num_sections * sizeof(byte *));
+  sighs = (size_t *)malloc(num_sections * sizeof(size_t));
+  H = (CROSS_PLATFORM_FILE_HANDLE *)malloc(num_sections * sizeof(CROSS_PLATFORM_FILE_HANDLE));
+  MH = (HANDLE *)malloc(num_sections * sizeof(HANDLE));
+  if (header == NULL || inmem == NULL || sighs == NULL || H == NULL || MH == NULL) {
+    free(header);
+    free(inmem);
+    free(sighs);
+    free(H);
+    free(MH);
+    return -220091;   // ----------------->
+  }
+  memset(header, 0, QBX_PAGE_SIZE);
+  memset(inmem, 0, num_sections * sizeof(byte *));
+
+  memcpy(header->magic, QBX_MAGIC, sizeof(header->magic));
+  header->format_version = QBX_FORMAT_VERSION;
+  header->num_sections = num_sections;
+  offset = QBX_PAGE_SIZE;
+  for (s = 0; s < num_sections; s++) {
+    inmem[s] = (byte *)mmap_all_of(fnames[s], sighs + s, FALSE, H + s, MH + s, &error_code);
+    if (error_code < 0) break;
+    strcpy(header->sections[s].name, (char *)section_names[s]);
+    header->sections[s].offset = offset;
+    header->sections[s].length = sighs[s];
+    header->sections[s].checksum = fnv_64a_buf(inmem[s], sighs[s], FNV1A_64_INIT);
+    if (verbose) printf("  %-20s %14zu bytes at offset %14llu from %s\n", section_names[s], sighs[s], offset, fnames[s]);
+    offset = round_up_to_page(offset + sighs[s]);
+  }
+
+  if (error_code >= 0) {
+    header->container_size = offset;
+    header->toc_checksum = fnv_64a_buf(header->sections, num_sections * sizeof(qbx_section_t), FNV1A_64_INIT);
+    wh = open_w((char *)container_name, &error_code);
+  }
+
+  if (error_code >= 0) {
+    buffered_write(wh, &buffer, PACKING_BUFFER_SIZE, &bytes_in_buffer, (byte *)header, QBX_PAGE_SIZE, "container header");
+    for (s = 0; s < num_sections; s++) {
+      buffered_write(wh, &buffer, PACKING_BUFFER_SIZE, &bytes_in_buffer, inmem[s], sighs[s], (char *)section_names[s]);
+      buffered_write(wh, &buffer, PACKING_BUFFER_SIZE, &bytes_in_buffer, zeroes,
+		     round_up_to_page(sighs[s]) - sighs[s], "container padding");
+    }
+    buffered_flush(wh, &buffer, &bytes_in_buffer, "container", TRUE);
+  }
+
+  for (s = 0; s < num_sections; s++) {
+    if (inmem[s] != NULL) unmmap_all_of(inmem[s], H[s], MH[s], sighs[s]);
+  }
+  free(header);
+  free(inmem);
+  free(sighs);
+  free(H);
+  free(MH);
+  return error_code;
+}
+
+
+int qbx_check_header(byte *container, size_t sighs) {
+  // Check the magic number, version and table of contents of a mapped container of sighs bytes.
+  // The section contents are not checked, since that would mean reading the whole container.
+  // Return 0 or a negative error code.
+  qbx_header_t *header = (qbx_header_t *)container;
+  u_int s;
+
+  if (sighs < QBX_PAGE_SIZE || memcmp(header->magic, QBX_MAGIC, sizeof(header->magic))
+      || header->format_version != QBX_FORMAT_VERSION || header->num_sections > QBX_MAX_SECTIONS
+      || header->toc_checksum != fnv_64a_buf(header->sections, header->num_sections * sizeof(qbx_section_t),
+					     FNV1A_64_INIT))
+    return -200088;   // ----------------->
+
+  if (header->container_size != sighs) return -200089;   // ----------------->
+  for (s = 0; s < header->num_sections; s++) {
+    if (header->sections[s].offset % QBX_PAGE_SIZE != 0
+	|| header->sections[s].offset < QBX_PAGE_SIZE
+	|| header->sections[s].offset + header->sections[s].length > sighs
+	|| memchr(header->sections[s].name, 0, QBX_MAX_SECTION_NAME) == NULL)
+      return -200089;   // ----------------->
+  }
+  return 0;
+}
+
+
+int qbx_verify_checksums(byte *container, BOOL verbose) {
+  // Recompute the checksum of every section of a container which has already passed qbx_check_header().
+  // Return 0 or -200090 if any section doesn't match.
+  qbx_header_t *header = (qbx_header_t *)container;
+  qbx_section_t *section;
+  u_int s;
+  int error_code = 0;
+
+  for (s = 0; s < header->num_sections; s++) {
+    section = header->sections + s;
+    if (fnv_64a_buf(container + section->offset, section->length, FNV1A_64_INIT) != section->checksum) {
+      if (verbose) printf("Checksum mismatch in container section %s\n", section->name);
+      error_code = -200090;
+    }
+  }
+  return error_code;
+}
+
+
+byte *qbx_find_section(byte *container, char *name, size_t *length) {
+  // Return a pointer to the start of the named section within a mapped container and set
+  // *length.  Return NULL if there is no such section.
+  qbx_header_t *header = (qbx_header_t *)container;
+  u_int s;
+
+  for (s = 0; s < header->num_sections; s++) {
+    if (!strcmp(header->sections[s].name, name)) {
+      *length = (size_t)header->sections[s].length;
+      return container + header->sections[s].offset;   // ----------------->
+    }
+  }
+  *length = 0;
+  return NULL;
+}
+
+
+void qbx_print_toc(FILE *printto, byte *container) {
+  qbx_header_t *header = (qbx_header_t *)container;
+  u_int s;
+
+  fprintf(printto, "Container format %u, %u sections, %llu bytes\n", header->format_version,
+	  header->num_sections, header->container_size);
+  for (s = 0; s < header->num_sections; s++) {
+    fprintf(printto, "  %-20s offset %14llu  length %14llu  checksum %016llx\n", header->sections[s].name,
+	    header->sections[s].offset, header->sections[s].length, header->sections[s].checksum);
+  }
+}
@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// A QBASHER index container (QBASH.qbx) is a single file holding the .forward, .if, .vocab and
+// .doctable files of an index, plus any sidecar files, as page-aligned sections.  The first page
+// is a binary header and table of contents.  Each section is an exact copy of the original file,
+// so pointers into a single mapping of the container can be used exactly as if the files had been
+// mapped individually.  Sections are looked up by name (normally the original file suffix, e.g. ".if")
+// so that new sections can be added without changing the format.
+//
+// All binary fields are little-endian.  Checksums are 64-bit FNV-1a.
+
+#define QBX_MAGIC "QBASHQBX"
+#define QBX_FORMAT_VERSION 1
+#define QBX_PAGE_SIZE 4096
+#define QBX_MAX_SECTIONS 64
+#define QBX_MAX_SECTION_NAME 24
+#define QBX_SUFFIX ".qbx"
+
+typedef struct {
+  char name[QBX_MAX_SECTION_NAME];  // Null terminated
+  u_ll offset;     // From the start of the container.  Always a multiple of QBX_PAGE_SIZE.
+  u_ll length;     // Not including padding up to the next page boundary.
+  u_ll checksum;   // FNV-1a over the length bytes of the section
+} qbx_section_t;
+
+
+typedef struct {
+  char magic[8];     // QBX_MAGIC, not null terminated
+  u_int format_version, num_sections;
+  u_ll container_size;
+  u_ll toc_checksum;  // FNV-1a over sections[0 .. num_sections - 1]
+  qbx_section_t sections[QBX_MAX_SECTIONS];
+} qbx_header_t;     // Must fit in QBX_PAGE_SIZE bytes
+
+
+int qbx_pack(u_char *container_name, u_char **fnames, u_char **section_names, int num_sections, BOOL verbose);
+
+int qbx_check_header(byte *container, size_t sighs);
+
+int qbx_verify_checksums(byte *container, BOOL verbose);
+
+byte *qbx_find_section(byte *container, char *name, size_t *length);
+
+void qbx_print_toc(FILE *printto, byte *container);
@@ -47,6 +47,39 @@ static byte utf8_b0_unary[5] = {
 static u_short map_unicode_to_lower[CODE_POINTS_IN_BMP], map_unicode_to_unaccented[CODE_POINTS_IN_BMP];
 
 
+// The conversion arrays above are expanded by initialize_unicode_conversion_arrays() into
+// folding tables which give, for each code point in the BMP, the UTF-8 bytes to be written
+// in its place.  That lets fold_utf8() convert a two or three byte UTF-8 sequence with
+// a single table lookup rather than decoding it with utf8_getchar(), mapping the code point and
+// re-encoding it with utf8_putchar().  There is a third table which lower cases and removes
+// accents at the same time, so that query-time text can be converted in one pass.
+
+typedef struct {
+  byte utf8[3];   // The UTF-8 bytes to be written.  A BMP code point never needs more than 3.
+  byte info;      // Bits 0-1: length of utf8[], bits 2-3: length after lower casing alone,
+                  // bit 7: set if the code point was changed (or for the combined table, if
+                  // an accent was removed.)
+} utf8_fold_t;
+
+#define FOLD_LEN(f) ((f)->info & 3)
+#define FOLD_LOWERED_LEN(f) (((f)->info >> 2) & 3)
+#define FOLD_CHANGED 0x80
+
+// How a folding table treats ASCII characters.  In the first two cases fold_utf8() converts
+// eight ASCII bytes at a time.
+#define ASCII_UNCHANGED 0
+#define ASCII_LOWERED 1
+#define ASCII_OTHER 2
+
+typedef struct {
+  utf8_fold_t map[CODE_POINTS_IN_BMP];
+  byte ascii[128];  // The byte written for each ASCII byte, exactly as the per-character code did.
+  int ascii_treatment;
+} utf8_fold_table_t;
+
+static utf8_fold_table_t fold_to_lower, fold_to_unaccented, fold_to_lower_unaccented;
+
+
 
 // Conversions from CodePage 1252 (based on ISO_8859-1) upper range characters to Unicode.
 // Data from https://en.wikipedia.org/wiki/Windows-1252.  
@@ -198,6 +231,45 @@ void display_ascii_non_tokens() {
 }
 
 
+static void build_fold_table(utf8_fold_table_t *ft, u_short *first_map, u_short *second_map) {
+  // Fill in ft by applying first_map and then, if it's not NULL, second_map to every code point
+  // in the BMP.  Outputs are those of utf8_putchar() so that table lookup gives exactly the
+  // same bytes as the per-character conversion.
+  unicode_t c, first, mapped;
+  u_char buf[4], *end, lowered_len;
+  BOOL changed;
+  int a, lower_ok = TRUE, unchanged_ok = TRUE;
+
+  for (c = 0; c < CODE_POINTS_IN_BMP; c++) {
+    first = first_map[c];
+    lowered_len = (u_char)(utf8_putchar(first, buf) - buf);
+    if (second_map == NULL) {
+      mapped = first;
+      changed = (mapped != c);
+    } else {
+      mapped = second_map[first];
+      changed = (mapped != first);
+    }
+    end = utf8_putchar(mapped, buf);
+    memcpy(ft->map[c].utf8, buf, 3);
+    ft->map[c].info = (byte)(end - buf) | (lowered_len << 2) | (changed ? FOLD_CHANGED : 0);
+  }
+
+  // The per-character code wrote ASCII through a (u_char) cast of the mapping, and when two
+  // mappings were applied in succession, the second one saw the result of the first.
+  for (a = 0; a < 128; a++) {
+    ft->ascii[a] = (u_char)first_map[a];
+    if (second_map != NULL && ft->ascii[a] < 0x80) ft->ascii[a] = (u_char)second_map[ft->ascii[a]];
+    if (a == 0) continue;
+    if (ft->ascii[a] != a) unchanged_ok = FALSE;
+    if (ft->ascii[a] != ((a >= 'A' && a <= 'Z') ? a + ('a' - 'A') : a)) lower_ok = FALSE;
+  }
+  if (unchanged_ok) ft->ascii_treatment = ASCII_UNCHANGED;
+  else if (lower_ok) ft->ascii_treatment = ASCII_LOWERED;
+  else ft->ascii_treatment = ASCII_OTHER;
+}
+
+
 void initialize_unicode_conversion_arrays(BOOL verbose) {
   int c, length_increases = 0, length_decreases = 0;
   // setup pass through mappings and override using statements from the perl.
@@ -237,6 +309,10 @@ void initialize_unicode_conversion_arrays(BOOL verbose) {
     }  
   }
 
+  build_fold_table(&fold_to_lower, map_unicode_to_lower, NULL);
+  build_fold_table(&fold_to_unaccented, map_unicode_to_unaccented, NULL);
+  build_fold_table(&fold_to_lower_unaccented, map_unicode_to_lower, map_unicode_to_unaccented);
+
   if (verbose) printf("Unicode initialisation complete:  %d length increasing transformations suppressed, %d length decreases\n",
 	 length_increases, length_decreases);
 
@@ -257,6 +333,96 @@ static int count_leading_ones_b(byte b) {
 }
 
 
+#define OCTET_HIGH_BITS 0x8080808080808080ULL
+#define OCTET_LOW_BITS 0x0101010101010101ULL
+
+static u_ll lower_case_ascii_octet(u_ll octet) {
+  // octet holds eight ASCII bytes.  Lower case any which are upper case letters.  Adding 0x3F to
+  // a byte sets its top bit iff it's >= 'A', adding 0x25 iff it's > 'Z'.  No carries can occur.
+  u_ll at_least_A = octet + 0x3F3F3F3F3F3F3F3FULL, beyond_Z = octet + 0x2525252525252525ULL;
+  u_ll upper = at_least_A & ~beyond_Z & OCTET_HIGH_BITS;
+  return octet | (upper >> 2);   // 0x80 >> 2 is the 0x20 which distinguishes 'a' from 'A'
+}
+
+
+static size_t fold_utf8(u_char *dest, u_char *src, size_t nbytes, utf8_fold_table_t *ft,
+			BOOL cp1252_conversion, int *characters_changed) {
+  // Convert null-terminated UTF-8 string src into dest using folding table ft.  dest may be the
+  // same as src, since no conversion increases length.  Like strncpy() no more than nbytes bytes
+  // are written, not counting the terminating null which is always written.  Returns the length 
+  // of the result in bytes.
+  //
+  // Runs of ASCII are converted a word at a time, and valid two and three byte UTF-8 sequences
+  // with a single table lookup.  Anything else (four byte sequences, invalid UTF-8 or CP-1252) goes
+  // through utf8_getchar() and utf8_putchar() as before.  nbytes is charged with the length after 
+  // lower casing alone, so that the combined table gives exactly the same result as lower casing
+  // followed by accent removal.
+  u_char *r = src, *w = dest, *next, *start_utf8_seq;
+  size_t room_left = nbytes;
+  int bius;   // Bytes in UTF-8 sequence
+  unicode_t ucs;
+  utf8_fold_t *f;
+  u_ll octet;
+  BOOL bulk_ascii = (ft->ascii_treatment != ASCII_OTHER);
+
+  while (*r && room_left > 0) {
+    if (bulk_ascii && room_left >= 8 && ((size_t)r & 4095) <= 4088) {
+      // A load which doesn't cross a page boundary is safe even if the string ends within it.
+      memcpy(&octet, r, 8);
+      if (!(octet & OCTET_HIGH_BITS) && !((octet - OCTET_LOW_BITS) & OCTET_HIGH_BITS)) {
+	// Eight ASCII bytes, none of them null.
+	if (ft->ascii_treatment == ASCII_LOWERED) octet = lower_case_ascii_octet(octet);
+	memcpy(w, &octet, 8);
+	r += 8;
+	w += 8;
+	room_left -= 8;
+	continue;
+      }
+    }
+
+    if (!(*r & 0x80)) {  // ASCII
+      *w++ = ft->ascii[*r++];
+      room_left--;
+      continue;
+    }
+
+    // This weak test allows us to handle CP-1252.  r marks the start of a UTF-8 sequence of bytes
+    bius = count_leading_ones_b(*r);  // This is the number of bytes in this UTF-8 sequence
+    if (bius > room_left) break;  // Don't copy any of it.
+    f = NULL;
+    if (bius == 2 && (r[1] & 0xC0) == 0x80) {
+      f = ft->map + (((r[0] & 0x1F) << 6) | (r[1] & 0x3F));
+      r += 2;
+    } else if (bius == 3 && (r[1] & 0xC0) == 0x80 && (r[2] & 0xC0) == 0x80) {
+      f = ft->map + (((r[0] & 0x0F) << 12) | ((r[1] & 0x3F) << 6) | (r[2] & 0x3F));
+      r += 3;
+    } else {
+      start_utf8_seq = w;
+      ucs = utf8_getchar(r, &next, cp1252_conversion);
+      r = next;
+      if (ucs > BMP_MASK) { // Make sure not to access beyond the mapping table.
+	w = utf8_putchar(ucs, w);  // Leave these other non-BMP chars alone.
+	room_left -= (w - start_utf8_seq);
+      } 
+      else f = ft->map + ucs;
+    }
+
+    if (f != NULL) {
+      w[0] = f->utf8[0];
+      if (FOLD_LEN(f) > 1) {
+	w[1] = f->utf8[1];
+	if (FOLD_LEN(f) > 2) w[2] = f->utf8[2];
+      }
+      w += FOLD_LEN(f);
+      room_left -= FOLD_LOWERED_LEN(f);
+      if (f->info & FOLD_CHANGED) (*characters_changed)++;
+    }
+  }
+  *w = 0;  // String might be shorter.
+  return (w - dest);
+}
+
+
 //***********************************************************************************
 //                                 API functions
 //***********************************************************************************
@@ -589,25 +755,8 @@ int utf8_remove_accents(u_char *string) {
   //
   // Return value is a count of the characters changed.
   int characters_changed = 0;
-  unicode_t ucs;
-  u_char *r = string, *w = string, *next;
   if (0) printf("utf8_remove_accents(%s)\n", string);
-  while (*r) {
-    if (*r & 0x80) { // This weak test allows us to handle CP-1252 
-      // Since string is UTF-8 r marks the start of a muti-byte UTF-8 sequence
-      ucs = utf8_getchar(r, &next, FALSE); 
-      r = next;
-      if (ucs > BMP_MASK) { // Make sure not to access beyond the mapping table.
-	w = utf8_putchar(ucs, w);  // Leave these other non-BMP chars alone.
-      } else {
-	w = utf8_putchar(map_unicode_to_unaccented[ucs], w);
-	if (ucs != map_unicode_to_unaccented[ucs]) characters_changed++;
-      }
-    } else {
-      *w++ = (u_char)map_unicode_to_unaccented[*r++];  // Shouldn't change anything
-    }
-  }
-  *w = 0;  // String might be shorter.
+  fold_utf8(string, string, (size_t)-1, &fold_to_unaccented, FALSE, &characters_changed);
   return characters_changed;
 }
 
@@ -616,26 +765,8 @@ int utf8_lower_case(u_char *string) {
   // In-place lower casing from null-terminated UTF-8 string.  Note that the function
   // which initialises the unicode mapping tables removes any length-increasing mapping.
   // Returns the length of the result in bytes.  It might be shorter.
-  int len = 0;
-  unicode_t ucs;
-  u_char *r = string, *w = string, *next;
-  while (*r) {
-    if (*r & 0x80) { // This weak test allows us to handle CP-1252 
-      // Since string is UTF-8 this r marks the start of a UTF-8 string
-      ucs = utf8_getchar(r, &next, FALSE);
-      if (ucs > BMP_MASK) { // Make sure not to access beyond the mapping table.
-	w = utf8_putchar(ucs, w);  // Leave these other non-BMP chars alone.
-      } else {
-	w = utf8_putchar(map_unicode_to_lower[ucs], w);
-      }
-      r = next;
-    } else {
-      *w++ = (u_char)map_unicode_to_lower[*r++];  // No risk here.
-    }
-  }
-  *w = 0;  // String might be shorter.
-  len = (int)( w - string);
-  return len;
+  int ignore = 0;
+  return (int)fold_utf8(string, string, (size_t)-1, &fold_to_lower, FALSE, &ignore);
 }
 
 
@@ -644,27 +775,8 @@ size_t utf8_lowering_copy(u_char *dest, u_char *src) {
   // which initialises the unicode mapping tables removes any length-increasing mapping.
   // Callers responsibility to ensure that dest is at least strlen(src) + 1 bytes long
   // Returns the length of the result in bytes.  It might be shorter.
-  size_t len = 0;
-  unicode_t ucs;
-  u_char *r = src, *w = dest, *next;
-
-  while (*r) {
-    if (*r & 0x80) { // This weak test allows us to handle CP-1252
-      // Since string is UTF-8 this r marks the start of a UTF-8 string
-      ucs = utf8_getchar(r, &next, FALSE);   // Avoid potential length increases from CP-1252
-      if (ucs > BMP_MASK) { // Make sure not to access beyond the mapping table.
-        w = utf8_putchar(ucs, w);  // Leave these other non-BMP chars alone.
-      } else {
-        w = utf8_putchar(map_unicode_to_lower[ucs], w);
-      }
-      r = next;
-    } else {
-      *w++ = (u_char)map_unicode_to_lower[*r++];  // No risk here.
-    }
-  }
-  *w = 0;  // String might be shorter.
-  len = (int)(w - dest);
-  return len;
+  int ignore = 0;
+  return fold_utf8(dest, src, (size_t)-1, &fold_to_lower, FALSE, &ignore);
 }
 
 
@@ -676,38 +788,31 @@ size_t utf8_lowering_ncopy(u_char *dest, u_char *src, size_t nbytes) {
   // Callers responsibility to ensure that dest is at least nbytes bytes long
   // Returns the length of the result in bytes.
   //
-  // Coding this is a little tricky because the nbytes cutoff could fall in the
+  // fold_utf8() takes care of the case where the nbytes cutoff falls in the
   // middle of a UTF-8 sequence.
-  size_t len = 0, room_left = nbytes;
-  unicode_t ucs;
-  u_char *r = src, *w = dest, *next, *start_utf8_seq = NULL;
-  int bius = 0;  // Bytes in UTF-8 sequence
+  int ignore = 0;
+  return fold_utf8(dest, src, nbytes, &fold_to_lower, TRUE, &ignore);
+}
 
-  while (*r && room_left > 0) {
-    if (*r & 0x80) { // This weak test allows us to handle CP-1252 
-      // Since string is UTF-8 this r marks the start of a UTF-8 sequence of bytes
-      start_utf8_seq = w;
-      bius = count_leading_ones_b(*r);  // This is the number of bytes in this UTF-8 sequence
-      if (bius > room_left) {
-	*w = 0;  // Don't copy any of it.
-	return (w - dest);   // -------------------------->
-      }
-      ucs = utf8_getchar(r, &next, TRUE);
-      if (ucs > BMP_MASK) { // Make sure not to access beyond the mapping table.
-	w = utf8_putchar(ucs, w);  // Leave these other non-BMP chars alone.
-      } else {
-	w = utf8_putchar(map_unicode_to_lower[ucs], w);
-      }
-      r = next;
-      room_left -= (w - start_utf8_seq);  // Have to do it this way in case lower casing reduces width
-    } else {  // ASCII
-      *w++ = (u_char)map_unicode_to_lower[*r++];  // No risk here.
-      room_left--;
-    }
-  }
-  *w = 0;  // String might be shorter.
-  len = (w - dest);
-  return len;
+
+size_t utf8_lowering_unaccenting_ncopy(u_char *dest, u_char *src, size_t nbytes) {
+  // Equivalent to utf8_lowering_ncopy() followed by utf8_remove_accents() on dest, but
+  // done in a single pass.
+  int ignore = 0;
+  return fold_utf8(dest, src, nbytes, &fold_to_lower_unaccented, TRUE, &ignore);
+}
+
+
+unicode_t unicode_to_lower(unicode_t ucs) {
+  // Per-character access to the mapping, e.g. for checking the UTF-8 functions.
+  if (ucs > BMP_MASK) return ucs;
+  return map_unicode_to_lower[ucs];
+}
+
+
+unicode_t unicode_to_unaccented(unicode_t ucs) {
+  if (ucs > BMP_MASK) return ucs;
+  return map_unicode_to_unaccented[ucs];
 }
 
 
@@ -63,6 +63,12 @@ size_t utf8_lowering_copy(u_char *dest, u_char *src);
 
 size_t utf8_lowering_ncopy(u_char *dest, u_char *src, size_t nbytes);
 
+size_t utf8_lowering_unaccenting_ncopy(u_char *dest, u_char *src, size_t nbytes);
+
+unicode_t unicode_to_lower(unicode_t ucs);
+
+unicode_t unicode_to_unaccented(unicode_t ucs);
+
 BOOL utf8_contains_accented(byte *s);
 
 int utf8_remove_accents(u_char *string);
@@ -1,6 +1,10 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT license.
 
+#ifndef WIN64
+#define _DEFAULT_SOURCE   // For madvise() and getrusage() under -std=c11
+#endif
+
 #ifdef WIN64
 #include <tchar.h>
 #include <strsafe.h>
@@ -10,6 +14,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #endif
 
 #include <stdio.h>
@@ -149,6 +154,61 @@ void report_memory_usage(FILE *printto, u_char *msg, DWORD *pagefaultcount) {
 #endif
 
 
+#ifndef WIN64
+static BOOL rlc_initialized = FALSE;   // RMU = Report Memory Usage
+static double rmu_last_clock;
+
+void report_memory_usage(FILE *printto, u_char *msg, DWORD *pagefaultcount) {
+  // Linux equivalent of the Windows version above, using getrusage().  There is no
+  // GetProcessMemoryInfo() so we report what the kernel keeps per process: soft and hard
+  // page faults and the peak resident set size (in kB).
+  // If pagefaultcount isn't NULL, return the current pagefaultcount (soft + hard).
+  struct rusage ru;
+  double now;
+
+  if (!rlc_initialized) {
+    rlc_initialized = TRUE;
+    rmu_last_clock = what_time_is_it();
+  }
+  now = what_time_is_it();
+  getrusage(RUSAGE_SELF, &ru);
+  if (pagefaultcount != NULL) *pagefaultcount = (DWORD)(ru.ru_minflt + ru.ru_majflt);
+  fprintf(printto, "----------- Memory Usage Summary (%s %.3f sec. since previous summary) -----------\n"
+	  "   Page fault count: %ld (soft %ld, hard %ld)\n"
+	  "   Peak resident set size: %ld kB  -- %.1fMB\n"
+	  "-------------------------------------------------------\n\n",
+	  msg,
+	  now - rmu_last_clock,
+	  ru.ru_minflt + ru.ru_majflt,
+	  ru.ru_minflt,
+	  ru.ru_majflt,
+	  ru.ru_maxrss,
+	  (double)ru.ru_maxrss / 1024.0
+	  );
+  rmu_last_clock = now;
+}
+#endif
+
+
+long long get_page_fault_count() {
+  // Return the total number of page faults (soft + hard) incurred by this process so far.
+  // Used to attribute page faults to individual queries or processing phases.
+#ifdef WIN64
+#ifdef QBASHER_LITE
+  return 0;
+#else
+  PROCESS_MEMORY_COUNTERS m;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &m, (DWORD)sizeof(m))) return 0;
+  return (long long)m.PageFaultCount;
+#endif
+#else
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru)) return 0;
+  return (long long)(ru.ru_minflt + ru.ru_majflt);
+#endif
+}
+
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //  Functions dealing with file i/o and memory mapping
@@ -478,6 +538,56 @@ void *mmap_all_of(u_char *fname, size_t *sighs, BOOL verbose, CROSS_PLATFORM_FIL
 }
 
 
+u_char *access_hint_names[] = {
+  // Must be kept in step with the access_hint_t enum in utility_nodeps.h
+  (u_char *)"none",
+  (u_char *)"random",
+  (u_char *)"sequential",
+  (u_char *)"hugepage",
+  (u_char *)"willneed"
+};
+
+
+int apply_access_hint(void *start, size_t length, access_hint_t hint) {
+  // Tell the kernel how we expect to access length bytes of a memory mapping starting at
+  // start.  start need not be page aligned -- it is rounded down to the start of its page.
+  // On Linux this is a call to madvise().  Windows has no direct equivalent for a
+  // file mapping (apart from PrefetchVirtualMemory() for WILLNEED) so hints are ignored there.
+  //
+  // Return 0 on success or if the hint is ignored, otherwise a negative error code.
+  // Failure is not fatal:  the mapping is still perfectly usable.
+#ifdef WIN64
+  return 0;
+#else
+  static long pagesize = 0;
+  byte *aligned;
+  int advice;
+
+  if (hint == ACCESS_HINT_NONE || start == NULL || length == 0) return 0;
+  if (pagesize == 0) pagesize = sysconf(_SC_PAGESIZE);
+  aligned = (byte *)((size_t)start & ~((size_t)pagesize - 1));
+  length += (byte *)start - aligned;
+
+  switch (hint) {
+  case ACCESS_HINT_RANDOM: advice = MADV_RANDOM; break;
+  case ACCESS_HINT_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+  case ACCESS_HINT_WILLNEED: advice = MADV_WILLNEED; break;
+  case ACCESS_HINT_HUGEPAGE:
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages.  Only honoured for file mappings if the kernel was built
+    // with CONFIG_READ_ONLY_THP_FOR_FS, otherwise madvise() fails with EINVAL.
+    advice = MADV_HUGEPAGE; break;
+#else
+    return -130084;
+#endif
+  default: return -130084;
+  }
+  if (madvise(aligned, length, advice)) return -130084;
+  return 0;
+#endif
+}
+
+
 void unmmap_all_of(void *inmem, CROSS_PLATFORM_FILE_HANDLE H, HANDLE MH, size_t length) {
   // Note MH is only used on Windows and length is only used on Unix-like systems.
 #ifdef WIN64
@@ -578,9 +688,105 @@ void Privilege(TCHAR* pszPrivilege, BOOL bEnable, BOOL *x_use_large_pages, size_
 
 #endif
 
+#ifndef WIN64
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Linux huge pages.  lp_malloc() first tries to take explicit huge pages from the pool reserved by the                //
+// administrator (vm.nr_hugepages) using MAP_HUGETLB.  If the pool can't supply them, it falls back to an             //
+// anonymous mapping aligned to the huge page size and asks for transparent huge pages with MADV_HUGEPAGE.             //
+// Requests smaller than a huge page are just malloc()ed.  lp_free() must be given the size that was requested so     //
+// that it can tell whether the memory was mapped, and how much to unmap.                                             //
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static size_t lp_hugetlb_bytes = 0, lp_thp_advised_bytes = 0;   // Totals ever allocated by each method
+
+
+size_t get_huge_page_size() {
+  // The default huge page size, from /proc/meminfo.  2MB if it can't be determined.
+  static size_t huge_page_size = 0;
+  FILE *MI;
+  char line[200];
+  unsigned long long kB;
+  if (huge_page_size > 0) return huge_page_size;
+  huge_page_size = 2 * 1048576;
+  MI = fopen("/proc/meminfo", "rb");
+  if (MI == NULL) return huge_page_size;   // ----------------------------------->
+  while (fgets(line, sizeof(line), MI) != NULL) {
+    if (sscanf(line, "Hugepagesize: %llu kB", &kB) == 1) {
+      if (kB > 0) huge_page_size = (size_t)kB * 1024;
+      break;
+    }
+  }
+  fclose(MI);
+  return huge_page_size;
+}
+
+
+static long long proc_self_kB(char *fname, char *field) {
+  // Look for a line "<field>:  <n> kB" in /proc/self/<fname> and return n, or -1 if not found.
+  FILE *PF;
+  char line[200], path[100];
+  size_t fl = strlen(field);
+  long long kB = -1;
+  sprintf(path, "/proc/self/%s", fname);
+  PF = fopen(path, "rb");
+  if (PF == NULL) return -1;   // ----------------------------------->
+  while (fgets(line, sizeof(line), PF) != NULL) {
+    if (!strncmp(line, field, fl) && line[fl] == ':') {
+      kB = strtoll(line + fl + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(PF);
+  return kB;
+}
+#endif
+
+
+void lp_report_usage(FILE *printto) {
+  // Report how much of the memory allocated by lp_malloc() has actually landed on large pages.
+#ifndef WIN64
+  long long hugetlb_kB = proc_self_kB("status", "HugetlbPages"),
+    thp_kB = proc_self_kB("smaps_rollup", "AnonHugePages");
+  fprintf(printto, "Large pages: %.1fMB obtained with MAP_HUGETLB, %.1fMB with MADV_HUGEPAGE (huge page size %zuKB).\n",
+	  (double)lp_hugetlb_bytes / 1048576.0, (double)lp_thp_advised_bytes / 1048576.0, get_huge_page_size() / 1024);
+  if (hugetlb_kB >= 0) fprintf(printto, "    Currently mapped hugetlb pages:  %.1fMB\n", (double)hugetlb_kB / 1024.0);
+  if (thp_kB >= 0) fprintf(printto, "    Currently on transparent huge pages:  %.1fMB\n", (double)thp_kB / 1024.0);
+#endif
+}
+
+
+#ifndef WIN64
+static void *huge_page_mmap(size_t how_many_bytes, size_t huge_page_size) {
+  // how_many_bytes is a multiple of huge_page_size.  Return NULL on failure.
+  byte *rslt = MAP_FAILED, *aligned;
+  size_t head;
+#ifdef MAP_HUGETLB
+  rslt = (byte *)mmap(NULL, how_many_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (rslt != MAP_FAILED) {
+    __sync_fetch_and_add(&lp_hugetlb_bytes, how_many_bytes);
+    return rslt;   // ----------------------------------->
+  }
+#endif
+  // Over-allocate so that the mapping can be trimmed to huge page boundaries.  Transparent 
+  // huge pages can only back aligned ranges.
+  rslt = (byte *)mmap(NULL, how_many_bytes + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (rslt == MAP_FAILED) return NULL;   // ----------------------------------->
+  aligned = (byte *)(((size_t)rslt + huge_page_size - 1) & ~(huge_page_size - 1));
+  head = aligned - rslt;
+  if (head > 0) munmap(rslt, head);
+  munmap(aligned + how_many_bytes, huge_page_size - head);
+#ifdef MADV_HUGEPAGE
+  if (madvise(aligned, how_many_bytes, MADV_HUGEPAGE) == 0)
+    __sync_fetch_and_add(&lp_thp_advised_bytes, how_many_bytes);
+#endif
+  return aligned;
+}
+#endif
+
+
 void *lp_malloc(size_t how_many_bytes, BOOL x_use_large_pages, size_t large_page_minimum) {
   // Use either malloc or virtualalloc() (with LARGE PAGES) depending upon the setting of the global
-  // x_use_large_pages
+  // x_use_large_pages.  On Linux, large_page_minimum is ignored and huge pages are used as described above.
 
   void *rslt;
 #ifdef WIN64
@@ -605,13 +811,21 @@ void *lp_malloc(size_t how_many_bytes, BOOL x_use_large_pages, size_t large_page
     }
   }
   else 
+#else
+  size_t huge_page_size = get_huge_page_size();
+  if (x_use_large_pages && how_many_bytes >= huge_page_size) {
+    how_many_bytes = ((how_many_bytes + huge_page_size - 1) / huge_page_size) * huge_page_size;
+    rslt = huge_page_mmap(how_many_bytes, huge_page_size);
+  }
+  else
 #endif	
     rslt = malloc(how_many_bytes);
   return rslt;
 }
 
 
-void lp_free(void *memory_to_free, BOOL x_use_large_pages) {
+void lp_free(void *memory_to_free, size_t how_many_bytes, BOOL x_use_large_pages) {
+  // how_many_bytes must be the size originally passed to lp_malloc().  (It's ignored on Windows.)
 #ifdef WIN64
   if (x_use_large_pages) {
     BOOL success = VirtualFree(
@@ -623,6 +837,13 @@ void lp_free(void *memory_to_free, BOOL x_use_large_pages) {
     }
   }
   else 
+#else
+  size_t huge_page_size = get_huge_page_size();
+  if (x_use_large_pages && how_many_bytes >= huge_page_size) {
+    how_many_bytes = ((how_many_bytes + huge_page_size - 1) / huge_page_size) * huge_page_size;
+    if (munmap(memory_to_free, how_many_bytes)) printf("munmap failed in lp_free(): %s\n", strerror(errno));
+  }
+  else
 #endif	
     free(memory_to_free);
 }
@@ -66,10 +66,15 @@ typedef DWORD *LPDWORD;
 #endif
 
 #if defined(WIN64) && !defined(QBASHER_LITE)
-void report_memory_usage(FILE *printto, u_char *msg, DWORD *pagefaultcount);
 void set_cpu_affinity(u_int cpu);
 #endif
 
+#ifndef QBASHER_LITE
+void report_memory_usage(FILE *printto, u_char *msg, DWORD *pagefaultcount);
+#endif
+
+long long get_page_fault_count();
+
 
 double what_time_is_it();
 
@@ -114,6 +119,26 @@ void *mmap_all_of(u_char *fname, size_t *sighs, BOOL verbose, CROSS_PLATFORM_FIL
 
 void unmmap_all_of(void *inmem, CROSS_PLATFORM_FILE_HANDLE H, HANDLE MH, size_t length);
 
+// Hints about how a memory mapped file (or part of one) will be accessed. (madvise() on Linux)
+typedef enum {
+  ACCESS_HINT_NONE,
+  ACCESS_HINT_RANDOM,
+  ACCESS_HINT_SEQUENTIAL,
+  ACCESS_HINT_HUGEPAGE,
+  ACCESS_HINT_WILLNEED
+} access_hint_t;
+
+extern u_char *access_hint_names[];
+
+int apply_access_hint(void *start, size_t length, access_hint_t hint);
+
+// Ask for the cache line containing addr to be fetched, without waiting for it.  Never faults.
+#ifdef WIN64
+#define PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+#else
+#define PREFETCH(addr) __builtin_prefetch((const void *)(addr))
+#endif
+
 byte **load_all_lines_from_textfile(u_char *fname, int *line_count, CROSS_PLATFORM_FILE_HANDLE *H,
 				    HANDLE *MH, byte **file_in_mem, size_t *sighs);
 
@@ -124,9 +149,15 @@ void unload_all_lines_from_textfile(CROSS_PLATFORM_FILE_HANDLE H, HANDLE MH, byt
 void Privilege(TCHAR* pszPrivilege, BOOL bEnable, BOOL *x_use_large_pages, size_t *large_page_minimum);
 #endif
 
+#ifndef WIN64
+size_t get_huge_page_size();
+#endif
+
 void *lp_malloc(size_t how_many_bytes, BOOL x_use_large_pages, size_t large_page_minimum);
 
-void lp_free(void *memory_to_free, BOOL x_use_large_pages);
+void lp_free(void *memory_to_free, size_t how_many_bytes, BOOL x_use_large_pages);
+
+void lp_report_usage(FILE *printto);
 
 void *cmalloc(size_t s, u_char *msg, BOOL verbose);
 
@@ -56,6 +56,21 @@
 //             need for insertion, because of (i).
 //     d. Doubling requires an exclusive lock (no lookups, no other inserts, no other doubling)
 //
+//  5. Alternatively, if the probing method is DAHASH_PROBE_GROUPS when the table is created, entries
+//     are organised in aligned groups of DAHASH_GROUP_SIZE (16), in the style of the "Swiss table".
+//     A separate control array holds one byte per entry: DAHASH_CTRL_EMPTY or a 7-bit fingerprint
+//     taken from the key's hash.  A lookup compares the fingerprint against all the control bytes 
+//     of a group at once (with SSE2 where available) and only calls strcmp() on the entries whose
+//     fingerprints match.  If the group has an empty entry, the search stops there; otherwise
+//     groups are probed with triangular steps, which visit every group when the number of groups
+//     is a power of two.  The full hash of each key is also kept, so that doubling places the old
+//     entries in the new table without hashing or comparing any keys.  The layout of the entries
+//     themselves is unchanged, so code which scans ht->table for non-empty keys still works.
+//
+//     Doubling is still done all at once rather than incrementally, because callers hold pointers 
+//     to values and scan ht->table directly, and neither would be valid while entries were spread 
+//     across two tables.
+//
 //     ERROR HANDLING:  This code is written for a demo.  No fault tolerance or error recovery 
 //     is required.  Hence an error exit is taken whenever any error condition is detected.
 
@@ -70,6 +85,15 @@
 #include "../imported/Fowler-Noll-Vo-hash/fnv.h"
 #include "dahash.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DAHASH_SSE2
+#endif
+
+static int probing_method = DAHASH_PROBE_RPR;
+static BOOL large_pages = FALSE;
+static size_t large_page_minimum = 0;
+
 dahash_table_t *dahash_create(u_char *name, int bits, size_t key_len, size_t val_size,
 			      double max_full_frac, BOOL verbose) {
   // Create and return the control block for a hash table.  Allocate and clear the memory for
@@ -99,6 +123,9 @@ dahash_table_t *dahash_create(u_char *name, int bits, size_t key_len, size_t val
   ht->entries_used = 0;
   ht->times_doubled = 0;
   ht->collisions = 0;
+  ht->ctrl = NULL;
+  ht->hashes = NULL;
+  ht->large_pages = large_pages;
 	
   if (max_full_frac < 0.01 || max_full_frac > 0.99) {
     printf("Error: dahash_create(): max_full_frac was %f but should lie between 0.01 and 0.99\n", max_full_frac);
@@ -107,12 +134,27 @@ dahash_table_t *dahash_create(u_char *name, int bits, size_t key_len, size_t val
   ht->max_full_frac = max_full_frac;
 
   // Allocate the power of two table
-  ht->table = lp_malloc(entsize * table_ents, FALSE, 0);    // Freed by dahash_destroy()
+  ht->table = lp_malloc(entsize * table_ents, ht->large_pages, large_page_minimum);    // Freed by dahash_destroy()
   if (ht->table == NULL)	{
     printf("Error: dahash_table(): Failed to malloc ht->table\n");
     exit(1);
   }
   memset(ht->table, 0, entsize * table_ents);
+
+  if (probing_method == DAHASH_PROBE_GROUPS) {
+    if (table_ents < DAHASH_GROUP_SIZE) {
+      printf("Error: dahash_create(): Tables probed in groups need at least %d entries (%d bits), but bits = %d\n",
+	     DAHASH_GROUP_SIZE, DAHASH_GROUP_BITS, bits);
+      exit(1);
+    }
+    ht->ctrl = (byte *)malloc(table_ents);   // Freed by dahash_destroy()
+    ht->hashes = (unsigned long long *)lp_malloc(table_ents * sizeof(unsigned long long), ht->large_pages, large_page_minimum);    // Freed by dahash_destroy()
+    if (ht->ctrl == NULL || ht->hashes == NULL) {
+      printf("Error: dahash_create(): Failed to malloc ht->ctrl or ht->hashes\n");
+      exit(1);
+    }
+    memset(ht->ctrl, DAHASH_CTRL_EMPTY, table_ents);
+  }
   if (verbose) printf("Hash table %s created. (Bits = %d.) Memory allocated: %zu * %zu = %.1fMB\n",
 	 name, ht->bits, table_ents, entsize, (double)(entsize * table_ents) /1048576.0);
   return ht;
@@ -122,7 +164,9 @@ dahash_table_t *dahash_create(u_char *name, int bits, size_t key_len, size_t val
 void dahash_destroy(dahash_table_t **ht) {
   // Free memory associated with *ht and set *ht to NULL.
   if (*ht == NULL) return;
-  if ((*ht)->table != NULL) lp_free((*ht)->table, FALSE);
+  if ((*ht)->table != NULL) lp_free((*ht)->table, (*ht)->entry_size * (*ht)->capacity, (*ht)->large_pages);
+  if ((*ht)->ctrl != NULL) free((*ht)->ctrl);
+  if ((*ht)->hashes != NULL) lp_free((*ht)->hashes, (*ht)->capacity * sizeof(unsigned long long), (*ht)->large_pages);
   free(*ht);
   *ht = NULL;
 }
@@ -141,6 +185,70 @@ static unsigned long long dahash(byte *key) {
 }
 
 
+static u_int group_match(byte *ctrl, byte b) {
+  // Return a mask with bit i set if ctrl[i] == b, for i in 0 .. DAHASH_GROUP_SIZE - 1
+#ifdef DAHASH_SSE2
+  __m128i group = _mm_loadu_si128((__m128i *)ctrl);
+  return (u_int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)b)));
+#else
+  u_int mask = 0;
+  int i;
+  for (i = 0; i < DAHASH_GROUP_SIZE; i++) if (ctrl[i] == b) mask |= (1U << i);
+  return mask;
+#endif
+}
+
+
+static int lowest_bit(u_int mask) {
+  // mask must be non-zero
+#ifdef WIN64
+  unsigned long i;
+  _BitScanForward(&i, mask);
+  return (int)i;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+
+static size_t first_empty_in_probe_sequence(dahash_table_t *ht, unsigned long long hash) {
+  // Used when it's known that the key isn't in the table.
+  size_t g, step = 0, group_mask = (ht->capacity >> DAHASH_GROUP_BITS) - 1;
+  u_int mask;
+  g = (size_t)(hash >> 7) & group_mask;
+  while ((mask = group_match(ht->ctrl + (g << DAHASH_GROUP_BITS), DAHASH_CTRL_EMPTY)) == 0) {
+    step++;
+    g = (g + step) & group_mask;
+  }
+  return (g << DAHASH_GROUP_BITS) + lowest_bit(mask);
+}
+
+
+static void dahash_double_groups(dahash_table_t *ht, size_t old_capacity, void *old_table) {
+  // Move the entries of old_table into the (empty, already doubled) ht->table, using the 
+  // hashes cached in ht->hashes to find their new positions.
+  byte *old_ctrl = ht->ctrl;
+  unsigned long long *old_hashes = ht->hashes;
+  size_t e, slot;
+
+  ht->ctrl = (byte *)malloc(ht->capacity);
+  ht->hashes = (unsigned long long *)lp_malloc(ht->capacity * sizeof(unsigned long long), ht->large_pages, large_page_minimum);
+  if (ht->ctrl == NULL || ht->hashes == NULL) {
+    printf("Error: dahash_double(): Failed to malloc ht->ctrl or ht->hashes\n");
+    exit(1);
+  }
+  memset(ht->ctrl, DAHASH_CTRL_EMPTY, ht->capacity);
+  for (e = 0; e < old_capacity; e++) {
+    if (old_ctrl[e] == DAHASH_CTRL_EMPTY) continue;
+    slot = first_empty_in_probe_sequence(ht, old_hashes[e]);
+    memcpy((byte *)ht->table + slot * ht->entry_size, (byte *)old_table + e * ht->entry_size, ht->entry_size);
+    ht->ctrl[slot] = old_ctrl[e];
+    ht->hashes[slot] = old_hashes[e];
+  }
+  free(old_ctrl);
+  lp_free(old_hashes, old_capacity * sizeof(unsigned long long), ht->large_pages);
+}
+
 
 static void dahash_double(dahash_table_t *ht) {
   // double the capacity of ht, and hash the old entries into the new
@@ -164,7 +272,7 @@ static void dahash_double(dahash_table_t *ht) {
   table_ents = 1ULL << ht->bits;
   old_capacity = ht->capacity;
   ht->capacity = table_ents;
-  new_table = (void *)lp_malloc(ht->entry_size * table_ents, FALSE, 0);
+  new_table = (void *)lp_malloc(ht->entry_size * table_ents, ht->large_pages, large_page_minimum);
   // Old table freed later in this function
   if (new_table == NULL)	{
     printf("Error: dahash_table(): Failed to malloc ht->table\n");
@@ -176,32 +284,103 @@ static void dahash_double(dahash_table_t *ht) {
   // Future: Obtain exclusive lock on ht.
   old_table = ht->table;
   ht->table = new_table;
-  // Rehash all the items in the original table into the bigger one
-  idx_off = 0;
-  ht->entries_used = 0;
-  for (e = 0; e < old_capacity; e++) {
-    if (((byte *)old_table)[idx_off])  {
-      // If first byte of key is non-null, this slot is unused
-      byte *val;
-      val = (byte *)dahash_lookup(ht, (byte *)old_table + idx_off, 1);
-      memcpy(val, (byte *)old_table + idx_off + ht->key_size, ht->val_size);
+  if (ht->ctrl != NULL) dahash_double_groups(ht, old_capacity, old_table);
+  else {
+    // Rehash all the items in the original table into the bigger one
+    idx_off = 0;
+    ht->entries_used = 0;
+    for (e = 0; e < old_capacity; e++) {
+      if (((byte *)old_table)[idx_off])  {
+	// If first byte of key is non-null, this slot is unused
+	byte *val;
+	val = (byte *)dahash_lookup(ht, (byte *)old_table + idx_off, 1);
+	memcpy(val, (byte *)old_table + idx_off + ht->key_size, ht->val_size);
+      }
+      idx_off += ht->entry_size;
     }
-    idx_off += ht->entry_size;
   }
-  lp_free(old_table, FALSE);
+  lp_free(old_table, ht->entry_size * old_capacity, ht->large_pages);
   ht->times_doubled++;
   printf("Dahash: Hash table capacity doubled to %zu entries.  Used: %zu\n",
 	 ht->capacity, ht->entries_used);
 }
 
 
-static int probing_method = 0;  // 0 - means relatively prime rehash,  1 - means linear
-
 void dahash_set_probing_method(int method) {
   probing_method = method;
 }
 
 
+void dahash_set_large_pages(BOOL use_large_pages, size_t lp_minimum) {
+  large_pages = use_large_pages;
+  large_page_minimum = lp_minimum;
+}
+
+
+
+static void *dahash_lookup_groups(dahash_table_t *ht, byte *key, int insert_flag) {
+  // The DAHASH_PROBE_GROUPS equivalent of the probing part of dahash_lookup().
+  unsigned long long hash = dahash(key);
+  size_t g, slot, step = 0, group_mask = (ht->capacity >> DAHASH_GROUP_BITS) - 1;
+  byte fingerprint = (byte)(hash & 0x7F), *ctrl, *entry;
+  u_int mask;
+
+  g = (size_t)(hash >> 7) & group_mask;
+  while (1) {
+    ctrl = ht->ctrl + (g << DAHASH_GROUP_BITS);
+    mask = group_match(ctrl, fingerprint);
+    while (mask) {
+      slot = (g << DAHASH_GROUP_BITS) + lowest_bit(mask);
+      entry = (byte *)ht->table + slot * ht->entry_size;
+      if (!strcmp((char *)key, (char *)entry)) {
+	// It's a hit.
+	return entry + ht->key_size;    // ------------------------------------>
+      }
+      mask &= mask - 1;
+    }
+    mask = group_match(ctrl, DAHASH_CTRL_EMPTY);
+    if (mask) break;   // The key would have been in this group if it were in the table.
+    step++;
+    g = (g + step) & group_mask;
+    ht->collisions++;
+  }
+
+  if (!insert_flag) return NULL;   // ------------------------------------>
+
+  slot = (g << DAHASH_GROUP_BITS) + lowest_bit(mask);
+  entry = (byte *)ht->table + slot * ht->entry_size;
+  strcpy((char *)entry, (char *)key);
+  ht->ctrl[slot] = fingerprint;
+  ht->hashes[slot] = hash;
+  ht->entries_used++;
+  if ((double)(ht->entries_used) / (double)(ht->capacity) > ht->max_full_frac) {
+    dahash_double(ht);
+    // After doubling, the index for the just-added key has changed
+    return dahash_lookup_groups(ht, key, 0); // find it again.
+  }
+  return entry + ht->key_size;
+}
+
+
+size_t dahash_truncate_key(byte *key, size_t key_len) {
+  // Truncate key in place to at most key_len bytes, as dahash_lookup() does with overlong keys.
+  // Return the resulting key length, or zero (leaving key untouched) if truncation would have
+  // left nothing.
+  size_t kl = strlen((char *)key);
+  if (kl > key_len)  {
+    // Truncate overlong key taking care not to garble UTF-8 characters
+    kl = key_len;
+    // If the two most significant (MS) bits of the byte we want to null out are 10
+    // then this is a UTF-8 continuation byte and we must go further back to 
+    // find the UTF-8 start byte (MS bits == 11). If the MS bits are 00 or 01 then 
+    // the character is a single byte.
+    while ((key[kl] & 0xC0) == 0x80 && kl) kl--;
+    if (kl == 0) return 0;   // ------------------------------------>
+    key[kl] = 0;
+  }
+  return kl;
+}
+
 
 void *dahash_lookup(dahash_table_t *ht, byte *key, int insert_flag) {
   // Lookup key in ht.
@@ -225,24 +404,15 @@ void *dahash_lookup(dahash_table_t *ht, byte *key, int insert_flag) {
     printf("Error: dahash_lookup(): attempt to lookup key %s in NULL table.\n", key);
     return NULL;
   }
-  kl = strlen((char *)key);
-  
-  if (kl > (ht->key_size - 1))  {
-    // Truncate overlong key taking care not to garble UTF-8 characters
-    kl = ht->key_size - 1;
-    // If the two most significant (MS) bits of the byte we want to null out are 10
-    // then this is a UTF-8 continuation byte and we must go further back to 
-    // find the UTF-8 start byte (MS bits == 11). If the MS bits are 00 or 01 then 
-    // the character is a single byte.
-    while ((key[kl] & 0xC0) == 0x80 && kl) kl--;
-    if (kl == 0) {
-      printf("Error: dahash_lookup(): Attempt to lookup key which became empty after UTF-8 truncation.\n");
-      return NULL;
-    }
-    key[kl] = 0;
+  kl = dahash_truncate_key(key, ht->key_size - 1);
+  if (kl == 0) {
+    printf("Error: dahash_lookup(): Attempt to lookup key which became empty after UTF-8 truncation.\n");
+    return NULL;
   }
+  if (ht->ctrl != NULL) return dahash_lookup_groups(ht, key, insert_flag);    // ------------------------------------>
+
   index = (dahash(key) % ht->capacity);
-  if (probing_method != 0) rehash_step = 1;  //  linear probing
+  if (probing_method == DAHASH_PROBE_LINEAR) rehash_step = 1;  //  linear probing
   else rehash_step = index | 1;   // Ensure that rehash_step is odd and therefore relatively
   // prime to the power-of-two table size.   
 
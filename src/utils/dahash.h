@@ -24,8 +24,21 @@ typedef struct {
 	size_t entries_used;
 	int times_doubled;
 	unsigned long long collisions;
+	// Only used by tables created with DAHASH_PROBE_GROUPS.  Otherwise NULL.
+	byte *ctrl;                   // One byte per entry: DAHASH_CTRL_EMPTY or a 7-bit fingerprint of the key's hash
+	unsigned long long *hashes;   // The full hash of the key in each used entry, so that doubling needs no rehashing
+	BOOL large_pages;             // Whether table and hashes were allocated by lp_malloc() with large pages
 } dahash_table_t;
 
+// Collision handling methods, see dahash_set_probing_method()
+#define DAHASH_PROBE_RPR 0       // Relatively prime rehash
+#define DAHASH_PROBE_LINEAR 1
+#define DAHASH_PROBE_GROUPS 2    // Groups of DAHASH_GROUP_SIZE fingerprint bytes compared in parallel
+
+#define DAHASH_GROUP_BITS 4
+#define DAHASH_GROUP_SIZE (1 << DAHASH_GROUP_BITS)
+#define DAHASH_CTRL_EMPTY 0x80
+
 // Create a hash table
 dahash_table_t *dahash_create(u_char *name, int bits, size_t key_len, size_t value_size,
 			      double max_full_frac, BOOL verbose);
@@ -36,9 +49,17 @@ void dahash_destroy(dahash_table_t **ht);
 // Lookup a key, insert it if necessary and return a pointer to the entry
 void *dahash_lookup(dahash_table_t *ht, byte *key, int insert_flag);
 
+// Truncate an overlong key in place exactly as dahash_lookup() would, without looking it up
+size_t dahash_truncate_key(byte *key, size_t key_len);
+
 // Dump out the (key, val) pairs in a dahash,alphabetically sorted by key and
 // using a display_val() function passed as a parameter to display the value.
 void dahash_dump_alphabetic(dahash_table_t *ht, doh_t ll_heap, void(dump_key)(const void *),
 	void(dump_val)(const void *, doh_t));
 
+// Set the collision handling method for subsequent lookups in RPR and LINEAR tables.  A table
+// created while the method is DAHASH_PROBE_GROUPS always uses groups.
 void dahash_set_probing_method(int method);
+
+// Set whether subsequently created tables are allocated on large pages, if possible.  See lp_malloc()
+void dahash_set_large_pages(BOOL use_large_pages, size_t large_page_minimum);
@@ -3,7 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-
+#include <string.h>
 
 #include "../shared/utility_nodeps.h"   // Needed for some type definitions and Large Page malloc and free lp_blah
 #include "dahash.h"
@@ -16,13 +16,121 @@
 // Keys are of fixed maximum length which you specify at creation time
 // Values are also of fixed maximum length  which you specify at creation time.  You can store
 // single scalars, structs, pointers or whatever you like. 
+//
+// If given the name of a text file (e.g. a QBASH.forward), dahash_demo.exe instead benchmarks the
+// three collision handling methods by counting the occurrences of each word in the file, 
+// then looking every word up again.  The optional second argument sets the initial table bits.
+
+
+#define BENCH_KEY_LEN 15   // The same as MAX_WD_LEN in QBASHI
+
+
+static byte **split_into_words(u_char *fname, size_t *num_words) {
+  // Return an array of pointers to all the lower-cased words in the file.  Anything other
+  // than an ASCII letter or digit or a UTF-8 byte breaks words.
+  CROSS_PLATFORM_FILE_HANDLE H;
+  HANDLE MH;
+  size_t sighs, b, w = 0, words_allocated = 1000000;
+  int error_code = 0;
+  byte *text, *copy, *p, **words;
+  BOOL in_word = FALSE;
 
+  text = (byte *)mmap_all_of(fname, &sighs, FALSE, &H, &MH, &error_code);
+  if (error_code) {
+    printf("Error: Can't map %s.  Code = %d\n", fname, error_code);
+    exit(1);
+  }
+  copy = (byte *)malloc(sighs + 1);
+  words = (byte **)malloc(words_allocated * sizeof(byte *));
+  if (copy == NULL || words == NULL) {
+    printf("Error: malloc failed in split_into_words()\n");
+    exit(1);
+  }
+  p = copy;
+  for (b = 0; b < sighs; b++) {
+    byte c = text[b];
+    if (c >= 'A' && c <= 'Z') c += ('a' - 'A');
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+      if (!in_word) {
+	if (w >= words_allocated) {
+	  words_allocated *= 2;
+	  words = (byte **)realloc(words, words_allocated * sizeof(byte *));
+	  if (words == NULL) {
+	    printf("Error: realloc failed in split_into_words()\n");
+	    exit(1);
+	  }
+	}
+	words[w++] = p;
+	in_word = TRUE;
+      }
+      *p++ = c;
+    }
+    else if (in_word) {
+      *p++ = 0;
+      in_word = FALSE;
+    }
+  }
+  *p = 0;
+  unmmap_all_of(text, H, MH, sighs);
+  *num_words = w;
+  return words;
+}
+
+
+static void benchmark(u_char *fname, int bits) {
+  static char *method_names[] = { "relatively prime rehash", "linear probing", "fingerprint groups" };
+  dahash_table_t *ht;
+  byte **words, key[BENCH_KEY_LEN + 1];
+  size_t num_words, w;
+  int method;
+  u_int *value_ptr;
+  unsigned long long checksum;
+  double start, insert_time, lookup_time;
 
+  words = split_into_words(fname, &num_words);
+  printf("%zu words read from %s\n\n", num_words, fname);
+  if (num_words == 0) return;
+
+  for (method = DAHASH_PROBE_RPR; method <= DAHASH_PROBE_GROUPS; method++) {
+    dahash_set_probing_method(method);
+    ht = dahash_create((u_char *)"Bench", bits, BENCH_KEY_LEN, sizeof(u_int), 0.90, FALSE);
+    // Keys may be truncated by dahash_lookup(), so work on a copy.
+    start = what_time_is_it();
+    for (w = 0; w < num_words; w++) {
+      strncpy((char *)key, (char *)words[w], BENCH_KEY_LEN);
+      key[BENCH_KEY_LEN] = 0;
+      value_ptr = (u_int *)dahash_lookup(ht, key, 1);
+      (*value_ptr)++;
+    }
+    insert_time = what_time_is_it() - start;
+    checksum = 0;
+    start = what_time_is_it();
+    for (w = 0; w < num_words; w++) {
+      strncpy((char *)key, (char *)words[w], BENCH_KEY_LEN);
+      key[BENCH_KEY_LEN] = 0;
+      value_ptr = (u_int *)dahash_lookup(ht, key, 0);
+      if (value_ptr != NULL) checksum += *value_ptr;
+    }
+    lookup_time = what_time_is_it() - start;
+    printf("%-24s: insert/count %7.3f sec (%5.1f ns/word);  lookup %7.3f sec (%5.1f ns/word)\n",
+	   method_names[method], insert_time, insert_time * 1.0e9 / num_words,
+	   lookup_time, lookup_time * 1.0e9 / num_words);
+    printf("%24s  %zu distinct, capacity %zu, doubled %d times, %llu collisions, checksum %llu\n\n", "",
+	   ht->entries_used, ht->capacity, ht->times_doubled, ht->collisions, checksum);
+    dahash_destroy(&ht);
+  }
+  free(words[0]);
+  free(words);
+}
 
 
 int main(int argc, char**argv) {
    dahash_table_t *demo_hash;
    int *value_ptr;
+   if (argc > 1) {
+     benchmark((u_char *)argv[1], argc > 2 ? atoi(argv[2]) : 10);
+     exit(0);
+   }
   // Create a hash table called Demo with an initial theoretical maximum size of 1024 (10 bits), whose keys 
   // are strings of max length 20 bytes and whose values are ints.
    demo_hash =  dahash_create((u_char *)"Demo", 10, 20, sizeof(int), 0.90, TRUE); 
@@ -18,6 +18,14 @@
 #define MEGA 1048576.0
 #endif
 
+// DOH blocks are only put on large pages on Linux, where lp_malloc() falls back to ordinary
+// pages.  On Windows, VirtualAlloc() fails rather than falling back.
+#ifdef WIN64
+#define DOH_LARGE_PAGES FALSE
+#else
+#define DOH_LARGE_PAGES x_use_large_pages
+#endif
+
 // Functions for operating on a single linked list augmented for fast appending
 // by the use of a list head block which has pointers to both head and tail.
 // 
@@ -97,7 +105,7 @@ doh_t doh_create_heap(size_t max_blocks, size_t blockbytes) {
 	for (b = 0; b < max_blocks; b++) newone[b] = NULL;   // Signal that none of the blocks are allocated.
 
 	// Allocate the first block.
-	newone[0] = (posting_p)lp_malloc(blockbytes, FALSE, 0);
+	newone[0] = (posting_p)lp_malloc(blockbytes, DOH_LARGE_PAGES, large_page_minimum);
 	if (newone[0] == NULL) error_exit("doh_create_heap: lp_malloc failed\n");
 	printf("doh_create_heap(): Header values are: %zu %zu %zu %zu\n", szptr[0], szptr[1],
 		szptr[2], szptr[3]);
@@ -138,14 +146,14 @@ void doh_print_usage_report(doh_t heap) {
 
 
 
-static u_ll doh_allocate(doh_t heap, int K, size_t *bloknum, size_t *byteoffset) {
-	// Allocate K * PAYLOAD_SIZE + NEXT_POINTER_SIZE bytes for a posting from within the current block
+static u_ll doh_allocate(doh_t heap, u_int payload_bytes, size_t *bloknum, size_t *byteoffset) {
+	// Allocate payload_bytes + NEXT_POINTER_SIZE bytes for a chunk from within the current block
 	// controlled by this DOH.  If the current one is full
 	// allocate a new block.  If max_blocks are already allocated,
 	// take an error exit.
 	//
 	// Return a composite of heapblock number and itemnumber within block.   No longer a pointer.
-	size_t *header, request_size = K * PAYLOAD_SIZE + NEXT_POINTER_SIZE;
+	size_t *header, request_size = payload_bytes + NEXT_POINTER_SIZE;
 	posting_p *blocks, newitem;
 	u_ll rslt;
 
@@ -161,7 +169,7 @@ static u_ll doh_allocate(doh_t heap, int K, size_t *bloknum, size_t *byteoffset)
 			error_exit("Doh:  All space exhausted\n");
 		}
 		// allocate a new block
-		blocks[header[1]] = (byte *)lp_malloc(header[2], FALSE, 0);
+		blocks[header[1]] = (byte *)lp_malloc(header[2], DOH_LARGE_PAGES, large_page_minimum);
 		if (blocks[header[1]] == NULL) error_exit("doh_allocate: lp_malloc failed\n");
 		header[1]++;   // Increment number of blocks allocated
 		header[3] = 0; // Haven't used any entries in this block yet
@@ -202,12 +210,26 @@ void doh_free(doh_t *heap) {
 	if (heap == NULL) error_exit("doh_free: NULL");
 	header = (size_t *)*heap;
 	newone = (posting_p *)(header + DOH_HEADER_ENTS);
-	for (b = 0; b < header[1]; b++) lp_free(newone[b], FALSE);
+	for (b = 0; b < header[1]; b++) lp_free(newone[b], header[2], DOH_LARGE_PAGES);
 	free(*heap);
 	*heap = NULL;
 }
 
 
+u_int chunk_payload_bytes(u_int K, u_int chunkno) {
+	// The number of payload bytes in a chunk of K payloads which is the chunkno-th chunk of its list.
+	// (Chunk numbers saturate at 0xFFFF.)  Must be used both when building and when reading lists.
+	//
+	// A vbyte-compressed list usually starts life with the three postings moved out of the vocab
+	// entry, needing 9 or 10 bytes between them.  Making the first chunk big enough to hold them 
+	// saves one or two extra chunks, each with its own NEXT field, for each of the many short lists.
+	u_int bytes = K * PAYLOAD_SIZE;
+	if (chunkno <= 1 && x_use_vbyte_in_chunks && x_2postings_in_vocab && bytes < FIRST_VBYTE_CHUNK_BYTES)
+		return FIRST_VBYTE_CHUNK_BYTES;
+	return bytes;
+}
+
+
 void append_posting(doh_t heap, vocab_entry_p list, docnum_t docnum, int wordnum, u_char *word) {
 	// Append a (docnum, wordnum) element to the chunked in-memory postings list (list) for a vocab
 	// term.  word is only passed for debugging purposes.
@@ -244,13 +266,13 @@ void append_posting(doh_t heap, vocab_entry_p list, docnum_t docnum, int wordnum
 	}
 	// After this loop chunk_length[k] >= chunk_count
 	K = chunk_K_table[k];  // The size of the chunk (in payloads) containing this element of the list.
-	payload_bytes_in_this_chunk = K * PAYLOAD_SIZE;
+	payload_bytes_in_this_chunk = chunk_payload_bytes(K, chunk_count);
 
 
 	if (count == 1) {   // count already updated by process_a_word()
 		// ------------------------------------------ List was empty ---------------------------------------
 		// Insert the first list element
-		chunk_to_use = doh_allocate(heap, K, &blocknum, &byteoffset);
+		chunk_to_use = doh_allocate(heap, payload_bytes_in_this_chunk, &blocknum, &byteoffset);
 		if (0) printf("Inserting first list element: %llu\n", chunk_to_use);
 		// Note we stop counting after 65,535 to avoid overflow.
 		if (chunk_count < 0xFFFF) ve_store_chunk_count(list, (chunk_count + 1));
@@ -353,13 +375,13 @@ void append_posting(doh_t heap, vocab_entry_p list, docnum_t docnum, int wordnum
 			}
 			// After this loop chunk_length[k] >= chunk_count
 			K = chunk_K_table[k];  // The size of the chunk (in payloads) containing this element of the list.
-			payload_bytes_in_this_chunk = K * PAYLOAD_SIZE;
+			payload_bytes_in_this_chunk = chunk_payload_bytes(K, chunk_count);
 			if (bytes_needed > payload_bytes_in_this_chunk) 
 				error_exit("Avoiding infinite chunk allocation loop.  bytes_needed is bigger than the whole chunk");
 		}
 		// Otherwise K stays as it was
 
-		chunk_to_use = doh_allocate(heap, K, &blocknum, &byteoffset);
+		chunk_to_use = doh_allocate(heap, payload_bytes_in_this_chunk, &blocknum, &byteoffset);
 		chunk_to_useptr = doh_get_pointer(heap, chunk_to_use);
 		ve_pack455x(list, count, head, chunk_to_use);  // Use 455x to avoid updating the chunk_count
 		if (0) printf("Wrote(%llu, %u) into start of new chunk (%llu) of size %d * %d\n",
@@ -409,7 +431,7 @@ void append_posting(doh_t heap, vocab_entry_p list, docnum_t docnum, int wordnum
 		bytes_used = bytes_needed;
 		last_docnum |= (bytes_used & LL_NEXT_BYTES_USED_MASK);  // last_docnum has already been shifted.
 
-		nextptrptr = chunk_to_useptr + K * PAYLOAD_SIZE;  // Now operating on the newly created chunk
+		nextptrptr = chunk_to_useptr + payload_bytes_in_this_chunk;  // Now operating on the newly created chunk
 		for (bo = 0; bo < NEXT_POINTER_SIZE; bo++) {    // Writing 7 bytes in little-endian order
 			nextptrptr[bo] = last_docnum & 0xFF;
 			last_docnum >>= 8;
@@ -427,7 +449,7 @@ void append_posting(doh_t heap, vocab_entry_p list, docnum_t docnum, int wordnum
 
 	// Now store the payload in the right spot in the chunk pointed to by lastptr 
 	payloadptr = tailptr + bytes_used;
-	nextptrptr = tailptr + K * PAYLOAD_SIZE;
+	nextptrptr = tailptr + payload_bytes_in_this_chunk;
 
 	//Store just one byte of wordnum   *** Now write it BEFORE the docnum ***
 	payloadptr[0] = wordnum & WDPOS_MASK;
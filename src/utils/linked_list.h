@@ -16,6 +16,7 @@ extern u_ll chunk_length_table[MAX_K_TABLE_ENTS + 1];
 extern u_int chunk_K_table[MAX_K_TABLE_ENTS + 1];
 #define PAYLOAD_SIZE 6 
 #define NEXT_POINTER_SIZE 7  // Increased by one byte to allow overloading 37 bits + 19 bits
+#define FIRST_VBYTE_CHUNK_BYTES 16  // Minimum payload bytes in the first chunk of a vbyte-compressed list.
 
 
 
@@ -33,6 +34,8 @@ void doh_print_usage_report(doh_t heap);
 
 void doh_free(doh_t *heap);
 
+u_int chunk_payload_bytes(u_int K, u_int chunkno);
+
 void append_posting(doh_t heap, vocab_entry_p list, long long docnum, int wordnum, u_char *word);
 
 posting_p get_next_posting(doh_t heap, posting_p ppp, int K);
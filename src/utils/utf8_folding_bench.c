@@ -0,0 +1,216 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../shared/utility_nodeps.h"
+#include "../shared/unicode.h"
+
+// Microbenchmark for the UTF-8 case folding and accent removal functions in shared/unicode.c.
+// Usage: utf8_folding_bench.exe <QBASH.forward> [repetitions]
+//
+// The first column of every record is lower cased (as by possibly_record_candidate() in QBASHQ)
+// in three ways:  by the original method of decoding, mapping and re-encoding one code point at a
+// time (reproduced below), by the table-driven utf8_lowering_ncopy() and utf8_remove_accents(), and
+// by the single-pass utf8_lowering_unaccenting_ncopy().  Each is timed with and without accent removal
+// and the results are checked to be identical to those of the original method.
+
+
+#define MAX_TRIGGER 10000
+
+
+static int count_leading_ones(byte b) {
+  int count = 0;
+  while (b & 0x80) {
+    count++;
+    b <<= 1;
+  }
+  return count;
+}
+
+
+static size_t per_character_lowering_ncopy(u_char *dest, u_char *src, size_t nbytes) {
+  // The original utf8_lowering_ncopy()
+  size_t room_left = nbytes;
+  unicode_t ucs;
+  u_char *r = src, *w = dest, *next, *start_utf8_seq = NULL;
+  int bius = 0;  // Bytes in UTF-8 sequence
+
+  while (*r && room_left > 0) {
+    if (*r & 0x80) {
+      start_utf8_seq = w;
+      bius = count_leading_ones(*r);
+      if (bius > room_left) {
+	*w = 0;
+	return (w - dest);   // -------------------------->
+      }
+      ucs = utf8_getchar(r, &next, TRUE);
+      w = utf8_putchar(unicode_to_lower(ucs), w);
+      r = next;
+      room_left -= (w - start_utf8_seq);
+    } else {  // ASCII
+      *w++ = (u_char)unicode_to_lower(*r++);
+      room_left--;
+    }
+  }
+  *w = 0;
+  return (w - dest);
+}
+
+
+static int per_character_remove_accents(u_char *string) {
+  // The original utf8_remove_accents()
+  int characters_changed = 0;
+  unicode_t ucs;
+  u_char *r = string, *w = string, *next;
+  while (*r) {
+    if (*r & 0x80) {
+      ucs = utf8_getchar(r, &next, FALSE);
+      r = next;
+      w = utf8_putchar(unicode_to_unaccented(ucs), w);
+      if (ucs <= BMP_MASK && ucs != unicode_to_unaccented(ucs)) characters_changed++;
+    } else {
+      *w++ = (u_char)unicode_to_unaccented(*r++);
+    }
+  }
+  *w = 0;
+  return characters_changed;
+}
+
+
+static u_char **find_triggers(u_char *text, size_t sighs, size_t *num_triggers) {
+  // Return an array of pointers to the start of every record.
+  size_t b, t = 0, allocated = 1000000;
+  u_char **triggers = (u_char **)malloc(allocated * sizeof(u_char *));
+  BOOL at_start = TRUE;
+
+  for (b = 0; b < sighs; b++) {
+    if (at_start) {
+      if (t >= allocated) {
+	allocated *= 2;
+	triggers = (u_char **)realloc(triggers, allocated * sizeof(u_char *));
+      }
+      if (triggers == NULL) {
+	printf("Error: malloc failed in find_triggers()\n");
+	exit(1);
+      }
+      triggers[t++] = text + b;
+      at_start = FALSE;
+    }
+    if (text[b] == '\n') at_start = TRUE;
+  }
+  *num_triggers = t;
+  return triggers;
+}
+
+
+static size_t trigger_length(u_char *trigger, u_char *eof) {
+  u_char *p = trigger;
+  while (p < eof && *p != '\t' && *p != '\n' && (p - trigger) < MAX_TRIGGER) p++;
+  return p - trigger;
+}
+
+
+int main(int argc, char **argv) {
+  static char *method_names[] = { "per-character", "table-driven", "single-pass table" };
+  CROSS_PLATFORM_FILE_HANDLE H;
+  HANDLE MH;
+  size_t sighs, num_triggers, total_bytes, t, len, *lengths;
+  u_char *text, *eof, **triggers, *reference, *output;
+  int error_code = 0, reps, rep, method, remove_accents, mismatches;
+  double start, elapsed;
+  unsigned long long checksum;
+
+  if (argc < 2) {
+    printf("Usage: %s <QBASH.forward> [repetitions]\n", argv[0]);
+    exit(1);
+  }
+  reps = argc > 2 ? atoi(argv[2]) : 5;
+  if (reps < 1) reps = 1;
+
+  initialize_unicode_conversion_arrays(FALSE);
+  text = (u_char *)mmap_all_of((u_char *)argv[1], &sighs, FALSE, &H, &MH, &error_code);
+  if (error_code) {
+    printf("Error: Can't map %s.  Code = %d\n", argv[1], error_code);
+    exit(1);
+  }
+  eof = text + sighs;
+  triggers = find_triggers(text, sighs, &num_triggers);
+  lengths = (size_t *)malloc((num_triggers + 1) * sizeof(size_t));
+  if (lengths == NULL) {
+    printf("Error: malloc failed\n");
+    exit(1);
+  }
+  total_bytes = 0;
+  for (t = 0; t < num_triggers; t++) {
+    lengths[t] = trigger_length(triggers[t], eof);
+    total_bytes += lengths[t];
+  }
+  printf("%zu records, %zu bytes of trigger text, %d repetitions\n\n", num_triggers, total_bytes, reps);
+
+  // Room for a CP-1252 byte to be expanded to three bytes of UTF-8
+  reference = (u_char *)malloc(3 * MAX_TRIGGER + 1);
+  output = (u_char *)malloc(3 * MAX_TRIGGER + 1);
+  if (reference == NULL || output == NULL) {
+    printf("Error: malloc failed\n");
+    exit(1);
+  }
+
+  for (remove_accents = 0; remove_accents <= 1; remove_accents++) {
+    printf("Lower casing%s:\n", remove_accents ? " and accent removal" : "");
+    for (method = 0; method <= 2; method++) {
+      if (method == 2 && !remove_accents) continue;
+      checksum = 0;
+      start = what_time_is_it();
+      for (rep = 0; rep < reps; rep++) {
+	for (t = 0; t < num_triggers; t++) {
+	  len = lengths[t];
+	  if (method == 0) {
+	    per_character_lowering_ncopy(output, triggers[t], len);
+	    if (remove_accents) per_character_remove_accents(output);
+	  } else if (method == 1) {
+	    utf8_lowering_ncopy(output, triggers[t], len);
+	    if (remove_accents) utf8_remove_accents(output);
+	  } else {
+	    utf8_lowering_unaccenting_ncopy(output, triggers[t], len);
+	  }
+	  checksum += output[0];
+	}
+      }
+      elapsed = what_time_is_it() - start;
+
+      // Check the results against the original method.
+      mismatches = 0;
+      if (method > 0) {
+	for (t = 0; t < num_triggers; t++) {
+	  len = lengths[t];
+	  per_character_lowering_ncopy(reference, triggers[t], len);
+	  if (remove_accents) per_character_remove_accents(reference);
+	  if (method == 1) {
+	    utf8_lowering_ncopy(output, triggers[t], len);
+	    if (remove_accents) utf8_remove_accents(output);
+	  } else {
+	    utf8_lowering_unaccenting_ncopy(output, triggers[t], len);
+	  }
+	  if (strcmp((char *)reference, (char *)output)) {
+	    if (mismatches < 5) printf("   Mismatch: '%s' v. '%s'\n", reference, output);
+	    mismatches++;
+	  }
+	}
+      }
+      printf("   %-18s: %7.3f sec, %6.2f ns/byte, %7.1f MB/sec, checksum %llu, %d mismatches\n",
+	     method_names[method], elapsed, elapsed * 1.0e9 / ((double)total_bytes * reps),
+	     (double)total_bytes * reps / elapsed / 1.0e6, checksum, mismatches);
+    }
+    printf("\n");
+  }
+
+  free(reference);
+  free(output);
+  free(triggers);
+  free(lengths);
+  unmmap_all_of(text, H, MH, sighs);
+  return 0;
+}
@@ -20,6 +20,11 @@
 // lengths of words, both distinct words and word occurrences.  This is now done, resulting
 // in another output file:
 // .wdlens - length distinct_prob occurrence_prob, suitable for gnuplotting
+//
+// Fourth, QBASH.vocab may be front-coded (see shared/front_coded_vocab.h).  It is
+// expanded to fixed-length records before processing.  The prefix= option just lists
+// the terms starting with a prefix, using the vocab iterator, which avoids expanding
+// the whole vocabulary.
 
 
 
@@ -43,6 +48,7 @@
 #include "../shared/unicode.h"
 #include "../shared/QBASHER_common_definitions.h"
 #include "../shared/utility_nodeps.h"
+#include "../shared/front_coded_vocab.h"
 
 #define OBUF_SIZE (50 * 1048576)   // X * 1MB
 
@@ -239,12 +245,13 @@ static void write_tfd_file(FILE *TFD, FILE *SDF, byte *fileinmem, int *permute,
 }
 
 void print_usage(char *progname){
-    printf("Usage: %s <.vocab, .bigrams, .ngrams, .cooccurs or .repetitions file> [sort=alpha] [head_terms=<int>] [piecewise_segments=<int>]\n"
+    printf("Usage: %s <.vocab, .bigrams, .ngrams, .cooccurs or .repetitions file> [sort=alpha] [head_terms=<int>] [piecewise_segments=<int>] [prefix=<str>]\n"
 	   "       Output goes to vocab.tsv, bigrams.tsv, ngrams.tsv, cooccurs.tsv, or repetitions.tsv in same directory as first arg.\n"
 	   "       Unless sort=alpha, extra files are written:\n"
 	   "          *.tfd - a summary of term freq distribution, in the form of generate_a_corpus options.\n"
 	   "	      *.plot - a subset of the logfreq v. logrank data points for plotting.\n"
-	   "          *.segdat - data for plotting the piecewise segments in GNUPLOT format.\n",
+	   "          *.segdat - data for plotting the piecewise segments in GNUPLOT format.\n"
+	   "       If prefix= is given with a .vocab file, the terms starting with that prefix are just listed on stdout.\n",
 	   progname);
     exit(1);
  
@@ -260,8 +267,8 @@ int main(int argc, char **argv) {
   long long h, max_freq = 0;
   size_t l, entry_len = VOCABFILE_REC_LEN;
   int a, distinct_wds, w, pw, *permute = NULL, error_code, wdlen;
-  byte *fileinmem = NULL, *vp = NULL, qidf;
-  char *obuf, *p, *outfilename, *suffix;
+  byte *fileinmem = NULL, *mapped = NULL, *vp = NULL, qidf;
+  char *obuf, *p, *outfilename, *suffix, *prefix = NULL;
   double start_time, very_start;
   CROSS_PLATFORM_FILE_HANDLE FH;
   FILE *tsvfile, *tfdfile = NULL, *plotfile = NULL, *segdatfile = NULL,
@@ -273,7 +280,7 @@ int i;
 
   // Variables needed to accumulate the data for writing the .tfd file.
   u_ll totfreq = 0;
-  size_t vsz, singletons = 0;
+  size_t vsz, mapped_size, singletons = 0;
 
   double lastlogrank = -1.0, logrank, logfreq;  
 
@@ -343,12 +350,34 @@ int i;
     } else if (!strncmp(p, "piecewise_segments=", 19)) {
       PIECEWISE_SEGMENTS = strtol(p + 19, NULL, 10);
       printf("PIECEWISE_SEGMENTS = %d\n", PIECEWISE_SEGMENTS);
+    } else if (!strncmp(p, "prefix=", 7)) {
+      prefix = p + 7;
     } else {
       printf("Unrecognized argument '%s'.\n", argv[a]);
       print_usage(argv[0]);
     }
   }
 
+  if (prefix != NULL) {
+    vocab_iterator_t it;
+    if (whichtype != VOCAB) error_exit("Error: prefix= only applies to .vocab files\n");
+    mapped = (byte *)mmap_all_of((u_char *)argv[1], &mapped_size, FALSE, &FH, &FMH, &error_code);
+    if (error_code < 0) {
+      printf("Error: Can't map %s.  Code = %d\n", argv[1], error_code);
+      exit(1);
+    }
+    count = 0;
+    vocab_iterator_start(&it, mapped, mapped_size, (u_char *)prefix);
+    while ((vp = vocab_iterator_next(&it)) != NULL) {
+      vocabfile_entry_unpacker(vp, MAX_WD_LEN + 1, &freq, &qidf, &payload);
+      printf("%s\t%llu\n", vp, freq);
+      count++;
+    }
+    printf("%llu terms start with '%s'.\n", count, prefix);
+    unmmap_all_of(mapped, FH, FMH, mapped_size);
+    exit(0);
+  }
+
   // Open the TSV file
 #ifdef WIN64
   _set_errno(0);
@@ -456,7 +485,13 @@ int i;
   very_start = start_time;
 
 
-  fileinmem = (byte *)mmap_all_of((u_char *)argv[1], &vsz, FALSE, &FH, &FMH, &error_code);
+  mapped = (byte *)mmap_all_of((u_char *)argv[1], &mapped_size, FALSE, &FH, &FMH, &error_code);
+  fileinmem = mapped;
+  vsz = mapped_size;
+  if (whichtype == VOCAB && vocab_is_front_coded(mapped, mapped_size)) {
+    fileinmem = vocab_to_standard_records(mapped, mapped_size, &vsz);
+    printf("Vocab_lister: %s is front-coded.  Expanded %zu bytes to %zu.\n", argv[1], mapped_size, vsz);
+  }
   if (vsz % entry_len != 0) {
     printf("Error: Size of file %s should be a multiple of %zu but it isn't\n",
 	   argv[1], entry_len);
@@ -755,7 +790,8 @@ printf("  vocab.wdfreqs written.\n");
   printf("All files written. Time taken: %.2f sec\n", what_time_is_it() - start_time);
 
 
-  unmmap_all_of(fileinmem, FH, FMH, vsz);
+  if (fileinmem != mapped) free(fileinmem);
+  unmmap_all_of(mapped, FH, FMH, mapped_size);
 
   if (permute != NULL) free(permute);
   if (score_histo != NULL) free(score_histo);